@@ -10,12 +10,29 @@
 
 #include <stdio.h>
 #include <windows.h>
+#include <tchar.h>
 #include <ddraw.h>
 #include <dinput.h>
 #include <mmsystem.h>
 
 #include "resource.h"
 #include "ddutil.h"
+#include "profiler.h"
+#include "logger.h"
+#include "framestats.h"
+#include "capture.h"
+#include "pool.h"
+#include "multiball.h"
+#include "bench.h"
+#include "tune.h"
+#include "net.h"
+#include "rollback.h"
+#include "replay.h"
+#include "softdisplay.h"
+#include "framepacer.h"
+#include "trails.h"
+#include "particles.h"
+#include "pongy.h"
 
 //-----------------------------------------------------------------------------
 // Defines and constants
@@ -23,57 +40,56 @@
 #define SAFE_DELETE(p)  { if(p) { delete (p);     (p)=NULL; } }
 #define SAFE_RELEASE(p) { if(p) { (p)->Release(); (p)=NULL; } }
 
-#define WINDOW_WIDTH			640
-#define WINDOW_HEIGHT			480
-
-#define BALL_SPRITE_DIAMETER	32
-
-#define BAT_SPRITE_WIDTH		10
-#define BAT_SPRITE_HEIGHT		75
-#define BAT_EDGE_SPACER			10
-#define COMPUTER_LEVEL			250.0
-
-#define NUM_SPRITES				3
-
-#define BALL_SPEED				5
-#define BALL_SPEED_INC			50.0
-#define BAT_SPEED				15
-
-enum SpriteType {playerBat, computerBat, ball};
-enum PlayerType {human, computer};
-
-struct SPRITE_STRUCT
-{
-	SpriteType sType;
-    FLOAT fPosX; 
-    FLOAT fPosY;
-    FLOAT fVelX; 
-    FLOAT fVelY;
-};
-
-struct SCORE_STRUCT
-{
-	int nPlayerScore;
-	int nComputerScore;
-};
+#define SCORE_WIDEST	TEXT("YOU 9999 - 9999 CMP")	// Sizes the score surface
 
 //-----------------------------------------------------------------------------
 // Global variables
 //-----------------------------------------------------------------------------
 HWND					g_hMainWnd		= NULL;
-CDisplay*				g_pDisplay		= NULL;
-CSurface*				g_pBallSurface	= NULL;
-CSurface*				g_pBatSurface	= NULL;  
-CSurface*				g_pTextSurface	= NULL;
+CDisplayHandle			g_pDisplay;
+CSurfaceHandle			g_pBallSurface;
+CSurfaceHandle			g_pBatSurface;
+CSurfaceHandle			g_pTextSurface;
+CSurfaceHandle			g_pParticleSurface;
 LPDIRECTINPUT8			g_pDI			= NULL;
 LPDIRECTINPUTDEVICE8	g_pKeyboard		= NULL;
 RECT					g_rcViewport;          
 RECT					g_rcScreen;            
 BOOL					g_bActive		= FALSE; 
 DWORD					g_dwLastTick;
-SPRITE_STRUCT			g_Sprite[NUM_SPRITES];
-SCORE_STRUCT			g_Score;
-PlayerType				whoseTurn;
+SIM_STATE				g_Sim;
+CFrameStats				g_Stats;
+CFrameCapture			g_Capture;
+CArena					g_FrameArena;
+CMultiBall				g_MultiBall;
+CUdpTransport			g_Net;
+CRollback				g_Rollback;
+DWORD					g_dwNetTime		= 0;
+CReplayWriter			g_Replay;
+CSoftDisplay			g_SoftDisplay;
+CSoftSurface			g_SoftBall;
+CSoftSurface			g_SoftBat;
+CSoftSurface			g_SoftText;
+CSoftSurface			g_SoftParticle;
+CIndexedDisplay			g_IndexedDisplay;
+CIndexedSurface			g_IndexedBall;
+CIndexedSurface			g_IndexedBat;
+CIndexedSurface			g_IndexedText;
+CIndexedSurface			g_IndexedParticle;
+VIEW					g_View;
+HFONT					g_hScoreFont	= NULL;		// The system font, scaled with the view
+SIZE					g_sizeScore;				// The score surface, in pixels
+BOOL					g_bSizing		= FALSE;	// The window is being dragged to a new size
+BOOL					g_bResizePending = FALSE;	// The client area no longer fits the view
+BOOL					g_bFullScreen	= FALSE;	// Exclusive, flipping rather than blting
+DWORD					g_dwScreenWidth;			// The full screen mode
+DWORD					g_dwScreenHeight;
+DWORD					g_dwBackBuffers	= 1;		// Behind the front buffer when full screen
+CFramePacer				g_Pacer;
+BOOL					g_bSoftware		= FALSE;	// Frames are drawn on the processor, with -software
+BOOL					g_bAlphaSprites	= FALSE;	// The ball and score are premultiplied alpha surfaces
+CTrails					g_Trails;
+CParticles				g_Particles;
 
 //-----------------------------------------------------------------------------
 // Function-prototypes
@@ -81,18 +97,31 @@ PlayerType				whoseTurn;
 LRESULT CALLBACK MainWndProc( HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam );
 HRESULT WinInit( HINSTANCE hInst, int nCmdShow, HWND* phWnd, HACCEL* phAccel );
 HRESULT InitDirectDraw();
+HRESULT ResetDirectDraw();
 HRESULT InitDirectInput( HINSTANCE hInst );
-VOID	InitSprites();
 HRESULT	ProcessIdle();
 VOID	FreeDirectDraw();
 BOOL	CleanUp();
 HRESULT ProcessNextFrame();
-VOID    UpdatePlayerBat( FLOAT fTimeDelta );
+int		GetPlayerMove();
+VOID    UpdatePlayerBat( FLOAT fTimeDelta, int nMove );
 VOID    UpdateComputerBat( FLOAT fTimeDelta );
 VOID    UpdateBall( FLOAT fTimeDelta );
-VOID	UpdateScore( PlayerType pType );
-HRESULT DisplayFrame();
+VOID    UpdateMultiBall( FLOAT fTimeDelta );
+DWORD   UpdateNetplay( DWORD dwTickDiff );
+VOID	UpdateScore( BOOL bBurst );
+HRESULT DrawScore();
+HRESULT DisplayFrame( BOOL bRepaint );
 HRESULT RestoreSurfaces();
+HRESULT CopySoftSurfaces();
+HRESULT BuildPalette();
+HRESULT DrawSprites();
+VOID	SetView( DWORD dwWidth, DWORD dwHeight );
+DWORD	ViewSize( DWORD dwFieldUnits );
+VOID	ViewPoint( FLOAT fX, FLOAT fY, DWORD dwWidth, DWORD dwHeight, DRAWITEM* pItem );
+HRESULT CreateScoreFont();
+HRESULT ResizeView();
+BOOL	GetCommandLineOption( LPSTR pCmdLine, const TCHAR* strOption, TCHAR* strValue, int cchValue );
 
 //-----------------------------------------------------------------------------
 // Name: WinMain()
@@ -104,7 +133,81 @@ int APIENTRY WinMain( HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR pCmdLine, int
     MSG		 msg;
     HACCEL   hAccel;
 
-    srand( GetTickCount() );
+    // Start recording trace zones, this does nothing unless built with
+    // PONGY_PROFILE defined
+    PROF_INIT( TEXT("pongy_trace.json") );
+
+#if defined(DEBUG) | defined(_DEBUG)
+    // Send DXTRACE and DEBUG_MSG output through the background logger
+    Log_Init( TEXT("pongy.log") );
+#endif
+
+    // Stream per-frame timings to a CSV file if asked to with -stats <file>
+    TCHAR strStatsFile[MAX_PATH];
+    if( GetCommandLineOption( pCmdLine, TEXT("-stats"), strStatsFile, MAX_PATH ) )
+        g_Stats.OpenCsv( strStatsFile );
+
+    // Take the whole screen and flip if asked to with -fullscreen, at the
+    // desktop's size or at -fullscreen <width>x<height>, with
+    // -backbuffers <count> in the flip chain
+    TCHAR strFullScreen[MAX_PATH];
+    if( GetCommandLineOption( pCmdLine, TEXT("-fullscreen"), strFullScreen, MAX_PATH ) )
+    {
+        g_bFullScreen    = TRUE;
+        g_dwScreenWidth  = GetSystemMetrics( SM_CXSCREEN );
+        g_dwScreenHeight = GetSystemMetrics( SM_CYSCREEN );
+        _stscanf( strFullScreen, TEXT("%lux%lu"), &g_dwScreenWidth, &g_dwScreenHeight );
+
+        TCHAR strBackBuffers[MAX_PATH];
+        if( GetCommandLineOption( pCmdLine, TEXT("-backbuffers"), strBackBuffers, MAX_PATH ) )
+            g_dwBackBuffers = max( 1, min( _ttoi( strBackBuffers ), MAX_BACK_BUFFERS ) );
+    }
+
+    // Record every presented frame to a .y4m file if asked to with -capture <file>
+    TCHAR strCaptureFile[MAX_PATH];
+    if( GetCommandLineOption( pCmdLine, TEXT("-capture"), strCaptureFile, MAX_PATH ) )
+    {
+        HRESULT hrCapture;
+        if( g_bFullScreen )
+            hrCapture = g_Capture.Start( strCaptureFile, g_dwScreenWidth, g_dwScreenHeight, 60 );
+        else
+            hrCapture = g_Capture.Start( strCaptureFile, VIEW_DEFAULT_WIDTH, VIEW_DEFAULT_HEIGHT, 60 );
+
+        // Chroma is stored for each 2x2 block, so an odd size can't be
+        // recorded
+        if( FAILED( hrCapture ) )
+        {
+            MessageBox( NULL, ( hrCapture == E_INVALIDARG ) ?
+                        TEXT("Capture needs an even width and height. Pongy will now exit. ") :
+                        TEXT("Capture could not start. Pongy will now exit. "),
+                        TEXT("Pongy"), MB_ICONERROR | MB_OK );
+            return CleanUp();
+        }
+    }
+
+    // A fixed pool for the sparks off hits and points, so a burst never
+    // allocates
+    if( FAILED( g_Particles.Create( PARTICLE_POOL_SIZE, GetTickCount() ) ) )
+    {
+        MessageBox( NULL, TEXT("Out of memory. ")
+                    TEXT("Pongy will now exit. "), TEXT("Pongy"), 
+                    MB_ICONERROR | MB_OK );
+        return CleanUp();
+    }
+
+    // Sweep the difficulty settings instead of playing if asked to with
+    // -tune <file>. This needs no window, so it runs before one is made.
+    TCHAR strTuneFile[MAX_PATH];
+    if( GetCommandLineOption( pCmdLine, TEXT("-tune"), strTuneFile, MAX_PATH ) )
+    {
+        if( FAILED( RunTuning( strTuneFile ) ) )
+        {
+            MessageBox( NULL, TEXT("Tuning failed. ")
+                        TEXT("Pongy will now exit. "), TEXT("Pongy"), 
+                        MB_ICONERROR | MB_OK );
+        }
+        return CleanUp();
+    }
 
     if( FAILED( WinInit( hInst, nCmdShow, &g_hMainWnd, &hAccel ) ) )
 	{
@@ -114,6 +217,12 @@ int APIENTRY WinMain( HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR pCmdLine, int
         return CleanUp();
 	}
 
+    // Draw frames on the processor if asked to with -software [threads]. The
+    // ball and score get soft edges when it does, as only it can blend them.
+    TCHAR strSoftware[MAX_PATH];
+    g_bSoftware     = GetCommandLineOption( pCmdLine, TEXT("-software"), strSoftware, MAX_PATH );
+    g_bAlphaSprites = g_bSoftware;
+
     if( FAILED( InitDirectDraw() ) )
     {
         MessageBox( g_hMainWnd, TEXT("DirectDraw init failed. ")
@@ -122,6 +231,17 @@ int APIENTRY WinMain( HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR pCmdLine, int
         return CleanUp();
     }
 
+    // Pace presents to -fps <rate>, or not at all with -fps 0. Without it
+    // windowed frames go as fast as they come and full screen flips wait
+    // for every refresh.
+    TCHAR strFps[MAX_PATH];
+    if( GetCommandLineOption( pCmdLine, TEXT("-fps"), strFps, MAX_PATH ) )
+    {
+        DWORD dwRefreshRate = 0;
+        g_pDisplay->GetDirectDraw()->GetMonitorFrequency( &dwRefreshRate );
+        g_Pacer.Create( _ttoi( strFps ), dwRefreshRate, g_bFullScreen );
+    }
+
 	if( FAILED( InitDirectInput( hInst ) ) )
 	{
         MessageBox( g_hMainWnd, TEXT("DirectInput init failed.  ")
@@ -130,7 +250,152 @@ int APIENTRY WinMain( HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR pCmdLine, int
         return CleanUp();
 	}
 
- 	InitSprites();
+    // Draw frames on the processor instead of through DirectDraw if asked
+    // to with -software [threads], on every processor unless told otherwise
+    if( g_bSoftware )
+    {
+        if( FAILED( g_SoftDisplay.Create( g_View.dwWidth, g_View.dwHeight, _ttoi( strSoftware ) ) ) ||
+            FAILED( CopySoftSurfaces() ) )
+        {
+            MessageBox( g_hMainWnd, TEXT("Software drawing needs a 32 bit display. ")
+                        TEXT("Pongy will now exit. "), TEXT("Pongy"), 
+                        MB_ICONERROR | MB_OK );
+            return CleanUp();
+        }
+    }
+
+    // Or draw 8 bit frames with a palette made from the sprites if asked to
+    // with -indexed [threads], the threads only expanding them for display
+    TCHAR strIndexed[MAX_PATH];
+    if( !g_SoftDisplay.IsCreated() &&
+        GetCommandLineOption( pCmdLine, TEXT("-indexed"), strIndexed, MAX_PATH ) )
+    {
+        if( FAILED( g_IndexedDisplay.Create( g_View.dwWidth, g_View.dwHeight, _ttoi( strIndexed ) ) ) ||
+            FAILED( BuildPalette() ) || FAILED( CopySoftSurfaces() ) )
+        {
+            MessageBox( g_hMainWnd, TEXT("Indexed drawing needs a 32 bit display. ")
+                        TEXT("Pongy will now exit. "), TEXT("Pongy"), 
+                        MB_ICONERROR | MB_OK );
+            return CleanUp();
+        }
+    }
+
+    // Leave fading trails behind the balls if asked to with -trails [decay],
+    // keeping decay out of 256 of each pixel a 60th of a second. They are
+    // blended on the software display only: the indexed display can't
+    // blend, and blending into a DirectDraw back buffer would read it back
+    // from video memory every frame.
+    TCHAR strTrails[MAX_PATH];
+    if( GetCommandLineOption( pCmdLine, TEXT("-trails"), strTrails, MAX_PATH ) )
+    {
+        DWORD dwDecay = _ttoi( strTrails );
+        if( dwDecay == 0 || dwDecay > 255 )
+            dwDecay = TRAIL_DECAY_DEFAULT;
+
+        if( !g_SoftDisplay.IsCreated() )
+        {
+            MessageBox( g_hMainWnd, TEXT("Trails need -software. ")
+                        TEXT("Pongy will now exit. "), TEXT("Pongy"), 
+                        MB_ICONERROR | MB_OK );
+            return CleanUp();
+        }
+
+        if( FAILED( g_Trails.Create( g_View.dwWidth, g_View.dwHeight, dwDecay ) ) ||
+            FAILED( g_Trails.SetSprite( g_pBallSurface ) ) )
+        {
+            MessageBox( g_hMainWnd, TEXT("Trails need a 32 bit display. ")
+                        TEXT("Pongy will now exit. "), TEXT("Pongy"), 
+                        MB_ICONERROR | MB_OK );
+            return CleanUp();
+        }
+    }
+
+	DWORD dwSeed = GetTickCount();
+	Sim_Init( &g_Sim, dwSeed );
+
+    // Play with lots of balls at once if asked to with -balls <count>
+    TCHAR strBalls[MAX_PATH];
+    if( GetCommandLineOption( pCmdLine, TEXT("-balls"), strBalls, MAX_PATH ) )
+    {
+        if( FAILED( g_MultiBall.Create( _ttoi( strBalls ), GetTickCount() ) ) )
+        {
+            MessageBox( g_hMainWnd, TEXT("Multi-ball needs between 1 and 4096 balls. ")
+                        TEXT("Pongy will now exit. "), TEXT("Pongy"), 
+                        MB_ICONERROR | MB_OK );
+            return CleanUp();
+        }
+    }
+
+    // Scratch memory for anything that only lives for a frame, big enough
+    // for the draw list with every ball
+    C_ASSERT( FRAME_ARENA_SIZE( MULTIBALL_MAX ) <= FRAME_ARENA_MAX_SIZE );
+    if( FAILED( g_FrameArena.Create( FRAME_ARENA_SIZE( g_MultiBall.GetNumBalls() ) ) ) )
+    {
+        MessageBox( g_hMainWnd, TEXT("Out of memory. ")
+                    TEXT("Pongy will now exit. "), TEXT("Pongy"), 
+                    MB_ICONERROR | MB_OK );
+        return CleanUp();
+    }
+
+    // Run the benchmark suite instead of the game if asked to with -bench <file>
+    TCHAR strBenchFile[MAX_PATH];
+    if( GetCommandLineOption( pCmdLine, TEXT("-bench"), strBenchFile, MAX_PATH ) )
+    {
+        if( FAILED( RunBenchmarks( strBenchFile ) ) )
+        {
+            MessageBox( g_hMainWnd, TEXT("Benchmarks failed. ")
+                        TEXT("Pongy will now exit. "), TEXT("Pongy"), 
+                        MB_ICONERROR | MB_OK );
+        }
+        return CleanUp();
+    }
+
+    // Play another person over the network if asked to with -host <port>
+    // or -join <address:port>, optionally over a worse network than the
+    // real one with -netsim <latency ms>,<jitter ms>,<loss %>
+    TCHAR strHost[MAX_PATH];
+    TCHAR strJoin[MAX_PATH];
+    BOOL  bHost = GetCommandLineOption( pCmdLine, TEXT("-host"), strHost, MAX_PATH );
+    BOOL  bJoin = GetCommandLineOption( pCmdLine, TEXT("-join"), strJoin, MAX_PATH );
+    if( bHost || bJoin )
+    {
+        if( FAILED( g_Net.Create( bHost ? (WORD)_ttoi( strHost ) : 0 ) ) ||
+            ( bJoin && FAILED( g_Net.SetPeer( strJoin, NETPLAY_PORT ) ) ) )
+        {
+            MessageBox( g_hMainWnd, TEXT("Network init failed. ")
+                        TEXT("Pongy will now exit. "), TEXT("Pongy"), 
+                        MB_ICONERROR | MB_OK );
+            return CleanUp();
+        }
+
+        TCHAR strNetSim[MAX_PATH];
+        if( GetCommandLineOption( pCmdLine, TEXT("-netsim"), strNetSim, MAX_PATH ) )
+        {
+            DWORD dwLatency = 0, dwJitter = 0, dwLoss = 0;
+            _stscanf( strNetSim, TEXT("%lu,%lu,%lu"), &dwLatency, &dwJitter, &dwLoss );
+            g_Net.SetConditions( dwLatency, dwJitter, dwLoss );
+        }
+
+        // The host has the left bat
+        g_Rollback.Create( &g_Sim, bHost ? 0 : 1, &g_Net );
+    }
+
+    // Log the game to a replay file for pongy-verify if asked to with
+    // -record <file>. Only a game against the computer with one ball is
+    // played by the sim alone, so that is the only one recorded.
+    TCHAR strReplayFile[MAX_PATH];
+    if( GetCommandLineOption( pCmdLine, TEXT("-record"), strReplayFile, MAX_PATH ) &&
+        !g_MultiBall.IsActive() && !g_Rollback.IsActive() )
+    {
+        if( FAILED( g_Replay.Open( strReplayFile ) ) ||
+            FAILED( g_Replay.BeginMatch( replaySingle, dwSeed, &g_Sim.params ) ) )
+        {
+            MessageBox( g_hMainWnd, TEXT("Can't open the replay file. ")
+                        TEXT("Pongy will now exit. "), TEXT("Pongy"), 
+                        MB_ICONERROR | MB_OK );
+            return CleanUp();
+        }
+    }
 
     g_dwLastTick = timeGetTime();
 
@@ -196,22 +461,41 @@ HRESULT WinInit( HINSTANCE hInst, int nCmdShow, HWND* phWnd, HACCEL* phAccel )
     // Load keyboard accelerators
     hAccel = LoadAccelerators( hInst, MAKEINTRESOURCE(IDR_MAIN_ACCEL) );
 
-    // Calculate the proper size for the window given a client of 640x480
+    // Calculate the proper size for the window given the default client size
     DWORD dwFrameWidth    = GetSystemMetrics( SM_CXSIZEFRAME );
     DWORD dwFrameHeight   = GetSystemMetrics( SM_CYSIZEFRAME );
     DWORD dwMenuHeight    = GetSystemMetrics( SM_CYMENU );
     DWORD dwCaptionHeight = GetSystemMetrics( SM_CYCAPTION );
-    DWORD dwWindowWidth   = WINDOW_WIDTH  + dwFrameWidth * 2;
-    DWORD dwWindowHeight  = WINDOW_HEIGHT + dwFrameHeight * 2 + 
+    DWORD dwWindowWidth   = VIEW_DEFAULT_WIDTH  + dwFrameWidth * 2;
+    DWORD dwWindowHeight  = VIEW_DEFAULT_HEIGHT + dwFrameHeight * 2 + 
                             dwMenuHeight + dwCaptionHeight;
 
-    // Create and show the main window
-    DWORD dwStyle = WS_OVERLAPPEDWINDOW & ~WS_MAXIMIZEBOX;
-    hWnd = CreateWindowEx( 0, TEXT("Pongy"), TEXT("Pongy"),
-                           dwStyle, CW_USEDEFAULT, CW_USEDEFAULT,
-  	                       dwWindowWidth, dwWindowHeight, NULL, NULL, hInst, NULL );
-    if( hWnd == NULL )
-    	return E_FAIL;
+    // Create and show the main window, which can be resized and maximised
+    // unless a recording needs it to stay the same size
+    DWORD dwStyle = WS_OVERLAPPEDWINDOW;
+    if( g_Capture.IsCapturing() )
+        dwStyle &= ~WS_MAXIMIZEBOX;
+
+    if( g_bFullScreen )
+    {
+        // A bare window covering the screen, for DirectDraw to take over
+        hWnd = CreateWindowEx( WS_EX_TOPMOST, TEXT("Pongy"), TEXT("Pongy"),
+                               WS_POPUP, 0, 0, g_dwScreenWidth, g_dwScreenHeight,
+                               NULL, NULL, hInst, NULL );
+        if( hWnd == NULL )
+            return E_FAIL;
+
+        SetMenu( hWnd, NULL );
+        ShowCursor( FALSE );
+    }
+    else
+    {
+        hWnd = CreateWindowEx( 0, TEXT("Pongy"), TEXT("Pongy"),
+                               dwStyle, CW_USEDEFAULT, CW_USEDEFAULT,
+  	                           dwWindowWidth, dwWindowHeight, NULL, NULL, hInst, NULL );
+        if( hWnd == NULL )
+    	    return E_FAIL;
+    }
 
     ShowWindow( hWnd, nCmdShow );
     UpdateWindow( hWnd );
@@ -230,35 +514,115 @@ HRESULT InitDirectDraw()
 {
     HRESULT	hr;
 
-    g_pDisplay = new CDisplay();
-    if( FAILED( hr = g_pDisplay->CreateWindowedDisplay( g_hMainWnd, WINDOW_WIDTH, WINDOW_HEIGHT ) ) )
+    // The back buffer matches the screen mode or the client area the window
+    // opened with, and the field is scaled to fit it
+    g_pDisplay.Reset( new CDisplay() );
+    if( g_bFullScreen )
+    {
+        SetView( g_dwScreenWidth, g_dwScreenHeight );
+
+        if( FAILED( hr = g_pDisplay->CreateFullScreenDisplay( g_hMainWnd, g_View.dwWidth, g_View.dwHeight,
+                                                              FULLSCREEN_BPP, g_dwBackBuffers ) ) )
+            return hr;
+    }
+    else
+    {
+        RECT rcClient;
+        GetClientRect( g_hMainWnd, &rcClient );
+        SetView( max( rcClient.right - rcClient.left, 1 ), max( rcClient.bottom - rcClient.top, 1 ) );
+
+        if( FAILED( hr = g_pDisplay->CreateWindowedDisplay( g_hMainWnd, g_View.dwWidth, g_View.dwHeight ) ) )
+            return hr;
+    }
+
+	// Create the ball and bat surfaces at the view's scale, and draw their
+	// bitmap resources on them. The ball's black colour key is set first,
+	// as an alpha ball is made clear there as it loads.
+    if( g_bAlphaSprites )
+        hr = g_pDisplay->CreateAlphaSurface( g_pBallSurface.Receive(), ViewSize( BALL_SPRITE_DIAMETER ), 
+                                             ViewSize( BALL_SPRITE_DIAMETER ) );
+    else
+        hr = g_pDisplay->CreateSurface( g_pBallSurface.Receive(), ViewSize( BALL_SPRITE_DIAMETER ), 
+                                        ViewSize( BALL_SPRITE_DIAMETER ) );
+    if( FAILED( hr ) )
         return hr;
 
-	// Create a ball surface, and draw a ball bitmap resource on it.  
-    if( FAILED( hr = g_pDisplay->CreateSurfaceFromBitmap( &g_pBallSurface, MAKEINTRESOURCE( IDB_BALL ), 
-                                                          BALL_SPRITE_DIAMETER, BALL_SPRITE_DIAMETER ) ) )
+    if( FAILED( hr = g_pBallSurface->SetColorKey( 0 ) ) )
         return hr;
 
-	// Create a bat surface, and draw a bat bitmap resource on it.  
-    if( FAILED( hr = g_pDisplay->CreateSurfaceFromBitmap( &g_pBatSurface, MAKEINTRESOURCE( IDB_BAT ), 
-                                                          BAT_SPRITE_WIDTH, BAT_SPRITE_HEIGHT ) ) )
+	// The particles are small copies of the ball, made the same way
+    if( g_bAlphaSprites )
+        hr = g_pDisplay->CreateAlphaSurface( g_pParticleSurface.Receive(), ViewSize( PARTICLE_DIAMETER ), 
+                                             ViewSize( PARTICLE_DIAMETER ) );
+    else
+        hr = g_pDisplay->CreateSurface( g_pParticleSurface.Receive(), ViewSize( PARTICLE_DIAMETER ), 
+                                        ViewSize( PARTICLE_DIAMETER ) );
+    if( FAILED( hr ) )
         return hr;
 
-	// Create a surface, and draw text to it.
-	TCHAR scoreMsg[MAX_PATH] = TEXT("");
-	sprintf( scoreMsg, TEXT("YOU %d - %d CMP"), g_Score.nPlayerScore, g_Score.nComputerScore);
+    if( FAILED( hr = g_pParticleSurface->SetColorKey( 0 ) ) )
+        return hr;
 
-	if( FAILED( hr = g_pDisplay->CreateSurfaceFromText( &g_pTextSurface, NULL, scoreMsg, 
-                                                        RGB(0,0,0), RGB(255, 255, 0) ) ) )
+    if( FAILED( hr = g_pDisplay->CreateSurface( g_pBatSurface.Receive(), ViewSize( BAT_SPRITE_WIDTH ), 
+                                                ViewSize( BAT_SPRITE_HEIGHT ) ) ) )
         return hr;
 
-    // Set the color key for the ball sprite to black
-    if( FAILED( hr = g_pBallSurface->SetColorKey( 0 ) ) )
+    if( FAILED( hr = DrawSprites() ) )
+        return hr;
+
+	// Create a surface wide enough for any four digit score, so it never has
+	// to be re-created mid-game, and draw the current score on it.
+	if( FAILED( hr = CreateScoreFont() ) )
+		return hr;
+
+	if( FAILED( hr = g_pDisplay->CreateSurfaceFromText( g_pTextSurface.Receive(), g_hScoreFont, SCORE_WIDEST, 
+                                                        RGB(0,0,0), RGB(255, 255, 0), g_bAlphaSprites ) ) )
+        return hr;
+
+	if( FAILED( hr = DrawScore() ) )
+		return hr;
+
+    // Create the frame stats overlay surfaces
+    if( FAILED( hr = g_Stats.CreateOverlay( g_pDisplay ) ) )
         return hr;
 
     return S_OK;
 }
 
+//-----------------------------------------------------------------------------
+// Name: ResetDirectDraw()
+// Desc: Recovers from a display mode change by recreating every surface in
+//       place and redrawing them. The CDisplay, the CSurfaces and the game
+//       state are all kept, so nothing is allocated and the rally goes on.
+//-----------------------------------------------------------------------------
+HRESULT ResetDirectDraw()
+{
+    HRESULT hr;
+
+    if( FAILED( hr = g_pDisplay->ResetObjects() ) )
+        return hr;
+
+    LPDIRECTDRAW7 pDD = g_pDisplay->GetDirectDraw();
+
+    if( FAILED( hr = g_pBallSurface->Reset( pDD ) ) )
+        return hr;
+
+    if( FAILED( hr = g_pBatSurface->Reset( pDD ) ) )
+        return hr;
+
+    if( FAILED( hr = g_pTextSurface->Reset( pDD ) ) )
+        return hr;
+
+    if( FAILED( hr = g_pParticleSurface->Reset( pDD ) ) )
+        return hr;
+
+    if( FAILED( hr = g_Stats.ResetOverlay( g_pDisplay ) ) )
+        return hr;
+
+    // Put the pictures back on the new surfaces
+    return RestoreSurfaces();
+}
+
 //-----------------------------------------------------------------------------
 // Name: InitDirectInput()
 // Desc: Initialise the DirectInput objects
@@ -292,58 +656,6 @@ HRESULT InitDirectInput( HINSTANCE hInst )
 	return S_OK;
 }
 
-//-----------------------------------------------------------------------------
-// Name: InitSprites()
-// Desc: Initialises each of the sprites
-//-----------------------------------------------------------------------------
-VOID InitSprites()
-{
-	ZeroMemory( &g_Sprite, sizeof(SPRITE_STRUCT) * NUM_SPRITES );
-
-	// Set the ball sprite
-	g_Sprite[0].sType = ball;
-
-	// Set the position and velocity
-	g_Sprite[0].fPosX = (float) ((WINDOW_WIDTH / 2) - (BALL_SPRITE_DIAMETER / 2));
-	g_Sprite[0].fPosY = (float) (0);
-
-	// Keep changing the x velocity until speed is realistic
-	while (1)
-	{
-		g_Sprite[0].fVelX = 500.0f * rand() / RAND_MAX - 250.0f;
-		g_Sprite[0].fVelY = 500.0f * rand() / RAND_MAX - 250.0f;
-		if( g_Sprite[0].fVelX > 100.0 || g_Sprite[0].fVelX < -100.0)
-			if( g_Sprite[0].fVelY > 50.0 || g_Sprite[0].fVelY < -50.0)
-				break;
-	}
-	if( g_Sprite[0].fVelX >= 0)
-		whoseTurn = computer;
-	else
-		whoseTurn = human;
-
-
-	// Set the player bat sprite
-	g_Sprite[1].sType = playerBat;
-
-    // Set the position and velocity
-    g_Sprite[1].fPosX = (float) (BAT_EDGE_SPACER);
-    g_Sprite[1].fPosY = (float) ((WINDOW_HEIGHT / 2) - (BAT_SPRITE_HEIGHT / 2)); 
-
-    g_Sprite[1].fVelX = 0;
-    g_Sprite[1].fVelY = 500.0f * BAT_SPEED / RAND_MAX - 250.0f;
-
-
-	// Set the computer bat sprite
-	g_Sprite[2].sType = computerBat;
-
-    // Set the position and velocity
-    g_Sprite[2].fPosX = (float) (WINDOW_WIDTH - (BAT_SPRITE_WIDTH + BAT_EDGE_SPACER));
-    g_Sprite[2].fPosY = (float) ((WINDOW_HEIGHT / 2) - (BAT_SPRITE_HEIGHT / 2)); 
-
-    g_Sprite[2].fVelX = 0;
-    g_Sprite[2].fVelY = 500.0f * BAT_SPEED / RAND_MAX - 250.0f;
-}
-
 //-----------------------------------------------------------------------------
 // Name: ProcessIdle()
 // Desc: Performs the actual program operation, updating the 
@@ -355,11 +667,20 @@ HRESULT ProcessIdle()
 
 	if( g_bActive )
 	{
+		// Fit the view to the window once it has settled at a new size,
+		// rather than on every frame while it is being dragged
+		if( g_bResizePending && !g_bSizing )
+		{
+			g_bResizePending = FALSE;
+			if( FAILED( hr = ResizeView() ) )
+				return hr;
+		}
+
 		// Move the sprites, blt them to the back buffer, then 
 		// flip or blt the back buffer to the primary buffer
 		if( FAILED( hr = ProcessNextFrame() ) )
 		{
-			if( hr = DDERR_SURFACELOST )
+			if( hr == DDERR_SURFACELOST )
 			{
 				 // The surfaces were lost so restore them 
 				if( FAILED( hr = RestoreSurfaces() ) )
@@ -396,6 +717,13 @@ LRESULT CALLBACK MainWndProc( HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam
                     // Received key/menu command to exit app
             	    PostMessage( hWnd, WM_CLOSE, 0, 0 );
                     return 0L;
+
+                case IDM_STATS:
+                    // Show or hide the frame stats overlay
+                    g_Stats.ToggleOverlay();
+                    if( g_Stats.IsOverlayShown() )
+                        g_Stats.UpdateOverlay();
+                    return 0L;
             }
             break; // Continue with default processing
 
@@ -405,12 +733,13 @@ LRESULT CALLBACK MainWndProc( HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam
             // The app will not be active, but it will be visible.
             if( g_pDisplay )
             {
-                // Display the new position of the sprite
-                if( DisplayFrame() == DDERR_SURFACELOST )
+                // Draw the last frame again. Nothing has moved, so the
+                // trails, capture and stats are left alone.
+                if( DisplayFrame( TRUE ) == DDERR_SURFACELOST )
                 {
                     // If the surfaces were lost, then restore and try again
                     RestoreSurfaces();
-                    DisplayFrame();
+                    DisplayFrame( TRUE );
                 }
             }
             break; // Continue with default processing to validate the region
@@ -423,30 +752,40 @@ LRESULT CALLBACK MainWndProc( HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam
                 // since then.  So get the palette back from the primary 
                 // DirectDraw surface, and set it again so that DirectDraw 
                 // realises the palette, then release it again. 
-                LPDIRECTDRAWPALETTE pDDPal = NULL; 
-                g_pDisplay->GetFrontBuffer()->GetPalette( &pDDPal );
+                CPaletteHandle pDDPal; 
+                g_pDisplay->GetFrontBuffer()->GetPalette( pDDPal.Receive() );
                 g_pDisplay->GetFrontBuffer()->SetPalette( pDDPal );
-                SAFE_RELEASE( pDDPal );
             }
             break;
 
         case WM_GETMINMAXINFO:
             {
-                // Don't allow resizing in windowed mode.  
-                // Fix the size of the window to 640x480 (client size)
+                // Allow any client size down to VIEW_MIN_*. A recording
+                // fixes it at the size the recording was started at.
                 MINMAXINFO* pMinMax = (MINMAXINFO*) lParam;
 
                 DWORD dwFrameWidth    = GetSystemMetrics( SM_CXSIZEFRAME );
                 DWORD dwFrameHeight   = GetSystemMetrics( SM_CYSIZEFRAME );
                 DWORD dwMenuHeight    = GetSystemMetrics( SM_CYMENU );
                 DWORD dwCaptionHeight = GetSystemMetrics( SM_CYCAPTION );
+                DWORD dwClientWidth   = VIEW_MIN_WIDTH;
+                DWORD dwClientHeight  = VIEW_MIN_HEIGHT;
+
+                if( g_Capture.IsCapturing() )
+                {
+                    dwClientWidth  = VIEW_DEFAULT_WIDTH;
+                    dwClientHeight = VIEW_DEFAULT_HEIGHT;
+                }
 
-                pMinMax->ptMinTrackSize.x = WINDOW_WIDTH  + dwFrameWidth * 2;
-                pMinMax->ptMinTrackSize.y = WINDOW_HEIGHT + dwFrameHeight * 2 + 
+                pMinMax->ptMinTrackSize.x = dwClientWidth  + dwFrameWidth * 2;
+                pMinMax->ptMinTrackSize.y = dwClientHeight + dwFrameHeight * 2 + 
                                             dwMenuHeight + dwCaptionHeight;
 
-                pMinMax->ptMaxTrackSize.x = pMinMax->ptMinTrackSize.x;
-                pMinMax->ptMaxTrackSize.y = pMinMax->ptMinTrackSize.y;
+                if( g_Capture.IsCapturing() )
+                {
+                    pMinMax->ptMaxTrackSize.x = pMinMax->ptMinTrackSize.x;
+                    pMinMax->ptMaxTrackSize.y = pMinMax->ptMinTrackSize.y;
+                }
             }
             return 0L;
 
@@ -460,8 +799,14 @@ LRESULT CALLBACK MainWndProc( HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam
             g_dwLastTick = timeGetTime();
             break;
 
+        case WM_ENTERSIZEMOVE:
+            // Hold any resize until the drag is over
+            g_bSizing = TRUE;
+            break;
+
         case WM_EXITSIZEMOVE:
             // Ignore time spent resizing
+            g_bSizing    = FALSE;
             g_dwLastTick = timeGetTime();
             break;
 
@@ -472,8 +817,14 @@ LRESULT CALLBACK MainWndProc( HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam
             else
                 g_bActive = TRUE;
 
+			// Until the view is resized the old back buffer is stretched
+			// over the new client area. Full screen it is always the mode.
 			if( g_pDisplay )
+			{
 		        g_pDisplay->UpdateBounds();
+				if( g_bActive && g_pDisplay->IsWindowed() )
+					g_bResizePending = TRUE;
+			}
             break;
             
         case WM_DESTROY:
@@ -493,6 +844,8 @@ LRESULT CALLBACK MainWndProc( HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam
 //-----------------------------------------------------------------------------
 HRESULT ProcessNextFrame()
 {
+    PROF_ZONE( "ProcessNextFrame" );
+
     HRESULT hr;
 
     // Figure how much time has passed since the last time
@@ -505,48 +858,95 @@ HRESULT ProcessNextFrame()
 
     g_dwLastTick = dwCurrTick;
 
-    // Move the sprites according their type & how much time has passed
-	for( int i = 0; i < NUM_SPRITES; i++ )
-	{
-		switch( g_Sprite[i].sType )
-		{
-			case playerBat:
-				UpdatePlayerBat( dwTickDiff / 1000.0f );
-				break;
+    // Everything in the frame arena belonged to the last frame
+    g_FrameArena.Reset();
+
+    DWORD    dwAllocStart  = Mem_GetHeapAllocs();
+    DWORD    dwReplayStart = g_Rollback.GetResimulated();
+    LONGLONG llSimStart    = g_Stats.GetTime();
+    DWORD    dwTicks       = 1;
 
-			case computerBat:
-				UpdateComputerBat( dwTickDiff / 1000.0f );
-				break;
+    // Move the sprites according their type & how much time has passed,
+	// or play fixed frames through rollback in a network game
+	if( g_Rollback.IsActive() )
+	{
+		dwTicks = UpdateNetplay( dwTickDiff );
+	}
+	else
+	{
+		int nMove = GetPlayerMove();
 
-			case ball:
-				UpdateBall( dwTickDiff / 1000.0f );
-				break;
+		for( int i = 0; i < NUM_SPRITES; i++ )
+		{
+			switch( g_Sim.aSprite[i].sType )
+			{
+				case playerBat:
+					UpdatePlayerBat( dwTickDiff / 1000.0f, nMove );
+					break;
+
+				case computerBat:
+					UpdateComputerBat( dwTickDiff / 1000.0f );
+					break;
+
+				case ball:
+					if( g_MultiBall.IsActive() )
+						UpdateMultiBall( dwTickDiff / 1000.0f );
+					else
+						UpdateBall( dwTickDiff / 1000.0f );
+					break;
+			}
 		}
+
+		// The sprites are in the same order as Sim_Step() moves them, so
+		// this frame plays back as one step
+		g_Replay.AddTick( nMove, 0, dwTickDiff / 1000.0f, &g_Sim );
 	}
 
+	// The sparks are only for show, so they move in real time even in a
+	// network game
+	g_Particles.Update( dwTickDiff / 1000.0f );
+
+	// The trails fade by real time as well, so they are as long at any
+	// frame rate
+	if( g_Trails.IsCreated() )
+		g_Trails.Decay( dwTickDiff / 1000.0f );
+
+	// Only recorded once the frame is sure to be drawn, below, so a frame
+	// skipped while the display is lost doesn't land in the stats
+	FLOAT fSimMs     = g_Stats.GetElapsedMs( llSimStart );
+	DWORD dwReplayed = g_Rollback.GetResimulated() - dwReplayStart;
+
     // Check the cooperative level before rendering
     if( FAILED( hr = g_pDisplay->GetDirectDraw()->TestCooperativeLevel() ) )
     {
         switch( hr )
         {
             case DDERR_EXCLUSIVEMODEALREADYSET:
-                // Do nothing because some other app has exclusive mode
+            case DDERR_NOEXCLUSIVEMODE:
+                // Do nothing because some other app has exclusive mode,
+                // or we have been switched away from full screen
                 Sleep(10);
                 return S_OK;
 
             case DDERR_WRONGMODE:
 
-                // The display mode changed on us. Update the
-                // DirectDraw surfaces accordingly
-                FreeDirectDraw();
-				InitSprites();
-                return InitDirectDraw();
+                // The display mode changed on us. Recreate the
+                // DirectDraw surfaces in place and carry on
+                return ResetDirectDraw();
         }
         return hr;
     }
 
+    g_Stats.AddSample( statSim, fSimMs );
+    g_Stats.AddSample( statTicks, (FLOAT)dwTicks );
+    g_Stats.AddSample( statReplayed, (FLOAT)dwReplayed );
+
     // Display the sprites on the screen
-    if( FAILED( hr = DisplayFrame() ) )
+    hr = DisplayFrame( FALSE );
+    g_Stats.AddSample( statAllocs, (FLOAT)( Mem_GetHeapAllocs() - dwAllocStart ) );
+    g_Stats.EndFrame();
+
+    if( FAILED( hr ) )
     {
         if( hr != DDERR_SURFACELOST )
             return hr;
@@ -560,7 +960,19 @@ HRESULT ProcessNextFrame()
 // Desc: Move the players bat around and make it bounce based on how much time 
 //       has passed
 //-----------------------------------------------------------------------------
-VOID UpdatePlayerBat( FLOAT fTimeDelta )
+VOID UpdatePlayerBat( FLOAT fTimeDelta, int nMove )
+{
+	PROF_ZONE( "UpdatePlayerBat" );
+
+	Sim_MovePlayerBat( &g_Sim, nMove, fTimeDelta );
+}
+
+//-----------------------------------------------------------------------------
+// Name: GetPlayerMove()
+// Desc: Reads the keyboard and returns which way the player wants their bat
+//       to go: -1 up, 1 down or 0 to stay put
+//-----------------------------------------------------------------------------
+int GetPlayerMove()
 {
 	#define KEYDOWN(name, key) (name[key] & 0x80) 
  
@@ -586,26 +998,14 @@ VOID UpdatePlayerBat( FLOAT fTimeDelta )
 		}
     } 
  
-    // Update the player bat position
+    // Work out the player bat direction
+	int nMove = 0;
     if (KEYDOWN(buffer, DIK_UP))
-	{
-		g_Sprite[1].fPosY += g_Sprite[1].fVelY * fTimeDelta;
-	}	
+		nMove = -1;
     else if (KEYDOWN(buffer, DIK_DOWN))
-	{
-		g_Sprite[1].fPosY -= g_Sprite[1].fVelY * fTimeDelta;
-	}
-
-	// Check bat not going beyond screen borders
-    if( g_Sprite[1].fPosY < 0 )
-    {
-        g_Sprite[1].fPosY = 0;
-    }
+		nMove = 1;
 
-    if( g_Sprite[1].fPosY > WINDOW_HEIGHT - BAT_SPRITE_HEIGHT )
-    {
-        g_Sprite[1].fPosY = WINDOW_HEIGHT - 1 - BAT_SPRITE_HEIGHT;
-    }   
+	return nMove;
 }
 
 //-----------------------------------------------------------------------------
@@ -615,27 +1015,9 @@ VOID UpdatePlayerBat( FLOAT fTimeDelta )
 //-----------------------------------------------------------------------------
 VOID UpdateComputerBat( FLOAT fTimeDelta )
 {    
-	// Computer will not move until player has hit ball
-	if((whoseTurn == human) || (g_Sprite[0].fPosX < COMPUTER_LEVEL))
-		return;
-
-	// Update the computers bat position based on ball position
-	if(g_Sprite[2].fPosY < g_Sprite[0].fPosY)
-		g_Sprite[2].fPosY -= g_Sprite[2].fVelY * fTimeDelta;
+	PROF_ZONE( "UpdateComputerBat" );
 
-	if(g_Sprite[2].fPosY > g_Sprite[0].fPosY)
-		g_Sprite[2].fPosY += g_Sprite[2].fVelY * fTimeDelta;
-
-	// Check bat not going beyond screen borders
-    if( g_Sprite[2].fPosY < 0 )
-    {
-        g_Sprite[2].fPosY = 0;
-    }
-
-    if( g_Sprite[2].fPosY > WINDOW_HEIGHT - BAT_SPRITE_HEIGHT )
-    {
-        g_Sprite[2].fPosY = WINDOW_HEIGHT - 1 - BAT_SPRITE_HEIGHT;
-    }   
+	Sim_UpdateComputerBat( &g_Sim, fTimeDelta );
 }
 
 //-----------------------------------------------------------------------------
@@ -645,161 +1027,323 @@ VOID UpdateComputerBat( FLOAT fTimeDelta )
 //-----------------------------------------------------------------------------
 VOID UpdateBall( FLOAT fTimeDelta )
 {    
-	PlayerType type;
+	PROF_ZONE( "UpdateBall" );
 
-    // Update the sprite position
-    g_Sprite[0].fPosX += g_Sprite[0].fVelX * fTimeDelta;
-    g_Sprite[0].fPosY += g_Sprite[0].fVelY * fTimeDelta;
+	SimEvent event = Sim_UpdateBall( &g_Sim, fTimeDelta );
 
-    // Check if computer scored a point
-    if( g_Sprite[0].fPosX < 0.0f )
-    {
-		type = computer;
-		UpdateScore(type);
-		InitSprites();
+	// Throw sparks off the bat the ball has just left, carried along a
+	// little by the ball
+	if( event == simPlayerHit || event == simComputerHit )
+	{
+		SPRITE_STRUCT* pBall = &g_Sim.aSprite[0];
+		FLOAT          fX    = ( event == simPlayerHit ) ? pBall->fPosX : pBall->fPosX + BALL_SPRITE_DIAMETER;
 
- 		return;
-    }
+		g_Particles.Emit( fX, pBall->fPosY + BALL_SPRITE_DIAMETER / 2, pBall->fVelX * 0.5f, pBall->fVelY * 0.5f,
+						  PARTICLE_HIT_SPEED, PARTICLE_HIT_COUNT );
+	}
 
-	// Check if player scored a point
-    if( g_Sprite[0].fPosX >= WINDOW_WIDTH - BALL_SPRITE_DIAMETER )
-    {
-		type = human;
-		UpdateScore(type);
-		InitSprites();
+	// Redraw the score if either side scored a point
+	if( SIM_IS_POINT( event ) )
+		UpdateScore( TRUE );
+}
 
-		return;
-    }
+//-----------------------------------------------------------------------------
+// Name: UpdateMultiBall()
+// Desc: Steps every ball in multi-ball mode and adds up the points scored.
+//       g_Sim.aSprite[0] is kept on whichever ball will reach the computer's
+//       bat next, so the computer bat chases that one.
+//-----------------------------------------------------------------------------
+VOID UpdateMultiBall( FLOAT fTimeDelta )
+{
+	PROF_ZONE( "UpdateMultiBall" );
 
-	// Bounce the ball if it hits the top or bottom
-    if( g_Sprite[0].fPosY < 0 )
-    {
-        g_Sprite[0].fPosY = 0;
-        g_Sprite[0].fVelY = -g_Sprite[0].fVelY;
-		return;
-    }
+	DWORD dwPlayerPoints;
+	DWORD dwComputerPoints;
 
-    if( g_Sprite[0].fPosY > WINDOW_HEIGHT - BALL_SPRITE_DIAMETER )
-    {
-        g_Sprite[0].fPosY = WINDOW_HEIGHT - 1 - BALL_SPRITE_DIAMETER;
-        g_Sprite[0].fVelY = -g_Sprite[0].fVelY;
-		return;
-    }
+	g_MultiBall.Update( fTimeDelta, &g_Sim.aSprite[1], &g_Sim.aSprite[2], 
+						&dwPlayerPoints, &dwComputerPoints );
 
-	// Bounce the ball if it hit the players bat
-	if( g_Sprite[0].fPosX <= (g_Sprite[1].fPosX + BAT_SPRITE_WIDTH))
+	BALL_STRUCT* pLead = g_MultiBall.GetLeadBall();
+	g_Sim.aSprite[0].fPosX = pLead->fPosX;
+	g_Sim.aSprite[0].fPosY = pLead->fPosY;
+	g_Sim.aSprite[0].fVelX = pLead->fVelX;
+	g_Sim.aSprite[0].fVelY = pLead->fVelY;
+	g_Sim.whoseTurn = ( pLead->fVelX > 0 ) ? computer : human;
+
+	// Redraw the score once for all the points this step, rather than once
+	// per point
+	if( dwPlayerPoints || dwComputerPoints )
 	{
-		if( (g_Sprite[0].fPosY + BALL_SPRITE_DIAMETER >= g_Sprite[1].fPosY) &&
-			(g_Sprite[0].fPosY <= g_Sprite[1].fPosY + BAT_SPRITE_HEIGHT ) )
-		{
-			g_Sprite[0].fPosX  = (float) (BAT_EDGE_SPACER + BAT_SPRITE_WIDTH);
-			g_Sprite[0].fVelX = -g_Sprite[0].fVelX;
-			
-			// Up the ball speed
-			g_Sprite[0].fVelX += BALL_SPEED_INC;
-
-			// Inform computer that its it's turn
-			whoseTurn = computer;
-			return;
-		}
+		g_Sim.score.nPlayerScore   += dwPlayerPoints;
+		g_Sim.score.nComputerScore += dwComputerPoints;
+		DrawScore();
 	}
+}
 
-	// Bounce the ball if it hit the computers bat
-	if( g_Sprite[0].fPosX + BALL_SPRITE_DIAMETER >= g_Sprite[2].fPosX)
-	{
-		if( (g_Sprite[0].fPosY + BALL_SPRITE_DIAMETER >= g_Sprite[2].fPosY) &&
-			(g_Sprite[0].fPosY <= g_Sprite[2].fPosY + BAT_SPRITE_HEIGHT ) )
-		{
-			g_Sprite[0].fPosX = (float) (WINDOW_WIDTH - (BAT_EDGE_SPACER + BAT_SPRITE_WIDTH + BALL_SPRITE_DIAMETER));
-			g_Sprite[0].fVelX = -g_Sprite[0].fVelX;
+//-----------------------------------------------------------------------------
+// Name: UpdateNetplay()
+// Desc: Plays a network game at a steady 60 frames a second, whatever the
+//       display rate, through rollback. A rollback can change the score as
+//       well as where things are, so the score is compared rather than
+//       waiting for a point, and only a score that went up gets sparks, not
+//       a point taken back. Returns how many new frames were played,
+//       not counting those a rollback played again.
+//-----------------------------------------------------------------------------
+DWORD UpdateNetplay( DWORD dwTickDiff )
+{
+	PROF_ZONE( "UpdateNetplay" );
 
-			// Up the ball speed
-			g_Sprite[0].fVelX -= BALL_SPEED_INC;
+	SCORE_STRUCT score    = g_Sim.score;
+	int          nMove    = GetPlayerMove();
+	DWORD        dwFrames = 0;
 
-			// Inform player that its their turn
-			whoseTurn = human;
-			return;
-		}
+	// Count time in 60ths of a millisecond so whole frames come out even,
+	// and never try to catch up more than a few frames after a stall
+	g_dwNetTime += dwTickDiff * 60;
+	if( g_dwNetTime > NETPLAY_MAX_CATCHUP * 1000 )
+		g_dwNetTime = NETPLAY_MAX_CATCHUP * 1000;
+
+	while( g_dwNetTime >= 1000 )
+	{
+		g_dwNetTime -= 1000;
+		if( S_OK == g_Rollback.AdvanceFrame( nMove, timeGetTime() ) )
+			dwFrames++;
 	}
+
+	if( score.nPlayerScore   != g_Sim.score.nPlayerScore ||
+		score.nComputerScore != g_Sim.score.nComputerScore )
+		UpdateScore( g_Sim.score.nPlayerScore   > score.nPlayerScore ||
+					 g_Sim.score.nComputerScore > score.nComputerScore );
+
+	return dwFrames;
 }
 
 //-----------------------------------------------------------------------------
 // Name: UpdateScore()
-// Desc: Updates the current score and the score text surface
+// Desc: Updates the score text surface after the score changes, with a
+//       burst of sparks out of it if bBurst
 //-----------------------------------------------------------------------------
-VOID UpdateScore(PlayerType type)
+VOID UpdateScore( BOOL bBurst )
 {
 	HRESULT hr;
 
-	switch(type)
-	{
-		case human:
-			g_Score.nPlayerScore += 1;
-			break;
-		case computer:
-			g_Score.nComputerScore += 1;
-			break;
-	}
+	if( bBurst )
+		g_Particles.Emit( (FIELD_WIDTH / 2) - 50 + g_sizeScore.cx / ( 2.0f * g_View.fScale ),
+						  10 + g_sizeScore.cy / ( 2.0f * g_View.fScale ), 0.0f, 0.0f,
+						  PARTICLE_POINT_SPEED, PARTICLE_POINT_COUNT );
 
 	// Update the score text surface.
-	TCHAR scoreMsg[MAX_PATH] = TEXT("");
-	sprintf( scoreMsg, TEXT("YOU %d - %d CMP"), g_Score.nPlayerScore, g_Score.nComputerScore);
-	
-	if(g_Score.nPlayerScore > 9 || g_Score.nComputerScore > 9)
+	if( FAILED( hr = DrawScore() ) )
 	{
-		SAFE_DELETE( g_pTextSurface );
-		if( FAILED( hr = g_pDisplay->CreateSurfaceFromText( &g_pTextSurface, NULL, scoreMsg, 
-										                  RGB(0,0,0), RGB(255, 255, 0) ) ) )
-		{
-			MessageBox( g_hMainWnd, TEXT("Update score failed. ")
-						TEXT("Pongy will now exit. "), TEXT("Pongy"), 
-						MB_ICONERROR | MB_OK );
-			CleanUp();
-			exit(0);
-		}
+		MessageBox( g_hMainWnd, TEXT("Update score failed. ")
+					TEXT("Pongy will now exit. "), TEXT("Pongy"), 
+					MB_ICONERROR | MB_OK );
+		CleanUp();
+		exit(0);
 	}
-	else
-		g_pTextSurface->DrawText( NULL, scoreMsg, 0, 0, RGB(0,0,0), RGB(255, 255, 0) );
+}
+
+//-----------------------------------------------------------------------------
+// Name: DrawScore()
+// Desc: Redraws the score on the text surface, blanking it first as the 
+//       surface is sized for the widest score.
+//-----------------------------------------------------------------------------
+HRESULT DrawScore()
+{
+	TCHAR scoreMsg[32];
+	sprintf( scoreMsg, TEXT("YOU %d - %d CMP"), g_Sim.score.nPlayerScore, g_Sim.score.nComputerScore);
+
+    DDBLTFX ddbltfx;
+    ZeroMemory( &ddbltfx, sizeof(ddbltfx) );
+    ddbltfx.dwSize      = sizeof(ddbltfx);
+    ddbltfx.dwFillColor = 0;
+    g_pTextSurface->GetDDrawSurface()->Blt( NULL, NULL, NULL, DDBLT_COLORFILL | DDBLT_WAIT, &ddbltfx );
+
+    HRESULT hr = g_pTextSurface->DrawText( g_hScoreFont, scoreMsg, 0, 0, RGB(0,0,0), RGB(255, 255, 0) );
+
+    // The software and indexed displays draw from their own copies
+    if( SUCCEEDED( hr ) && g_SoftDisplay.IsCreated() )
+        hr = g_SoftText.CopyFrom( g_pTextSurface );
+    if( SUCCEEDED( hr ) && g_IndexedDisplay.IsCreated() )
+        hr = g_IndexedText.CopyFrom( g_pTextSurface, g_IndexedDisplay.GetPalette() );
+
+    return hr;
 }
 
 //-----------------------------------------------------------------------------
 // Name: DisplayFrame()
 // Desc: Blts a the sprites to the back buffer, then it blts or flips the 
-//       back buffer onto the primary buffer.
+//       back buffer onto the primary buffer. bRepaint draws the same sim
+//       state again for WM_PAINT, without stamping the trails, capturing,
+//       pacing or sampling the present time. Whatever it takes from the
+//       frame arena is given back before it returns.
 //-----------------------------------------------------------------------------
-HRESULT DisplayFrame()
+HRESULT DisplayFrame( BOOL bRepaint )
 {
+    PROF_ZONE( "DisplayFrame" );
+
     HRESULT hr;
+    DWORD   dwArenaMark = g_FrameArena.GetMark();
 
 	// Fill the back buffer with black, ignoring errors until the flip
-    g_pDisplay->Clear( 0 );
+    {
+        PROF_ZONE( "Clear" );
+        if( g_SoftDisplay.IsCreated() )
+            g_SoftDisplay.Clear( 0 );
+        else if( g_IndexedDisplay.IsCreated() )
+            g_IndexedDisplay.Clear( 0 );
+        else
+            g_pDisplay->Clear( 0 );
+    }
 
-	// Blt the score text on the backbuffer, ignoring errors until the flip
-	int msgPosX = ((WINDOW_WIDTH / 2) - 50);
-    g_pDisplay->Blt( msgPosX, 10, g_pTextSurface, NULL );
+	// Build this frame's draw list in the frame arena, the score text
+	// first and then the sprites
+	DWORD     dwNumBalls = g_MultiBall.GetNumBalls();
+	DRAWITEM* pDrawList  = (DRAWITEM*)g_FrameArena.Alloc( DRAW_LIST_SIZE( dwNumBalls ) );
+	if( NULL == pDrawList )
+		return E_OUTOFMEMORY;
+
+	// Everything is placed in field units and mapped into the view
+	DWORD dwBallSize  = ViewSize( BALL_SPRITE_DIAMETER );
+	DWORD dwBatWidth  = ViewSize( BAT_SPRITE_WIDTH );
+	DWORD dwBatHeight = ViewSize( BAT_SPRITE_HEIGHT );
+
+	DWORD dwNumItems = 0;
+	ViewPoint( (FIELD_WIDTH / 2) - 50, 10, g_sizeScore.cx, g_sizeScore.cy, &pDrawList[dwNumItems] );
+	pDrawList[dwNumItems].pSurface = g_pTextSurface;
+	pDrawList[dwNumItems].pSoft    = &g_SoftText;
+	pDrawList[dwNumItems].pIndexed = &g_IndexedText;
+	dwNumItems++;
 
-    // Blt all the sprites onto the back buffer using color keying,
-    // ignoring errors until the last blt. Note that all of these sprites 
-    // use the same DirectDraw surface.
     for( int i = 0; i < NUM_SPRITES; i++ )
     {
-		if( g_Sprite[i].sType == ball)
-		{
-			g_pDisplay->Blt( (DWORD)g_Sprite[i].fPosX, 
-							(DWORD)g_Sprite[i].fPosY, 
-							g_pBallSurface, NULL );
-		}
+		// In multi-ball mode the ball sprite is only a stand in for one of
+		// the real balls, which are added below
+		if( g_Sim.aSprite[i].sType == ball && dwNumBalls > 0 )
+			continue;
+
+		if( g_Sim.aSprite[i].sType == ball )
+			ViewPoint( g_Sim.aSprite[i].fPosX, g_Sim.aSprite[i].fPosY, dwBallSize, dwBallSize, &pDrawList[dwNumItems] );
 		else
+			ViewPoint( g_Sim.aSprite[i].fPosX, g_Sim.aSprite[i].fPosY, dwBatWidth, dwBatHeight, &pDrawList[dwNumItems] );
+		pDrawList[dwNumItems].pSurface = ( g_Sim.aSprite[i].sType == ball ) ? g_pBallSurface : g_pBatSurface;
+		pDrawList[dwNumItems].pSoft    = ( g_Sim.aSprite[i].sType == ball ) ? &g_SoftBall : &g_SoftBat;
+		pDrawList[dwNumItems].pIndexed = ( g_Sim.aSprite[i].sType == ball ) ? &g_IndexedBall : &g_IndexedBat;
+		dwNumItems++;
+    }
+
+	BALL_STRUCT* pBalls = g_MultiBall.GetBalls();
+	for( DWORD i = 0; i < dwNumBalls; i++ )
+	{
+		ViewPoint( pBalls[i].fPosX, pBalls[i].fPosY, dwBallSize, dwBallSize, &pDrawList[dwNumItems] );
+		pDrawList[dwNumItems].pSurface = g_pBallSurface;
+		pDrawList[dwNumItems].pSoft    = &g_SoftBall;
+		pDrawList[dwNumItems].pIndexed = &g_IndexedBall;
+		dwNumItems++;
+	}
+
+	// Place every particle in the view in one pass, to blt the particle
+	// sprite at each after the other sprites. Those off the field or the
+	// view are left out.
+	DWORD        dwNumParticles = 0;
+	const POINT* pParticles     = NULL;
+	if( g_Particles.GetNumParticles() > 0 )
+		pParticles = g_Particles.Project( &g_View, ViewSize( PARTICLE_DIAMETER ), &dwNumParticles );
+
+	// Stamp this frame's balls into the trails, already faded for the time
+	// since the last frame. The one ball is followed so a fast one leaves
+	// no gaps; multi-balls are only stamped where they are.
+	if( g_Trails.IsCreated() && !bRepaint )
+	{
+		PROF_ZONE( "Trails" );
+		for( DWORD i = 0; i < dwNumItems; i++ )
 		{
-			g_pDisplay->Blt( (DWORD)g_Sprite[i].fPosX, 
-                         (DWORD)g_Sprite[i].fPosY, 
-                         g_pBatSurface, NULL );
+			if( pDrawList[i].pSurface != g_pBallSurface )
+				continue;
+
+			if( dwNumBalls > 0 )
+				g_Trails.Stamp( pDrawList[i].x, pDrawList[i].y );
+			else
+				g_Trails.Follow( pDrawList[i].x, pDrawList[i].y );
 		}
+	}
+
+    // Blt everything onto the back buffer, using color keying where the 
+    // surface has it, ignoring errors until the flip. The software display
+    // draws its tiles across its threads and copies the frame over, and the
+    // indexed display draws indices and expands them across its threads.
+    if( g_SoftDisplay.IsCreated() )
+    {
+        PROF_ZONE( "SoftRender" );
+        if( g_Trails.IsCreated() )
+            g_Trails.Draw( &g_SoftDisplay );
+
+        for( DWORD i = 0; i < dwNumItems; i++ )
+            g_SoftDisplay.Blt( pDrawList[i].x, pDrawList[i].y, pDrawList[i].pSoft );
+        for( DWORD i = 0; i < dwNumParticles; i++ )
+            g_SoftDisplay.Blt( pParticles[i].x, pParticles[i].y, &g_SoftParticle );
+
+        g_SoftDisplay.Present( g_pDisplay );
+    }
+    else if( g_IndexedDisplay.IsCreated() )
+    {
+        PROF_ZONE( "IndexedRender" );
+        for( DWORD i = 0; i < dwNumItems; i++ )
+            g_IndexedDisplay.Blt( pDrawList[i].x, pDrawList[i].y, pDrawList[i].pIndexed );
+        for( DWORD i = 0; i < dwNumParticles; i++ )
+            g_IndexedDisplay.Blt( pParticles[i].x, pParticles[i].y, &g_IndexedParticle );
+
+        g_IndexedDisplay.Present( g_pDisplay );
+    }
+    else
+    {
+        PROF_ZONE( "BltSprites" );
+
+        // A back buffer in system memory stays locked for all the sprites,
+        // and the particle sprite is locked once for all the particles
+        g_pDisplay->BeginBatch();
+        for( DWORD i = 0; i < dwNumItems; i++ )
+            g_pDisplay->Blt( pDrawList[i].x, pDrawList[i].y, pDrawList[i].pSurface, NULL );
+        if( dwNumParticles > 0 )
+            g_pDisplay->Blt( pParticles, dwNumParticles, g_pParticleSurface, NULL );
+        g_pDisplay->EndBatch();
     }
 
-    // We are in windowed mode so perform a blt from the backbuffer 
-    // to the primary, returning any errors like DDERR_SURFACELOST
-    if( FAILED( hr = g_pDisplay->Present() ) )
+    // Draw the frame stats on top of everything else, if they are shown
+    g_Stats.DrawOverlay( g_pDisplay, 4, g_View.dwHeight - NUM_STATS * 16 - 4 );
+
+    // Copy the finished frame out for the encoder if we are recording, an
+    // indexed frame as it is without the stats
+    if( g_Capture.IsCapturing() && !bRepaint )
+    {
+        PROF_ZONE( "Capture" );
+        if( g_IndexedDisplay.IsCreated() )
+            g_Capture.CaptureIndexed( g_IndexedDisplay.GetBits(), g_IndexedDisplay.GetPitch(),
+                                      g_IndexedDisplay.GetWidth(), g_IndexedDisplay.GetHeight(),
+                                      g_IndexedDisplay.GetPalette() );
+        else
+            g_Capture.CaptureFrame( g_pDisplay->GetBackBuffer() );
+    }
+
+    // Wait until the frame is due, then blt the backbuffer to the primary
+    // or flip to it when full screen, returning any errors like
+    // DDERR_SURFACELOST
+    PROF_ZONE( "Present" );
+    if( bRepaint )
+    {
+        hr = g_pDisplay->Present( g_Pacer.GetFlipFlags() );
+    }
+    else
+    {
+        g_Pacer.Wait();
+        LONGLONG llPresentStart = g_Stats.GetTime();
+        hr = g_pDisplay->Present( g_Pacer.GetFlipFlags() );
+        g_Stats.AddSample( statPresent, g_Stats.GetElapsedMs( llPresentStart ) );
+    }
+
+    g_FrameArena.Rewind( dwArenaMark );
+
+    if( FAILED( hr ) )
         return hr;
 
     return S_OK;
@@ -816,27 +1360,274 @@ HRESULT RestoreSurfaces()
 	if( FAILED( hr = g_pDisplay->GetDirectDraw()->RestoreAllSurfaces() ) )
         return hr;
 
- 	// No need to re-create the surface, just re-draw it.
-    if( FAILED( hr = g_pBallSurface->DrawBitmap( MAKEINTRESOURCE( IDB_BALL ),
-												BAT_SPRITE_WIDTH, BALL_SPRITE_DIAMETER ) ) )
+ 	// No need to re-create the surfaces, just re-draw them.
+    if( FAILED( hr = DrawSprites() ) )
         return hr;
 
 	// No need to re-create the surface, just re-draw it.
-	TCHAR scoreMsg[MAX_PATH] = TEXT("");
-	sprintf( scoreMsg, TEXT("YOU %d - %d CMP"), g_Score.nPlayerScore, g_Score.nComputerScore);
+    if( FAILED( hr = DrawScore() ) )
+        return hr;
+
+    // Redraw the stats overlay text
+    if( FAILED( hr = g_Stats.UpdateOverlay() ) )
+        return hr;
+
+    return CopySoftSurfaces();
+}
+
+//-----------------------------------------------------------------------------
+// Name: CopySoftSurfaces()
+// Desc: Copies the sprites and score into the software or indexed display's
+//       own surfaces after they have been drawn, if either is in use
+//-----------------------------------------------------------------------------
+HRESULT CopySoftSurfaces()
+{
+    HRESULT hr;
+
+    if( g_SoftDisplay.IsCreated() )
+    {
+        if( FAILED( hr = g_SoftBall.CopyFrom( g_pBallSurface ) ) ||
+            FAILED( hr = g_SoftBat.CopyFrom( g_pBatSurface ) ) ||
+            FAILED( hr = g_SoftText.CopyFrom( g_pTextSurface ) ) ||
+            FAILED( hr = g_SoftParticle.CopyFrom( g_pParticleSurface ) ) )
+            return hr;
+    }
+
+    if( g_IndexedDisplay.IsCreated() )
+    {
+        const PALETTE* pPalette = g_IndexedDisplay.GetPalette();
+
+        if( FAILED( hr = g_IndexedBall.CopyFrom( g_pBallSurface, pPalette ) ) ||
+            FAILED( hr = g_IndexedBat.CopyFrom( g_pBatSurface, pPalette ) ) ||
+            FAILED( hr = g_IndexedText.CopyFrom( g_pTextSurface, pPalette ) ) ||
+            FAILED( hr = g_IndexedParticle.CopyFrom( g_pParticleSurface, pPalette ) ) )
+            return hr;
+    }
+
+    return S_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: BuildPalette()
+// Desc: Makes the indexed display's palette from the sprites and the score
+//       as first drawn, with black fixed for the clear and the bars. The
+//       sprites redrawn at other scales later take the nearest colours.
+//-----------------------------------------------------------------------------
+HRESULT BuildPalette()
+{
+    HRESULT           hr;
+    CPaletteQuantizer quantizer;
+    CSoftSurface      soft;
+
+    if( FAILED( hr = quantizer.Create() ) )
+        return hr;
+
+    CSurface* apSurfaces[] = { g_pBallSurface, g_pBatSurface, g_pTextSurface };
+    for( int i = 0; i < 3; i++ )
+    {
+        if( FAILED( hr = soft.CopyFrom( apSurfaces[i] ) ) )
+            return hr;
+
+        quantizer.AddPixels( soft.GetBits(), soft.GetPitch(), soft.GetWidth(), soft.GetHeight(),
+                             soft.IsColorKeyed(), soft.GetColorKey() );
+    }
+
+    PALETTE* pPalette = new PALETTE;
+    if( NULL == pPalette )
+        return E_OUTOFMEMORY;
+
+    static const DWORD s_dwBlack = 0;
+    if( SUCCEEDED( hr = quantizer.Build( pPalette, PALETTE_MAX_COLORS, &s_dwBlack, 1 ) ) )
+        g_IndexedDisplay.SetPalette( pPalette );
+
+    delete pPalette;
+
+    return hr;
+}
 
-    if( FAILED( hr = g_pTextSurface->DrawText( NULL, scoreMsg, 
-                                               0, 0, RGB(0,0,0), RGB(255, 255, 0) ) ) )
+//-----------------------------------------------------------------------------
+// Name: DrawSprites()
+// Desc: Draws the ball and bat bitmaps onto their surfaces, and the ball
+//       again small for the particles, scaled to the surfaces' sizes. The
+//       bat is filtered to stay smooth at any scale; the balls keep the
+//       nearest pixel so their black colour key is exact, unless they have
+//       premultiplied alpha, which filters to soft edges.
+//-----------------------------------------------------------------------------
+HRESULT DrawSprites()
+{
+    HRESULT        hr;
+    ResampleFilter filter = resampleNearest;
+
+    if( g_View.fScale > 1.0f )
+        filter = resampleBilinear;
+    else if( g_View.fScale < 1.0f )
+        filter = resampleBox;
+
+    if( FAILED( hr = g_pBallSurface->DrawBitmap( MAKEINTRESOURCE( IDB_BALL ),
+                                                 ViewSize( BALL_SPRITE_DIAMETER ), 
+                                                 ViewSize( BALL_SPRITE_DIAMETER ),
+                                                 g_bAlphaSprites ? filter : resampleNearest ) ) )
         return hr;
 
-    // No need to re-create the surface, just re-draw it.
     if( FAILED( hr = g_pBatSurface->DrawBitmap( MAKEINTRESOURCE( IDB_BAT ),
-                                                BAT_SPRITE_WIDTH, BAT_SPRITE_HEIGHT ) ) )
+                                                ViewSize( BAT_SPRITE_WIDTH ), 
+                                                ViewSize( BAT_SPRITE_HEIGHT ), filter ) ) )
+        return hr;
+
+    if( FAILED( hr = g_pParticleSurface->DrawBitmap( MAKEINTRESOURCE( IDB_BALL ),
+                                                     ViewSize( PARTICLE_DIAMETER ), 
+                                                     ViewSize( PARTICLE_DIAMETER ),
+                                                     g_bAlphaSprites ? filter : resampleNearest ) ) )
         return hr;
 
     return S_OK;
 }
 
+//-----------------------------------------------------------------------------
+// Name: SetView()
+// Desc: Fits the field into a back buffer of the given size
+//-----------------------------------------------------------------------------
+VOID SetView( DWORD dwWidth, DWORD dwHeight )
+{
+	FLOAT fScaleX = (FLOAT)dwWidth  / FIELD_WIDTH;
+	FLOAT fScaleY = (FLOAT)dwHeight / FIELD_HEIGHT;
+
+	g_View.dwWidth  = dwWidth;
+	g_View.dwHeight = dwHeight;
+	g_View.fScale   = min( fScaleX, fScaleY );
+	g_View.lLeft    = ( (LONG)dwWidth  - (LONG)( FIELD_WIDTH  * g_View.fScale + 0.5f ) ) / 2;
+	g_View.lTop     = ( (LONG)dwHeight - (LONG)( FIELD_HEIGHT * g_View.fScale + 0.5f ) ) / 2;
+}
+
+//-----------------------------------------------------------------------------
+// Name: ViewSize()
+// Desc: A length in field units, in pixels at the view's scale
+//-----------------------------------------------------------------------------
+DWORD ViewSize( DWORD dwFieldUnits )
+{
+	DWORD dwPixels = (DWORD)( dwFieldUnits * g_View.fScale + 0.5f );
+
+	return ( dwPixels > 0 ) ? dwPixels : 1;
+}
+
+//-----------------------------------------------------------------------------
+// Name: ViewPoint()
+// Desc: Sets where a draw item dwWidth by dwHeight pixels goes in the back
+//       buffer for a top left of ( fX, fY ) in the field. It is kept wholly
+//       inside the buffer, as a blt hanging off the edge by a rounded pixel
+//       would be refused.
+//-----------------------------------------------------------------------------
+VOID ViewPoint( FLOAT fX, FLOAT fY, DWORD dwWidth, DWORD dwHeight, DRAWITEM* pItem )
+{
+	LONG x     = g_View.lLeft + (LONG)( fX * g_View.fScale );
+	LONG y     = g_View.lTop  + (LONG)( fY * g_View.fScale );
+	LONG lMaxX = (LONG)g_View.dwWidth  - (LONG)dwWidth;
+	LONG lMaxY = (LONG)g_View.dwHeight - (LONG)dwHeight;
+
+	pItem->x = (DWORD)max( 0, min( x, lMaxX ) );
+	pItem->y = (DWORD)max( 0, min( y, lMaxY ) );
+}
+
+//-----------------------------------------------------------------------------
+// Name: CreateScoreFont()
+// Desc: Makes the score's font, the system font scaled with the view, and
+//       measures the widest score in it. The raster system font only comes
+//       in a few sizes, so any other scale asks for a TrueType face.
+//-----------------------------------------------------------------------------
+HRESULT CreateScoreFont()
+{
+	LOGFONT lf;
+	if( 0 == GetObject( GetStockObject( SYSTEM_FONT ), sizeof(lf), &lf ) )
+		return E_FAIL;
+
+	lf.lfHeight = (LONG)( lf.lfHeight * g_View.fScale + 0.5f );
+	lf.lfWidth  = (LONG)( lf.lfWidth  * g_View.fScale + 0.5f );
+	if( g_View.fScale != 1.0f )
+		lf.lfOutPrecision = OUT_TT_ONLY_PRECIS;
+
+	HFONT hFont = CreateFontIndirect( &lf );
+	if( NULL == hFont )
+		return E_FAIL;
+
+	if( g_hScoreFont )
+		DeleteObject( g_hScoreFont );
+	g_hScoreFont = hFont;
+
+	HDC     hDC      = GetDC( NULL );
+	HGDIOBJ hOldFont = SelectObject( hDC, g_hScoreFont );
+	GetTextExtentPoint32( hDC, SCORE_WIDEST, lstrlen( SCORE_WIDEST ), &g_sizeScore );
+	SelectObject( hDC, hOldFont );
+	ReleaseDC( NULL, hDC );
+
+	return S_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: ResizeView()
+// Desc: Fits the view to the client area after the window has changed size.
+//       The back buffer and every sprite are recreated in place at the new
+//       scale, so frames are drawn with 1:1 blts and presented without
+//       stretching, and nothing is reallocated until the size next changes.
+//-----------------------------------------------------------------------------
+HRESULT ResizeView()
+{
+	HRESULT hr;
+	RECT    rcClient;
+
+	GetClientRect( g_hMainWnd, &rcClient );
+	DWORD dwWidth  = max( rcClient.right - rcClient.left, 1 );
+	DWORD dwHeight = max( rcClient.bottom - rcClient.top, 1 );
+
+	if( dwWidth == g_View.dwWidth && dwHeight == g_View.dwHeight )
+		return S_OK;
+
+	if( FAILED( hr = g_pDisplay->ResizeBackBuffer( dwWidth, dwHeight ) ) )
+		return hr;
+
+	SetView( dwWidth, dwHeight );
+
+	if( FAILED( hr = CreateScoreFont() ) )
+		return hr;
+
+	LPDIRECTDRAW7 pDD = g_pDisplay->GetDirectDraw();
+
+	if( FAILED( hr = g_pBallSurface->Resize( pDD, ViewSize( BALL_SPRITE_DIAMETER ), 
+	                                         ViewSize( BALL_SPRITE_DIAMETER ) ) ) )
+		return hr;
+
+	if( FAILED( hr = g_pBatSurface->Resize( pDD, ViewSize( BAT_SPRITE_WIDTH ), 
+	                                        ViewSize( BAT_SPRITE_HEIGHT ) ) ) )
+		return hr;
+
+	if( FAILED( hr = g_pTextSurface->Resize( pDD, g_sizeScore.cx, g_sizeScore.cy ) ) )
+		return hr;
+
+	if( FAILED( hr = g_pParticleSurface->Resize( pDD, ViewSize( PARTICLE_DIAMETER ), 
+	                                             ViewSize( PARTICLE_DIAMETER ) ) ) )
+		return hr;
+
+	if( g_SoftDisplay.IsCreated() && FAILED( hr = g_SoftDisplay.Resize( dwWidth, dwHeight ) ) )
+		return hr;
+
+	if( g_IndexedDisplay.IsCreated() && FAILED( hr = g_IndexedDisplay.Resize( dwWidth, dwHeight ) ) )
+		return hr;
+
+	// Draw everything again at its new size
+	if( FAILED( hr = RestoreSurfaces() ) )
+		return hr;
+
+	// The trails start again at the new size, from the ball at its new scale
+	if( g_Trails.IsCreated() )
+	{
+		if( FAILED( hr = g_Trails.Resize( dwWidth, dwHeight ) ) )
+			return hr;
+
+		return g_Trails.SetSprite( g_pBallSurface );
+	}
+
+	return S_OK;
+}
+
 //-----------------------------------------------------------------------------
 // Name: CleanUp()
 // Desc: Releases all DirectX objects
@@ -845,6 +1636,23 @@ BOOL CleanUp()
 {
 	FreeDirectDraw();
 
+	// Flush and close the trace file, log, stats stream and recording
+	PROF_SHUTDOWN();
+	Log_Shutdown();
+	g_Stats.CloseCsv();
+	g_Capture.Stop();
+	g_FrameArena.Destroy();
+	g_MultiBall.Destroy();
+	g_Rollback.Destroy();
+	g_Net.Destroy();
+	g_Replay.EndMatch( &g_Sim );
+	g_Replay.Close();
+	g_SoftDisplay.Destroy();
+	g_IndexedDisplay.Destroy();
+	g_Trails.Destroy();
+	g_Particles.Destroy();
+	g_Pacer.Destroy();
+
     if (g_pDI) 
     { 
         if (g_pKeyboard) 
@@ -858,11 +1666,6 @@ BOOL CleanUp()
         g_pDI = NULL; 
     }
 
-	SAFE_DELETE( g_pBallSurface );
-	SAFE_DELETE( g_pBatSurface );
-    SAFE_DELETE( g_pTextSurface );
-    SAFE_DELETE( g_pDisplay );
-
 	return FALSE;
 }
 
@@ -872,10 +1675,57 @@ BOOL CleanUp()
 //-----------------------------------------------------------------------------
 VOID FreeDirectDraw()
 {
-    g_pBallSurface->Destroy();
-	g_pBatSurface->Destroy();
-    g_pTextSurface->Destroy();
-    g_pDisplay->DestroyObjects();
+    g_pBallSurface.Reset();
+	g_pBatSurface.Reset();
+    g_pTextSurface.Reset();
+    g_pParticleSurface.Reset();
+    g_Stats.DestroyOverlay();
+    g_pDisplay.Reset();
+
+    if( g_hScoreFont )
+    {
+        DeleteObject( g_hScoreFont );
+        g_hScoreFont = NULL;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Name: GetCommandLineOption()
+// Desc: Looks for "strOption value" on the command line, copying the value
+//       into strValue. Returns TRUE if the option was found.
+//-----------------------------------------------------------------------------
+BOOL GetCommandLineOption( LPSTR pCmdLine, const TCHAR* strOption, TCHAR* strValue, int cchValue )
+{
+	if( NULL == pCmdLine )
+		return FALSE;
+
+	int   cchOption = lstrlen( strOption );
+	TCHAR* p = pCmdLine;
+
+	while( NULL != ( p = strstr( p, strOption ) ) )
+	{
+		// Only match whole words
+		if( ( p == pCmdLine || p[-1] == ' ' ) &&
+			( p[cchOption] == ' ' || p[cchOption] == 0 ) )
+			break;
+
+		p += cchOption;
+	}
+
+	if( NULL == p )
+		return FALSE;
+
+	// Skip to the value, which runs up to the next space
+	p += cchOption;
+	while( *p == ' ' )
+		p++;
+
+	int cch = 0;
+	while( *p && *p != ' ' && cch < cchValue - 1 )
+		strValue[cch++] = *p++;
+	strValue[cch] = 0;
+
+	return TRUE;
 }
 
 
@@ -0,0 +1,1291 @@
+//-----------------------------------------------------------------------------
+// File: bench.cpp
+//
+// Desc: The benchmark runner and the benchmarks themselves. Everything runs
+//       inside the game process against the real display, after the window,
+//       DirectDraw surfaces and sprites have been set up, so the numbers
+//       include whatever the driver does for each call.
+//-----------------------------------------------------------------------------
+#define STRICT
+#include <windows.h>
+#include <tchar.h>
+#include <stdio.h>
+#include <string.h>
+#include <ddraw.h>
+#include "resource.h"
+#include "ddutil.h"
+#include "dxutil.h"
+#include "pongy.h"
+#include "multiball.h"
+#include "vecenv.h"
+#include "rollback.h"
+#include "snapshot.h"
+#include "resample.h"
+#include "threadpool.h"
+#include "softdisplay.h"
+#include "fill.h"
+#include "palette.h"
+#include "indexeddisplay.h"
+#include "blitter.h"
+#include "trails.h"
+#include "particles.h"
+#include "bench.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines, constants, and global variables
+//-----------------------------------------------------------------------------
+#define BENCH_MIN_SECONDS   0.1     // Shortest run that counts as a result
+#define BENCH_MAX_ITERS     1000000000
+#define BENCH_ROLLBACK      10      // Frames re-simulated per rollback
+#define BENCH_SNAPSHOTS     1024    // Snapshots in the codec benchmarks, a power of 2
+#define BENCH_SOFT_SPRITES  1000    // Sprites in a software display frame
+#define BENCH_TRAIL_BALLS   64      // Most balls leaving trails at once
+#define BENCH_PARTICLES     100000  // Particles kept alive in the particle benchmarks
+
+static FILE*    g_pBenchFile  = NULL;
+static BOOL     g_bBenchFirst = TRUE;
+static LONGLONG g_llBenchFreq = 0;
+static char     g_strBenchCounter[32] = "";
+static double   g_fBenchCounter = 0.0;
+
+struct BALL_BENCH
+{
+    FLOAT fSpeed;
+    FLOAT fTimeDelta;
+};
+
+struct VECENV_BENCH
+{
+    CVecEnv env;
+    int*    pnActions;
+    FLOAT*  pfObs;
+    FLOAT*  pfRewards;
+    BYTE*   pbDones;
+};
+
+// A game's snapshots 20 times a second, and each coded against the one
+// before it
+struct SNAPSHOT_BENCH
+{
+    SNAPSHOT    aSnaps[BENCH_SNAPSHOTS];
+    BYTE        aabEncoded[BENCH_SNAPSHOTS][SNAPSHOT_MAX_BYTES];
+    DWORD       adwSizes[BENCH_SNAPSHOTS];
+    SNAPSHOT    aRing[SNAPSHOT_RING];
+};
+
+struct SURFACE_BENCH
+{
+    CSurfaceHandle pSrc;
+    CSurfaceHandle pDest;
+};
+
+// A software display and a colour keyed ball to scatter over it
+struct SOFT_BENCH
+{
+    CSoftDisplay   display;
+    CSoftSurface   sprite;
+};
+
+// A frame in memory to fill, as a system memory back buffer would be
+struct FILL_BENCH
+{
+    BYTE*          pbBits;
+    LONG           lPitch;
+    DWORD          dwWidth;
+    DWORD          dwHeight;
+    DWORD          dwBitCount;
+    FillMode       mode;
+};
+
+// A 32 bit image to make a palette for, and an 8 bit frame to expand into
+// a 32 bit one with it
+struct PALETTE_BENCH
+{
+    CPaletteQuantizer quantizer;
+    PALETTE           palette;
+    DWORD*            pdwImage;
+    BYTE*             pbFrame;
+    DWORD*            pdwFrame;
+    DWORD             dwWidth;
+    DWORD             dwHeight;
+};
+
+// An indexed display and a colour keyed ball to scatter over it
+struct INDEXED_BENCH
+{
+    CIndexedDisplay   display;
+    CIndexedSurface   sprite;
+};
+
+// A sprite in memory to blt across a frame in memory, in any two formats
+struct BLITTER_BENCH
+{
+    CBlitter       blitter;
+    BLIT_IMAGE     src;
+    BLIT_IMAGE     dest;
+};
+
+// Trails behind balls bouncing around a frame in memory
+struct TRAILS_BENCH
+{
+    CTrails        trails;
+    BLIT_IMAGE     frame;
+    DWORD          dwNumBalls;
+    LONG           alX[BENCH_TRAIL_BALLS];
+    LONG           alY[BENCH_TRAIL_BALLS];
+    LONG           alDX[BENCH_TRAIL_BALLS];
+    LONG           alDY[BENCH_TRAIL_BALLS];
+};
+
+// Scaling between images in memory, such as the field to a 4K buffer
+struct RESAMPLE_BENCH
+{
+    CResampler     resampler;
+    CThreadPool*   pPool;
+    RESAMPLE_IMAGE src;
+    RESAMPLE_IMAGE dest;
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Bench_Open()
+// Desc: Creates the results file and writes the context block
+//-----------------------------------------------------------------------------
+HRESULT Bench_Open( const TCHAR* strFile )
+{
+    if( NULL == ( g_pBenchFile = _tfopen( strFile, TEXT("w") ) ) )
+        return E_FAIL;
+
+    LARGE_INTEGER qwFreq;
+    QueryPerformanceFrequency( &qwFreq );
+    g_llBenchFreq = qwFreq.QuadPart;
+
+    SYSTEM_INFO si;
+    GetSystemInfo( &si );
+
+    SYSTEMTIME st;
+    GetLocalTime( &st );
+
+    fprintf( g_pBenchFile, "{\n  \"context\": {\n"
+                           "    \"date\": \"%04d-%02d-%02dT%02d:%02d:%02d\",\n"
+                           "    \"executable\": \"Pongy\",\n"
+                           "    \"num_cpus\": %lu,\n"
+#if defined(DEBUG) | defined(_DEBUG)
+                           "    \"library_build_type\": \"debug\"\n"
+#else
+                           "    \"library_build_type\": \"release\"\n"
+#endif
+                           "  },\n  \"benchmarks\": [",
+             st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond,
+             si.dwNumberOfProcessors );
+
+    g_bBenchFirst = TRUE;
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Bench_Close()
+// Desc: Finishes off the results file
+//-----------------------------------------------------------------------------
+VOID Bench_Close()
+{
+    if( NULL == g_pBenchFile )
+        return;
+
+    fprintf( g_pBenchFile, "\n  ]\n}\n" );
+    fclose( g_pBenchFile );
+    g_pBenchFile = NULL;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Bench_Run()
+// Desc: Times one benchmark and writes its result
+//-----------------------------------------------------------------------------
+VOID Bench_Run( const char* strName, BENCHFN pfnBench, VOID* pContext,
+                DWORD dwItemsPerIter )
+{
+    LARGE_INTEGER qwStart, qwEnd;
+    DWORD         dwIters = 1;
+    double        fSeconds;
+
+    // Warm up caches and let the driver do any lazy setup
+    pfnBench( pContext, 1 );
+
+    while( TRUE )
+    {
+        QueryPerformanceCounter( &qwStart );
+        pfnBench( pContext, dwIters );
+        QueryPerformanceCounter( &qwEnd );
+
+        fSeconds = (double)( qwEnd.QuadPart - qwStart.QuadPart ) / (double)g_llBenchFreq;
+        if( fSeconds >= BENCH_MIN_SECONDS || dwIters >= BENCH_MAX_ITERS )
+            break;
+
+        // Aim a little past the minimum, but never grow by more than 10x
+        double fScale = ( fSeconds > 0.0 ) ? ( BENCH_MIN_SECONDS * 1.4 / fSeconds ) : 10.0;
+        if( fScale > 10.0 ) fScale = 10.0;
+        if( fScale < 2.0 )  fScale = 2.0;
+        dwIters = (DWORD)min( (double)BENCH_MAX_ITERS, dwIters * fScale );
+    }
+
+    double fNanoSecs = fSeconds * 1e9 / dwIters;
+
+    if( g_pBenchFile )
+    {
+        fprintf( g_pBenchFile, "%s\n    {\n      \"name\": \"%s\",\n"
+                               "      \"run_type\": \"iteration\",\n"
+                               "      \"iterations\": %lu,\n"
+                               "      \"real_time\": %.3f,\n"
+                               "      \"cpu_time\": %.3f,\n"
+                               "      \"time_unit\": \"ns\"",
+                 g_bBenchFirst ? "" : ",", strName, dwIters, fNanoSecs, fNanoSecs );
+
+        if( dwItemsPerIter )
+            fprintf( g_pBenchFile, ",\n      \"items_per_second\": %.1f",
+                     (double)dwItemsPerIter * dwIters / fSeconds );
+
+        if( g_strBenchCounter[0] )
+            fprintf( g_pBenchFile, ",\n      \"%s\": %.3f", g_strBenchCounter, g_fBenchCounter );
+
+        fprintf( g_pBenchFile, "\n    }" );
+        fflush( g_pBenchFile );
+        g_bBenchFirst = FALSE;
+    }
+
+    g_strBenchCounter[0] = 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Bench_SetCounter()
+// Desc: Sets a counter for the next Bench_Run() to write with its result
+//-----------------------------------------------------------------------------
+VOID Bench_SetCounter( const char* strName, double fValue )
+{
+    strncpy( g_strBenchCounter, strName, sizeof(g_strBenchCounter) - 1 );
+    g_strBenchCounter[sizeof(g_strBenchCounter) - 1] = 0;
+    g_fBenchCounter = fValue;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Bench_UpdateBall()
+// Desc: Ball physics. Both bats are kept lined up with the ball so that it
+//       bounces back and forth, speeding up as it goes, rather than scoring
+//       (which would time GDI text drawing instead). The ball is re-served
+//       from a new seed every 256 steps.
+//-----------------------------------------------------------------------------
+static VOID Bench_UpdateBall( VOID* pContext, DWORD dwIterations )
+{
+    BALL_BENCH* pBench = (BALL_BENCH*)pContext;
+    SIM_STATE   sim;
+
+    for( DWORD i = 0; i < dwIterations; i++ )
+    {
+        if( ( i & 255 ) == 0 )
+        {
+            Sim_Init( &sim, i >> 8 );
+
+            // Scale the served velocity up to the speed being tested
+            FLOAT fScale = pBench->fSpeed / 250.0f;
+            sim.aSprite[0].fVelX *= fScale;
+            sim.aSprite[0].fVelY *= fScale;
+        }
+
+        sim.aSprite[1].fPosY = sim.aSprite[0].fPosY - ( BAT_SPRITE_HEIGHT - BALL_SPRITE_DIAMETER ) / 2;
+        sim.aSprite[2].fPosY = sim.aSprite[1].fPosY;
+
+        Sim_UpdateBall( &sim, pBench->fTimeDelta );
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Bench_UpdateComputerBat()
+// Desc: One AI step, chasing a ball that sweeps up and down the field
+//-----------------------------------------------------------------------------
+static VOID Bench_UpdateComputerBat( VOID* pContext, DWORD dwIterations )
+{
+    UNREFERENCED_PARAMETER( pContext );
+
+    SIM_STATE sim;
+    Sim_Init( &sim, 1 );
+    sim.whoseTurn = computer;
+    sim.aSprite[0].fPosX = FIELD_WIDTH - 100.0f;
+
+    for( DWORD i = 0; i < dwIterations; i++ )
+    {
+        sim.aSprite[0].fPosY = (FLOAT)( ( i * 7 ) % ( FIELD_HEIGHT - BALL_SPRITE_DIAMETER ) );
+        Sim_UpdateComputerBat( &sim, 1.0f / 60.0f );
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Bench_MultiBall()
+// Desc: A multi-ball step, moving every ball and resolving collisions
+//       through the grid. The bats sit in the middle of the field.
+//-----------------------------------------------------------------------------
+static VOID Bench_MultiBall( VOID* pContext, DWORD dwIterations )
+{
+    CMultiBall*   pMultiBall  = (CMultiBall*)pContext;
+    SPRITE_STRUCT batPlayer   = g_Sim.aSprite[1];
+    SPRITE_STRUCT batComputer = g_Sim.aSprite[2];
+    DWORD         dwPlayerPoints;
+    DWORD         dwComputerPoints;
+
+    for( DWORD i = 0; i < dwIterations; i++ )
+        pMultiBall->Update( 1.0f / 60.0f, &batPlayer, &batComputer,
+                            &dwPlayerPoints, &dwComputerPoints );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Bench_VecEnv()
+// Desc: A training environment step across every game. Each game's action
+//       cycles through up, stay and down.
+//-----------------------------------------------------------------------------
+static VOID Bench_VecEnv( VOID* pContext, DWORD dwIterations )
+{
+    VECENV_BENCH* pBench = (VECENV_BENCH*)pContext;
+
+    for( DWORD i = 0; i < dwIterations; i++ )
+        pBench->env.Step( pBench->pnActions, pBench->pfObs, pBench->pfRewards, pBench->pbDones );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Bench_Rollback()
+// Desc: A rollback of BENCH_ROLLBACK frames: restoring the saved state and
+//       playing every frame since again
+//-----------------------------------------------------------------------------
+static VOID Bench_Rollback( VOID* pContext, DWORD dwIterations )
+{
+    CRollback* pRollback = (CRollback*)pContext;
+
+    for( DWORD i = 0; i < dwIterations; i++ )
+        pRollback->Resimulate( pRollback->GetFrame() - BENCH_ROLLBACK );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Bench_SnapshotEncode() and Bench_SnapshotDecode()
+// Desc: Coding one snapshot against the one before it, and decoding it
+//       again with the baselines in a ring as a client would
+//-----------------------------------------------------------------------------
+static VOID Bench_SnapshotEncode( VOID* pContext, DWORD dwIterations )
+{
+    SNAPSHOT_BENCH* pBench = (SNAPSHOT_BENCH*)pContext;
+
+    for( DWORD i = 0; i < dwIterations; i++ )
+    {
+        DWORD dwSnap = ( i % ( BENCH_SNAPSHOTS - 1 ) ) + 1;
+        pBench->adwSizes[dwSnap] = Snapshot_Encode( &pBench->aSnaps[dwSnap], &pBench->aSnaps[dwSnap - 1],
+                                                    pBench->aabEncoded[dwSnap] );
+    }
+}
+
+static VOID Bench_SnapshotDecode( VOID* pContext, DWORD dwIterations )
+{
+    SNAPSHOT_BENCH* pBench = (SNAPSHOT_BENCH*)pContext;
+
+    for( DWORD i = 0; i < dwIterations; i++ )
+    {
+        DWORD dwSnap = ( i % ( BENCH_SNAPSHOTS - 1 ) ) + 1;
+
+        // Start each pass through from the first snapshot, as if it had
+        // been sent in full
+        if( dwSnap == 1 )
+            pBench->aRing[SNAPSHOT_SLOT( pBench->aSnaps[0].dwFrame )] = pBench->aSnaps[0];
+
+        SNAPSHOT* pSnap = &pBench->aRing[SNAPSHOT_SLOT( pBench->aSnaps[dwSnap].dwFrame )];
+        Snapshot_Decode( pBench->aabEncoded[dwSnap], pBench->adwSizes[dwSnap], pBench->aRing, pSnap );
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Bench_CheckSnapshotLimits()
+// Desc: Codes every velocity at the edge of its width, in full and as a
+//       delta from the opposite edge, then one just past it. The first two
+//       must come back exactly and the last must be clamped and counted.
+//       Run before the snapshot benchmarks so they time a codec that works.
+//-----------------------------------------------------------------------------
+static HRESULT Bench_CheckSnapshotLimits()
+{
+    SIM_STATE state;
+    SNAPSHOT  aRing[SNAPSHOT_RING];
+    SNAPSHOT  aSnaps[2];
+    SNAPSHOT  decoded;
+    BYTE      abEncoded[SNAPSHOT_MAX_BYTES];
+    DWORD     dwSize;
+
+    Sim_Init( &state, 1 );
+    Snapshot_ClearRing( aRing );
+
+    for( DWORD i = 0; i < 2; i++ )
+    {
+        FLOAT fSign = ( i == 0 ) ? 1.0f : -1.0f;
+        state.aSprite[0].fVelX =  fSign * SNAPSHOT_VEL_MAX;
+        state.aSprite[0].fVelY = -fSign * SNAPSHOT_VEL_MAX;
+        state.aSprite[1].fVelY =  fSign * SNAPSHOT_VEL_MAX;
+        state.aSprite[2].fVelY = -fSign * SNAPSHOT_VEL_MAX;
+        Snapshot_FromState( &aSnaps[i], &state, i );
+
+        dwSize = Snapshot_Encode( &aSnaps[i], ( i == 0 ) ? NULL : &aSnaps[0], abEncoded );
+        if( FAILED( Snapshot_Decode( abEncoded, dwSize, aRing, &decoded ) ) ||
+            0 != memcmp( &decoded, &aSnaps[i], sizeof(SNAPSHOT) ) )
+            return E_FAIL;
+
+        SIM_STATE decodedState = state;
+        Snapshot_ToState( &decoded, &decodedState );
+        if( decodedState.aSprite[0].fVelX != state.aSprite[0].fVelX ||
+            decodedState.aSprite[2].fVelY != state.aSprite[2].fVelY )
+            return E_FAIL;
+
+        aRing[SNAPSHOT_SLOT( i )] = decoded;
+    }
+
+    LONG lSaturated = Snapshot_GetSaturated();
+    state.aSprite[0].fVelX = SNAPSHOT_VEL_MAX + 1.0f;
+    Snapshot_FromState( &aSnaps[0], &state, 2 );
+    Snapshot_ToState( &aSnaps[0], &state );
+
+    if( Snapshot_GetSaturated() != lSaturated + 1 || state.aSprite[0].fVelX != SNAPSHOT_VEL_MAX )
+        return E_FAIL;
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Bench_WaitForSurface()
+// Desc: Blts may be queued up by the driver, so lock the destination to make
+//       sure they have really finished before the clock is stopped
+//-----------------------------------------------------------------------------
+static VOID Bench_WaitForSurface( CSurface* pSurface )
+{
+    DDSURFACEDESC2 ddsd;
+    ZeroMemory( &ddsd, sizeof(ddsd) );
+    ddsd.dwSize = sizeof(ddsd);
+
+    if( SUCCEEDED( pSurface->GetDDrawSurface()->Lock( NULL, &ddsd, DDLOCK_WAIT | DDLOCK_READONLY, NULL ) ) )
+        pSurface->GetDDrawSurface()->Unlock( NULL );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Bench_Clear(), Bench_Blt() and Bench_ColorKeyBlt()
+// Desc: Surface fills and copies
+//-----------------------------------------------------------------------------
+static VOID Bench_Clear( VOID* pContext, DWORD dwIterations )
+{
+    SURFACE_BENCH* pBench = (SURFACE_BENCH*)pContext;
+
+    DDBLTFX ddbltfx;
+    ZeroMemory( &ddbltfx, sizeof(ddbltfx) );
+    ddbltfx.dwSize = sizeof(ddbltfx);
+
+    for( DWORD i = 0; i < dwIterations; i++ )
+    {
+        ddbltfx.dwFillColor = i;
+        pBench->pDest->GetDDrawSurface()->Blt( NULL, NULL, NULL, DDBLT_COLORFILL | DDBLT_WAIT, &ddbltfx );
+    }
+
+    Bench_WaitForSurface( pBench->pDest );
+}
+
+static VOID Bench_Blt( VOID* pContext, DWORD dwIterations )
+{
+    SURFACE_BENCH* pBench = (SURFACE_BENCH*)pContext;
+
+    for( DWORD i = 0; i < dwIterations; i++ )
+        pBench->pDest->GetDDrawSurface()->BltFast( 0, 0, pBench->pSrc->GetDDrawSurface(), NULL, DDBLTFAST_WAIT );
+
+    Bench_WaitForSurface( pBench->pDest );
+}
+
+static VOID Bench_ColorKeyBlt( VOID* pContext, DWORD dwIterations )
+{
+    SURFACE_BENCH* pBench = (SURFACE_BENCH*)pContext;
+
+    for( DWORD i = 0; i < dwIterations; i++ )
+        pBench->pDest->GetDDrawSurface()->BltFast( 0, 0, pBench->pSrc->GetDDrawSurface(), NULL,
+                                                   DDBLTFAST_SRCCOLORKEY | DDBLTFAST_WAIT );
+
+    Bench_WaitForSurface( pBench->pDest );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Bench_Fill() and Bench_Memset()
+// Desc: Whole frames filled by the fill kernels, and by memset() for the
+//       speed of memory to compare them with
+//-----------------------------------------------------------------------------
+static VOID Bench_Fill( VOID* pContext, DWORD dwIterations )
+{
+    FILL_BENCH* pBench = (FILL_BENCH*)pContext;
+
+    for( DWORD i = 0; i < dwIterations; i++ )
+        Fill_Rect( pBench->pbBits, pBench->lPitch, pBench->dwBitCount, pBench->dwWidth, pBench->dwHeight,
+                   i, pBench->mode );
+}
+
+static VOID Bench_Memset( VOID* pContext, DWORD dwIterations )
+{
+    FILL_BENCH* pBench = (FILL_BENCH*)pContext;
+
+    for( DWORD i = 0; i < dwIterations; i++ )
+        memset( pBench->pbBits, (int)i, pBench->lPitch * pBench->dwHeight );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Bench_SoftDisplay()
+// Desc: A software display frame: a clear and BENCH_SOFT_SPRITES sprites
+//       spread over the frame, binned and drawn across the threads
+//-----------------------------------------------------------------------------
+static VOID Bench_SoftDisplay( VOID* pContext, DWORD dwIterations )
+{
+    SOFT_BENCH* pBench   = (SOFT_BENCH*)pContext;
+    DWORD       dwWidth  = pBench->display.GetWidth();
+    DWORD       dwHeight = pBench->display.GetHeight();
+
+    for( DWORD i = 0; i < dwIterations; i++ )
+    {
+        pBench->display.Clear( i );
+        for( DWORD s = 0; s < BENCH_SOFT_SPRITES; s++ )
+            pBench->display.Blt( ( s * 7919 + i ) % dwWidth, ( s * 104729 ) % dwHeight, &pBench->sprite );
+
+        pBench->display.Render();
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Bench_PaletteBuild() and Bench_PaletteExpand()
+// Desc: Cutting a 640x480 image's colours down to a palette, and looking
+//       up a 4K frame's colours
+//-----------------------------------------------------------------------------
+static VOID Bench_PaletteBuild( VOID* pContext, DWORD dwIterations )
+{
+    PALETTE_BENCH* pBench = (PALETTE_BENCH*)pContext;
+    DWORD          dwBlack = 0;
+
+    for( DWORD i = 0; i < dwIterations; i++ )
+    {
+        pBench->quantizer.Reset();
+        pBench->quantizer.AddPixels( pBench->pdwImage, FIELD_WIDTH * sizeof(DWORD), FIELD_WIDTH, FIELD_HEIGHT,
+                                     FALSE, 0 );
+        pBench->quantizer.Build( &pBench->palette, PALETTE_MAX_COLORS, &dwBlack, 1 );
+    }
+}
+
+static VOID Bench_PaletteExpand( VOID* pContext, DWORD dwIterations )
+{
+    PALETTE_BENCH* pBench = (PALETTE_BENCH*)pContext;
+
+    for( DWORD i = 0; i < dwIterations; i++ )
+    {
+        for( DWORD y = 0; y < pBench->dwHeight; y++ )
+            Palette_ExpandRow( pBench->pdwFrame + y * pBench->dwWidth, pBench->pbFrame + y * pBench->dwWidth,
+                               pBench->dwWidth, pBench->palette.adwColors );
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Bench_IndexedDisplay()
+// Desc: An indexed display frame, a clear and BENCH_SOFT_SPRITES sprites
+//       in the same places as Bench_SoftDisplay(), without the expansion
+//-----------------------------------------------------------------------------
+static VOID Bench_IndexedDisplay( VOID* pContext, DWORD dwIterations )
+{
+    INDEXED_BENCH* pBench   = (INDEXED_BENCH*)pContext;
+    DWORD          dwWidth  = pBench->display.GetWidth();
+    DWORD          dwHeight = pBench->display.GetHeight();
+
+    for( DWORD i = 0; i < dwIterations; i++ )
+    {
+        pBench->display.Clear( i );
+        for( DWORD s = 0; s < BENCH_SOFT_SPRITES; s++ )
+            pBench->display.Blt( ( s * 7919 + i ) % dwWidth, ( s * 104729 ) % dwHeight, &pBench->sprite );
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Bench_Blitter()
+// Desc: A sprite blted to 16 places on the frame, some off its edges
+//-----------------------------------------------------------------------------
+static VOID Bench_Blitter( VOID* pContext, DWORD dwIterations )
+{
+    BLITTER_BENCH* pBench = (BLITTER_BENCH*)pContext;
+    LONG           lWidth  = (LONG)pBench->dest.dwWidth;
+    LONG           lHeight = (LONG)pBench->dest.dwHeight;
+
+    for( DWORD i = 0; i < dwIterations; i++ )
+    {
+        for( LONG s = 0; s < 16; s++ )
+            pBench->blitter.Blt( &pBench->dest, ( s * 7919 + (LONG)i ) % lWidth - 64,
+                                 ( s * 104729 ) % lHeight - 64, &pBench->src );
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Bench_Trails()
+// Desc: A frame of trails: fading them, moving the balls and stamping
+//       them, then blending the trails into the frame. One ball is
+//       followed, as in the game, and more are stamped where they are.
+//-----------------------------------------------------------------------------
+static VOID Bench_Trails( VOID* pContext, DWORD dwIterations )
+{
+    TRAILS_BENCH* pBench  = (TRAILS_BENCH*)pContext;
+    LONG          lWidth  = (LONG)pBench->frame.dwWidth - BALL_SPRITE_DIAMETER;
+    LONG          lHeight = (LONG)pBench->frame.dwHeight - BALL_SPRITE_DIAMETER;
+
+    for( DWORD i = 0; i < dwIterations; i++ )
+    {
+        pBench->trails.Decay( 1.0f / 60.0f );
+
+        for( DWORD b = 0; b < pBench->dwNumBalls; b++ )
+        {
+            pBench->alX[b] += pBench->alDX[b];
+            pBench->alY[b] += pBench->alDY[b];
+            if( pBench->alX[b] < 0 || pBench->alX[b] > lWidth )
+                pBench->alDX[b] = -pBench->alDX[b];
+            if( pBench->alY[b] < 0 || pBench->alY[b] > lHeight )
+                pBench->alDY[b] = -pBench->alDY[b];
+
+            if( pBench->dwNumBalls == 1 )
+                pBench->trails.Follow( pBench->alX[b], pBench->alY[b] );
+            else
+                pBench->trails.Stamp( pBench->alX[b], pBench->alY[b] );
+        }
+
+        pBench->trails.Draw( &pBench->frame );
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Bench_ParticleUpdate()
+// Desc: A step of BENCH_PARTICLES particles, then bursts from the middle of
+//       the field to replace the ones that died, as a busy game would
+//-----------------------------------------------------------------------------
+static VOID Bench_ParticleUpdate( VOID* pContext, DWORD dwIterations )
+{
+    CParticles* pParticles = (CParticles*)pContext;
+
+    for( DWORD i = 0; i < dwIterations; i++ )
+    {
+        pParticles->Update( 1.0f / 60.0f );
+        pParticles->Emit( FIELD_WIDTH / 2, FIELD_HEIGHT / 2, 0.0f, -200.0f, PARTICLE_POINT_SPEED,
+                          BENCH_PARTICLES - pParticles->GetNumParticles() );
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Bench_ParticleProject()
+// Desc: Placing BENCH_PARTICLES particles in a 1080p view
+//-----------------------------------------------------------------------------
+static VOID Bench_ParticleProject( VOID* pContext, DWORD dwIterations )
+{
+    CParticles* pParticles = (CParticles*)pContext;
+    VIEW        view       = { 1920, 1080, 2.25f, 240, 0 };
+    DWORD       dwCount;
+
+    for( DWORD i = 0; i < dwIterations; i++ )
+        pParticles->Project( &view, 14, &dwCount );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Bench_Resample()
+// Desc: Scaling one image to another, on one thread or a pool's worth
+//-----------------------------------------------------------------------------
+static VOID Bench_Resample( VOID* pContext, DWORD dwIterations )
+{
+    RESAMPLE_BENCH* pBench = (RESAMPLE_BENCH*)pContext;
+
+    for( DWORD i = 0; i < dwIterations; i++ )
+        pBench->resampler.Run( &pBench->dest, &pBench->src, pBench->pPool );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Bench_BmpDecode()
+// Desc: Loading a bitmap resource onto a new surface, as done at startup
+//-----------------------------------------------------------------------------
+static VOID Bench_BmpDecode( VOID* pContext, DWORD dwIterations )
+{
+    UNREFERENCED_PARAMETER( pContext );
+
+    for( DWORD i = 0; i < dwIterations; i++ )
+    {
+        CSurfaceHandle pSurface;
+        g_pDisplay->CreateSurfaceFromBitmap( pSurface.Receive(), MAKEINTRESOURCE( IDB_BALL ),
+                                             BALL_SPRITE_DIAMETER, BALL_SPRITE_DIAMETER );
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Bench_DrawText()
+// Desc: Redrawing the score text, as done whenever a point is scored
+//-----------------------------------------------------------------------------
+static VOID Bench_DrawText( VOID* pContext, DWORD dwIterations )
+{
+    UNREFERENCED_PARAMETER( pContext );
+
+    for( DWORD i = 0; i < dwIterations; i++ )
+        DrawScore();
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Bench_DisplayFrame()
+// Desc: A full frame: clear, score, sprites and present
+//-----------------------------------------------------------------------------
+static VOID Bench_DisplayFrame( VOID* pContext, DWORD dwIterations )
+{
+    UNREFERENCED_PARAMETER( pContext );
+
+    for( DWORD i = 0; i < dwIterations; i++ )
+    {
+        g_FrameArena.Reset();
+        DisplayFrame( FALSE );
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: RunBenchmarks()
+// Desc: Runs the suite. The sprites and score are put back afterwards.
+//-----------------------------------------------------------------------------
+HRESULT RunBenchmarks( const TCHAR* strFile )
+{
+    HRESULT hr;
+    char    strName[64];
+
+    if( FAILED( hr = Bench_Open( strFile ) ) )
+        return hr;
+
+    // Physics, over a spread of ball speeds
+    static const FLOAT s_afSpeeds[] = { 250.0f, 1000.0f, 2000.0f };
+    for( int i = 0; i < 3; i++ )
+    {
+        BALL_BENCH ballBench;
+        ballBench.fSpeed     = s_afSpeeds[i];
+        ballBench.fTimeDelta = 1.0f / 240.0f;
+
+        sprintf( strName, "UpdateBall/speed:%d", (int)s_afSpeeds[i] );
+        Bench_Run( strName, Bench_UpdateBall, &ballBench, 1 );
+    }
+
+    Bench_Run( "UpdateComputerBat", Bench_UpdateComputerBat, NULL, 1 );
+
+    // Multi-ball, over a spread of ball counts to show how the grid scales
+    static const DWORD s_adwBalls[] = { 64, 256, 1024, 4096 };
+    for( int i = 0; i < 4; i++ )
+    {
+        CMultiBall multiBall;
+        if( FAILED( hr = multiBall.Create( s_adwBalls[i], 1 ) ) )
+            break;
+
+        sprintf( strName, "MultiBall/balls:%lu", s_adwBalls[i] );
+        Bench_Run( strName, Bench_MultiBall, &multiBall, s_adwBalls[i] );
+    }
+
+    // Training environment steps, on one thread and then on all of them
+    VECENV_BENCH vecBench;
+    DWORD        dwGames = 4096;
+
+    vecBench.pnActions = new int[dwGames];
+    vecBench.pfObs     = new FLOAT[dwGames * VECENV_OBS_SIZE];
+    vecBench.pfRewards = new FLOAT[dwGames];
+    vecBench.pbDones   = new BYTE[dwGames];
+
+    if( vecBench.pnActions && vecBench.pfObs && vecBench.pfRewards && vecBench.pbDones )
+    {
+        for( DWORD i = 0; i < dwGames; i++ )
+            vecBench.pnActions[i] = (int)( i % 3 ) - 1;
+
+        static const DWORD s_adwThreads[] = { 1, 0 };
+        for( int i = 0; i < 2; i++ )
+        {
+            if( FAILED( vecBench.env.Create( dwGames, 1, s_adwThreads[i] ) ) )
+                break;
+
+            sprintf( strName, "VecEnv/games:%lu/threads:%lu", dwGames, vecBench.env.GetNumThreads() );
+            Bench_Run( strName, Bench_VecEnv, &vecBench, dwGames );
+        }
+    }
+
+    vecBench.env.Destroy();
+    SAFE_DELETE_ARRAY( vecBench.pnActions );
+    SAFE_DELETE_ARRAY( vecBench.pfObs );
+    SAFE_DELETE_ARRAY( vecBench.pfRewards );
+    SAFE_DELETE_ARRAY( vecBench.pbDones );
+
+    // Rollback, after playing just enough frames on guesses to go back
+    SIM_STATE rollbackSim;
+    CRollback rollback;
+    rollback.Create( &rollbackSim, 0, NULL );
+    for( DWORD i = 0; i < BENCH_ROLLBACK; i++ )
+        rollback.AdvanceFrame( (int)( i % 3 ) - 1, 0 );
+
+    sprintf( strName, "Rollback/frames:%d", BENCH_ROLLBACK );
+    Bench_Run( strName, Bench_Rollback, &rollback, BENCH_ROLLBACK );
+
+    if( FAILED( hr = Bench_CheckSnapshotLimits() ) )
+    {
+        Bench_Close();
+        return hr;
+    }
+
+    // Snapshots of a game where both bats wander, 20 a second
+    SNAPSHOT_BENCH* pSnapBench = new SNAPSHOT_BENCH;
+    if( pSnapBench )
+    {
+        SIM_STATE snapSim;
+        DWORD     dwBytes = 0;
+
+        Sim_Init( &snapSim, 1 );
+        Snapshot_ClearRing( pSnapBench->aRing );
+
+        for( DWORD i = 0; i < BENCH_SNAPSHOTS * 3; i++ )
+        {
+            Sim_StepVersus( &snapSim, (int)( ( i / 37 ) % 3 ) - 1, (int)( ( i / 53 ) % 3 ) - 1, 1.0f / 60.0f );
+            if( i % 3 == 2 )
+                Snapshot_FromState( &pSnapBench->aSnaps[i / 3], &snapSim, i );
+        }
+
+        Bench_SnapshotEncode( pSnapBench, BENCH_SNAPSHOTS - 1 );
+        for( DWORD i = 1; i < BENCH_SNAPSHOTS; i++ )
+            dwBytes += pSnapBench->adwSizes[i];
+
+        Bench_SetCounter( "bytes_per_snapshot", (double)dwBytes / ( BENCH_SNAPSHOTS - 1 ) );
+        Bench_Run( "Snapshot/encode", Bench_SnapshotEncode, pSnapBench, 1 );
+        Bench_Run( "Snapshot/decode", Bench_SnapshotDecode, pSnapBench, 1 );
+
+        delete pSnapBench;
+    }
+
+    // Fills and blts, over a spread of surface sizes
+    static const DWORD s_adwSizes[] = { 32, 128, 512 };
+    for( int i = 0; i < 3; i++ )
+    {
+        DWORD         dwSize = s_adwSizes[i];
+        SURFACE_BENCH surfBench;
+
+        if( FAILED( hr = g_pDisplay->CreateSurface( surfBench.pSrc.Receive(), dwSize, dwSize ) ) )
+            break;
+
+        if( FAILED( hr = g_pDisplay->CreateSurface( surfBench.pDest.Receive(), dwSize, dwSize ) ) )
+            break;
+
+        sprintf( strName, "Clear/%lu", dwSize );
+        Bench_Run( strName, Bench_Clear, &surfBench, dwSize * dwSize );
+
+        sprintf( strName, "Blt/%lu", dwSize );
+        Bench_Run( strName, Bench_Blt, &surfBench, dwSize * dwSize );
+
+        surfBench.pSrc->SetColorKey( 0 );
+        sprintf( strName, "ColorKeyBlt/%lu", dwSize );
+        Bench_Run( strName, Bench_ColorKeyBlt, &surfBench, dwSize * dwSize );
+    }
+
+    // Frames in memory filled with cached and streamed stores at each pixel
+    // size, at 1080p and 4K, against memset() over the same bytes. Items are
+    // bytes, so the rates compare directly.
+    static const DWORD s_adwFillSizes[2][2] = { { 1920, 1080 }, { 3840, 2160 } };
+    static const DWORD s_adwFillBits[]      = { 8, 16, 24, 32 };
+    static const char* s_astrFillModes[]    = { "cached", "stream" };
+
+    FILL_BENCH fillBench;
+    fillBench.pbBits = new BYTE[3840 * 2160 * 4];
+    if( fillBench.pbBits )
+    {
+        for( int s = 0; s < 2; s++ )
+        {
+            fillBench.dwWidth  = s_adwFillSizes[s][0];
+            fillBench.dwHeight = s_adwFillSizes[s][1];
+
+            for( int b = 0; b < 4; b++ )
+            {
+                fillBench.dwBitCount = s_adwFillBits[b];
+                fillBench.lPitch     = fillBench.dwWidth * fillBench.dwBitCount / 8;
+
+                for( int m = 0; m < 2; m++ )
+                {
+                    fillBench.mode = m ? fillStream : fillCached;
+
+                    sprintf( strName, "Fill/%lu/%lux%lu/%s", fillBench.dwBitCount,
+                             fillBench.dwWidth, fillBench.dwHeight, s_astrFillModes[m] );
+                    Bench_Run( strName, Bench_Fill, &fillBench, fillBench.lPitch * fillBench.dwHeight );
+                }
+            }
+
+            fillBench.lPitch = fillBench.dwWidth * 4;
+            sprintf( strName, "Memset/%lux%lux32", fillBench.dwWidth, fillBench.dwHeight );
+            Bench_Run( strName, Bench_Memset, &fillBench, fillBench.lPitch * fillBench.dwHeight );
+        }
+    }
+
+    SAFE_DELETE_ARRAY( fillBench.pbBits );
+
+    // The software display at 1080p, 4K and 8K, on one thread and then on
+    // all of them
+    SOFT_BENCH* pSoftBench = new SOFT_BENCH;
+    if( pSoftBench && SUCCEEDED( pSoftBench->sprite.Create( BALL_SPRITE_DIAMETER, BALL_SPRITE_DIAMETER ) ) )
+    {
+        // A ball: a disc on the key colour
+        DWORD* pdwBits = pSoftBench->sprite.GetBits();
+        LONG   lRadius = BALL_SPRITE_DIAMETER / 2;
+        for( LONG y = 0; y < BALL_SPRITE_DIAMETER; y++ )
+        {
+            for( LONG x = 0; x < BALL_SPRITE_DIAMETER; x++ )
+            {
+                LONG dx = x - lRadius;
+                LONG dy = y - lRadius;
+                pdwBits[y * BALL_SPRITE_DIAMETER + x] = ( dx * dx + dy * dy <= lRadius * lRadius ) ? 0x00FFFFFF : 0;
+            }
+        }
+        pSoftBench->sprite.SetColorKey( 0 );
+
+        static const DWORD s_adwSoftSizes[3][2] = { { 1920, 1080 }, { 3840, 2160 }, { 7680, 4320 } };
+        for( int s = 0; s < 3; s++ )
+        {
+            static const DWORD s_adwThreads[] = { 1, 0 };
+            for( int t = 0; t < 2; t++ )
+            {
+                if( FAILED( pSoftBench->display.Create( s_adwSoftSizes[s][0], s_adwSoftSizes[s][1], s_adwThreads[t] ) ) )
+                    break;
+
+                sprintf( strName, "SoftDisplay/%lux%lu/sprites:%d/threads:%lu",
+                         s_adwSoftSizes[s][0], s_adwSoftSizes[s][1], BENCH_SOFT_SPRITES,
+                         pSoftBench->display.GetNumThreads() );
+                Bench_Run( strName, Bench_SoftDisplay, pSoftBench, s_adwSoftSizes[s][0] * s_adwSoftSizes[s][1] );
+            }
+        }
+    }
+
+    SAFE_DELETE( pSoftBench );
+
+    // A palette for a 640x480 image of smooth gradients, the worst case for
+    // the quantiser, then that palette expanding a 4K frame on one thread
+    PALETTE_BENCH* pPaletteBench = new PALETTE_BENCH;
+    if( pPaletteBench && SUCCEEDED( pPaletteBench->quantizer.Create() ) )
+    {
+        pPaletteBench->dwWidth  = 3840;
+        pPaletteBench->dwHeight = 2160;
+        pPaletteBench->pdwImage = new DWORD[FIELD_WIDTH * FIELD_HEIGHT];
+        pPaletteBench->pbFrame  = new BYTE[3840 * 2160];
+        pPaletteBench->pdwFrame = new DWORD[3840 * 2160];
+
+        if( pPaletteBench->pdwImage && pPaletteBench->pbFrame && pPaletteBench->pdwFrame )
+        {
+            for( DWORD y = 0; y < FIELD_HEIGHT; y++ )
+            {
+                for( DWORD x = 0; x < FIELD_WIDTH; x++ )
+                    pPaletteBench->pdwImage[y * FIELD_WIDTH + x] = ( ( x * 255 / FIELD_WIDTH ) << 16 ) |
+                                                                   ( ( y * 255 / FIELD_HEIGHT ) << 8 ) |
+                                                                   ( ( x ^ y ) & 0xFF );
+            }
+
+            for( DWORD i = 0; i < 3840 * 2160; i++ )
+                pPaletteBench->pbFrame[i] = (BYTE)( i * 7 );
+
+            Bench_Run( "Palette/build/640x480", Bench_PaletteBuild, pPaletteBench, FIELD_WIDTH * FIELD_HEIGHT );
+            Bench_Run( "Palette/expand/3840x2160", Bench_PaletteExpand, pPaletteBench, 3840 * 2160 );
+        }
+
+        SAFE_DELETE_ARRAY( pPaletteBench->pdwImage );
+        SAFE_DELETE_ARRAY( pPaletteBench->pbFrame );
+        SAFE_DELETE_ARRAY( pPaletteBench->pdwFrame );
+    }
+
+    SAFE_DELETE( pPaletteBench );
+
+    // The indexed display at the same sizes as the software display. The
+    // ball goes through its starting palette, as the colours don't change
+    // the cost.
+    INDEXED_BENCH* pIndexedBench = new INDEXED_BENCH;
+    if( pIndexedBench && SUCCEEDED( pIndexedBench->display.Create( 1920, 1080, 1 ) ) )
+    {
+        if( g_pBallSurface )
+            pIndexedBench->sprite.CopyFrom( g_pBallSurface, pIndexedBench->display.GetPalette() );
+
+        static const DWORD s_adwIndexedSizes[3][2] = { { 1920, 1080 }, { 3840, 2160 }, { 7680, 4320 } };
+        for( int s = 0; pIndexedBench->sprite.GetBits() && s < 3; s++ )
+        {
+            if( FAILED( pIndexedBench->display.Resize( s_adwIndexedSizes[s][0], s_adwIndexedSizes[s][1] ) ) )
+                break;
+
+            sprintf( strName, "IndexedDisplay/%lux%lu/sprites:%d",
+                     s_adwIndexedSizes[s][0], s_adwIndexedSizes[s][1], BENCH_SOFT_SPRITES );
+            Bench_Run( strName, Bench_IndexedDisplay, pIndexedBench, s_adwIndexedSizes[s][0] * s_adwIndexedSizes[s][1] );
+        }
+    }
+
+    SAFE_DELETE( pIndexedBench );
+
+    // A 256x256 sprite blted in memory between the common formats, with
+    // each blt the template for its pair and flags, or an SSE2 kernel for
+    // 32 bit colour keys and premultiplied alpha. The premultiplied blend
+    // is meant to stay within 1.5x of the 32 bit colour key. Items are
+    // pixels.
+    static const DDPIXELFORMAT s_ddpfBlit[] =
+    {
+        { sizeof(DDPIXELFORMAT), DDPF_RGB, 0, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0 },
+        { sizeof(DDPIXELFORMAT), DDPF_RGB, 0, 24, 0x00FF0000, 0x0000FF00, 0x000000FF, 0 },
+        { sizeof(DDPIXELFORMAT), DDPF_RGB, 0, 16, 0xF800, 0x07E0, 0x001F, 0 },
+        { sizeof(DDPIXELFORMAT), DDPF_RGB | DDPF_ALPHAPIXELS, 0, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000 },
+        { sizeof(DDPIXELFORMAT), DDPF_RGB | DDPF_ALPHAPIXELS | DDPF_ALPHAPREMULT, 0, 32,
+          0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000 },
+    };
+    static const struct { int nSrc; int nDest; DWORD dwFlags; const char* strName; } s_aBlits[] =
+    {
+        { 0, 0, 0,             "Blitter/32->32/copy" },
+        { 0, 0, BLIT_COLORKEY, "Blitter/32->32/key" },
+        { 2, 0, BLIT_COLORKEY, "Blitter/565->32/key" },
+        { 0, 2, BLIT_COLORKEY, "Blitter/32->565/key" },
+        { 1, 0, 0,             "Blitter/24->32/copy" },
+        { 3, 0, BLIT_ALPHA,    "Blitter/8888->32/alpha" },
+        { 4, 0, BLIT_ALPHA,    "Blitter/8888pm->32/alpha" },
+    };
+
+    BLITTER_BENCH* pBlitterBench = new BLITTER_BENCH;
+    BYTE*          pbSprite      = new BYTE[256 * 256 * 4];
+    BYTE*          pbFrame       = new BYTE[1920 * 1080 * 4];
+
+    if( pBlitterBench && pbSprite && pbFrame )
+    {
+        // A premultiplied disc with a smooth edge, on the key colour, 0,
+        // so the same pixels serve the colour keys
+        for( LONG y = 0; y < 256; y++ )
+        {
+            for( LONG x = 0; x < 256; x++ )
+            {
+                LONG  dx      = x - 128;
+                LONG  dy      = y - 128;
+                LONG  lCover  = ( 128 * 128 - dx * dx - dy * dy ) * 255 / 256 + 128;
+                DWORD dwAlpha = (DWORD)max( 0, min( lCover, 255 ) );
+                DWORD dwGrey  = dwAlpha * ( 255 - y / 2 ) / 255;
+
+                *(DWORD*)( pbSprite + ( y * 256 + x ) * 4 ) = ( dwAlpha << 24 ) | ( dwGrey * 0x010101 );
+            }
+        }
+        ZeroMemory( pbFrame, 1920 * 1080 * 4 );
+
+        for( DWORD b = 0; b < sizeof(s_aBlits) / sizeof(s_aBlits[0]); b++ )
+        {
+            const DDPIXELFORMAT* pddpfSrc  = &s_ddpfBlit[s_aBlits[b].nSrc];
+            const DDPIXELFORMAT* pddpfDest = &s_ddpfBlit[s_aBlits[b].nDest];
+
+            if( FAILED( pBlitterBench->blitter.Create( pddpfSrc, pddpfDest, s_aBlits[b].dwFlags | BLIT_CLIP, 0 ) ) )
+                continue;
+
+            pBlitterBench->src.pBits     = pbSprite;
+            pBlitterBench->src.lPitch    = 256 * pddpfSrc->dwRGBBitCount / 8;
+            pBlitterBench->src.dwWidth   = 256;
+            pBlitterBench->src.dwHeight  = 256;
+            pBlitterBench->dest.pBits    = pbFrame;
+            pBlitterBench->dest.lPitch   = 1920 * pddpfDest->dwRGBBitCount / 8;
+            pBlitterBench->dest.dwWidth  = 1920;
+            pBlitterBench->dest.dwHeight = 1080;
+
+            Bench_Run( s_aBlits[b].strName, Bench_Blitter, pBlitterBench, 16 * 256 * 256 );
+        }
+    }
+
+    SAFE_DELETE( pBlitterBench );
+    SAFE_DELETE_ARRAY( pbSprite );
+    SAFE_DELETE_ARRAY( pbFrame );
+
+    // Trails on a 1080p frame behind one ball and then a crowd of them,
+    // each run started from a second's worth of trail. The live tiles
+    // counter is how many of the frame's tiles were being faded and drawn
+    // by then, against the name's count for the whole frame.
+    TRAILS_BENCH* pTrailsBench = new TRAILS_BENCH;
+    BYTE*         pbTrailFrame = new BYTE[1920 * 1080 * 4];
+
+    if( pTrailsBench && pbTrailFrame && g_pBallSurface &&
+        SUCCEEDED( pTrailsBench->trails.Create( 1920, 1080 ) ) &&
+        SUCCEEDED( pTrailsBench->trails.SetSprite( g_pBallSurface ) ) )
+    {
+        ZeroMemory( pbTrailFrame, 1920 * 1080 * 4 );
+        pTrailsBench->frame.pBits    = pbTrailFrame;
+        pTrailsBench->frame.lPitch   = 1920 * 4;
+        pTrailsBench->frame.dwWidth  = 1920;
+        pTrailsBench->frame.dwHeight = 1080;
+
+        static const DWORD s_adwTrailBalls[] = { 1, BENCH_TRAIL_BALLS };
+        for( int n = 0; n < 2; n++ )
+        {
+            pTrailsBench->trails.Resize( 1920, 1080 );
+            pTrailsBench->dwNumBalls = s_adwTrailBalls[n];
+            for( DWORD b = 0; b < pTrailsBench->dwNumBalls; b++ )
+            {
+                pTrailsBench->alX[b]  = ( b * 7919 ) % 1800;
+                pTrailsBench->alY[b]  = ( b * 104729 ) % 1000;
+                pTrailsBench->alDX[b] = 12 + (LONG)( b % 5 );
+                pTrailsBench->alDY[b] = 7 - (LONG)( b % 15 );
+            }
+            Bench_Trails( pTrailsBench, 60 );
+
+            Bench_SetCounter( "live_tiles", pTrailsBench->trails.GetNumLiveTiles() );
+            sprintf( strName, "Trails/1920x1080/balls:%lu/tiles:%lu",
+                     pTrailsBench->dwNumBalls, pTrailsBench->trails.GetNumTiles() );
+            Bench_Run( strName, Bench_Trails, pTrailsBench, 1 );
+        }
+    }
+
+    SAFE_DELETE( pTrailsBench );
+    SAFE_DELETE_ARRAY( pbTrailFrame );
+
+    // BENCH_PARTICLES particles stepped with the dead replaced each time,
+    // then placed in a view. The counter is how many were replaced a step
+    // once the pool had settled, which is what compacting costs. Items are
+    // particles.
+    CParticles* pParticles = new CParticles;
+    if( pParticles && SUCCEEDED( pParticles->Create( BENCH_PARTICLES, 1 ) ) )
+    {
+        pParticles->Emit( FIELD_WIDTH / 2, FIELD_HEIGHT / 2, 0.0f, -200.0f, PARTICLE_POINT_SPEED, BENCH_PARTICLES );
+        Bench_ParticleUpdate( pParticles, 120 );
+
+        pParticles->Update( 1.0f / 60.0f );
+        Bench_SetCounter( "replaced_per_step", BENCH_PARTICLES - pParticles->GetNumParticles() );
+        pParticles->Emit( FIELD_WIDTH / 2, FIELD_HEIGHT / 2, 0.0f, -200.0f, PARTICLE_POINT_SPEED,
+                          BENCH_PARTICLES - pParticles->GetNumParticles() );
+
+        sprintf( strName, "Particles/update/particles:%d", BENCH_PARTICLES );
+        Bench_Run( strName, Bench_ParticleUpdate, pParticles, BENCH_PARTICLES );
+
+        sprintf( strName, "Particles/project/particles:%d", BENCH_PARTICLES );
+        Bench_Run( strName, Bench_ParticleProject, pParticles, BENCH_PARTICLES );
+    }
+
+    SAFE_DELETE( pParticles );
+
+    // Resampling the field up to 4K and back down, with each filter, on one
+    // thread and then on all of them
+    static const DWORD      s_adwResample[2][4] = { { 640, 480, 3840, 2160 }, { 3840, 2160, 640, 480 } };
+    static const char*      s_astrFilters[]     = { "nearest", "bilinear", "box" };
+    CThreadPool             resamplePool;
+    RESAMPLE_BENCH*         pResample = new RESAMPLE_BENCH;
+    BYTE*                   pbSrc     = new BYTE[3840 * 2160 * sizeof(DWORD)];
+    BYTE*                   pbDest    = new BYTE[3840 * 2160 * sizeof(DWORD)];
+
+    if( pResample && pbSrc && pbDest && SUCCEEDED( resamplePool.Create( 0 ) ) )
+    {
+        for( DWORD i = 0; i < 3840 * 2160 * sizeof(DWORD); i++ )
+            pbSrc[i] = (BYTE)( i * 7 + ( i >> 12 ) );
+
+        for( int s = 0; s < 2; s++ )
+        {
+            const DWORD* pdwSize = s_adwResample[s];
+
+            pResample->src.pBits     = pbSrc;
+            pResample->src.lPitch    = pdwSize[0] * sizeof(DWORD);
+            pResample->src.dwWidth   = pdwSize[0];
+            pResample->src.dwHeight  = pdwSize[1];
+            pResample->dest.pBits    = pbDest;
+            pResample->dest.lPitch   = pdwSize[2] * sizeof(DWORD);
+            pResample->dest.dwWidth  = pdwSize[2];
+            pResample->dest.dwHeight = pdwSize[3];
+
+            for( int f = 0; f < 3; f++ )
+            {
+                if( FAILED( pResample->resampler.Create( pdwSize[0], pdwSize[1], pdwSize[2], pdwSize[3],
+                                                         (ResampleFilter)f, resamplePool.GetNumThreads() ) ) )
+                    break;
+
+                for( int t = 0; t < 2; t++ )
+                {
+                    pResample->pPool = t ? &resamplePool : NULL;
+
+                    sprintf( strName, "Resample/%s/%lux%lu->%lux%lu/threads:%lu", s_astrFilters[f],
+                             pdwSize[0], pdwSize[1], pdwSize[2], pdwSize[3],
+                             t ? resamplePool.GetNumThreads() : 1 );
+                    Bench_Run( strName, Bench_Resample, pResample, pdwSize[2] * pdwSize[3] );
+                }
+            }
+        }
+    }
+
+    resamplePool.Destroy();
+    SAFE_DELETE( pResample );
+    SAFE_DELETE_ARRAY( pbSrc );
+    SAFE_DELETE_ARRAY( pbDest );
+
+    Bench_Run( "BmpDecode/ball", Bench_BmpDecode, NULL, 0 );
+    Bench_Run( "DrawText/score", Bench_DrawText, NULL, 0 );
+
+    Bench_Run( "DisplayFrame", Bench_DisplayFrame, NULL, 0 );
+
+    Bench_Close();
+
+    return S_OK;
+}
@@ -0,0 +1,53 @@
+//-----------------------------------------------------------------------------
+// File: bench.h
+//
+// Desc: Built-in microbenchmarks, run with "Pongy.exe -bench <file>". Results
+//       are written as JSON in the same layout Google Benchmark uses, so the
+//       usual comparison scripts and dashboards can read them.
+//-----------------------------------------------------------------------------
+#ifndef BENCH_H
+#define BENCH_H
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: BENCHFN
+// Desc: A benchmark body. It is called with the number of iterations to run
+//       and should do that much work in one go, so the cost of the call
+//       itself is spread over the batch.
+//-----------------------------------------------------------------------------
+typedef VOID (*BENCHFN)( VOID* pContext, DWORD dwIterations );
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Bench_*()
+// Desc: Bench_Open() starts a results file and Bench_Close() finishes it.
+//       Bench_Run() times pfnBench, growing the iteration count until a run
+//       takes long enough to measure, and writes a result. dwItemsPerIter
+//       is used to report items_per_second, pass 0 to leave it out.
+//       Bench_SetCounter() adds a number of the caller's own, such as a
+//       size, to the next result only.
+//-----------------------------------------------------------------------------
+HRESULT Bench_Open( const TCHAR* strFile );
+VOID    Bench_Close();
+VOID    Bench_Run( const char* strName, BENCHFN pfnBench, VOID* pContext,
+                   DWORD dwItemsPerIter );
+VOID    Bench_SetCounter( const char* strName, double fValue );
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: RunBenchmarks()
+// Desc: Runs the whole suite against the live display and writes the
+//       results to strFile
+//-----------------------------------------------------------------------------
+HRESULT RunBenchmarks( const TCHAR* strFile );
+
+
+
+
+#endif // BENCH_H
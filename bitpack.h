@@ -0,0 +1,153 @@
+//-----------------------------------------------------------------------------
+// File: bitpack.h
+//
+// Desc: Bit-level writing and reading for packing values into the fewest
+//       bits they need. Bits gather in a 64 bit register and go to memory
+//       32 at a time, so a value costs a shift and an or rather than a
+//       loop over its bits. Values are packed low bit first.
+//-----------------------------------------------------------------------------
+#ifndef BITPACK_H
+#define BITPACK_H
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: class CBitWriter
+// Desc: Writes into a buffer the caller has made big enough. Finish()
+//       flushes the last partial byte and returns the size in bytes.
+//-----------------------------------------------------------------------------
+class CBitWriter
+{
+    BYTE*       m_pOut;
+    BYTE*       m_pStart;
+    ULONGLONG   m_qwBits;
+    DWORD       m_dwCount;          // Bits held in m_qwBits
+
+public:
+    CBitWriter( BYTE* pOut )
+    {
+        m_pOut    = pOut;
+        m_pStart  = pOut;
+        m_qwBits  = 0;
+        m_dwCount = 0;
+    }
+
+    // dwBits is 1 to 32; bits of dwValue above dwBits must be 0
+    VOID Write( DWORD dwValue, DWORD dwBits )
+    {
+        m_qwBits  |= (ULONGLONG)dwValue << m_dwCount;
+        m_dwCount += dwBits;
+
+        if( m_dwCount >= 32 )
+        {
+            m_pOut[0] = (BYTE)( m_qwBits );
+            m_pOut[1] = (BYTE)( m_qwBits >> 8 );
+            m_pOut[2] = (BYTE)( m_qwBits >> 16 );
+            m_pOut[3] = (BYTE)( m_qwBits >> 24 );
+            m_pOut    += 4;
+            m_qwBits >>= 32;
+            m_dwCount -= 32;
+        }
+    }
+
+    DWORD Finish()
+    {
+        while( m_dwCount > 0 )
+        {
+            *m_pOut++  = (BYTE)m_qwBits;
+            m_qwBits >>= 8;
+            m_dwCount  = m_dwCount > 8 ? m_dwCount - 8 : 0;
+        }
+
+        return (DWORD)( m_pOut - m_pStart );
+    }
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: class CBitReader
+// Desc: Reads what a CBitWriter wrote. Reading past the end gives zeros
+//       and sets the overrun flag rather than touching memory it shouldn't,
+//       so a short or corrupt packet can be decoded and then thrown away.
+//-----------------------------------------------------------------------------
+class CBitReader
+{
+    const BYTE* m_pIn;
+    const BYTE* m_pEnd;
+    ULONGLONG   m_qwBits;
+    DWORD       m_dwCount;          // Bits held in m_qwBits
+    DWORD       m_dwMissing;        // Bits read that weren't there
+
+public:
+    CBitReader( const BYTE* pIn, DWORD dwSize )
+    {
+        m_pIn       = pIn;
+        m_pEnd      = pIn + dwSize;
+        m_qwBits    = 0;
+        m_dwCount   = 0;
+        m_dwMissing = 0;
+    }
+
+    // dwBits is 1 to 32
+    DWORD Read( DWORD dwBits )
+    {
+        if( m_dwCount < dwBits )
+        {
+            if( m_pEnd - m_pIn >= 4 )
+            {
+                m_qwBits |= (ULONGLONG)( m_pIn[0] | ( m_pIn[1] << 8 ) | ( m_pIn[2] << 16 ) |
+                                         ( (DWORD)m_pIn[3] << 24 ) ) << m_dwCount;
+                m_pIn     += 4;
+                m_dwCount += 32;
+            }
+            else
+            {
+                while( m_dwCount < dwBits && m_pIn < m_pEnd )
+                {
+                    m_qwBits  |= (ULONGLONG)*m_pIn++ << m_dwCount;
+                    m_dwCount += 8;
+                }
+
+                if( m_dwCount < dwBits )
+                {
+                    m_dwMissing += dwBits - m_dwCount;
+                    m_dwCount    = dwBits;
+                }
+            }
+        }
+
+        DWORD dwValue = (DWORD)( m_qwBits & ( ( (ULONGLONG)1 << dwBits ) - 1 ) );
+        m_qwBits  >>= dwBits;
+        m_dwCount  -= dwBits;
+
+        return dwValue;
+    }
+
+    BOOL IsOverrun()        { return m_dwMissing != 0; }
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: ZigZag() and UnZigZag()
+// Desc: Map signed values to unsigned ones that stay small when the value
+//       is small either side of 0: 0, -1, 1, -2, 2 become 0, 1, 2, 3, 4
+//-----------------------------------------------------------------------------
+inline DWORD ZigZag( LONG lValue )
+{
+    return ( (DWORD)lValue << 1 ) ^ (DWORD)( lValue >> 31 );
+}
+
+inline LONG UnZigZag( DWORD dwValue )
+{
+    return (LONG)( dwValue >> 1 ) ^ -(LONG)( dwValue & 1 );
+}
+
+
+
+
+#endif // BITPACK_H
@@ -0,0 +1,566 @@
+//-----------------------------------------------------------------------------
+// File: blitter.cpp
+//
+// Desc: The blt templates, the table of every instance of them, the format
+//       tables they convert with, and the SSE2 row kernels.
+//-----------------------------------------------------------------------------
+#define STRICT
+#include <windows.h>
+#include <string.h>
+#include <emmintrin.h>
+#include <ddraw.h>
+#include "ddutil.h"
+#include "blitter.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: struct Pixel
+// Desc: Reading and writing a pixel of BYTES bytes, in the low bits of a
+//       DWORD
+//-----------------------------------------------------------------------------
+template <DWORD BYTES> struct Pixel;
+
+template <> struct Pixel<1>
+{
+    static inline DWORD Read( const BYTE* pb )          { return *pb; }
+    static inline VOID  Write( BYTE* pb, DWORD dw )     { *pb = (BYTE)dw; }
+};
+
+template <> struct Pixel<2>
+{
+    static inline DWORD Read( const BYTE* pb )          { return *(const WORD*)pb; }
+    static inline VOID  Write( BYTE* pb, DWORD dw )     { *(WORD*)pb = (WORD)dw; }
+};
+
+template <> struct Pixel<3>
+{
+    static inline DWORD Read( const BYTE* pb )          { return pb[0] | ( pb[1] << 8 ) | ( pb[2] << 16 ); }
+    static inline VOID  Write( BYTE* pb, DWORD dw )
+    {
+        pb[0] = (BYTE)dw;
+        pb[1] = (BYTE)( dw >> 8 );
+        pb[2] = (BYTE)( dw >> 16 );
+    }
+};
+
+template <> struct Pixel<4>
+{
+    static inline DWORD Read( const BYTE* pb )          { return *(const DWORD*)pb; }
+    static inline VOID  Write( BYTE* pb, DWORD dw )     { *(DWORD*)pb = dw; }
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Convert()
+// Desc: A source pixel in the destination's format, opaque if it has alpha
+//-----------------------------------------------------------------------------
+static inline DWORD Convert( const BLIT_TABLES* pTables, DWORD dwSrc )
+{
+    return pTables->adwConvert[0][( dwSrc >> pTables->adwSrcShift[0] ) & pTables->adwSrcMask[0]] |
+           pTables->adwConvert[1][( dwSrc >> pTables->adwSrcShift[1] ) & pTables->adwSrcMask[1]] |
+           pTables->adwConvert[2][( dwSrc >> pTables->adwSrcShift[2] ) & pTables->adwSrcMask[2]] |
+           pTables->dwDestAlpha;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Blend()
+// Desc: A source pixel over a destination one by the source's alpha, each
+//       channel mixed at 8 bits with rounding. ( x + ( x >> 8 ) ) >> 8 is
+//       x / 255 for the sums a mix can make. A premultiplied source is
+//       weighted by 255 rather than its alpha. A destination with alpha
+//       gets the two coverages combined the same way, and one without
+//       reads as opaque.
+//-----------------------------------------------------------------------------
+static inline DWORD Blend( const BLIT_TABLES* pTables, DWORD dwSrc, DWORD dwDest )
+{
+    DWORD dwAlpha  = pTables->abSrcTo8[3][( dwSrc >> pTables->adwSrcShift[3] ) & pTables->adwSrcMask[3]];
+    DWORD dwWeight = pTables->abAlphaWeight[dwAlpha];
+    DWORD dwOut    = 0;
+
+    for( int i = 0; i < 4; i++ )
+    {
+        DWORD dwS = ( i < 3 ) ? pTables->abSrcTo8[i][( dwSrc >> pTables->adwSrcShift[i] ) & pTables->adwSrcMask[i]] * dwWeight
+                              : dwAlpha * 255;
+        DWORD dwD = pTables->abDestTo8[i][( dwDest >> pTables->adwDestShift[i] ) & pTables->adwDestMask[i]];
+        DWORD dwX = dwS + dwD * ( 255 - dwAlpha ) + 128;
+
+        dwOut |= pTables->adwDestFrom8[i][( dwX + ( dwX >> 8 ) ) >> 8];
+    }
+
+    return dwOut;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: ClipBlt()
+// Desc: Fits a blt's source rectangle to the source, moving the destination
+//       with it, then to the destination, moving the source with it. FALSE
+//       if nothing is left.
+//-----------------------------------------------------------------------------
+static BOOL ClipBlt( const BLIT_IMAGE* pDest, LONG* px, LONG* py, const BLIT_IMAGE* pSrc, RECT* prcSrc )
+{
+    RECT rcBounds;
+    LONG lLeft = prcSrc->left;
+    LONG lTop  = prcSrc->top;
+
+    SetRect( &rcBounds, 0, 0, pSrc->dwWidth, pSrc->dwHeight );
+    if( !IntersectRect( prcSrc, prcSrc, &rcBounds ) )
+        return FALSE;
+
+    LONG x = *px + prcSrc->left - lLeft;
+    LONG y = *py + prcSrc->top - lTop;
+
+    RECT rcDest;
+    SetRect( &rcDest, x, y, x + prcSrc->right - prcSrc->left, y + prcSrc->bottom - prcSrc->top );
+    SetRect( &rcBounds, 0, 0, pDest->dwWidth, pDest->dwHeight );
+    if( !IntersectRect( &rcBounds, &rcDest, &rcBounds ) )
+        return FALSE;
+
+    prcSrc->left  += rcBounds.left - x;
+    prcSrc->top   += rcBounds.top - y;
+    prcSrc->right  = prcSrc->left + rcBounds.right - rcBounds.left;
+    prcSrc->bottom = prcSrc->top + rcBounds.bottom - rcBounds.top;
+    *px = rcBounds.left;
+    *py = rcBounds.top;
+
+    return TRUE;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: BltImage()
+// Desc: One blt, for a SRC byte source and a DEST byte destination. CONVERT
+//       goes through the tables, or copies the pixels as they are for two
+//       images in one format. KEY leaves the destination wherever the
+//       source is the key colour, with a mask rather than a branch. ALPHA
+//       blends. CLIP fits the rectangle to both images first.
+//
+//       Every flag is a constant here, so each instance only has the code
+//       for its own combination.
+//-----------------------------------------------------------------------------
+template <DWORD SRC, DWORD DEST, BOOL CONVERT, BOOL KEY, BOOL ALPHA, BOOL CLIP>
+static HRESULT BltImage( const BLIT_TABLES* pTables, BLIT_IMAGE* pDest, LONG x, LONG y,
+                         const BLIT_IMAGE* pSrc, const RECT* prcSrc )
+{
+    RECT rcSrc;
+    if( prcSrc )
+        rcSrc = *prcSrc;
+    else
+        SetRect( &rcSrc, 0, 0, pSrc->dwWidth, pSrc->dwHeight );
+
+    if( CLIP && !ClipBlt( pDest, &x, &y, pSrc, &rcSrc ) )
+        return S_OK;
+
+    DWORD       dwWidth   = rcSrc.right - rcSrc.left;
+    const BYTE* pbSrcRow  = pSrc->pBits + rcSrc.top * pSrc->lPitch + rcSrc.left * SRC;
+    BYTE*       pbDestRow = pDest->pBits + y * pDest->lPitch + x * DEST;
+
+    for( LONG lRow = rcSrc.top; lRow < rcSrc.bottom; lRow++ )
+    {
+        if( !CONVERT && !KEY && !ALPHA )
+        {
+            memcpy( pbDestRow, pbSrcRow, dwWidth * SRC );
+        }
+        else
+        {
+            const BYTE* pbSrc  = pbSrcRow;
+            BYTE*       pbDest = pbDestRow;
+
+            for( DWORD i = 0; i < dwWidth; i++, pbSrc += SRC, pbDest += DEST )
+            {
+                DWORD dwSrc = Pixel<SRC>::Read( pbSrc );
+                DWORD dwOut;
+
+                if( ALPHA )
+                    dwOut = Blend( pTables, dwSrc, Pixel<DEST>::Read( pbDest ) );
+                else if( CONVERT )
+                    dwOut = Convert( pTables, dwSrc );
+                else
+                    dwOut = dwSrc;
+
+                // All ones where the source is the key, keeping what is there
+                if( KEY )
+                {
+                    DWORD dwKeep = 0 - (DWORD)( ( dwSrc & pTables->dwKeyMask ) == pTables->dwColorKey );
+                    dwOut = ( Pixel<DEST>::Read( pbDest ) & dwKeep ) | ( dwOut & ~dwKeep );
+                }
+
+                Pixel<DEST>::Write( pbDest, dwOut );
+            }
+        }
+
+        pbSrcRow  += pSrc->lPitch;
+        pbDestRow += pDest->lPitch;
+    }
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: BltRows()
+// Desc: A blt between 32 bit images a row at a time through one of the
+//       SSE2 kernels: premultiplied blending if BLEND, or colour keying
+//-----------------------------------------------------------------------------
+template <BOOL BLEND, BOOL CLIP>
+static HRESULT BltRows( const BLIT_TABLES* pTables, BLIT_IMAGE* pDest, LONG x, LONG y,
+                        const BLIT_IMAGE* pSrc, const RECT* prcSrc )
+{
+    RECT rcSrc;
+    if( prcSrc )
+        rcSrc = *prcSrc;
+    else
+        SetRect( &rcSrc, 0, 0, pSrc->dwWidth, pSrc->dwHeight );
+
+    if( CLIP && !ClipBlt( pDest, &x, &y, pSrc, &rcSrc ) )
+        return S_OK;
+
+    DWORD       dwWidth   = rcSrc.right - rcSrc.left;
+    const BYTE* pbSrcRow  = pSrc->pBits + rcSrc.top * pSrc->lPitch + rcSrc.left * sizeof(DWORD);
+    BYTE*       pbDestRow = pDest->pBits + y * pDest->lPitch + x * sizeof(DWORD);
+
+    for( LONG lRow = rcSrc.top; lRow < rcSrc.bottom; lRow++ )
+    {
+        if( BLEND )
+            Blit_BlendRow( (DWORD*)pbDestRow, (const DWORD*)pbSrcRow, dwWidth );
+        else
+            Blit_ColorKeyRow( (DWORD*)pbDestRow, (const DWORD*)pbSrcRow, dwWidth, pTables->dwColorKey );
+
+        pbSrcRow  += pSrc->lPitch;
+        pbDestRow += pDest->lPitch;
+    }
+
+    return S_OK;
+}
+
+static const BLITFN s_apfnBltRows[2][2] =
+{
+    { BltRows<FALSE, FALSE>, BltRows<FALSE, TRUE> },
+    { BltRows<TRUE, FALSE>,  BltRows<TRUE, TRUE> },
+};
+
+
+
+
+// Every instance, indexed by source and destination bytes per pixel less
+// one, then converting, colour keying, blending and clipping. Copying as
+// is between different sizes is never picked.
+#define BLT_CLIP( S, D, C, K, A )   { BltImage<S, D, C, K, A, FALSE>, BltImage<S, D, C, K, A, TRUE> }
+#define BLT_ALPHA( S, D, C, K )     { BLT_CLIP( S, D, C, K, FALSE ), BLT_CLIP( S, D, C, K, TRUE ) }
+#define BLT_KEY( S, D, C )          { BLT_ALPHA( S, D, C, FALSE ), BLT_ALPHA( S, D, C, TRUE ) }
+#define BLT_CONVERT( S, D )         { BLT_KEY( S, D, FALSE ), BLT_KEY( S, D, TRUE ) }
+#define BLT_DEST( S )               { BLT_CONVERT( S, 1 ), BLT_CONVERT( S, 2 ), BLT_CONVERT( S, 3 ), BLT_CONVERT( S, 4 ) }
+
+static const BLITFN s_apfnBlt[4][4][2][2][2][2] =
+{
+    BLT_DEST( 1 ), BLT_DEST( 2 ), BLT_DEST( 3 ), BLT_DEST( 4 )
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Blit_ColorKeyRow()
+// Desc: The key test gives a mask of all ones where a pixel is the key,
+//       which picks the destination pixel there and the source elsewhere
+//-----------------------------------------------------------------------------
+VOID Blit_ColorKeyRow( DWORD* pdwDest, const DWORD* pdwSrc, DWORD dwCount, DWORD dwColorKey )
+{
+    __m128i key  = _mm_set1_epi32( (int)( dwColorKey & BLIT_COLOR_MASK ) );
+    __m128i mask = _mm_set1_epi32( BLIT_COLOR_MASK );
+    DWORD   x    = 0;
+
+    for( ; x + 4 <= dwCount; x += 4 )
+    {
+        __m128i s    = _mm_loadu_si128( (const __m128i*)( pdwSrc + x ) );
+        __m128i d    = _mm_loadu_si128( (const __m128i*)( pdwDest + x ) );
+        __m128i keep = _mm_cmpeq_epi32( _mm_and_si128( s, mask ), key );
+
+        _mm_storeu_si128( (__m128i*)( pdwDest + x ),
+                          _mm_or_si128( _mm_and_si128( keep, d ), _mm_andnot_si128( keep, s ) ) );
+    }
+
+    for( ; x < dwCount; x++ )
+    {
+        if( ( pdwSrc[x] & BLIT_COLOR_MASK ) != ( dwColorKey & BLIT_COLOR_MASK ) )
+            pdwDest[x] = pdwSrc[x];
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Blit_BlendRow()
+// Desc: Each pixel's 255 - alpha is spread over the four 16 bit lanes of
+//       its channels, the destination is scaled by it with the same
+//       rounding as Blend(), and the source added on. A premultiplied
+//       channel is never more than its alpha, so the sum fits a byte.
+//-----------------------------------------------------------------------------
+VOID Blit_BlendRow( DWORD* pdwDest, const DWORD* pdwSrc, DWORD dwCount )
+{
+    __m128i zero  = _mm_setzero_si128();
+    __m128i ff    = _mm_set1_epi32( 0xFF );
+    __m128i round = _mm_set1_epi16( 128 );
+    DWORD   x     = 0;
+
+    for( ; x + 4 <= dwCount; x += 4 )
+    {
+        __m128i s     = _mm_loadu_si128( (const __m128i*)( pdwSrc + x ) );
+        __m128i alpha = _mm_srli_epi32( s, 24 );
+
+        if( 0xFFFF == _mm_movemask_epi8( _mm_cmpeq_epi32( alpha, zero ) ) )
+            continue;
+
+        if( 0xFFFF == _mm_movemask_epi8( _mm_cmpeq_epi32( alpha, ff ) ) )
+        {
+            _mm_storeu_si128( (__m128i*)( pdwDest + x ), s );
+            continue;
+        }
+
+        __m128i d     = _mm_loadu_si128( (const __m128i*)( pdwDest + x ) );
+        __m128i inv   = _mm_xor_si128( alpha, ff );
+        inv = _mm_or_si128( inv, _mm_slli_epi32( inv, 16 ) );
+
+        __m128i lo = _mm_add_epi16( _mm_mullo_epi16( _mm_unpacklo_epi8( d, zero ), _mm_unpacklo_epi32( inv, inv ) ), round );
+        __m128i hi = _mm_add_epi16( _mm_mullo_epi16( _mm_unpackhi_epi8( d, zero ), _mm_unpackhi_epi32( inv, inv ) ), round );
+        lo = _mm_srli_epi16( _mm_add_epi16( lo, _mm_srli_epi16( lo, 8 ) ), 8 );
+        hi = _mm_srli_epi16( _mm_add_epi16( hi, _mm_srli_epi16( hi, 8 ) ), 8 );
+
+        _mm_storeu_si128( (__m128i*)( pdwDest + x ), _mm_adds_epu8( s, _mm_packus_epi16( lo, hi ) ) );
+    }
+
+    for( ; x < dwCount; x++ )
+    {
+        DWORD dwSrc   = pdwSrc[x];
+        DWORD dwAlpha = dwSrc >> 24;
+
+        if( dwAlpha == 0 )
+            continue;
+
+        if( dwAlpha == 255 )
+        {
+            pdwDest[x] = dwSrc;
+            continue;
+        }
+
+        DWORD dwDest = pdwDest[x];
+        DWORD dwOut  = 0;
+        for( DWORD dwShift = 0; dwShift < 32; dwShift += 8 )
+        {
+            DWORD dwX = ( ( dwDest >> dwShift ) & 0xFF ) * ( 255 - dwAlpha ) + 128;
+            DWORD dwC = ( ( dwSrc >> dwShift ) & 0xFF ) + ( ( dwX + ( dwX >> 8 ) ) >> 8 );
+            dwOut |= min( dwC, 255 ) << dwShift;
+        }
+        pdwDest[x] = dwOut;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: ChannelInfo()
+// Desc: Where a channel is and how many bits it has, read at no more than
+//       8 bits by dropping its lowest ones
+//-----------------------------------------------------------------------------
+static VOID ChannelInfo( DWORD dwMask, DWORD* pdwShift, DWORD* pdwMask, DWORD* pdwBits )
+{
+    DWORD dwShift, dwBits;
+    CSurface::GetBitMaskInfo( dwMask, &dwShift, &dwBits );
+
+    if( dwBits > 8 )
+    {
+        dwShift += dwBits - 8;
+        dwBits   = 8;
+    }
+
+    *pdwShift = dwShift;
+    *pdwMask  = ( 1 << dwBits ) - 1;
+    *pdwBits  = dwBits;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CBlitter()
+// Desc:
+//-----------------------------------------------------------------------------
+CBlitter::CBlitter()
+{
+    m_pfnBlt  = NULL;
+    m_dwFlags = 0;
+    ZeroMemory( &m_ddpfSrc, sizeof(m_ddpfSrc) );
+    ZeroMemory( &m_ddpfDest, sizeof(m_ddpfDest) );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CBlitter::Create()
+// Desc: Picks the blt for the two formats and the flags, and fills in the
+//       tables it reads. A source without alpha is opaque, so BLIT_ALPHA is
+//       dropped for it.
+//
+//       Colour keyed copies between 32 bit images of one 8:8:8 format, and
+//       premultiplied 8:8:8:8 sources blended onto 32 bit destinations with
+//       the same colour masks, take the SSE2 row kernels. The destination
+//       must have no alpha or premultiplied alpha in the top byte.
+//-----------------------------------------------------------------------------
+HRESULT CBlitter::Create( const DDPIXELFORMAT* pddpfSrc, const DDPIXELFORMAT* pddpfDest,
+                          DWORD dwFlags, DWORD dwColorKey )
+{
+    m_pfnBlt = NULL;
+
+    if( NULL == pddpfSrc || NULL == pddpfDest )
+        return E_INVALIDARG;
+
+    DWORD dwSrcBits  = pddpfSrc->dwRGBBitCount;
+    DWORD dwDestBits = pddpfDest->dwRGBBitCount;
+    if( dwSrcBits == 0 || dwSrcBits > 32 || ( dwSrcBits & 7 ) ||
+        dwDestBits == 0 || dwDestBits > 32 || ( dwDestBits & 7 ) )
+        return E_NOTIMPL;
+
+    BOOL bSrcAlpha      = ( pddpfSrc->dwFlags & DDPF_ALPHAPIXELS ) != 0;
+    BOOL bDestAlpha     = ( pddpfDest->dwFlags & DDPF_ALPHAPIXELS ) != 0;
+    BOOL bPremultiplied = bSrcAlpha && ( pddpfSrc->dwFlags & DDPF_ALPHAPREMULT ) != 0;
+    if( !bSrcAlpha )
+        dwFlags &= ~BLIT_ALPHA;
+
+    BOOL bSame = dwSrcBits == dwDestBits &&
+                 ( ( pddpfSrc->dwFlags ^ pddpfDest->dwFlags ) & DDPF_ALPHAPREMULT ) == 0 &&
+                 pddpfSrc->dwRBitMask == pddpfDest->dwRBitMask &&
+                 pddpfSrc->dwGBitMask == pddpfDest->dwGBitMask &&
+                 pddpfSrc->dwBBitMask == pddpfDest->dwBBitMask &&
+                 bSrcAlpha == bDestAlpha &&
+                 ( !bSrcAlpha || pddpfSrc->dwRGBAlphaBitMask == pddpfDest->dwRGBAlphaBitMask );
+
+    // Indices have no channels to convert or blend
+    BOOL bPalettised = ( ( pddpfSrc->dwFlags | pddpfDest->dwFlags ) & DDPF_PALETTEINDEXED8 ) != 0;
+    if( bPalettised && ( !bSame || ( dwFlags & BLIT_ALPHA ) ) )
+        return E_NOTIMPL;
+
+    // The tables
+    DWORD adwSrcMasks[4]  = { pddpfSrc->dwRBitMask, pddpfSrc->dwGBitMask, pddpfSrc->dwBBitMask,
+                              bSrcAlpha ? pddpfSrc->dwRGBAlphaBitMask : 0 };
+    DWORD adwDestMasks[4] = { pddpfDest->dwRBitMask, pddpfDest->dwGBitMask, pddpfDest->dwBBitMask,
+                              bDestAlpha ? pddpfDest->dwRGBAlphaBitMask : 0 };
+
+    ZeroMemory( &m_Tables, sizeof(m_Tables) );
+
+    for( int i = 0; i < 4; i++ )
+    {
+        DWORD dwBits;
+        ChannelInfo( adwSrcMasks[i], &m_Tables.adwSrcShift[i], &m_Tables.adwSrcMask[i], &dwBits );
+
+        DWORD dwMax = m_Tables.adwSrcMask[i];
+        for( DWORD v = 0; v <= dwMax; v++ )
+            m_Tables.abSrcTo8[i][v] = (BYTE)( dwMax ? ( v * 255 + dwMax / 2 ) / dwMax : 255 );
+    }
+
+    for( int i = 0; i < 4; i++ )
+    {
+        DWORD dwBits;
+        ChannelInfo( adwDestMasks[i], &m_Tables.adwDestShift[i], &m_Tables.adwDestMask[i], &dwBits );
+
+        DWORD dwMax = m_Tables.adwDestMask[i];
+        for( DWORD v = 0; v <= dwMax; v++ )
+            m_Tables.abDestTo8[i][v] = (BYTE)( dwMax ? ( v * 255 + dwMax / 2 ) / dwMax : ( i == 3 ? 255 : 0 ) );
+
+        // Back out to every bit of the channel, more than 8 if it has them
+        DWORD dwShift, dwFullBits;
+        CSurface::GetBitMaskInfo( adwDestMasks[i], &dwShift, &dwFullBits );
+
+        DWORD dwFullMax = ( dwFullBits >= 32 ) ? 0xFFFFFFFF : ( 1 << dwFullBits ) - 1;
+        for( DWORD v = 0; v < 256; v++ )
+            m_Tables.adwDestFrom8[i][v] = (DWORD)( ( (LONGLONG)v * dwFullMax + 127 ) / 255 ) << dwShift;
+
+        for( DWORD v = 0; i < 3 && v <= m_Tables.adwSrcMask[i]; v++ )
+            m_Tables.adwConvert[i][v] = m_Tables.adwDestFrom8[i][m_Tables.abSrcTo8[i][v]];
+    }
+
+    for( DWORD v = 0; v < 256; v++ )
+        m_Tables.abAlphaWeight[v] = (BYTE)( bPremultiplied ? 255 : v );
+
+    m_Tables.dwDestAlpha = bDestAlpha ? pddpfDest->dwRGBAlphaBitMask : 0;
+    m_Tables.dwKeyMask   = bPalettised ? 0xFF : ( adwSrcMasks[0] | adwSrcMasks[1] | adwSrcMasks[2] );
+    m_Tables.dwColorKey  = dwColorKey & m_Tables.dwKeyMask;
+
+    m_pfnBlt = s_apfnBlt[dwSrcBits / 8 - 1][dwDestBits / 8 - 1][bSame ? 0 : 1]
+                        [( dwFlags & BLIT_COLORKEY ) ? 1 : 0][( dwFlags & BLIT_ALPHA ) ? 1 : 0]
+                        [( dwFlags & BLIT_CLIP ) ? 1 : 0];
+
+    BOOL bRGB32 = dwSrcBits == 32 && dwDestBits == 32 && !bPalettised &&
+                  m_Tables.dwKeyMask == BLIT_COLOR_MASK &&
+                  pddpfSrc->dwRBitMask == pddpfDest->dwRBitMask &&
+                  pddpfSrc->dwGBitMask == pddpfDest->dwGBitMask &&
+                  pddpfSrc->dwBBitMask == pddpfDest->dwBBitMask;
+    BOOL bPremultipliedDest = !bDestAlpha || ( ( pddpfDest->dwFlags & DDPF_ALPHAPREMULT ) &&
+                                               pddpfDest->dwRGBAlphaBitMask == 0xFF000000 );
+
+    if( bRGB32 && dwFlags == ( BLIT_ALPHA | ( dwFlags & BLIT_CLIP ) ) &&
+        bPremultiplied && pddpfSrc->dwRGBAlphaBitMask == 0xFF000000 && bPremultipliedDest )
+        m_pfnBlt = s_apfnBltRows[1][( dwFlags & BLIT_CLIP ) ? 1 : 0];
+    else if( bRGB32 && bSame && dwFlags == ( BLIT_COLORKEY | ( dwFlags & BLIT_CLIP ) ) )
+        m_pfnBlt = s_apfnBltRows[0][( dwFlags & BLIT_CLIP ) ? 1 : 0];
+
+    m_ddpfSrc  = *pddpfSrc;
+    m_ddpfDest = *pddpfDest;
+    m_dwFlags  = dwFlags;
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CBlitter::Matches()
+// Desc: Whether Create() has already been called with these
+//-----------------------------------------------------------------------------
+BOOL CBlitter::Matches( const DDPIXELFORMAT* pddpfSrc, const DDPIXELFORMAT* pddpfDest,
+                        DWORD dwFlags, DWORD dwColorKey )
+{
+    if( NULL == m_pfnBlt || NULL == pddpfSrc || NULL == pddpfDest )
+        return FALSE;
+
+    if( !( pddpfSrc->dwFlags & DDPF_ALPHAPIXELS ) )
+        dwFlags &= ~BLIT_ALPHA;
+
+    return dwFlags == m_dwFlags &&
+           ( dwColorKey & m_Tables.dwKeyMask ) == m_Tables.dwColorKey &&
+           0 == memcmp( pddpfSrc, &m_ddpfSrc, sizeof(DDPIXELFORMAT) ) &&
+           0 == memcmp( pddpfDest, &m_ddpfDest, sizeof(DDPIXELFORMAT) );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CBlitter::Blt()
+// Desc:
+//-----------------------------------------------------------------------------
+HRESULT CBlitter::Blt( BLIT_IMAGE* pDest, LONG x, LONG y, const BLIT_IMAGE* pSrc, const RECT* prcSrc )
+{
+    if( NULL == m_pfnBlt )
+        return E_FAIL;
+    if( NULL == pDest || NULL == pSrc || NULL == pDest->pBits || NULL == pSrc->pBits )
+        return E_INVALIDARG;
+
+    return m_pfnBlt( &m_Tables, pDest, x, y, pSrc, prcSrc );
+}
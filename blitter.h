@@ -0,0 +1,124 @@
+//-----------------------------------------------------------------------------
+// File: blitter.h
+//
+// Desc: Blts between images in memory in any two RGB pixel formats that
+//       DirectDraw can describe with bit masks, 8, 16, 24 or 32 bits a
+//       pixel, for surfaces that live in system memory where DirectDraw's
+//       own blts go a pixel at a time through every format and flag check.
+//
+//       Each blt is a template instantiated for its source and destination
+//       pixel sizes, whether it converts between formats, and whether it
+//       colour keys, blends by the source's alpha and clips. CBlitter picks
+//       the one for a pair of formats and a set of flags in Create() and
+//       keeps it, so the inner loop tests nothing but the pixels.
+//
+//       Converting looks each source channel up in a table that gives its
+//       bits already in place in the destination format, worked out in
+//       Create() from the two formats' masks. Pairs of the same format skip
+//       the tables and copy pixels as they are.
+//
+//       A source with DDPF_ALPHAPREMULT has its colours already multiplied
+//       by its alpha, so blending it only scales the destination. 32 bit
+//       premultiplied sources onto 32 bit destinations, and colour keyed
+//       blts between two 32 bit images of the same format, go through the
+//       SSE2 row kernels below instead of the templates. The software
+//       display draws its sprites with the same kernels.
+//-----------------------------------------------------------------------------
+#ifndef BLITTER_H
+#define BLITTER_H
+
+#include <ddraw.h>
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+#define BLIT_COLORKEY           0x0001      // Skip source pixels of the key colour
+#define BLIT_ALPHA              0x0002      // Blend by the source's alpha channel
+#define BLIT_CLIP               0x0004      // Clip to both images, or trust the caller
+#define BLIT_COLOR_MASK         0x00FFFFFF  // The colour of a 32 bit pixel, for the row kernels
+
+// An image in memory, such as a locked surface
+struct BLIT_IMAGE
+{
+    BYTE*       pBits;
+    LONG        lPitch;             // Bytes from one row to the next
+    DWORD       dwWidth;
+    DWORD       dwHeight;
+};
+
+// What a blt needs from its formats and flags, all worked out in Create().
+// A channel is read as ( pixel >> dwShift ) & dwMask, at most 8 bits.
+struct BLIT_TABLES
+{
+    DWORD       adwSrcShift[4];     // Red, green, blue and alpha
+    DWORD       adwSrcMask[4];
+    DWORD       adwDestShift[4];
+    DWORD       adwDestMask[4];
+    DWORD       adwConvert[3][256]; // Source channel to its bits in the destination
+    BYTE        abSrcTo8[4][256];   // Source channel to 8 bits, alpha 255 if none
+    BYTE        abAlphaWeight[256]; // What the source is weighted by for its alpha, 255 if premultiplied
+    BYTE        abDestTo8[4][256];  // Alpha 255 if none
+    DWORD       adwDestFrom8[4][256];
+    DWORD       dwDestAlpha;        // Opaque alpha bits for the destination
+    DWORD       dwKeyMask;          // The colour bits a key compares
+    DWORD       dwColorKey;
+};
+
+typedef HRESULT (*BLITFN)( const BLIT_TABLES* pTables, BLIT_IMAGE* pDest, LONG x, LONG y,
+                           const BLIT_IMAGE* pSrc, const RECT* prcSrc );
+
+
+
+
+//-----------------------------------------------------------------------------
+// Row kernels for 32 bit pixels, four at a time with SSE2
+//-----------------------------------------------------------------------------
+
+// Copies the pixels whose colour isn't dwColorKey's, ignoring the top byte
+VOID Blit_ColorKeyRow( DWORD* pdwDest, const DWORD* pdwSrc, DWORD dwCount, DWORD dwColorKey );
+
+// Draws premultiplied pixels with alpha in the top byte over the
+// destination: dest = src + dest * ( 255 - alpha ) / 255 for all four
+// bytes, so a destination with alpha gets the combined coverage. Runs of
+// four clear or four opaque pixels skip the arithmetic.
+VOID Blit_BlendRow( DWORD* pdwDest, const DWORD* pdwSrc, DWORD dwCount );
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: class CBlitter
+// Desc: The blt for one pair of formats and flags, and its tables
+//-----------------------------------------------------------------------------
+class CBlitter
+{
+    BLITFN          m_pfnBlt;
+    DDPIXELFORMAT   m_ddpfSrc;
+    DDPIXELFORMAT   m_ddpfDest;
+    DWORD           m_dwFlags;
+    BLIT_TABLES     m_Tables;
+
+public:
+    CBlitter();
+
+    // dwColorKey is in the source's format. Palettised formats can only be
+    // copied to the same format.
+    HRESULT Create( const DDPIXELFORMAT* pddpfSrc, const DDPIXELFORMAT* pddpfDest,
+                    DWORD dwFlags, DWORD dwColorKey = 0 );
+    BOOL    Matches( const DDPIXELFORMAT* pddpfSrc, const DDPIXELFORMAT* pddpfDest,
+                     DWORD dwFlags, DWORD dwColorKey );
+
+    // Copies prcSrc, or all of pSrc, with its top left at x, y. Without
+    // BLIT_CLIP both rectangles must already be inside their images.
+    HRESULT Blt( BLIT_IMAGE* pDest, LONG x, LONG y, const BLIT_IMAGE* pSrc, const RECT* prcSrc = NULL );
+
+    BOOL    IsCreated()         { return m_pfnBlt != NULL; }
+};
+
+
+
+
+#endif // BLITTER_H
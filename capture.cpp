@@ -0,0 +1,456 @@
+//-----------------------------------------------------------------------------
+// File: capture.cpp
+//
+// Desc: Frame capture and the Y4M encoder thread.
+//
+//       The game thread only locks the back buffer and copies its rows; all
+//       pixel format and colour space conversion happens on the encoder
+//       thread. Frames are written as 4:2:0 planar YUV with full range
+//       BT.601 coefficients (C420jpeg), which ffmpeg and most players will
+//       read directly.
+//-----------------------------------------------------------------------------
+#define STRICT
+#include <windows.h>
+#include <tchar.h>
+#include <stdio.h>
+#include <string.h>
+#include <ddraw.h>
+#include "ddutil.h"
+#include "dxutil.h"
+#include "capture.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CFrameCapture()
+// Desc:
+//-----------------------------------------------------------------------------
+CFrameCapture::CFrameCapture()
+{
+    ZeroMemory( m_aFrames, sizeof(m_aFrames) );
+    m_pPlanes     = NULL;
+    m_dwFullWrite = 0;
+    m_dwFullRead  = 0;
+    m_dwFreeWrite = 0;
+    m_dwFreeRead  = 0;
+    m_dwWidth     = 0;
+    m_dwHeight    = 0;
+    m_pFile       = NULL;
+    m_hThread     = NULL;
+    m_hWake       = NULL;
+    m_lStop       = 0;
+    m_dwCaptured  = 0;
+    m_dwDropped   = 0;
+
+    ZeroMemory( m_adwChannelMask, sizeof(m_adwChannelMask) );
+    ZeroMemory( m_adwChannelShift, sizeof(m_adwChannelShift) );
+    ZeroMemory( m_abExpand, sizeof(m_abExpand) );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: ~CFrameCapture()
+// Desc:
+//-----------------------------------------------------------------------------
+CFrameCapture::~CFrameCapture()
+{
+    Stop();
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CFrameCapture::Start()
+// Desc: Opens the output file, allocates the frame pool and starts the
+//       encoder. dwWidth and dwHeight must be even for 4:2:0.
+//-----------------------------------------------------------------------------
+HRESULT CFrameCapture::Start( const TCHAR* strFile, DWORD dwWidth, DWORD dwHeight, DWORD dwFps )
+{
+    Stop();
+
+    if( NULL == strFile || ( dwWidth & 1 ) || ( dwHeight & 1 ) )
+        return E_INVALIDARG;
+
+    m_dwWidth  = dwWidth;
+    m_dwHeight = dwHeight;
+
+    // Every frame buffer is big enough for 32bpp, whatever the display is
+    for( DWORD i = 0; i < CAPTURE_POOL_SIZE; i++ )
+    {
+        m_aFrames[i].pBits = new BYTE[dwWidth * 4 * dwHeight];
+        if( NULL == m_aFrames[i].pBits )
+        {
+            Stop();
+            return E_OUTOFMEMORY;
+        }
+
+        m_adwFree[i] = i;
+    }
+
+    m_dwFreeRead  = 0;
+    m_dwFreeWrite = CAPTURE_POOL_SIZE;
+    m_dwFullRead  = 0;
+    m_dwFullWrite = 0;
+
+    m_pPlanes = new BYTE[dwWidth * dwHeight * 3 / 2];
+    if( NULL == m_pPlanes )
+    {
+        Stop();
+        return E_OUTOFMEMORY;
+    }
+
+    if( NULL == ( m_pFile = _tfopen( strFile, TEXT("wb") ) ) )
+    {
+        Stop();
+        return E_FAIL;
+    }
+
+    setvbuf( m_pFile, NULL, _IOFBF, 1 << 20 );
+    fprintf( m_pFile, "YUV4MPEG2 W%lu H%lu F%lu:1 Ip A1:1 C420jpeg\n", dwWidth, dwHeight, dwFps );
+
+    m_lStop      = 0;
+    m_dwCaptured = 0;
+    m_dwDropped  = 0;
+    m_hWake      = CreateEvent( NULL, FALSE, FALSE, NULL );
+    m_hThread    = CreateThread( NULL, 0, EncoderThread, this, 0, NULL );
+    if( NULL == m_hWake || NULL == m_hThread )
+    {
+        Stop();
+        return E_FAIL;
+    }
+
+    SetThreadPriority( m_hThread, THREAD_PRIORITY_BELOW_NORMAL );
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CFrameCapture::Stop()
+// Desc: Lets the encoder finish any frames already queued, then closes the
+//       file and frees the pool
+//-----------------------------------------------------------------------------
+VOID CFrameCapture::Stop()
+{
+    if( m_hThread )
+    {
+        InterlockedExchange( &m_lStop, 1 );
+        SetEvent( m_hWake );
+        WaitForSingleObject( m_hThread, INFINITE );
+        CloseHandle( m_hThread );
+        m_hThread = NULL;
+    }
+
+    if( m_hWake )
+    {
+        CloseHandle( m_hWake );
+        m_hWake = NULL;
+    }
+
+    if( m_pFile )
+    {
+        fclose( m_pFile );
+        m_pFile = NULL;
+    }
+
+    for( DWORD i = 0; i < CAPTURE_POOL_SIZE; i++ )
+        SAFE_DELETE_ARRAY( m_aFrames[i].pBits );
+
+    SAFE_DELETE_ARRAY( m_pPlanes );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CFrameCapture::CaptureFrame()
+// Desc: Copies the surface into a free frame and queues it for the encoder.
+//       Returns S_FALSE if the frame had to be dropped.
+//-----------------------------------------------------------------------------
+HRESULT CFrameCapture::CaptureFrame( LPDIRECTDRAWSURFACE7 pdds )
+{
+    HRESULT hr;
+
+    if( NULL == m_pFile )
+        return S_OK;
+    if( NULL == pdds )
+        return E_INVALIDARG;
+
+    FRAME* pFrame = GetFreeFrame();
+    if( NULL == pFrame )
+        return S_FALSE;
+
+    DDSURFACEDESC2 ddsd;
+    ZeroMemory( &ddsd, sizeof(ddsd) );
+    ddsd.dwSize = sizeof(ddsd);
+
+    if( FAILED( hr = pdds->Lock( NULL, &ddsd, DDLOCK_WAIT | DDLOCK_READONLY | DDLOCK_NOSYSLOCK, NULL ) ) )
+        return hr;
+
+    DWORD dwBytesPerPixel = ( ddsd.ddpfPixelFormat.dwRGBBitCount + 7 ) / 8;
+    DWORD dwRows          = min( m_dwHeight, ddsd.dwHeight );
+    DWORD dwRowBytes      = min( m_dwWidth, ddsd.dwWidth ) * dwBytesPerPixel;
+
+    pFrame->dwPitch    = m_dwWidth * dwBytesPerPixel;
+    pFrame->dwBitCount = ddsd.ddpfPixelFormat.dwRGBBitCount;
+    pFrame->dwRBitMask = ddsd.ddpfPixelFormat.dwRBitMask;
+    pFrame->dwGBitMask = ddsd.ddpfPixelFormat.dwGBitMask;
+    pFrame->dwBBitMask = ddsd.ddpfPixelFormat.dwBBitMask;
+    pFrame->bPalette   = FALSE;
+
+    BYTE* pSrc  = (BYTE*)ddsd.lpSurface;
+    BYTE* pDest = pFrame->pBits;
+    for( DWORD y = 0; y < dwRows; y++ )
+    {
+        CopyMemory( pDest, pSrc, dwRowBytes );
+        pSrc  += ddsd.lPitch;
+        pDest += pFrame->dwPitch;
+    }
+
+    pdds->Unlock( NULL );
+
+    QueueFrame( pFrame );
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CFrameCapture::CaptureIndexed()
+// Desc: Copies an 8 bit frame and its palette into a free frame and queues
+//       it for the encoder. Returns S_FALSE if the frame had to be dropped.
+//-----------------------------------------------------------------------------
+HRESULT CFrameCapture::CaptureIndexed( const BYTE* pbBits, LONG lPitch, DWORD dwWidth, DWORD dwHeight,
+                                       const PALETTE* pPalette )
+{
+    if( NULL == m_pFile )
+        return S_OK;
+    if( NULL == pbBits || NULL == pPalette )
+        return E_INVALIDARG;
+
+    FRAME* pFrame = GetFreeFrame();
+    if( NULL == pFrame )
+        return S_FALSE;
+
+    DWORD dwRows     = min( m_dwHeight, dwHeight );
+    DWORD dwRowBytes = min( m_dwWidth, dwWidth );
+
+    pFrame->dwPitch    = m_dwWidth;
+    pFrame->dwBitCount = 8;
+    pFrame->dwRBitMask = 0;
+    pFrame->dwGBitMask = 0;
+    pFrame->dwBBitMask = 0;
+    pFrame->bPalette   = TRUE;
+    memcpy( pFrame->adwPalette, pPalette->adwColors, sizeof(pFrame->adwPalette) );
+
+    for( DWORD y = 0; y < dwRows; y++ )
+        CopyMemory( pFrame->pBits + y * pFrame->dwPitch, pbBits + y * lPitch, dwRowBytes );
+
+    QueueFrame( pFrame );
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CFrameCapture::GetFreeFrame()
+// Desc: The next frame on the free queue, left there until QueueFrame() so
+//       a failed copy doesn't lose it. NULL, and counted as dropped, if the
+//       encoder has every frame.
+//-----------------------------------------------------------------------------
+CFrameCapture::FRAME* CFrameCapture::GetFreeFrame()
+{
+    if( m_dwFreeRead == m_dwFreeWrite )
+    {
+        m_dwDropped++;
+        return NULL;
+    }
+
+    _ReadWriteBarrier();
+    return &m_aFrames[m_adwFree[m_dwFreeRead & (CAPTURE_POOL_SIZE - 1)]];
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CFrameCapture::QueueFrame()
+// Desc: Passes a frame from GetFreeFrame() over to the encoder
+//-----------------------------------------------------------------------------
+VOID CFrameCapture::QueueFrame( FRAME* pFrame )
+{
+    DWORD dwIndex = (DWORD)( pFrame - m_aFrames );
+    m_dwFreeRead++;
+    m_adwFull[m_dwFullWrite & (CAPTURE_POOL_SIZE - 1)] = dwIndex;
+    _ReadWriteBarrier();
+    m_dwFullWrite++;
+    m_dwCaptured++;
+
+    SetEvent( m_hWake );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CFrameCapture::EncoderThread()
+// Desc: Encodes queued frames until Stop() is called and the queue is empty
+//-----------------------------------------------------------------------------
+DWORD WINAPI CFrameCapture::EncoderThread( LPVOID pParam )
+{
+    CFrameCapture* pCapture = (CFrameCapture*)pParam;
+
+    while( TRUE )
+    {
+        WaitForSingleObject( pCapture->m_hWake, 100 );
+
+        while( pCapture->m_dwFullRead != pCapture->m_dwFullWrite )
+        {
+            _ReadWriteBarrier();
+            DWORD dwIndex = pCapture->m_adwFull[pCapture->m_dwFullRead & (CAPTURE_POOL_SIZE - 1)];
+            pCapture->m_dwFullRead++;
+
+            pCapture->EncodeFrame( &pCapture->m_aFrames[dwIndex] );
+
+            // Give the frame back to the game thread
+            pCapture->m_adwFree[pCapture->m_dwFreeWrite & (CAPTURE_POOL_SIZE - 1)] = dwIndex;
+            _ReadWriteBarrier();
+            pCapture->m_dwFreeWrite++;
+        }
+
+        if( pCapture->m_lStop )
+            break;
+    }
+
+    return 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CFrameCapture::MakeExpandTable()
+// Desc: Works out how to read one channel of a new format. A channel wider
+//       than 8 bits keeps only its top 8. Each value is expanded by
+//       repeating its bits down to the bottom of the byte, so full scale
+//       stays full scale at any width.
+//-----------------------------------------------------------------------------
+VOID CFrameCapture::MakeExpandTable( DWORD dwChannel, DWORD dwBitMask )
+{
+    DWORD dwShift, dwBits;
+    CSurface::GetBitMaskInfo( dwBitMask, &dwShift, &dwBits );
+
+    if( dwBits > 8 )
+    {
+        dwShift += dwBits - 8;
+        dwBits   = 8;
+    }
+
+    m_adwChannelMask[dwChannel]  = dwBitMask;
+    m_adwChannelShift[dwChannel] = dwShift;
+
+    for( DWORD i = 0; i < 256; i++ )
+    {
+        DWORD dwValue = i & ( ( 1 << dwBits ) - 1 );
+        DWORD dwOut   = 0;
+
+        for( int nPos = 8 - (int)dwBits; dwBits > 0 && nPos > -(int)dwBits; nPos -= dwBits )
+            dwOut |= ( nPos >= 0 ) ? ( dwValue << nPos ) : ( dwValue >> -nPos );
+
+        m_abExpand[dwChannel][i] = (BYTE)dwOut;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CFrameCapture::EncodeFrame()
+// Desc: Converts a frame to 4:2:0 YUV and appends it to the file. Each 2x2
+//       block of pixels gives four luma samples and one averaged pair of
+//       chroma samples.
+//-----------------------------------------------------------------------------
+VOID CFrameCapture::EncodeFrame( FRAME* pFrame )
+{
+    DWORD adwMask[3] = { pFrame->dwRBitMask, pFrame->dwGBitMask, pFrame->dwBBitMask };
+    for( DWORD c = 0; c < 3; c++ )
+    {
+        if( adwMask[c] != m_adwChannelMask[c] )
+            MakeExpandTable( c, adwMask[c] );
+    }
+
+    DWORD dwBytesPerPixel = ( pFrame->dwBitCount + 7 ) / 8;
+    BYTE* pY  = m_pPlanes;
+    BYTE* pCb = pY + m_dwWidth * m_dwHeight;
+    BYTE* pCr = pCb + ( m_dwWidth / 2 ) * ( m_dwHeight / 2 );
+
+    for( DWORD y = 0; y < m_dwHeight; y += 2 )
+    {
+        for( DWORD x = 0; x < m_dwWidth; x += 2 )
+        {
+            int nRSum = 0, nGSum = 0, nBSum = 0;
+
+            for( DWORD j = 0; j < 4; j++ )
+            {
+                DWORD dwX = x + ( j & 1 );
+                DWORD dwY = y + ( j >> 1 );
+                BYTE* p   = pFrame->pBits + dwY * pFrame->dwPitch + dwX * dwBytesPerPixel;
+                DWORD dwPixel;
+
+                switch( dwBytesPerPixel )
+                {
+                    case 4:  dwPixel = *(DWORD*)p;                       break;
+                    case 3:  dwPixel = p[0] | ( p[1] << 8 ) | ( p[2] << 16 ); break;
+                    case 2:  dwPixel = *(WORD*)p;                        break;
+                    default: dwPixel = *p;                               break;
+                }
+
+                // Expand each channel to 8 bits through its table
+                int r, g, b;
+                if( pFrame->dwRBitMask )
+                {
+                    r = m_abExpand[0][( dwPixel & m_adwChannelMask[0] ) >> m_adwChannelShift[0]];
+                    g = m_abExpand[1][( dwPixel & m_adwChannelMask[1] ) >> m_adwChannelShift[1]];
+                    b = m_abExpand[2][( dwPixel & m_adwChannelMask[2] ) >> m_adwChannelShift[2]];
+                }
+                else if( pFrame->bPalette )
+                {
+                    DWORD dwColor = pFrame->adwPalette[dwPixel & 0xFF];
+                    r = ( dwColor >> 16 ) & 0xFF;
+                    g = ( dwColor >> 8 ) & 0xFF;
+                    b = dwColor & 0xFF;
+                }
+                else
+                {
+                    // Palettised, there is no palette to hand so show the
+                    // index as grey
+                    r = g = b = dwPixel & 0xFF;
+                }
+
+                pY[dwY * m_dwWidth + dwX] = (BYTE)( ( 77 * r + 150 * g + 29 * b ) >> 8 );
+                nRSum += r;
+                nGSum += g;
+                nBSum += b;
+            }
+
+            int   nCb = ( ( -43 * nRSum - 85 * nGSum + 128 * nBSum ) >> 10 ) + 128;
+            int   nCr = ( ( 128 * nRSum - 107 * nGSum - 21 * nBSum ) >> 10 ) + 128;
+            DWORD dwC = ( y / 2 ) * ( m_dwWidth / 2 ) + x / 2;
+            pCb[dwC] = (BYTE)max( 0, min( 255, nCb ) );
+            pCr[dwC] = (BYTE)max( 0, min( 255, nCr ) );
+        }
+    }
+
+    fputs( "FRAME\n", m_pFile );
+    fwrite( m_pPlanes, 1, m_dwWidth * m_dwHeight * 3 / 2, m_pFile );
+}
@@ -0,0 +1,103 @@
+//-----------------------------------------------------------------------------
+// File: capture.h
+//
+// Desc: Gameplay recording. Each presented frame is copied out of the back
+//       buffer into one of a fixed pool of frame buffers and handed to a
+//       background thread which converts it and writes it to a YUV4MPEG2
+//       (.y4m) file. If the encoder falls behind, frames are dropped rather
+//       than holding up the game, so memory use is bounded by the pool.
+//
+//       An indexed display's frame can be captured as it is, with its
+//       palette, which copies a quarter of the bytes of a 32 bit frame on
+//       the game thread and leaves the lookup to the encoder.
+//-----------------------------------------------------------------------------
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdio.h>
+#include <ddraw.h>
+#include "palette.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+#define CAPTURE_POOL_SIZE   8       // Frames in flight, must be a power of 2
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: class CFrameCapture
+// Desc: Owns the frame pool, the output file and the encoder thread
+//-----------------------------------------------------------------------------
+class CFrameCapture
+{
+    struct FRAME
+    {
+        BYTE*   pBits;          // Rows copied straight from the surface
+        DWORD   dwPitch;        // Bytes per row in pBits
+        DWORD   dwBitCount;
+        DWORD   dwRBitMask;
+        DWORD   dwGBitMask;
+        DWORD   dwBBitMask;
+        BOOL    bPalette;       // 8 bit, with its colours in adwPalette
+        DWORD   adwPalette[PALETTE_MAX_COLORS];
+    };
+
+    FRAME           m_aFrames[CAPTURE_POOL_SIZE];
+    BYTE*           m_pPlanes;      // Y, Cb and Cr planes for one frame
+
+    // Frames travel from the game thread to the encoder through m_adwFull,
+    // and come back through m_adwFree. Each queue has one writer and one
+    // reader so the positions only need to be volatile.
+    DWORD           m_adwFull[CAPTURE_POOL_SIZE];
+    DWORD           m_adwFree[CAPTURE_POOL_SIZE];
+    volatile DWORD  m_dwFullWrite;
+    volatile DWORD  m_dwFullRead;
+    volatile DWORD  m_dwFreeWrite;
+    volatile DWORD  m_dwFreeRead;
+
+    DWORD           m_dwWidth;
+    DWORD           m_dwHeight;
+    FILE*           m_pFile;
+    HANDLE          m_hThread;
+    HANDLE          m_hWake;
+    volatile LONG   m_lStop;
+    DWORD           m_dwCaptured;
+    DWORD           m_dwDropped;
+
+    // How the encoder reads red, green and blue in the last format it saw:
+    // masked, shifted down to at most 8 bits and looked up to 8 bits. Only
+    // the encoder thread touches these.
+    DWORD           m_adwChannelMask[3];
+    DWORD           m_adwChannelShift[3];
+    BYTE            m_abExpand[3][256];
+
+    static DWORD WINAPI EncoderThread( LPVOID pParam );
+    VOID    MakeExpandTable( DWORD dwChannel, DWORD dwBitMask );
+    VOID    EncodeFrame( FRAME* pFrame );
+    FRAME*  GetFreeFrame();
+    VOID    QueueFrame( FRAME* pFrame );
+
+public:
+    CFrameCapture();
+    ~CFrameCapture();
+
+    HRESULT Start( const TCHAR* strFile, DWORD dwWidth, DWORD dwHeight, DWORD dwFps );
+    VOID    Stop();
+    HRESULT CaptureFrame( LPDIRECTDRAWSURFACE7 pdds );
+    HRESULT CaptureIndexed( const BYTE* pbBits, LONG lPitch, DWORD dwWidth, DWORD dwHeight,
+                            const PALETTE* pPalette );
+
+    BOOL    IsCapturing()      { return m_pFile != NULL; }
+    DWORD   GetCaptured()      { return m_dwCaptured; }
+    DWORD   GetDropped()       { return m_dwDropped; }
+};
+
+
+
+
+#endif // CAPTURE_H
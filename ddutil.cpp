@@ -14,6 +14,66 @@
 #include <ddraw.h>
 #include "ddutil.h"
 #include "dxutil.h"
+#include "pool.h"
+#include "fill.h"
+#include "blitter.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines, constants, and global variables
+//-----------------------------------------------------------------------------
+#define SURFACE_POOL_SIZE   32      // Enough for the game, overlay and benchmarks
+#define BLITTER_CACHE_SIZE  8       // Format pairs and flags BltTo() keeps blitters for
+
+static CPool<CSurface, SURFACE_POOL_SIZE> g_SurfacePool;
+
+// A CBlitter is mostly its conversion tables, several kilobytes, and the
+// game only blts from a handful of formats to one back buffer, so the
+// surfaces share a few of them rather than each keeping its own
+static CBlitter g_aBlitterCache[BLITTER_CACHE_SIZE];
+static DWORD    g_dwNextBlitter = 0;
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: class CBitmapScratch
+// Desc: The pixels and resampler CSurface::ResampleBitmap() works with, kept
+//       across calls. Surfaces are redrawn together after a restore or a
+//       resize, mostly from bitmaps of the same size to the same size, so
+//       the buffer only grows and the resampler is rarely created again.
+//-----------------------------------------------------------------------------
+class CBitmapScratch
+{
+    DWORD*      m_pdwBits;
+    DWORD       m_dwSize;
+
+public:
+    CResampler  resampler;
+
+    CBitmapScratch()    { m_pdwBits = NULL; m_dwSize = 0; }
+    ~CBitmapScratch()   { SAFE_DELETE_ARRAY( m_pdwBits ); }
+
+    // Room for at least dwCount pixels, or NULL
+    DWORD* GetBits( DWORD dwCount )
+    {
+        if( dwCount > m_dwSize )
+        {
+            SAFE_DELETE_ARRAY( m_pdwBits );
+            m_dwSize = 0;
+
+            if( NULL == ( m_pdwBits = new DWORD[dwCount] ) )
+                return NULL;
+            m_dwSize = dwCount;
+        }
+
+        return m_pdwBits;
+    }
+};
+
+static CBitmapScratch g_BitmapScratch;
 
 
 
@@ -30,6 +90,8 @@ CDisplay::CDisplay()
     m_pddsFrontBuffer    = NULL;
     m_pddsBackBuffer     = NULL;
     m_pddsBackBufferLeft = NULL;
+    m_dwBackBufferCount  = 1;
+    m_bBatching          = FALSE;
 }
 
 
@@ -53,6 +115,8 @@ CDisplay::~CDisplay()
 //-----------------------------------------------------------------------------
 HRESULT CDisplay::DestroyObjects()
 {
+    EndBatch();
+
     SAFE_RELEASE( m_pddsBackBufferLeft );
     SAFE_RELEASE( m_pddsBackBuffer );
     SAFE_RELEASE( m_pddsFrontBuffer );
@@ -70,16 +134,24 @@ HRESULT CDisplay::DestroyObjects()
 
 //-----------------------------------------------------------------------------
 // Name: CreateFullScreenDisplay()
-// Desc:
+// Desc: Takes the screen exclusively at the given mode, with a flip chain
+//       of dwBackBufferCount back buffers. One more than the usual one lets
+//       drawing start on the next frame while a flip waits for the
+//       vertical blank, at the cost of a frame more latency.
 //-----------------------------------------------------------------------------
 HRESULT CDisplay::CreateFullScreenDisplay( HWND hWnd, DWORD dwWidth,
-                                           DWORD dwHeight, DWORD dwBPP )
+                                           DWORD dwHeight, DWORD dwBPP,
+                                           DWORD dwBackBufferCount )
 {
     HRESULT hr;
 
     // Cleanup anything from a previous call
     DestroyObjects();
 
+    if( dwBackBufferCount == 0 )
+        return E_INVALIDARG;
+    m_dwBackBufferCount = dwBackBufferCount;
+
     // DDraw stuff begins here
     if( FAILED( hr = DirectDrawCreateEx( NULL, (VOID**)&m_pDD,
                                          IID_IDirectDraw7, NULL ) ) )
@@ -94,6 +166,30 @@ HRESULT CDisplay::CreateFullScreenDisplay( HWND hWnd, DWORD dwWidth,
     if( FAILED( m_pDD->SetDisplayMode( dwWidth, dwHeight, dwBPP, 0, 0 ) ) )
         return E_FAIL;
 
+    if( FAILED( hr = CreateFullScreenBuffers() ) )
+        return hr;
+
+    m_hWnd      = hWnd;
+    m_bWindowed = FALSE;
+    UpdateBounds();
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CDisplay::CreateFullScreenBuffers()
+// Desc: Creates the primary surface with m_dwBackBufferCount back buffers
+//       attached. m_pddsBackBuffer is the one behind the front buffer, and
+//       each flip swaps what the surfaces point at, so it is always the
+//       next to be shown.
+//-----------------------------------------------------------------------------
+HRESULT CDisplay::CreateFullScreenBuffers()
+{
+    HRESULT hr;
+
     // Create primary surface (with backbuffer attached)
     DDSURFACEDESC2 ddsd;
     ZeroMemory( &ddsd, sizeof( ddsd ) );
@@ -101,7 +197,7 @@ HRESULT CDisplay::CreateFullScreenDisplay( HWND hWnd, DWORD dwWidth,
     ddsd.dwFlags           = DDSD_CAPS | DDSD_BACKBUFFERCOUNT;
     ddsd.ddsCaps.dwCaps    = DDSCAPS_PRIMARYSURFACE | DDSCAPS_FLIP |
                              DDSCAPS_COMPLEX | DDSCAPS_3DDEVICE;
-    ddsd.dwBackBufferCount = 1;
+    ddsd.dwBackBufferCount = m_dwBackBufferCount;
 
     if( FAILED( hr = m_pDD->CreateSurface( &ddsd, &m_pddsFrontBuffer,
                                            NULL ) ) )
@@ -118,10 +214,6 @@ HRESULT CDisplay::CreateFullScreenDisplay( HWND hWnd, DWORD dwWidth,
 
     m_pddsBackBuffer->AddRef();
 
-    m_hWnd      = hWnd;
-    m_bWindowed = FALSE;
-    UpdateBounds();
-
     return S_OK;
 }
     
@@ -180,6 +272,28 @@ HRESULT CDisplay::CreateWindowedDisplay( HWND hWnd, DWORD dwWidth, DWORD dwHeigh
     SetWindowPos( hWnd, NULL, rc.left, rc.top, 0, 0,
                   SWP_NOSIZE | SWP_NOZORDER | SWP_NOACTIVATE );
 
+    m_hWnd = hWnd;
+
+    if( FAILED( hr = CreateWindowedBuffers( dwWidth, dwHeight ) ) )
+        return hr;
+
+    m_bWindowed = TRUE;
+    UpdateBounds();
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CDisplay::CreateWindowedBuffers()
+// Desc: Creates the primary surface, clipped to the window, and an off 
+//       screen back buffer of the given size
+//-----------------------------------------------------------------------------
+HRESULT CDisplay::CreateWindowedBuffers( DWORD dwWidth, DWORD dwHeight )
+{
+    HRESULT             hr;
     LPDIRECTDRAWCLIPPER pcClipper;
     
     // Create the primary surface
@@ -204,7 +318,7 @@ HRESULT CDisplay::CreateWindowedDisplay( HWND hWnd, DWORD dwWidth, DWORD dwHeigh
     if( FAILED( hr = m_pDD->CreateClipper( 0, &pcClipper, NULL ) ) )
         return E_FAIL;
 
-    if( FAILED( hr = pcClipper->SetHWnd( 0, hWnd ) ) )
+    if( FAILED( hr = pcClipper->SetHWnd( 0, m_hWnd ) ) )
     {
         pcClipper->Release();
         return E_FAIL;
@@ -219,8 +333,43 @@ HRESULT CDisplay::CreateWindowedDisplay( HWND hWnd, DWORD dwWidth, DWORD dwHeigh
     // Done with clipper
     pcClipper->Release();
 
-    m_hWnd      = hWnd;
-    m_bWindowed = TRUE;
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CDisplay::ResetObjects()
+// Desc: Recreates the front and back buffers after a display mode change.
+//       Unlike calling Create*Display() again this keeps the DirectDraw
+//       object, the window and this CDisplay as they are, so it allocates
+//       nothing of its own and only swaps the surfaces underneath.
+//-----------------------------------------------------------------------------
+HRESULT CDisplay::ResetObjects()
+{
+    if( NULL == m_pDD || NULL == m_pddsBackBuffer )
+        return E_POINTER;
+
+    // Remember the back buffer size before letting it go
+    DDSURFACEDESC2 ddsd;
+    ZeroMemory( &ddsd, sizeof( ddsd ) );
+    ddsd.dwSize = sizeof( ddsd );
+    m_pddsBackBuffer->GetSurfaceDesc( &ddsd );
+
+    SAFE_RELEASE( m_pddsBackBufferLeft );
+    SAFE_RELEASE( m_pddsBackBuffer );
+    SAFE_RELEASE( m_pddsFrontBuffer );
+
+    HRESULT hr;
+    if( m_bWindowed )
+        hr = CreateWindowedBuffers( ddsd.dwWidth, ddsd.dwHeight );
+    else
+        hr = CreateFullScreenBuffers();
+
+    if( FAILED( hr ) )
+        return hr;
+
     UpdateBounds();
 
     return S_OK;
@@ -229,6 +378,43 @@ HRESULT CDisplay::CreateWindowedDisplay( HWND hWnd, DWORD dwWidth, DWORD dwHeigh
 
 
 
+//-----------------------------------------------------------------------------
+// Name: CDisplay::ResizeBackBuffer()
+// Desc: Swaps a windowed display's back buffer for one of a new size, such
+//       as the client area after the window is resized, so Present() copies
+//       it across pixel for pixel rather than stretching it. The primary
+//       surface and its clipper are kept. The old back buffer is only let
+//       go once the new one exists, so a failure leaves the display as it
+//       was.
+//-----------------------------------------------------------------------------
+HRESULT CDisplay::ResizeBackBuffer( DWORD dwWidth, DWORD dwHeight )
+{
+    if( NULL == m_pDD || NULL == m_pddsBackBuffer )
+        return E_POINTER;
+    if( !m_bWindowed || dwWidth == 0 || dwHeight == 0 )
+        return E_INVALIDARG;
+
+    LPDIRECTDRAWSURFACE7 pddsBackBuffer;
+    DDSURFACEDESC2       ddsd;
+    ZeroMemory( &ddsd, sizeof( ddsd ) );
+    ddsd.dwSize         = sizeof( ddsd );
+    ddsd.dwFlags        = DDSD_CAPS | DDSD_WIDTH | DDSD_HEIGHT;    
+    ddsd.ddsCaps.dwCaps = DDSCAPS_OFFSCREENPLAIN | DDSCAPS_3DDEVICE;
+    ddsd.dwWidth        = dwWidth;
+    ddsd.dwHeight       = dwHeight;
+
+    if( FAILED( m_pDD->CreateSurface( &ddsd, &pddsBackBuffer, NULL ) ) )
+        return E_FAIL;
+
+    SAFE_RELEASE( m_pddsBackBuffer );
+    m_pddsBackBuffer = pddsBackBuffer;
+
+    return S_OK;
+}
+
+
+
+
 //-----------------------------------------------------------------------------
 // Name: 
 // Desc: 
@@ -253,7 +439,53 @@ HRESULT CDisplay::CreateSurface( CSurface** ppSurface,
     (*ppSurface) = new CSurface();
     if( FAILED( hr = (*ppSurface)->Create( m_pDD, &ddsd ) ) )
     {
-        delete (*ppSurface);
+        SAFE_DELETE( *ppSurface );
+        return hr;
+    }
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CDisplay::CreateAlphaSurface()
+// Desc: Creates a 32 bit surface in system memory with premultiplied alpha
+//       in the top byte, for sprites with soft edges. Only the processor
+//       can blend it, through CDisplay::Blt() to a back buffer in system
+//       memory or the software display. A colour key of black still works
+//       for BltFast(), as clear pixels are 0.
+//-----------------------------------------------------------------------------
+HRESULT CDisplay::CreateAlphaSurface( CSurface** ppSurface,
+                                      DWORD dwWidth, DWORD dwHeight )
+{
+    if( NULL == m_pDD )
+        return E_POINTER;
+    if( NULL == ppSurface )
+        return E_INVALIDARG;
+
+    HRESULT        hr;
+    DDSURFACEDESC2 ddsd;
+    ZeroMemory( &ddsd, sizeof( ddsd ) );
+    ddsd.dwSize         = sizeof( ddsd );
+    ddsd.dwFlags        = DDSD_CAPS | DDSD_WIDTH | DDSD_HEIGHT | DDSD_PIXELFORMAT;
+    ddsd.ddsCaps.dwCaps = DDSCAPS_OFFSCREENPLAIN | DDSCAPS_SYSTEMMEMORY;
+    ddsd.dwWidth        = dwWidth;
+    ddsd.dwHeight       = dwHeight;
+
+    ddsd.ddpfPixelFormat.dwSize            = sizeof(DDPIXELFORMAT);
+    ddsd.ddpfPixelFormat.dwFlags           = DDPF_RGB | DDPF_ALPHAPIXELS | DDPF_ALPHAPREMULT;
+    ddsd.ddpfPixelFormat.dwRGBBitCount     = 32;
+    ddsd.ddpfPixelFormat.dwRBitMask        = 0x00FF0000;
+    ddsd.ddpfPixelFormat.dwGBitMask        = 0x0000FF00;
+    ddsd.ddpfPixelFormat.dwBBitMask        = 0x000000FF;
+    ddsd.ddpfPixelFormat.dwRGBAlphaBitMask = 0xFF000000;
+
+    (*ppSurface) = new CSurface();
+    if( FAILED( hr = (*ppSurface)->Create( m_pDD, &ddsd ) ) )
+    {
+        SAFE_DELETE( *ppSurface );
         return hr;
     }
 
@@ -310,13 +542,15 @@ HRESULT CDisplay::CreateSurfaceFromBitmap( CSurface** ppSurface,
     (*ppSurface) = new CSurface();
     if( FAILED( hr = (*ppSurface)->Create( m_pDD, &ddsd ) ) )
     {
-        delete (*ppSurface);
+        SAFE_DELETE( *ppSurface );
+        DeleteObject( hBMP );
         return hr;
     }
 
     // Draw the bitmap on this surface
     if( FAILED( hr = (*ppSurface)->DrawBitmap( hBMP, 0, 0, 0, 0 ) ) )
     {
+        SAFE_DELETE( *ppSurface );
         DeleteObject( hBMP );
         return hr;
     }
@@ -332,16 +566,16 @@ HRESULT CDisplay::CreateSurfaceFromBitmap( CSurface** ppSurface,
 //-----------------------------------------------------------------------------
 // Name: CDisplay::CreateSurfaceFromText()
 // Desc: Creates a DirectDrawSurface from a text string using hFont or the default 
-//       GDI font if hFont is NULL.
+//       GDI font if hFont is NULL. With bAlpha it is an alpha surface and
+//       the background is clear.
 //-----------------------------------------------------------------------------
 HRESULT CDisplay::CreateSurfaceFromText( CSurface** ppSurface,
                                          HFONT hFont, TCHAR* strText, 
-                                         COLORREF crBackground, COLORREF crForeground )
+                                         COLORREF crBackground, COLORREF crForeground,
+                                         BOOL bAlpha )
 {
     HDC                  hDC  = NULL;
-    LPDIRECTDRAWSURFACE7 pDDS = NULL;
     HRESULT              hr;
-    DDSURFACEDESC2       ddsd;
     SIZE                 sizeText;
 
     if( m_pDD == NULL || strText == NULL || ppSurface == NULL )
@@ -357,24 +591,21 @@ HRESULT CDisplay::CreateSurfaceFromText( CSurface** ppSurface,
     GetTextExtentPoint32( hDC, strText, _tcslen(strText), &sizeText );
     ReleaseDC( NULL, hDC );
 
-    // Create a DirectDrawSurface for this bitmap
-    ZeroMemory( &ddsd, sizeof(ddsd) );
-    ddsd.dwSize         = sizeof(ddsd);
-    ddsd.dwFlags        = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH;
-    ddsd.ddsCaps.dwCaps = DDSCAPS_OFFSCREENPLAIN;
-    ddsd.dwWidth        = sizeText.cx;
-    ddsd.dwHeight       = sizeText.cy;
+    // Create a DirectDrawSurface for this text
+    if( bAlpha )
+        hr = CreateAlphaSurface( ppSurface, sizeText.cx, sizeText.cy );
+    else
+        hr = CreateSurface( ppSurface, sizeText.cx, sizeText.cy );
 
-    (*ppSurface) = new CSurface();
-    if( FAILED( hr = (*ppSurface)->Create( m_pDD, &ddsd ) ) )
-    {
-        delete (*ppSurface);
+    if( FAILED( hr ) )
         return hr;
-    }
 
     if( FAILED( hr = (*ppSurface)->DrawText( hFont, strText, 0, 0, 
                                              crBackground, crForeground ) ) )
+    {
+        SAFE_DELETE( *ppSurface );
         return hr;
+    }
 
     return S_OK;
 }
@@ -383,10 +614,13 @@ HRESULT CDisplay::CreateSurfaceFromText( CSurface** ppSurface,
 
 
 //-----------------------------------------------------------------------------
-// Name: 
-// Desc: 
+// Name: CDisplay::Present()
+// Desc: Shows the back buffer. Windowed that is a blt of the whole frame
+//       through the clipper; full screen it is a flip, which only swaps the
+//       surfaces over. dwFlipFlags go to Flip(), so a DDFLIP_INTERVAL flag
+//       can pace frames to every second refresh or more.
 //-----------------------------------------------------------------------------
-HRESULT CDisplay::Present()
+HRESULT CDisplay::Present( DWORD dwFlipFlags )
 {
     HRESULT hr;
 
@@ -399,7 +633,7 @@ HRESULT CDisplay::Present()
             hr = m_pddsFrontBuffer->Blt( &m_rcWindow, m_pddsBackBuffer,
                                          NULL, DDBLT_WAIT, NULL );
         else
-            hr = m_pddsFrontBuffer->Flip( NULL, 0 );
+            hr = m_pddsFrontBuffer->Flip( NULL, dwFlipFlags );
 
         if( hr == DDERR_SURFACELOST )
         {
@@ -473,13 +707,55 @@ HRESULT CDisplay::Blt( DWORD x, DWORD y, LPDIRECTDRAWSURFACE7 pdds, RECT* prc,
 
 
 //-----------------------------------------------------------------------------
-// Name: 
-// Desc: 
+// Name: IsInSystemMemory()
+// Desc: Whether DirectDraw would draw on a surface a pixel at a time
+//-----------------------------------------------------------------------------
+static BOOL IsInSystemMemory( LPDIRECTDRAWSURFACE7 pdds )
+{
+    DDSCAPS2 ddscaps;
+    ZeroMemory( &ddscaps, sizeof(ddscaps) );
+    pdds->GetCaps( &ddscaps );
+
+    return ( ddscaps.dwCaps & DDSCAPS_SYSTEMMEMORY ) != 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CDisplay::Blt()
+// Desc: Blts a surface to the back buffer, colour keyed if it has a key.
+//       A back buffer in system memory is drawn by the surface's CBlitter,
+//       unless it has no blt between the two formats.
 //-----------------------------------------------------------------------------
 HRESULT CDisplay::Blt( DWORD x, DWORD y, CSurface* pSurface, RECT* prc )
 {
     if( NULL == pSurface )
         return E_INVALIDARG;
+    if( NULL == m_pddsBackBuffer )
+        return E_POINTER;
+
+    HRESULT hr;
+
+    if( m_bBatching )
+    {
+        if( E_NOTIMPL != ( hr = pSurface->BltTo( &m_BatchDest, &m_ddpfBatch, x, y, prc ) ) )
+            return hr;
+
+        // DirectDraw can't blt to a locked surface, so a blt the blitter
+        // can't do unlocks the batch around it
+        EndBatch();
+        hr = Blt( x, y, pSurface, prc );
+        BeginBatch();
+        return hr;
+    }
+
+    if( IsInSystemMemory( m_pddsBackBuffer ) )
+    {
+        hr = pSurface->BltTo( m_pddsBackBuffer, x, y, prc );
+        if( hr != E_NOTIMPL )
+            return hr;
+    }
 
     if( pSurface->IsColorKeyed() )
         return Blt( x, y, pSurface->GetDDrawSurface(), prc, DDBLTFAST_SRCCOLORKEY );
@@ -490,22 +766,149 @@ HRESULT CDisplay::Blt( DWORD x, DWORD y, CSurface* pSurface, RECT* prc )
 
 
 
+//-----------------------------------------------------------------------------
+// Name: CDisplay::Blt()
+// Desc: Blts one surface at many points on the back buffer, as for the
+//       particles. Batched or in system memory, the back buffer and the
+//       surface are each locked once for all of them; in video memory the
+//       card does one BltFast() each, so the points must be in the view.
+//-----------------------------------------------------------------------------
+HRESULT CDisplay::Blt( const POINT* pPoints, DWORD dwCount, CSurface* pSurface, RECT* prc )
+{
+    HRESULT hr;
+
+    if( NULL == pPoints || NULL == pSurface )
+        return E_INVALIDARG;
+    if( NULL == m_pddsBackBuffer )
+        return E_POINTER;
+
+    BOOL bWasBatching = m_bBatching;
+
+    if( m_bBatching || IsInSystemMemory( m_pddsBackBuffer ) )
+    {
+        if( FAILED( hr = BeginBatch() ) )
+            return hr;
+
+        hr = pSurface->BltTo( &m_BatchDest, &m_ddpfBatch, pPoints, dwCount, prc );
+        if( hr != E_NOTIMPL )
+        {
+            if( !bWasBatching )
+                EndBatch();
+            return hr;
+        }
+
+        EndBatch();
+    }
+
+    DWORD dwFlags = pSurface->IsColorKeyed() ? DDBLTFAST_SRCCOLORKEY : 0L;
+    HRESULT hrBlt;
+
+    hr = S_OK;
+    for( DWORD i = 0; i < dwCount; i++ )
+    {
+        if( FAILED( hrBlt = Blt( pPoints[i].x, pPoints[i].y, pSurface->GetDDrawSurface(), prc, dwFlags ) ) )
+            hr = hrBlt;
+    }
+
+    if( bWasBatching )
+        BeginBatch();
+
+    return hr;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CDisplay::BeginBatch()
+// Desc: Locks a back buffer in system memory until EndBatch(), so the blts
+//       in between don't lock and unlock it once each
+//-----------------------------------------------------------------------------
+HRESULT CDisplay::BeginBatch()
+{
+    DDSURFACEDESC2 ddsd;
+    HRESULT        hr;
+
+    if( NULL == m_pddsBackBuffer )
+        return E_POINTER;
+    if( m_bBatching )
+        return S_OK;
+    if( !IsInSystemMemory( m_pddsBackBuffer ) )
+        return S_FALSE;
+
+    ZeroMemory( &ddsd, sizeof(ddsd) );
+    ddsd.dwSize = sizeof(ddsd);
+
+    if( FAILED( hr = m_pddsBackBuffer->Lock( NULL, &ddsd, DDLOCK_WAIT, NULL ) ) )
+        return hr;
+
+    m_BatchDest.pBits    = (BYTE*)ddsd.lpSurface;
+    m_BatchDest.lPitch   = ddsd.lPitch;
+    m_BatchDest.dwWidth  = ddsd.dwWidth;
+    m_BatchDest.dwHeight = ddsd.dwHeight;
+    m_ddpfBatch          = ddsd.ddpfPixelFormat;
+    m_bBatching          = TRUE;
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CDisplay::EndBatch()
+// Desc: Unlocks the back buffer after BeginBatch(), if it locked it
+//-----------------------------------------------------------------------------
+HRESULT CDisplay::EndBatch()
+{
+    if( !m_bBatching )
+        return S_FALSE;
+
+    m_bBatching = FALSE;
+
+    if( NULL == m_pddsBackBuffer )
+        return E_POINTER;
+
+    return m_pddsBackBuffer->Unlock( NULL );
+}
+
+
+
+
 //-----------------------------------------------------------------------------
 // Name: 
 // Desc: 
 //-----------------------------------------------------------------------------
 HRESULT CDisplay::Clear( DWORD dwColor )
+{
+    // Erase the background
+    return FillRect( NULL, dwColor );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CDisplay::FillRect()
+// Desc: Fills a rectangle of the back buffer, or all of it if prc is NULL,
+//       with a colour in the surface's pixel format. The card fills a back
+//       buffer in video memory. DirectDraw fills one in system memory a
+//       pixel at a time, so that is done here with Fill_Surface() instead.
+//-----------------------------------------------------------------------------
+HRESULT CDisplay::FillRect( const RECT* prc, DWORD dwColor )
 {
     if( NULL == m_pddsBackBuffer )
         return E_POINTER;
 
-    // Erase the background
+    if( IsInSystemMemory( m_pddsBackBuffer ) )
+        return Fill_Surface( m_pddsBackBuffer, prc, dwColor );
+
     DDBLTFX ddbltfx;
     ZeroMemory( &ddbltfx, sizeof(ddbltfx) );
     ddbltfx.dwSize      = sizeof(ddbltfx);
     ddbltfx.dwFillColor = dwColor;
 
-    return m_pddsBackBuffer->Blt( NULL, NULL, NULL, DDBLT_COLORFILL, &ddbltfx );
+    return m_pddsBackBuffer->Blt( (RECT*)prc, NULL, NULL, DDBLT_COLORFILL, &ddbltfx );
 }
 
 
@@ -700,6 +1103,8 @@ CSurface::CSurface()
 {
     m_pdds = NULL;
     m_bColorKeyed = NULL;
+    m_dwColorKey = 0;
+    m_pBlitter = NULL;
 }
 
 
@@ -717,6 +1122,32 @@ CSurface::~CSurface()
 
 
 
+//-----------------------------------------------------------------------------
+// Name: CSurface::operator new() and operator delete()
+// Desc: Takes CSurfaces from g_SurfacePool, only going to the heap if the
+//       pool has run dry
+//-----------------------------------------------------------------------------
+void* CSurface::operator new( size_t cb )
+{
+    VOID* p = g_SurfacePool.Alloc();
+    if( p )
+        return p;
+
+    DXTRACE( TEXT("Surface pool is full, falling back to the heap\n") );
+    return ::operator new( cb );
+}
+
+void CSurface::operator delete( void* p )
+{
+    if( g_SurfacePool.Owns( p ) )
+        g_SurfacePool.Free( p );
+    else
+        ::operator delete( p );
+}
+
+
+
+
 //-----------------------------------------------------------------------------
 // Name: 
 // Desc: 
@@ -764,6 +1195,72 @@ HRESULT CSurface::Create( LPDIRECTDRAW7 pDD, DDSURFACEDESC2* pddsd )
 
 
 
+//-----------------------------------------------------------------------------
+// Name: CSurface::Reset()
+// Desc: Recreates the DirectDraw surface on pDD with the same size and caps,
+//       e.g. after a display mode change, and puts back the color key. The
+//       CSurface itself stays put so anything pointing at it stays valid,
+//       but the contents are lost and need to be redrawn.
+//-----------------------------------------------------------------------------
+HRESULT CSurface::Reset( LPDIRECTDRAW7 pDD )
+{
+    HRESULT hr;
+
+    if( NULL == m_pdds || NULL == pDD )
+        return E_POINTER;
+
+    DDSURFACEDESC2 ddsd;
+    ZeroMemory( &ddsd, sizeof(ddsd) );
+    ddsd.dwSize         = sizeof(ddsd);
+    ddsd.dwFlags        = DDSD_CAPS | DDSD_WIDTH | DDSD_HEIGHT;
+    ddsd.ddsCaps.dwCaps = m_ddsd.ddsCaps.dwCaps & ( DDSCAPS_OFFSCREENPLAIN | DDSCAPS_3DDEVICE |
+                                                    DDSCAPS_SYSTEMMEMORY );
+    ddsd.dwWidth        = m_ddsd.dwWidth;
+    ddsd.dwHeight       = m_ddsd.dwHeight;
+
+    // An alpha surface keeps its format; others take the display's
+    if( m_ddsd.ddpfPixelFormat.dwFlags & DDPF_ALPHAPIXELS )
+    {
+        ddsd.dwFlags        |= DDSD_PIXELFORMAT;
+        ddsd.ddpfPixelFormat = m_ddsd.ddpfPixelFormat;
+    }
+
+    SAFE_RELEASE( m_pdds );
+
+    if( FAILED( hr = Create( pDD, &ddsd ) ) )
+        return hr;
+
+    if( m_bColorKeyed )
+        return SetColorKey( m_dwColorKey );
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CSurface::Resize()
+// Desc: Recreates the surface in place at a new size, keeping its colour
+//       key, so handles to this CSurface stay good. Its contents are lost
+//       and have to be drawn again.
+//-----------------------------------------------------------------------------
+HRESULT CSurface::Resize( LPDIRECTDRAW7 pDD, DWORD dwWidth, DWORD dwHeight )
+{
+    if( NULL == m_pdds || NULL == pDD )
+        return E_POINTER;
+    if( dwWidth == 0 || dwHeight == 0 )
+        return E_INVALIDARG;
+
+    m_ddsd.dwWidth  = dwWidth;
+    m_ddsd.dwHeight = dwHeight;
+
+    return Reset( pDD );
+}
+
+
+
+
 //-----------------------------------------------------------------------------
 // Name: 
 // Desc: 
@@ -780,11 +1277,13 @@ HRESULT CSurface::Destroy()
 //-----------------------------------------------------------------------------
 // Name: CSurface::DrawBitmap()
 // Desc: Draws a bitmap over an entire DirectDrawSurface, stretching the 
-//       bitmap if nessasary
+//       bitmap if nessasary. 32 bit surfaces are scaled with filter by
+//       ResampleBitmap(); others, such as palettized ones, go through GDI.
 //-----------------------------------------------------------------------------
 HRESULT CSurface::DrawBitmap( HBITMAP hBMP, 
                               DWORD dwBMPOriginX, DWORD dwBMPOriginY, 
-                              DWORD dwBMPWidth, DWORD dwBMPHeight )
+                              DWORD dwBMPWidth, DWORD dwBMPHeight,
+                              ResampleFilter filter )
 {
     HDC            hDCImage;
     HDC            hDC;
@@ -806,13 +1305,6 @@ HRESULT CSurface::DrawBitmap( HBITMAP hBMP,
     if( ddsd.ddpfPixelFormat.dwFlags == DDPF_FOURCC )
         return E_NOTIMPL;
 
-    // Select bitmap into a memoryDC so we can use it.
-    hDCImage = CreateCompatibleDC( NULL );
-    if( NULL == hDCImage )
-        return E_FAIL;
-
-    SelectObject( hDCImage, hBMP );
-
     // Get size of the bitmap
     GetObject( hBMP, sizeof(bmp), &bmp );
 
@@ -820,6 +1312,26 @@ HRESULT CSurface::DrawBitmap( HBITMAP hBMP,
     dwBMPWidth  = ( dwBMPWidth  == 0 ) ? bmp.bmWidth  : dwBMPWidth;     
     dwBMPHeight = ( dwBMPHeight == 0 ) ? bmp.bmHeight : dwBMPHeight;
 
+    // GetDIBits() gives pixels as blue, green, red and a spare byte, the
+    // same as a 32 bit surface with the usual masks
+    if( ddsd.ddpfPixelFormat.dwRGBBitCount == 32 &&
+        ddsd.ddpfPixelFormat.dwRBitMask == 0x00FF0000 &&
+        ddsd.ddpfPixelFormat.dwGBitMask == 0x0000FF00 &&
+        ddsd.ddpfPixelFormat.dwBBitMask == 0x000000FF &&
+        dwBMPOriginX + dwBMPWidth  <= (DWORD)bmp.bmWidth &&
+        dwBMPOriginY + dwBMPHeight <= (DWORD)bmp.bmHeight )
+    {
+        return ResampleBitmap( hBMP, &bmp, dwBMPOriginX, dwBMPOriginY, 
+                               dwBMPWidth, dwBMPHeight, filter );
+    }
+
+    // Select bitmap into a memoryDC so we can use it.
+    hDCImage = CreateCompatibleDC( NULL );
+    if( NULL == hDCImage )
+        return E_FAIL;
+
+    SelectObject( hDCImage, hBMP );
+
     // Stretch the bitmap to cover this surface
     if( FAILED( hr = m_pdds->GetDC( &hDC ) ) )
         return hr;
@@ -840,10 +1352,120 @@ HRESULT CSurface::DrawBitmap( HBITMAP hBMP,
 
 
 
+//-----------------------------------------------------------------------------
+// Name: PremultiplyPixels()
+// Desc: Scales pixels from GetDIBits() by their alpha. A bitmap without
+//       alpha, where every top byte is 0, is opaque except for the GDI
+//       colour crColorKey if it is keyed, so keyed sprites load as alpha
+//       sprites without changing their files.
+//-----------------------------------------------------------------------------
+static VOID PremultiplyPixels( DWORD* pdwBits, DWORD dwCount, BOOL bColorKeyed, COLORREF crColorKey )
+{
+    DWORD dwKey  = ( GetRValue( crColorKey ) << 16 ) | ( GetGValue( crColorKey ) << 8 ) | GetBValue( crColorKey );
+    BOOL  bAlpha = FALSE;
+
+    for( DWORD i = 0; i < dwCount && !bAlpha; i++ )
+        bAlpha = ( pdwBits[i] >> 24 ) != 0;
+
+    for( DWORD i = 0; i < dwCount; i++ )
+    {
+        DWORD dwPixel = pdwBits[i];
+        DWORD dwAlpha = bAlpha ? ( dwPixel >> 24 ) : 255;
+
+        if( !bAlpha && bColorKeyed && ( dwPixel & 0x00FFFFFF ) == dwKey )
+            dwAlpha = 0;
+
+        DWORD dwOut = dwAlpha << 24;
+        for( DWORD dwShift = 0; dwShift < 24; dwShift += 8 )
+        {
+            DWORD dwX = ( ( dwPixel >> dwShift ) & 0xFF ) * dwAlpha + 128;
+            dwOut |= ( ( dwX + ( dwX >> 8 ) ) >> 8 ) << dwShift;
+        }
+
+        pdwBits[i] = dwOut;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CSurface::ResampleBitmap()
+// Desc: Scales part of a bitmap over the whole of this 32 bit surface with
+//       a CResampler, or copies it if the sizes are the same
+//-----------------------------------------------------------------------------
+HRESULT CSurface::ResampleBitmap( HBITMAP hBMP, const BITMAP* pBmp,
+                                  DWORD dwBMPOriginX, DWORD dwBMPOriginY,
+                                  DWORD dwBMPWidth, DWORD dwBMPHeight,
+                                  ResampleFilter filter )
+{
+    DDSURFACEDESC2 ddsd;
+    BITMAPINFO     bmi;
+    CResampler&    resampler = g_BitmapScratch.resampler;
+    HRESULT        hr;
+
+    // Ask for the whole bitmap as 32 bit pixels, top row first
+    ZeroMemory( &bmi, sizeof(bmi) );
+    bmi.bmiHeader.biSize        = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth       = pBmp->bmWidth;
+    bmi.bmiHeader.biHeight      = -pBmp->bmHeight;
+    bmi.bmiHeader.biPlanes      = 1;
+    bmi.bmiHeader.biBitCount    = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    DWORD* pdwBits = g_BitmapScratch.GetBits( pBmp->bmWidth * pBmp->bmHeight );
+    if( NULL == pdwBits )
+        return E_OUTOFMEMORY;
+
+    HDC hDC    = GetDC( NULL );
+    int nLines = GetDIBits( hDC, hBMP, 0, pBmp->bmHeight, pdwBits, &bmi, DIB_RGB_COLORS );
+    ReleaseDC( NULL, hDC );
+
+    if( nLines != pBmp->bmHeight )
+        return E_FAIL;
+
+    // Premultiplied before scaling, so the filters blend edges properly
+    if( IsPremultiplied() )
+        PremultiplyPixels( pdwBits, pBmp->bmWidth * pBmp->bmHeight, m_bColorKeyed, m_dwColorKey );
+
+    ZeroMemory( &ddsd, sizeof(ddsd) );
+    ddsd.dwSize = sizeof(ddsd);
+    m_pdds->GetSurfaceDesc( &ddsd );
+
+    if( !resampler.Matches( dwBMPWidth, dwBMPHeight, ddsd.dwWidth, ddsd.dwHeight, filter ) &&
+        FAILED( hr = resampler.Create( dwBMPWidth, dwBMPHeight, ddsd.dwWidth, ddsd.dwHeight, filter ) ) )
+        return hr;
+
+    if( FAILED( hr = m_pdds->Lock( NULL, &ddsd, DDLOCK_WAIT | DDLOCK_WRITEONLY, NULL ) ) )
+        return hr;
+
+    RESAMPLE_IMAGE src;
+    src.pBits    = (BYTE*)( pdwBits + dwBMPOriginY * pBmp->bmWidth + dwBMPOriginX );
+    src.lPitch   = pBmp->bmWidth * sizeof(DWORD);
+    src.dwWidth  = dwBMPWidth;
+    src.dwHeight = dwBMPHeight;
+
+    RESAMPLE_IMAGE dest;
+    dest.pBits    = (BYTE*)ddsd.lpSurface;
+    dest.lPitch   = ddsd.lPitch;
+    dest.dwWidth  = ddsd.dwWidth;
+    dest.dwHeight = ddsd.dwHeight;
+
+    hr = resampler.Run( &dest, &src );
+
+    m_pdds->Unlock( NULL );
+
+    return hr;
+}
+
+
+
+
 //-----------------------------------------------------------------------------
 // Name: CSurface::DrawText()
 // Desc: Draws a text string on a DirectDraw surface using hFont or the default
-//       GDI font if hFont is NULL.  
+//       GDI font if hFont is NULL. An alpha surface is drawn by
+//       DrawAlphaText(), with a clear background whatever crBackground is.
 //-----------------------------------------------------------------------------
 HRESULT CSurface::DrawText( HFONT hFont, TCHAR* strText, 
                             DWORD dwOriginX, DWORD dwOriginY,
@@ -859,6 +1481,9 @@ HRESULT CSurface::DrawText( HFONT hFont, TCHAR* strText,
     if( FAILED( hr = m_pdds->Restore() ) )
         return hr;
 
+    if( IsPremultiplied() )
+        return DrawAlphaText( hFont, strText, dwOriginX, dwOriginY, crForeground );
+
     if( FAILED( hr = m_pdds->GetDC( &hDC ) ) )
         return hr;
 
@@ -881,13 +1506,99 @@ HRESULT CSurface::DrawText( HFONT hFont, TCHAR* strText,
 
 
 
+//-----------------------------------------------------------------------------
+// Name: CSurface::DrawAlphaText()
+// Desc: GDI draws the text on black in a DIB section the size of this
+//       surface, as it can't be trusted with an alpha surface's top byte.
+//       Each pixel's alpha is then how much of the foreground it has, which
+//       leaves its colour already premultiplied. Everything else on the
+//       surface is cleared. The foreground can't be black.
+//-----------------------------------------------------------------------------
+HRESULT CSurface::DrawAlphaText( HFONT hFont, TCHAR* strText, DWORD dwOriginX, DWORD dwOriginY,
+                                 COLORREF crForeground )
+{
+    DDSURFACEDESC2 ddsd;
+    BITMAPINFO     bmi;
+    VOID*          pvBits = NULL;
+    HRESULT        hr;
+
+    DWORD dwForeMax = max( GetRValue( crForeground ), max( GetGValue( crForeground ), GetBValue( crForeground ) ) );
+    if( dwForeMax == 0 )
+        return E_INVALIDARG;
+
+    ZeroMemory( &ddsd, sizeof(ddsd) );
+    ddsd.dwSize = sizeof(ddsd);
+    m_pdds->GetSurfaceDesc( &ddsd );
+
+    ZeroMemory( &bmi, sizeof(bmi) );
+    bmi.bmiHeader.biSize        = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth       = ddsd.dwWidth;
+    bmi.bmiHeader.biHeight      = -(LONG)ddsd.dwHeight;
+    bmi.bmiHeader.biPlanes      = 1;
+    bmi.bmiHeader.biBitCount    = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    HDC     hDC  = CreateCompatibleDC( NULL );
+    HBITMAP hDIB = hDC ? CreateDIBSection( hDC, &bmi, DIB_RGB_COLORS, &pvBits, NULL, 0 ) : NULL;
+    if( NULL == hDIB )
+    {
+        if( hDC )
+            DeleteDC( hDC );
+        return E_FAIL;
+    }
+
+    HGDIOBJ hOldBitmap = SelectObject( hDC, hDIB );
+    ZeroMemory( pvBits, ddsd.dwWidth * ddsd.dwHeight * sizeof(DWORD) );
+
+    SetBkMode( hDC, TRANSPARENT );
+    SetTextColor( hDC, crForeground );
+    if( hFont )
+        SelectObject( hDC, hFont );
+
+    TextOut( hDC, dwOriginX, dwOriginY, strText, _tcslen(strText) );
+    GdiFlush();
+
+    if( SUCCEEDED( hr = m_pdds->Lock( NULL, &ddsd, DDLOCK_WAIT | DDLOCK_WRITEONLY, NULL ) ) )
+    {
+        for( DWORD y = 0; y < ddsd.dwHeight; y++ )
+        {
+            const DWORD* pdwSrc  = (const DWORD*)pvBits + y * ddsd.dwWidth;
+            DWORD*       pdwDest = (DWORD*)( (BYTE*)ddsd.lpSurface + y * ddsd.lPitch );
+
+            for( DWORD x = 0; x < ddsd.dwWidth; x++ )
+            {
+                DWORD dwPixel = pdwSrc[x] & 0x00FFFFFF;
+                DWORD dwMax   = max( dwPixel >> 16, max( ( dwPixel >> 8 ) & 0xFF, dwPixel & 0xFF ) );
+                DWORD dwAlpha = min( dwMax * 255 / dwForeMax, 255 );
+
+                pdwDest[x] = ( dwAlpha << 24 ) | dwPixel;
+            }
+        }
+
+        m_pdds->Unlock( NULL );
+    }
+
+    SelectObject( hDC, hOldBitmap );
+    DeleteObject( hDIB );
+    DeleteDC( hDC );
+
+    return hr;
+}
+
+
+
+
 //-----------------------------------------------------------------------------
 // Name: CSurface::ReDrawBitmapOnSurface()
 // Desc: Load a bitmap from a file or resource into a DirectDraw surface.
-//       normaly used to re-load a surface after a restore.
+//       normaly used to re-load a surface after a restore. The bitmap is
+//       always loaded at its own size and DrawBitmap() scales it to the
+//       surface with filter, nearest included, so GDI never scales it. The
+//       desired size is that of the surface, which is already known.
 //-----------------------------------------------------------------------------
 HRESULT CSurface::DrawBitmap( TCHAR* strBMP, 
-                              DWORD dwDesiredWidth, DWORD dwDesiredHeight  )
+                              DWORD dwDesiredWidth, DWORD dwDesiredHeight,
+                              ResampleFilter filter )
 {
     HBITMAP hBMP;
     HRESULT hr;
@@ -897,19 +1608,17 @@ HRESULT CSurface::DrawBitmap( TCHAR* strBMP,
 
     //  Try to load the bitmap as a resource, if that fails, try it as a file
     hBMP = (HBITMAP) LoadImage( GetModuleHandle(NULL), strBMP, 
-                                IMAGE_BITMAP, dwDesiredWidth, dwDesiredHeight, 
-                                LR_CREATEDIBSECTION );
+                                IMAGE_BITMAP, 0, 0, LR_CREATEDIBSECTION );
     if( hBMP == NULL )
     {
-        hBMP = (HBITMAP) LoadImage( NULL, strBMP, IMAGE_BITMAP, 
-                                    dwDesiredWidth, dwDesiredHeight, 
+        hBMP = (HBITMAP) LoadImage( NULL, strBMP, IMAGE_BITMAP, 0, 0,
                                     LR_LOADFROMFILE | LR_CREATEDIBSECTION );
         if( hBMP == NULL )
             return E_FAIL;
     }
 
     // Draw the bitmap on this surface
-    if( FAILED( hr = DrawBitmap( hBMP, 0, 0, 0, 0 ) ) )
+    if( FAILED( hr = DrawBitmap( hBMP, 0, 0, 0, 0, filter ) ) )
     {
         DeleteObject( hBMP );
         return hr;
@@ -933,6 +1642,7 @@ HRESULT CSurface::SetColorKey( DWORD dwColorKey )
         return E_POINTER;
 
     m_bColorKeyed = TRUE;
+    m_dwColorKey  = dwColorKey;
 
     DDCOLORKEY ddck;
     ddck.dwColorSpaceLowValue  = ConvertGDIColor( dwColorKey );
@@ -944,6 +1654,145 @@ HRESULT CSurface::SetColorKey( DWORD dwColorKey )
 
 
 
+//-----------------------------------------------------------------------------
+// Name: FindBlitter()
+// Desc: The cached blitter for a pair of formats, flags and key, made in the
+//       next slot round if none matches. A blitter that can't be made
+//       leaves its slot empty, so the next one made goes there.
+//-----------------------------------------------------------------------------
+static HRESULT FindBlitter( const DDPIXELFORMAT* pddpfSrc, const DDPIXELFORMAT* pddpfDest,
+                            DWORD dwFlags, DWORD dwColorKey, CBlitter** ppBlitter )
+{
+    HRESULT hr;
+
+    for( DWORD i = 0; i < BLITTER_CACHE_SIZE; i++ )
+    {
+        if( g_aBlitterCache[i].Matches( pddpfSrc, pddpfDest, dwFlags, dwColorKey ) )
+        {
+            *ppBlitter = &g_aBlitterCache[i];
+            return S_OK;
+        }
+    }
+
+    CBlitter* pBlitter = &g_aBlitterCache[g_dwNextBlitter];
+    if( FAILED( hr = pBlitter->Create( pddpfSrc, pddpfDest, dwFlags, dwColorKey ) ) )
+        return hr;
+
+    g_dwNextBlitter = ( g_dwNextBlitter + 1 ) % BLITTER_CACHE_SIZE;
+    *ppBlitter      = pBlitter;
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CSurface::BltTo()
+// Desc: Blts this surface, or prc of it, to x, y on another with a CBlitter,
+//       blended if it has alpha or else colour keyed if it has a key, and
+//       clipped to the destination. The destination is locked around the
+//       one blt.
+//-----------------------------------------------------------------------------
+HRESULT CSurface::BltTo( LPDIRECTDRAWSURFACE7 pddsDest, DWORD x, DWORD y, RECT* prc )
+{
+    DDSURFACEDESC2 ddsdDest;
+    HRESULT        hr;
+
+    if( NULL == pddsDest )
+        return E_POINTER;
+
+    ZeroMemory( &ddsdDest, sizeof(ddsdDest) );
+    ddsdDest.dwSize = sizeof(ddsdDest);
+
+    if( FAILED( hr = pddsDest->Lock( NULL, &ddsdDest, DDLOCK_WAIT, NULL ) ) )
+        return hr;
+
+    BLIT_IMAGE dest = { (BYTE*)ddsdDest.lpSurface, ddsdDest.lPitch, ddsdDest.dwWidth, ddsdDest.dwHeight };
+
+    hr = BltTo( &dest, &ddsdDest.ddpfPixelFormat, x, y, prc );
+
+    pddsDest->Unlock( NULL );
+
+    return hr;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CSurface::BltTo()
+// Desc: Blts to an image that is already locked, such as the back buffer
+//       in a batch, locking only this surface
+//-----------------------------------------------------------------------------
+HRESULT CSurface::BltTo( BLIT_IMAGE* pDest, const DDPIXELFORMAT* pddpfDest, DWORD x, DWORD y, RECT* prc )
+{
+    POINT pt = { (LONG)x, (LONG)y };
+
+    return BltTo( pDest, pddpfDest, &pt, 1, prc );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CSurface::BltTo()
+// Desc: Blts this surface to each of dwCount points on a locked image,
+//       locking it once for all of them. The blitter is looked up in the
+//       cache again only when the destination's format or the key changes.
+//-----------------------------------------------------------------------------
+HRESULT CSurface::BltTo( BLIT_IMAGE* pDest, const DDPIXELFORMAT* pddpfDest, const POINT* pPoints, DWORD dwCount,
+                         RECT* prc )
+{
+    DDSURFACEDESC2 ddsdSrc;
+    HRESULT        hr;
+    HRESULT        hrBlt;
+
+    if( NULL == m_pdds || NULL == pDest || NULL == pddpfDest || NULL == pPoints )
+        return E_POINTER;
+
+    ZeroMemory( &ddsdSrc, sizeof(ddsdSrc) );
+    ddsdSrc.dwSize = sizeof(ddsdSrc);
+
+    if( FAILED( hr = m_pdds->GetSurfaceDesc( &ddsdSrc ) ) )
+        return hr;
+
+    DWORD      dwFlags    = BLIT_CLIP;
+    DWORD      dwColorKey = 0;
+    DDCOLORKEY ddck;
+
+    if( m_bColorKeyed && !IsPremultiplied() && SUCCEEDED( m_pdds->GetColorKey( DDCKEY_SRCBLT, &ddck ) ) )
+    {
+        dwFlags   |= BLIT_COLORKEY;
+        dwColorKey = ddck.dwColorSpaceLowValue;
+    }
+    if( ddsdSrc.ddpfPixelFormat.dwFlags & DDPF_ALPHAPIXELS )
+        dwFlags |= BLIT_ALPHA;
+
+    if( ( NULL == m_pBlitter ||
+          !m_pBlitter->Matches( &ddsdSrc.ddpfPixelFormat, pddpfDest, dwFlags, dwColorKey ) ) &&
+        FAILED( hr = FindBlitter( &ddsdSrc.ddpfPixelFormat, pddpfDest, dwFlags, dwColorKey, &m_pBlitter ) ) )
+        return hr;
+
+    if( FAILED( hr = m_pdds->Lock( NULL, &ddsdSrc, DDLOCK_WAIT | DDLOCK_READONLY, NULL ) ) )
+        return hr;
+
+    BLIT_IMAGE src = { (BYTE*)ddsdSrc.lpSurface, ddsdSrc.lPitch, ddsdSrc.dwWidth, ddsdSrc.dwHeight };
+
+    for( DWORD i = 0; i < dwCount; i++ )
+    {
+        if( FAILED( hrBlt = m_pBlitter->Blt( pDest, pPoints[i].x, pPoints[i].y, &src, prc ) ) )
+            hr = hrBlt;
+    }
+
+    m_pdds->Unlock( NULL );
+
+    return hr;
+}
+
+
+
+
 
 //-----------------------------------------------------------------------------
 // Name: CSurface::ConvertGDIColor()
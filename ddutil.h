@@ -10,6 +10,9 @@
 
 #include <ddraw.h>
 #include <d3d.h>
+#include "handle.h"
+#include "resample.h"
+#include "blitter.h"
 
 
 
@@ -50,6 +53,17 @@ protected:
     RECT                 m_rcWindow;
     BOOL                 m_bWindowed;
     BOOL                 m_bStereo;
+    DWORD                m_dwBackBufferCount;  // Behind the front buffer when full screen
+    BOOL                 m_bBatching;          // The back buffer is locked by BeginBatch()
+    BLIT_IMAGE           m_BatchDest;
+    DDPIXELFORMAT        m_ddpfBatch;
+
+    HRESULT CreateWindowedBuffers( DWORD dwWidth, DWORD dwHeight );
+    HRESULT CreateFullScreenBuffers();
+
+    // Owned through a CDisplayHandle, never copied
+    CDisplay( const CDisplay& );
+    CDisplay& operator=( const CDisplay& );
 
 public:
     CDisplay();
@@ -68,34 +82,48 @@ public:
 
     // Creation/destruction methods
     HRESULT CreateFullScreenDisplay( HWND hWnd, DWORD dwWidth, DWORD dwHeight,
-		                             DWORD dwBPP );
+		                             DWORD dwBPP, DWORD dwBackBufferCount = 1 );
     HRESULT CreateWindowedDisplay( HWND hWnd, DWORD dwWidth, DWORD dwHeight );
     HRESULT InitClipper();
     HRESULT UpdateBounds();
+    HRESULT ResetObjects();
+    HRESULT ResizeBackBuffer( DWORD dwWidth, DWORD dwHeight );
     virtual HRESULT DestroyObjects();
 
     // Methods to create child objects
     HRESULT CreateSurface( CSurface** ppSurface, DWORD dwWidth,
 		                   DWORD dwHeight );
+    HRESULT CreateAlphaSurface( CSurface** ppSurface, DWORD dwWidth,
+                                DWORD dwHeight );
     HRESULT CreateSurfaceFromBitmap( CSurface** ppSurface, TCHAR* strBMP,
 		                             DWORD dwDesiredWidth,
 									 DWORD dwDesiredHeight );
     HRESULT CreateSurfaceFromText( CSurface** ppSurface, HFONT hFont,
 		                           TCHAR* strText, 
 								   COLORREF crBackground,
-								   COLORREF crForeground );
+								   COLORREF crForeground,
+								   BOOL bAlpha = FALSE );
     HRESULT CreatePaletteFromBitmap( LPDIRECTDRAWPALETTE* ppPalette, const TCHAR* strBMP );
 
     // Display methods
     HRESULT Clear( DWORD dwColor = 0L );
+    HRESULT FillRect( const RECT* prc, DWORD dwColor );
     HRESULT ColorKeyBlt( DWORD x, DWORD y, LPDIRECTDRAWSURFACE7 pdds,
                          RECT* prc = NULL );
     HRESULT Blt( DWORD x, DWORD y, LPDIRECTDRAWSURFACE7 pdds,
 		         RECT* prc=NULL, DWORD dwFlags=0 );
     HRESULT Blt( DWORD x, DWORD y, CSurface* pSurface, RECT* prc = NULL );
+    HRESULT Blt( const POINT* pPoints, DWORD dwCount, CSurface* pSurface, RECT* prc = NULL );
     HRESULT ShowBitmap( HBITMAP hbm, LPDIRECTDRAWPALETTE pPalette=NULL );
     HRESULT SetPalette( LPDIRECTDRAWPALETTE pPalette );
-    HRESULT Present();
+    HRESULT Present( DWORD dwFlipFlags = DDFLIP_WAIT );
+
+    // Keeps a back buffer in system memory locked across a run of
+    // Blt( CSurface ) calls, which then only lock their sources. Nothing
+    // else may draw on the back buffer until EndBatch(). S_FALSE if the
+    // back buffer is in video memory, where the card does the blts.
+    HRESULT BeginBatch();
+    HRESULT EndBatch();
 };
 
 
@@ -110,14 +138,30 @@ class CSurface
     LPDIRECTDRAWSURFACE7 m_pdds;
     DDSURFACEDESC2       m_ddsd;
     BOOL                 m_bColorKeyed;
+    DWORD                m_dwColorKey;
+    CBlitter*            m_pBlitter;       // For BltTo(), shared by every surface of the same format
+
+    HRESULT ResampleBitmap( HBITMAP hBMP, const BITMAP* pBmp,
+                            DWORD dwBMPOriginX, DWORD dwBMPOriginY,
+                            DWORD dwBMPWidth, DWORD dwBMPHeight,
+                            ResampleFilter filter );
+    HRESULT DrawAlphaText( HFONT hFont, TCHAR* strText, DWORD dwOriginX, DWORD dwOriginY,
+                           COLORREF crForeground );
+
+    // Owned through a CSurfaceHandle, never copied
+    CSurface( const CSurface& );
+    CSurface& operator=( const CSurface& );
 
 public:
     LPDIRECTDRAWSURFACE7 GetDDrawSurface() { return m_pdds; }
     BOOL                 IsColorKeyed()    { return m_bColorKeyed; }
+    BOOL                 IsPremultiplied() { return ( m_ddsd.ddpfPixelFormat.dwFlags & DDPF_ALPHAPREMULT ) != 0; }
 
     HRESULT DrawBitmap( HBITMAP hBMP, DWORD dwBMPOriginX = 0, DWORD dwBMPOriginY = 0, 
-		                DWORD dwBMPWidth = 0, DWORD dwBMPHeight = 0 );
-    HRESULT DrawBitmap( TCHAR* strBMP, DWORD dwDesiredWidth, DWORD dwDesiredHeight );
+		                DWORD dwBMPWidth = 0, DWORD dwBMPHeight = 0,
+		                ResampleFilter filter = resampleNearest );
+    HRESULT DrawBitmap( TCHAR* strBMP, DWORD dwDesiredWidth, DWORD dwDesiredHeight,
+                        ResampleFilter filter = resampleNearest );
     HRESULT DrawText( HFONT hFont, TCHAR* strText, DWORD dwOriginX, DWORD dwOriginY,
 		              COLORREF crBackground, COLORREF crForeground );
 
@@ -125,10 +169,23 @@ public:
     DWORD   ConvertGDIColor( COLORREF dwGDIColor );
     static HRESULT GetBitMaskInfo( DWORD dwBitMask, DWORD* pdwShift, DWORD* pdwBits );
 
+    // Blts on the processor, for a destination in system memory, or one
+    // already locked in a batch
+    HRESULT BltTo( LPDIRECTDRAWSURFACE7 pddsDest, DWORD x, DWORD y, RECT* prc = NULL );
+    HRESULT BltTo( BLIT_IMAGE* pDest, const DDPIXELFORMAT* pddpfDest, DWORD x, DWORD y, RECT* prc = NULL );
+    HRESULT BltTo( BLIT_IMAGE* pDest, const DDPIXELFORMAT* pddpfDest, const POINT* pPoints, DWORD dwCount,
+                   RECT* prc = NULL );
+
     HRESULT Create( LPDIRECTDRAW7 pDD, DDSURFACEDESC2* pddsd );
     HRESULT Create( LPDIRECTDRAWSURFACE7 pdds );
+    HRESULT Reset( LPDIRECTDRAW7 pDD );
+    HRESULT Resize( LPDIRECTDRAW7 pDD, DWORD dwWidth, DWORD dwHeight );
     HRESULT Destroy();
 
+    // CSurfaces come from a fixed pool rather than the heap
+    static void* operator new( size_t cb );
+    static void  operator delete( void* p );
+
     CSurface();
     ~CSurface();
 };
@@ -136,5 +193,15 @@ public:
 
 
 
+//-----------------------------------------------------------------------------
+// Owning handles for the display objects
+//-----------------------------------------------------------------------------
+typedef CHandle<CDisplay>                           CDisplayHandle;
+typedef CHandle<CSurface>                           CSurfaceHandle;
+typedef CHandle<IDirectDrawPalette, CReleasePolicy> CPaletteHandle;
+
+
+
+
 #endif // DDUTIL_H
 
@@ -13,6 +13,7 @@
 #include <stdio.h> 
 #include <stdarg.h>
 #include "DXUtil.h"
+#include "logger.h"
 
 
 
@@ -619,22 +620,16 @@ VOID DXUtil_ConvertWideStringToGeneric( TCHAR* tstrDestination, const WCHAR* wst
 
 //-----------------------------------------------------------------------------
 // Name: _DbgOut()
-// Desc: Outputs a message to the debug stream
+// Desc: Outputs a message to the debug stream. The message is queued for
+//       the logger's writer thread, so strFile and strMsg must outlive the
+//       call (__FILE__ and string literals do).
 //-----------------------------------------------------------------------------
 HRESULT _DbgOut( TCHAR* strFile, DWORD dwLine, HRESULT hr, TCHAR* strMsg )
 {
-    TCHAR buffer[256];
-    wsprintf( buffer, _T("%s(%ld): "), strFile, dwLine );
-    OutputDebugString( buffer );
-    OutputDebugString( strMsg );
-
     if( hr )
-    {
-        wsprintf( buffer, _T("(hr=%08lx)\n"), hr );
-        OutputDebugString( buffer );
-    }
-
-    OutputDebugString( _T("\n") );
+        Log_Write( _T("%s(%ld): %s(hr=%08lx)\n"), strFile, dwLine, strMsg, hr );
+    else
+        Log_Write( _T("%s(%ld): %s\n"), strFile, dwLine, strMsg );
 
     return hr;
 }
@@ -645,19 +640,16 @@ HRESULT _DbgOut( TCHAR* strFile, DWORD dwLine, HRESULT hr, TCHAR* strMsg )
 //-----------------------------------------------------------------------------
 // Name: DXUtil_Trace()
 // Desc: Outputs to the debug stream a formatted string with a variable-
-//       argument list.
+//       argument list. Formatting is deferred to the logger's writer
+//       thread, so any %s arguments must outlive the call.
 //-----------------------------------------------------------------------------
 VOID DXUtil_Trace( TCHAR* strMsg, ... )
 {
 #if defined(DEBUG) | defined(_DEBUG)
-    TCHAR strBuffer[512];
-    
     va_list args;
     va_start(args, strMsg);
-    _vsntprintf( strBuffer, 512, strMsg, args );
+    Log_WriteV( strMsg, args );
     va_end(args);
-
-    OutputDebugString( strBuffer );
 #else
     UNREFERENCED_PARAMETER(strMsg);
 #endif
@@ -0,0 +1,184 @@
+//-----------------------------------------------------------------------------
+// File: fill.cpp
+//
+// Desc: The SSE2 fill kernels, one for each pixel size and for cached or
+//       streaming stores.
+//-----------------------------------------------------------------------------
+#define STRICT
+#include <windows.h>
+#include <string.h>
+#include <ddraw.h>
+#include <emmintrin.h>
+#include "fill.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines, constants, and global variables
+//-----------------------------------------------------------------------------
+#define FILL_PATTERN_BYTES      64      // The colour repeated, enough for any phase
+
+typedef VOID (*FILLFN)( BYTE* pbRow, LONG lPitch, DWORD dwRowBytes, DWORD dwHeight,
+                        const BYTE* pbPattern );
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Store()
+// Desc: One aligned 16 byte store, streamed past the caches or not
+//-----------------------------------------------------------------------------
+template <BOOL STREAM>
+static inline VOID Store( BYTE* pb, __m128i v )
+{
+    if( STREAM )
+        _mm_stream_si128( (__m128i*)pb, v );
+    else
+        _mm_store_si128( (__m128i*)pb, v );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: FillRows()
+// Desc: Fills dwHeight rows of dwRowBytes from pbPattern, the colour
+//       repeated from its first byte. BYTES is the pixel size, so the phase
+//       of the pattern at each point is known to the compiler, and STREAM
+//       picks non-temporal stores.
+//
+//       After the unaligned head the pattern carries on from dwHead bytes
+//       in, so the registers are loaded from there. Every pixel size
+//       divides 48, so three registers cover any of them.
+//-----------------------------------------------------------------------------
+template <DWORD BYTES, BOOL STREAM>
+static VOID FillRows( BYTE* pbRow, LONG lPitch, DWORD dwRowBytes, DWORD dwHeight,
+                      const BYTE* pbPattern )
+{
+    for( DWORD y = 0; y < dwHeight; y++, pbRow += lPitch )
+    {
+        BYTE* pb     = pbRow;
+        BYTE* pbEnd  = pbRow + dwRowBytes;
+        DWORD dwHead = (DWORD)( ( 16 - ( (UINT_PTR)pb & 15 ) ) & 15 );
+
+        if( dwHead > dwRowBytes )
+            dwHead = dwRowBytes;
+
+        memcpy( pb, pbPattern, dwHead );
+        pb += dwHead;
+
+        const BYTE* pbPhase = pbPattern + dwHead % BYTES;
+        __m128i     a       = _mm_loadu_si128( (const __m128i*)pbPhase );
+        __m128i     b       = _mm_loadu_si128( (const __m128i*)( pbPhase + 16 ) );
+        __m128i     c       = _mm_loadu_si128( (const __m128i*)( pbPhase + 32 ) );
+        BYTE*       pbBody  = pb + ( ( pbEnd - pb ) & ~15 );
+
+        for( ; pb + 48 <= pbBody; pb += 48 )
+        {
+            Store<STREAM>( pb, a );
+            Store<STREAM>( pb + 16, b );
+            Store<STREAM>( pb + 32, c );
+        }
+
+        // Up to two more whole registers' worth, carrying on the pattern
+        if( pb < pbBody )
+        {
+            Store<STREAM>( pb, a );
+            pb += 16;
+        }
+
+        if( pb < pbBody )
+        {
+            Store<STREAM>( pb, b );
+            pb += 16;
+        }
+
+        memcpy( pb, pbPattern + (DWORD)( pb - pbRow ) % BYTES, pbEnd - pb );
+    }
+
+    // Streamed stores aren't ordered with the ones that follow without this
+    if( STREAM )
+        _mm_sfence();
+}
+
+
+
+
+// Indexed by streaming, then bytes per pixel less one
+static const FILLFN s_apfnFill[2][4] =
+{
+    { FillRows<1, FALSE>, FillRows<2, FALSE>, FillRows<3, FALSE>, FillRows<4, FALSE> },
+    { FillRows<1, TRUE>,  FillRows<2, TRUE>,  FillRows<3, TRUE>,  FillRows<4, TRUE>  },
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Fill_Rect()
+// Desc: Fills a rectangle of pixels with one colour
+//-----------------------------------------------------------------------------
+HRESULT Fill_Rect( BYTE* pBits, LONG lPitch, DWORD dwBitCount, DWORD dwWidth, DWORD dwHeight,
+                   DWORD dwColor, FillMode mode )
+{
+    if( NULL == pBits )
+        return E_INVALIDARG;
+    if( dwBitCount != 8 && dwBitCount != 16 && dwBitCount != 24 && dwBitCount != 32 )
+        return E_INVALIDARG;
+    if( dwWidth == 0 || dwHeight == 0 )
+        return S_OK;
+
+    DWORD dwBytes    = dwBitCount / 8;
+    DWORD dwRowBytes = dwWidth * dwBytes;
+
+    BYTE abPattern[FILL_PATTERN_BYTES];
+    for( DWORD i = 0; i < FILL_PATTERN_BYTES; i++ )
+        abPattern[i] = (BYTE)( dwColor >> ( 8 * ( i % dwBytes ) ) );
+
+    BOOL bStream = ( mode == fillStream ) ||
+                   ( mode == fillAuto && dwRowBytes * dwHeight >= FILL_STREAM_BYTES );
+
+    s_apfnFill[bStream ? 1 : 0][dwBytes - 1]( pBits, lPitch, dwRowBytes, dwHeight, abPattern );
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Fill_Surface()
+// Desc: Fills a rectangle of a lockable surface
+//-----------------------------------------------------------------------------
+HRESULT Fill_Surface( LPDIRECTDRAWSURFACE7 pdds, const RECT* prc, DWORD dwColor )
+{
+    HRESULT hr;
+
+    if( NULL == pdds )
+        return E_INVALIDARG;
+
+    DDSURFACEDESC2 ddsd;
+    ZeroMemory( &ddsd, sizeof(ddsd) );
+    ddsd.dwSize = sizeof(ddsd);
+
+    if( FAILED( hr = pdds->Lock( NULL, &ddsd, DDLOCK_WAIT | DDLOCK_WRITEONLY, NULL ) ) )
+        return hr;
+
+    RECT rc;
+    SetRect( &rc, 0, 0, ddsd.dwWidth, ddsd.dwHeight );
+    if( prc && !IntersectRect( &rc, &rc, prc ) )
+    {
+        pdds->Unlock( NULL );
+        return S_OK;
+    }
+
+    DWORD dwBitCount = ddsd.ddpfPixelFormat.dwRGBBitCount;
+    BYTE* pBits      = (BYTE*)ddsd.lpSurface + rc.top * ddsd.lPitch + rc.left * ( dwBitCount / 8 );
+
+    hr = Fill_Rect( pBits, ddsd.lPitch, dwBitCount, rc.right - rc.left, rc.bottom - rc.top, dwColor );
+
+    pdds->Unlock( NULL );
+
+    return hr;
+}
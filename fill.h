@@ -0,0 +1,54 @@
+//-----------------------------------------------------------------------------
+// File: fill.h
+//
+// Desc: Filling rectangles of 8, 16, 24 or 32 bit pixels with one colour,
+//       for memory the processor draws on: the software display's frame
+//       and DirectDraw surfaces in system memory, which DirectDraw's own
+//       DDBLT_COLORFILL fills a pixel at a time.
+//
+//       Rows are filled 16 bytes at a time with SSE2, from registers holding
+//       the colour repeated. A 24 bit colour repeats every 48 bytes, so it
+//       takes three registers; the others take one. Each row is written a
+//       byte at a time up to a 16 byte boundary so the rest of the stores
+//       are aligned, and there is one function for each pixel size.
+//
+//       A fill of FILL_STREAM_BYTES or more streams its stores around the
+//       caches, so clearing a whole 4K frame runs at the speed of memory
+//       rather than reading every line in to write over it. Smaller fills
+//       keep their pixels in cache for whatever is drawn on them next.
+//-----------------------------------------------------------------------------
+#ifndef FILL_H
+#define FILL_H
+
+#include <ddraw.h>
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+#define FILL_STREAM_BYTES       ( 1024 * 1024 )     // Auto fills this big stream
+
+enum FillMode { fillAuto, fillCached, fillStream };
+
+
+
+
+//-----------------------------------------------------------------------------
+// Function-prototypes
+//-----------------------------------------------------------------------------
+
+// pBits is the rectangle's top left pixel. dwColor is in the pixel's own
+// format, in its low dwBitCount bits.
+HRESULT Fill_Rect( BYTE* pBits, LONG lPitch, DWORD dwBitCount, DWORD dwWidth, DWORD dwHeight,
+                   DWORD dwColor, FillMode mode = fillAuto );
+
+// Locks the surface and fills prc, or all of it if prc is NULL, clipped
+// to the surface
+HRESULT Fill_Surface( LPDIRECTDRAWSURFACE7 pdds, const RECT* prc, DWORD dwColor );
+
+
+
+
+#endif // FILL_H
@@ -0,0 +1,172 @@
+//-----------------------------------------------------------------------------
+// File: framepacer.cpp
+//
+// Desc: Frame pacing, by flip interval or by the performance counter.
+//-----------------------------------------------------------------------------
+#define STRICT
+#include <windows.h>
+#include <mmsystem.h>
+#include <ddraw.h>
+#include "framepacer.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines, constants, and global variables
+//-----------------------------------------------------------------------------
+
+// The flag for a flip that waits for n refreshes, indexed by n
+static const DWORD s_adwFlipInterval[PACER_MAX_FLIP_INTERVAL + 1] =
+{
+    0, 0, DDFLIP_INTERVAL2, DDFLIP_INTERVAL3, DDFLIP_INTERVAL4
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CFramePacer()
+// Desc:
+//-----------------------------------------------------------------------------
+CFramePacer::CFramePacer()
+{
+    LARGE_INTEGER qwFreq;
+    QueryPerformanceFrequency( &qwFreq );
+    m_llFreq = qwFreq.QuadPart;
+
+    m_llInterval    = 0;
+    m_llNextPresent = 0;
+    m_dwFlipFlags   = DDFLIP_WAIT;
+    m_dwLate        = 0;
+    m_bTimerPeriod  = FALSE;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: ~CFramePacer()
+// Desc:
+//-----------------------------------------------------------------------------
+CFramePacer::~CFramePacer()
+{
+    Destroy();
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CFramePacer::Create()
+// Desc: Chooses the pacing. A target within 2% of the refresh rate divided
+//       by 1 to PACER_MAX_FLIP_INTERVAL is left to the flip, as monitors
+//       often report 59 or 60 for the same 59.94Hz. Anything else is paced
+//       on the timer, and flips still wait for a vertical blank so nothing
+//       tears.
+//-----------------------------------------------------------------------------
+HRESULT CFramePacer::Create( DWORD dwTargetFps, DWORD dwRefreshRate, BOOL bFlipping )
+{
+    Destroy();
+
+    // Unpaced, presenting the moment a frame is done
+    if( dwTargetFps == 0 )
+    {
+        m_dwFlipFlags = DDFLIP_WAIT | DDFLIP_NOVSYNC;
+        return S_OK;
+    }
+
+    // GetMonitorFrequency() gives 0 or 1 for the adapter's default rate
+    if( bFlipping && dwRefreshRate > 1 )
+    {
+        DWORD dwRefreshes = ( dwRefreshRate + dwTargetFps / 2 ) / dwTargetFps;
+        LONG  lError      = (LONG)( dwRefreshes * dwTargetFps ) - (LONG)dwRefreshRate;
+
+        if( dwRefreshes >= 1 && dwRefreshes <= PACER_MAX_FLIP_INTERVAL &&
+            labs( lError ) * 50 <= (LONG)dwRefreshRate )
+        {
+            m_dwFlipFlags = DDFLIP_WAIT | s_adwFlipInterval[dwRefreshes];
+            return S_OK;
+        }
+    }
+
+    // Sleep() is only accurate to the millisecond with the timer period
+    // turned down to one
+    m_llInterval   = m_llFreq / dwTargetFps;
+    m_dwFlipFlags  = DDFLIP_WAIT;
+    m_bTimerPeriod = ( timeBeginPeriod( 1 ) == TIMERR_NOERROR );
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CFramePacer::Destroy()
+// Desc:
+//-----------------------------------------------------------------------------
+VOID CFramePacer::Destroy()
+{
+    if( m_bTimerPeriod )
+        timeEndPeriod( 1 );
+
+    m_llInterval    = 0;
+    m_llNextPresent = 0;
+    m_dwFlipFlags   = DDFLIP_WAIT;
+    m_dwLate        = 0;
+    m_bTimerPeriod  = FALSE;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CFramePacer::Wait()
+// Desc: Holds the frame until its present is due when pacing on the timer.
+//       A frame that is due already goes straight away, and one a whole
+//       frame or more late restarts the schedule from itself.
+//-----------------------------------------------------------------------------
+VOID CFramePacer::Wait()
+{
+    if( m_llInterval == 0 )
+        return;
+
+    LONGLONG llNow = GetTime();
+
+    if( m_llNextPresent == 0 || llNow - m_llNextPresent >= m_llInterval )
+    {
+        if( m_llNextPresent != 0 )
+            m_dwLate++;
+
+        m_llNextPresent = llNow + m_llInterval;
+        return;
+    }
+
+    // Sleep through most of the wait, then spin so the present is on time
+    LONGLONG llSpin = m_llFreq * PACER_SPIN_MS / 1000;
+    while( m_llNextPresent - llNow > llSpin )
+    {
+        Sleep( (DWORD)( ( m_llNextPresent - llNow - llSpin ) * 1000 / m_llFreq ) );
+        llNow = GetTime();
+    }
+
+    while( llNow < m_llNextPresent )
+        llNow = GetTime();
+
+    m_llNextPresent += m_llInterval;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CFramePacer::GetTime()
+// Desc:
+//-----------------------------------------------------------------------------
+LONGLONG CFramePacer::GetTime()
+{
+    LARGE_INTEGER qwTime;
+    QueryPerformanceCounter( &qwTime );
+    return qwTime.QuadPart;
+}
@@ -0,0 +1,67 @@
+//-----------------------------------------------------------------------------
+// File: framepacer.h
+//
+// Desc: Keeps frames going to the screen at an even rate. When the display
+//       flips and the target rate divides its refresh rate, the flip itself
+//       waits for the right vertical blank, which is the smoothest pacing
+//       there is and costs nothing. Otherwise, windowed or at a rate the
+//       refresh doesn't divide, Wait() holds each present back until it is
+//       due on the performance counter, sleeping for most of the gap and
+//       spinning for the last millisecond.
+//
+//       Presents that come late are never made up for by hurrying the next
+//       ones; the schedule starts again from the late one.
+//-----------------------------------------------------------------------------
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+
+#include <ddraw.h>
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+#define PACER_MAX_FLIP_INTERVAL 4       // Most refreshes a flip can wait for
+#define PACER_SPIN_MS           1       // Left to spin out rather than sleep
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: class CFramePacer
+// Desc: Works out how each frame is paced from the target and refresh rates,
+//       then waits for presents and gives the flags to flip with
+//-----------------------------------------------------------------------------
+class CFramePacer
+{
+    LONGLONG    m_llFreq;
+    LONGLONG    m_llInterval;           // Counts between presents, 0 if the flip paces
+    LONGLONG    m_llNextPresent;        // When the next present is due, 0 to start again
+    DWORD       m_dwFlipFlags;
+    DWORD       m_dwLate;               // Presents that missed their time by a frame
+    BOOL        m_bTimerPeriod;         // timeBeginPeriod( 1 ) needs ending
+
+    LONGLONG    GetTime();
+
+public:
+    CFramePacer();
+    ~CFramePacer();
+
+    // dwTargetFps of 0 presents as soon as each frame is ready, without
+    // waiting for vertical blanks. dwRefreshRate of 0 means unknown.
+    HRESULT Create( DWORD dwTargetFps, DWORD dwRefreshRate, BOOL bFlipping );
+    VOID    Destroy();
+
+    // Call just before presenting
+    VOID    Wait();
+
+    DWORD   GetFlipFlags()      { return m_dwFlipFlags; }
+    DWORD   GetLate()           { return m_dwLate; }
+};
+
+
+
+
+#endif // FRAMEPACER_H
@@ -0,0 +1,346 @@
+//-----------------------------------------------------------------------------
+// File: framestats.cpp
+//
+// Desc: Rolling frame statistics, the stats overlay and the CSV stream.
+//
+//       Each series keeps the last STATS_WINDOW samples. Percentiles are
+//       read off a sorted copy of them, so they are always a value that was
+//       actually seen; a sort of 256 floats only happens when the overlay
+//       is redrawn, every STATS_OVERLAY_INTERVAL frames.
+//-----------------------------------------------------------------------------
+#define STRICT
+#include <windows.h>
+#include <tchar.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ddraw.h>
+#include "framestats.h"
+#include "dxutil.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines, constants, and global variables
+//-----------------------------------------------------------------------------
+static const TCHAR* g_astrStatName[NUM_STATS] =
+{
+    TEXT("frame  "), TEXT("sim    "), TEXT("present"), TEXT("ticks  "), TEXT("replays"), TEXT("allocs ")
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CFrameStats()
+// Desc:
+//-----------------------------------------------------------------------------
+CFrameStats::CFrameStats()
+{
+    ZeroMemory( m_Series, sizeof(m_Series) );
+    ZeroMemory( m_afFrame, sizeof(m_afFrame) );
+
+    LARGE_INTEGER qwTime;
+    QueryPerformanceFrequency( &qwTime );
+    m_llFreq = qwTime.QuadPart;
+    QueryPerformanceCounter( &qwTime );
+    m_llLastFrame = qwTime.QuadPart;
+
+    m_dwFrame      = 0;
+    m_pCsvFile     = NULL;
+    m_bShowOverlay = FALSE;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: ~CFrameStats()
+// Desc:
+//-----------------------------------------------------------------------------
+CFrameStats::~CFrameStats()
+{
+    CloseCsv();
+    DestroyOverlay();
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CFrameStats::OpenCsv()
+// Desc: Starts streaming one line per frame to strFile
+//-----------------------------------------------------------------------------
+HRESULT CFrameStats::OpenCsv( const TCHAR* strFile )
+{
+    CloseCsv();
+
+    if( NULL == ( m_pCsvFile = _tfopen( strFile, TEXT("w") ) ) )
+        return E_FAIL;
+
+    // Only write to disk every 64K or so rather than every frame
+    setvbuf( m_pCsvFile, NULL, _IOFBF, 65536 );
+
+    fprintf( m_pCsvFile, "frame,frame_ms,sim_ms,present_ms,ticks,replayed,allocs\n" );
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CFrameStats::CloseCsv()
+// Desc:
+//-----------------------------------------------------------------------------
+VOID CFrameStats::CloseCsv()
+{
+    if( m_pCsvFile )
+    {
+        fclose( m_pCsvFile );
+        m_pCsvFile = NULL;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CFrameStats::GetTime() and GetElapsedMs()
+// Desc: Performance counter helpers for timing the parts of a frame
+//-----------------------------------------------------------------------------
+LONGLONG CFrameStats::GetTime()
+{
+    LARGE_INTEGER qwTime;
+    QueryPerformanceCounter( &qwTime );
+    return qwTime.QuadPart;
+}
+
+FLOAT CFrameStats::GetElapsedMs( LONGLONG llStart )
+{
+    return (FLOAT)( (double)( GetTime() - llStart ) * 1000.0 / (double)m_llFreq );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CFrameStats::CompareSamples()
+// Desc: qsort() comparison for sorting a copy of a window smallest first
+//-----------------------------------------------------------------------------
+int __cdecl CFrameStats::CompareSamples( const void* pA, const void* pB )
+{
+    FLOAT fA = *(const FLOAT*)pA;
+    FLOAT fB = *(const FLOAT*)pB;
+
+    return ( fA < fB ) ? -1 : ( fA > fB ) ? 1 : 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CFrameStats::EndFrame()
+// Desc: Closes off the current frame, pushing its samples into the window
+//       and the CSV stream
+//-----------------------------------------------------------------------------
+VOID CFrameStats::EndFrame()
+{
+    LONGLONG llNow = GetTime();
+    m_afFrame[statFrame] = (FLOAT)( (double)( llNow - m_llLastFrame ) * 1000.0 / (double)m_llFreq );
+    m_llLastFrame = llNow;
+
+    for( int i = 0; i < NUM_STATS; i++ )
+    {
+        SERIES* pSeries = &m_Series[i];
+        DWORD   dwSlot  = pSeries->dwNext;
+
+        // Overwrite the sample that is falling out of the window
+        if( pSeries->dwCount < STATS_WINDOW )
+            pSeries->dwCount++;
+
+        pSeries->afSamples[dwSlot] = m_afFrame[i];
+        pSeries->dwNext = ( dwSlot + 1 ) % STATS_WINDOW;
+    }
+
+    if( m_pCsvFile )
+    {
+        fprintf( m_pCsvFile, "%lu,%.4f,%.4f,%.4f,%.0f,%.0f,%.0f\n", m_dwFrame,
+                 m_afFrame[statFrame], m_afFrame[statSim],
+                 m_afFrame[statPresent], m_afFrame[statTicks],
+                 m_afFrame[statReplayed], m_afFrame[statAllocs] );
+    }
+
+    ZeroMemory( m_afFrame, sizeof(m_afFrame) );
+    m_dwFrame++;
+
+    if( m_bShowOverlay && ( m_dwFrame % STATS_OVERLAY_INTERVAL ) == 0 )
+        UpdateOverlay();
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CFrameStats::GetSummary()
+// Desc: Min/avg/max and percentiles over the rolling window
+//-----------------------------------------------------------------------------
+VOID CFrameStats::GetSummary( StatType stat, STAT_SUMMARY* pSummary )
+{
+    SERIES* pSeries = &m_Series[stat];
+
+    ZeroMemory( pSummary, sizeof(STAT_SUMMARY) );
+    if( pSeries->dwCount == 0 )
+        return;
+
+    FLOAT fSum = 0.0f;
+    pSummary->fMin = pSeries->afSamples[0];
+    pSummary->fMax = pSeries->afSamples[0];
+    for( DWORD i = 0; i < pSeries->dwCount; i++ )
+    {
+        FLOAT f = pSeries->afSamples[i];
+        fSum += f;
+        if( f < pSummary->fMin ) pSummary->fMin = f;
+        if( f > pSummary->fMax ) pSummary->fMax = f;
+    }
+    pSummary->fAvg = fSum / pSeries->dwCount;
+
+    // Nearest rank percentiles off a sorted copy of the window, so a
+    // series of small counts such as allocs reads as the counts themselves
+    FLOAT afSorted[STATS_WINDOW];
+    memcpy( afSorted, pSeries->afSamples, pSeries->dwCount * sizeof(FLOAT) );
+    qsort( afSorted, pSeries->dwCount, sizeof(FLOAT), CompareSamples );
+
+    pSummary->fP50 = afSorted[( pSeries->dwCount * 50 + 99 ) / 100 - 1];
+    pSummary->fP95 = afSorted[( pSeries->dwCount * 95 + 99 ) / 100 - 1];
+    pSummary->fP99 = afSorted[( pSeries->dwCount * 99 + 99 ) / 100 - 1];
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CFrameStats::CreateOverlay()
+// Desc: Creates a text surface for each line of the overlay, sized for the
+//       widest line that can be drawn on it
+//-----------------------------------------------------------------------------
+HRESULT CFrameStats::CreateOverlay( CDisplay* pDisplay )
+{
+    HRESULT hr;
+    TCHAR   strWidest[] = TEXT("present  0000.00  min 0000.00  avg 0000.00  max 0000.00  p95 0000.00  p99 0000.00");
+
+    DestroyOverlay();
+
+    for( int i = 0; i < NUM_STATS; i++ )
+    {
+        if( FAILED( hr = pDisplay->CreateSurfaceFromText( m_apOverlay[i].Receive(), NULL, strWidest,
+                                                          RGB(0,0,0), RGB(0,0,0) ) ) )
+            return hr;
+
+        // Black is see-through so the overlay does not hide the field
+        if( FAILED( hr = m_apOverlay[i]->SetColorKey( 0 ) ) )
+            return hr;
+    }
+
+    return UpdateOverlay();
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CFrameStats::ResetOverlay()
+// Desc: Recreates the overlay surfaces in place after a display mode change
+//-----------------------------------------------------------------------------
+HRESULT CFrameStats::ResetOverlay( CDisplay* pDisplay )
+{
+    HRESULT hr;
+
+    for( int i = 0; i < NUM_STATS; i++ )
+    {
+        if( NULL == m_apOverlay[i] )
+            continue;
+
+        if( FAILED( hr = m_apOverlay[i]->Reset( pDisplay->GetDirectDraw() ) ) )
+            return hr;
+    }
+
+    return UpdateOverlay();
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CFrameStats::UpdateOverlay()
+// Desc: Redraws the overlay text from the current summaries. GDI text is
+//       slow, so this is only done every STATS_OVERLAY_INTERVAL frames.
+//-----------------------------------------------------------------------------
+HRESULT CFrameStats::UpdateOverlay()
+{
+    HRESULT      hr;
+    STAT_SUMMARY summary;
+    TCHAR        strLine[MAX_PATH];
+
+    for( int i = 0; i < NUM_STATS; i++ )
+    {
+        if( NULL == m_apOverlay[i] )
+            continue;
+
+        GetSummary( (StatType)i, &summary );
+        _stprintf( strLine, TEXT("%s %8.2f  min %7.2f  avg %7.2f  max %7.2f  p95 %7.2f  p99 %7.2f"),
+                   g_astrStatName[i], m_Series[i].afSamples[( m_Series[i].dwNext + STATS_WINDOW - 1 ) % STATS_WINDOW],
+                   summary.fMin, summary.fAvg, summary.fMax, summary.fP95, summary.fP99 );
+
+        // Clear out the last lot of text as the new line may be shorter
+        DDBLTFX ddbltfx;
+        ZeroMemory( &ddbltfx, sizeof(ddbltfx) );
+        ddbltfx.dwSize      = sizeof(ddbltfx);
+        ddbltfx.dwFillColor = 0;
+        m_apOverlay[i]->GetDDrawSurface()->Blt( NULL, NULL, NULL, DDBLT_COLORFILL | DDBLT_WAIT, &ddbltfx );
+
+        if( FAILED( hr = m_apOverlay[i]->DrawText( NULL, strLine, 0, 0,
+                                                   RGB(0,0,0), RGB(0, 255, 0) ) ) )
+            return hr;
+    }
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CFrameStats::DrawOverlay()
+// Desc: Blts the overlay lines to the back buffer, one under another
+//-----------------------------------------------------------------------------
+HRESULT CFrameStats::DrawOverlay( CDisplay* pDisplay, DWORD x, DWORD y )
+{
+    if( !m_bShowOverlay )
+        return S_OK;
+
+    for( int i = 0; i < NUM_STATS; i++ )
+    {
+        if( NULL == m_apOverlay[i] )
+            continue;
+
+        pDisplay->Blt( x, y, m_apOverlay[i], NULL );
+        y += 16;
+    }
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CFrameStats::DestroyOverlay()
+// Desc:
+//-----------------------------------------------------------------------------
+VOID CFrameStats::DestroyOverlay()
+{
+    for( int i = 0; i < NUM_STATS; i++ )
+        m_apOverlay[i].Reset();
+}
@@ -0,0 +1,91 @@
+//-----------------------------------------------------------------------------
+// File: framestats.h
+//
+// Desc: Frame timing statistics. Keeps a rolling window of frame, sim,
+//       present, ticks-per-frame, rollback-replays-per-frame and
+//       heap-allocations-per-frame samples with
+//       min/avg/max and percentiles, draws them as an overlay, and
+//       can stream every frame to a CSV file for dashboards.
+//-----------------------------------------------------------------------------
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+
+#include <stdio.h>
+#include "ddutil.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+#define STATS_WINDOW            256     // Frames in the rolling window
+#define STATS_OVERLAY_INTERVAL  30      // Frames between overlay redraws
+
+enum StatType { statFrame, statSim, statPresent, statTicks, statReplayed, statAllocs, NUM_STATS };
+
+struct STAT_SUMMARY
+{
+    FLOAT fMin;
+    FLOAT fAvg;
+    FLOAT fMax;
+    FLOAT fP50;
+    FLOAT fP95;
+    FLOAT fP99;
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: class CFrameStats
+// Desc: Collects per-frame samples. Times are recorded in milliseconds,
+//       ticks, replayed frames and allocations per frame as plain counts.
+//-----------------------------------------------------------------------------
+class CFrameStats
+{
+    struct SERIES
+    {
+        FLOAT afSamples[STATS_WINDOW];
+        DWORD dwCount;
+        DWORD dwNext;
+    };
+
+    SERIES      m_Series[NUM_STATS];
+    FLOAT       m_afFrame[NUM_STATS];
+    DWORD       m_dwFrame;
+    LONGLONG    m_llFreq;
+    LONGLONG    m_llLastFrame;
+    FILE*       m_pCsvFile;
+    BOOL        m_bShowOverlay;
+    CSurfaceHandle m_apOverlay[NUM_STATS];
+
+    static int __cdecl CompareSamples( const void* pA, const void* pB );
+
+public:
+    CFrameStats();
+    ~CFrameStats();
+
+    HRESULT  OpenCsv( const TCHAR* strFile );
+    VOID     CloseCsv();
+
+    LONGLONG GetTime();
+    FLOAT    GetElapsedMs( LONGLONG llStart );
+
+    VOID     AddSample( StatType stat, FLOAT fValue ) { m_afFrame[stat] += fValue; }
+    VOID     EndFrame();
+    VOID     GetSummary( StatType stat, STAT_SUMMARY* pSummary );
+
+    VOID     ToggleOverlay()     { m_bShowOverlay = !m_bShowOverlay; }
+    BOOL     IsOverlayShown()    { return m_bShowOverlay; }
+    HRESULT  CreateOverlay( CDisplay* pDisplay );
+    HRESULT  ResetOverlay( CDisplay* pDisplay );
+    HRESULT  UpdateOverlay();
+    HRESULT  DrawOverlay( CDisplay* pDisplay, DWORD x, DWORD y );
+    VOID     DestroyOverlay();
+};
+
+
+
+
+#endif // FRAMESTATS_H
@@ -0,0 +1,87 @@
+//-----------------------------------------------------------------------------
+// File: handle.h
+//
+// Desc: Move-only owning handles. A CHandle frees what it holds when it is
+//       destroyed or reset, can be handed on with a move but never copied,
+//       so each display object has exactly one owner and no path through
+//       the code can free it twice or forget to free it at all.
+//-----------------------------------------------------------------------------
+#ifndef HANDLE_H
+#define HANDLE_H
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CDeletePolicy and CReleasePolicy
+// Desc: How a handle gives up what it owns; delete for our own classes,
+//       Release() for COM interfaces such as palettes
+//-----------------------------------------------------------------------------
+struct CDeletePolicy
+{
+    template <class T> static VOID Free( T* p )  { delete p; }
+};
+
+struct CReleasePolicy
+{
+    template <class T> static VOID Free( T* p )  { p->Release(); }
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: class CHandle
+// Desc: Owns a single T. It converts to a plain T* so it can be passed to
+//       anything that only borrows the object, and Receive() frees the
+//       current object and returns the address of the pointer, so a handle
+//       can be filled in by the Create*( T** ) style functions.
+//-----------------------------------------------------------------------------
+template <class T, class POLICY = CDeletePolicy>
+class CHandle
+{
+    T*  m_p;
+
+    // Not copyable, only movable
+    CHandle( const CHandle& );
+    CHandle& operator=( const CHandle& );
+
+public:
+    CHandle()                           : m_p( NULL ) {}
+    explicit CHandle( T* p )            : m_p( p ) {}
+    CHandle( CHandle&& other )          : m_p( other.m_p ) { other.m_p = NULL; }
+    ~CHandle()                          { Reset(); }
+
+    CHandle& operator=( CHandle&& other )
+    {
+        // Take the pointer before resetting, which also makes a move onto
+        // itself harmless
+        T* p = other.m_p;
+        other.m_p = NULL;
+        Reset( p );
+        return *this;
+    }
+
+    T*   Get() const                    { return m_p; }
+    T*   operator->() const             { return m_p; }
+    operator T*() const                 { return m_p; }
+
+    // Frees the current object, if any, for a Create*( T** ) to fill in
+    T**  Receive()                      { Reset(); return &m_p; }
+
+    // Gives up ownership without freeing
+    T*   Detach()                       { T* p = m_p; m_p = NULL; return p; }
+
+    // Frees the current object, if any, and takes ownership of p
+    VOID Reset( T* p = NULL )
+    {
+        if( m_p && m_p != p )
+            POLICY::Free( m_p );
+        m_p = p;
+    }
+};
+
+
+
+
+#endif // HANDLE_H
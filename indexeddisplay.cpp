@@ -0,0 +1,476 @@
+//-----------------------------------------------------------------------------
+// File: indexeddisplay.cpp
+//
+// Desc: The indexed display and its surfaces.
+//-----------------------------------------------------------------------------
+#define STRICT
+#include <windows.h>
+#include <string.h>
+#include <emmintrin.h>
+#include <ddraw.h>
+#include "dxutil.h"
+#include "fill.h"
+#include "indexeddisplay.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+#define INDEXED_COLOR_MASK      0x00FFFFFF  // Colour keys ignore the spare byte
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CIndexedSurface::CIndexedSurface()
+// Desc:
+//-----------------------------------------------------------------------------
+CIndexedSurface::CIndexedSurface()
+{
+    m_pbBits      = NULL;
+    m_lPitch      = 0;
+    m_dwWidth     = 0;
+    m_dwHeight    = 0;
+    m_bColorKeyed = FALSE;
+    m_bColorKey   = 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CIndexedSurface::~CIndexedSurface()
+// Desc:
+//-----------------------------------------------------------------------------
+CIndexedSurface::~CIndexedSurface()
+{
+    Destroy();
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CIndexedSurface::Create()
+// Desc: Makes a blank image with no colour key
+//-----------------------------------------------------------------------------
+HRESULT CIndexedSurface::Create( DWORD dwWidth, DWORD dwHeight )
+{
+    Destroy();
+
+    if( dwWidth == 0 || dwHeight == 0 )
+        return E_INVALIDARG;
+
+    if( NULL == ( m_pbBits = new BYTE[dwWidth * dwHeight] ) )
+        return E_OUTOFMEMORY;
+
+    ZeroMemory( m_pbBits, dwWidth * dwHeight );
+    m_lPitch   = dwWidth;
+    m_dwWidth  = dwWidth;
+    m_dwHeight = dwHeight;
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CIndexedSurface::CopyFrom()
+// Desc: Maps a 32 bit surface's pixels to the palette, making this the same
+//       size. The first pass finds the indices the surface's own pixels
+//       use, so the key can take one they don't and never hides any of
+//       them. Copy it again after redrawing the surface.
+//-----------------------------------------------------------------------------
+HRESULT CIndexedSurface::CopyFrom( CSurface* pSurface, const PALETTE* pPalette )
+{
+    HRESULT              hr;
+    DDSURFACEDESC2       ddsd;
+    LPDIRECTDRAWSURFACE7 pdds = pSurface ? pSurface->GetDDrawSurface() : NULL;
+
+    if( NULL == pdds || NULL == pPalette )
+        return E_INVALIDARG;
+
+    ZeroMemory( &ddsd, sizeof(ddsd) );
+    ddsd.dwSize = sizeof(ddsd);
+    pdds->GetSurfaceDesc( &ddsd );
+
+    if( ddsd.ddpfPixelFormat.dwRGBBitCount != 32 )
+        return E_NOTIMPL;
+
+    if( ddsd.dwWidth != m_dwWidth || ddsd.dwHeight != m_dwHeight )
+    {
+        if( FAILED( hr = Create( ddsd.dwWidth, ddsd.dwHeight ) ) )
+            return hr;
+    }
+
+    // The surface's key is kept as a GDI colour, so take the converted one
+    DDCOLORKEY ddck;
+    m_bColorKeyed = pSurface->IsColorKeyed() && SUCCEEDED( pdds->GetColorKey( DDCKEY_SRCBLT, &ddck ) );
+
+    DWORD dwKey = m_bColorKeyed ? ( ddck.dwColorSpaceLowValue & INDEXED_COLOR_MASK ) : 0;
+
+    if( FAILED( hr = pdds->Lock( NULL, &ddsd, DDLOCK_WAIT | DDLOCK_READONLY, NULL ) ) )
+        return hr;
+
+    BOOL abUsed[PALETTE_MAX_COLORS];
+    ZeroMemory( abUsed, sizeof(abUsed) );
+
+    for( DWORD y = 0; y < m_dwHeight && m_bColorKeyed; y++ )
+    {
+        const DWORD* pdwSrc = (const DWORD*)( (const BYTE*)ddsd.lpSurface + y * ddsd.lPitch );
+        for( DWORD x = 0; x < m_dwWidth; x++ )
+        {
+            if( ( pdwSrc[x] & INDEXED_COLOR_MASK ) != dwKey )
+                abUsed[Palette_Map( pPalette, pdwSrc[x] )] = TRUE;
+        }
+    }
+
+    m_bColorKey = 0;
+    while( m_bColorKeyed && abUsed[m_bColorKey] && m_bColorKey < PALETTE_MAX_COLORS - 1 )
+        m_bColorKey++;
+
+    if( m_bColorKeyed && abUsed[m_bColorKey] )
+    {
+        pdds->Unlock( NULL );
+        return E_FAIL;
+    }
+
+    for( DWORD y = 0; y < m_dwHeight; y++ )
+    {
+        const DWORD* pdwSrc = (const DWORD*)( (const BYTE*)ddsd.lpSurface + y * ddsd.lPitch );
+        BYTE*        pbDest = m_pbBits + y * m_lPitch;
+
+        for( DWORD x = 0; x < m_dwWidth; x++ )
+        {
+            if( m_bColorKeyed && ( pdwSrc[x] & INDEXED_COLOR_MASK ) == dwKey )
+                pbDest[x] = m_bColorKey;
+            else
+                pbDest[x] = Palette_Map( pPalette, pdwSrc[x] );
+        }
+    }
+
+    pdds->Unlock( NULL );
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CIndexedSurface::Destroy()
+// Desc:
+//-----------------------------------------------------------------------------
+VOID CIndexedSurface::Destroy()
+{
+    SAFE_DELETE_ARRAY( m_pbBits );
+
+    m_lPitch      = 0;
+    m_dwWidth     = 0;
+    m_dwHeight    = 0;
+    m_bColorKeyed = FALSE;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: ColorKeySpan()
+// Desc: Copies the indices that aren't the key, 16 at a time, picking the
+//       destination where the source is the key and the source elsewhere
+//-----------------------------------------------------------------------------
+static inline VOID ColorKeySpan( BYTE* pbDest, const BYTE* pbSrc, DWORD dwCount, BYTE bColorKey )
+{
+    __m128i key = _mm_set1_epi8( (char)bColorKey );
+    DWORD   x   = 0;
+
+    for( ; x + 16 <= dwCount; x += 16 )
+    {
+        __m128i s    = _mm_loadu_si128( (const __m128i*)( pbSrc + x ) );
+        __m128i d    = _mm_loadu_si128( (const __m128i*)( pbDest + x ) );
+        __m128i keep = _mm_cmpeq_epi8( s, key );
+
+        _mm_storeu_si128( (__m128i*)( pbDest + x ),
+                          _mm_or_si128( _mm_and_si128( keep, d ), _mm_andnot_si128( keep, s ) ) );
+    }
+
+    for( ; x < dwCount; x++ )
+    {
+        if( pbSrc[x] != bColorKey )
+            pbDest[x] = pbSrc[x];
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CIndexedDisplay::CIndexedDisplay()
+// Desc:
+//-----------------------------------------------------------------------------
+CIndexedDisplay::CIndexedDisplay()
+{
+    m_pbFrame     = NULL;
+    m_lPitch      = 0;
+    m_dwWidth     = 0;
+    m_dwHeight    = 0;
+    m_pbDest      = NULL;
+    m_lDestPitch  = 0;
+    m_dwDestWidth = 0;
+
+    // Black alone, which every colour maps to
+    ZeroMemory( &m_Palette, sizeof(m_Palette) );
+    m_Palette.dwNumColors = 1;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CIndexedDisplay::~CIndexedDisplay()
+// Desc:
+//-----------------------------------------------------------------------------
+CIndexedDisplay::~CIndexedDisplay()
+{
+    Destroy();
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CIndexedDisplay::Create()
+// Desc: Allocates the frame and starts the threads
+//-----------------------------------------------------------------------------
+HRESULT CIndexedDisplay::Create( DWORD dwWidth, DWORD dwHeight, DWORD dwNumThreads )
+{
+    HRESULT hr;
+
+    Destroy();
+
+    if( dwWidth == 0 || dwHeight == 0 )
+        return E_INVALIDARG;
+
+    if( NULL == ( m_pbFrame = new BYTE[dwWidth * dwHeight] ) )
+        return E_OUTOFMEMORY;
+
+    if( FAILED( hr = m_Pool.Create( dwNumThreads ) ) )
+    {
+        Destroy();
+        return hr;
+    }
+
+    ZeroMemory( m_pbFrame, dwWidth * dwHeight );
+    m_lPitch   = dwWidth;
+    m_dwWidth  = dwWidth;
+    m_dwHeight = dwHeight;
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CIndexedDisplay::Resize()
+// Desc: Reallocates the frame for a new size, such as when the window is
+//       resized
+//-----------------------------------------------------------------------------
+HRESULT CIndexedDisplay::Resize( DWORD dwWidth, DWORD dwHeight )
+{
+    if( !IsCreated() )
+        return E_FAIL;
+    if( dwWidth == 0 || dwHeight == 0 )
+        return E_INVALIDARG;
+    if( dwWidth == m_dwWidth && dwHeight == m_dwHeight )
+        return S_OK;
+
+    BYTE* pbFrame = new BYTE[dwWidth * dwHeight];
+    if( NULL == pbFrame )
+        return E_OUTOFMEMORY;
+
+    SAFE_DELETE_ARRAY( m_pbFrame );
+    m_pbFrame = pbFrame;
+
+    ZeroMemory( m_pbFrame, dwWidth * dwHeight );
+    m_lPitch   = dwWidth;
+    m_dwWidth  = dwWidth;
+    m_dwHeight = dwHeight;
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CIndexedDisplay::Destroy()
+// Desc:
+//-----------------------------------------------------------------------------
+VOID CIndexedDisplay::Destroy()
+{
+    m_Pool.Destroy();
+
+    SAFE_DELETE_ARRAY( m_pbFrame );
+
+    m_lPitch   = 0;
+    m_dwWidth  = 0;
+    m_dwHeight = 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CIndexedDisplay::SetPalette()
+// Desc:
+//-----------------------------------------------------------------------------
+VOID CIndexedDisplay::SetPalette( const PALETTE* pPalette )
+{
+    if( pPalette )
+        m_Palette = *pPalette;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CIndexedDisplay::Clear()
+// Desc:
+//-----------------------------------------------------------------------------
+HRESULT CIndexedDisplay::Clear( DWORD dwColor )
+{
+    if( !IsCreated() )
+        return E_POINTER;
+
+    return Fill_Rect( m_pbFrame, m_lPitch, 8, m_dwWidth, m_dwHeight, Palette_Map( &m_Palette, dwColor ) );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CIndexedDisplay::FillRect()
+// Desc:
+//-----------------------------------------------------------------------------
+HRESULT CIndexedDisplay::FillRect( const RECT* prc, DWORD dwColor )
+{
+    if( !IsCreated() )
+        return E_POINTER;
+    if( NULL == prc )
+        return E_INVALIDARG;
+
+    RECT rc;
+    SetRect( &rc, 0, 0, m_dwWidth, m_dwHeight );
+    if( !IntersectRect( &rc, &rc, prc ) )
+        return S_OK;
+
+    return Fill_Rect( m_pbFrame + rc.top * m_lPitch + rc.left, m_lPitch, 8,
+                      rc.right - rc.left, rc.bottom - rc.top, Palette_Map( &m_Palette, dwColor ) );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CIndexedDisplay::Blt()
+// Desc: Copies prcSrc, or all of pSrc, with its top left at x, y
+//-----------------------------------------------------------------------------
+HRESULT CIndexedDisplay::Blt( LONG x, LONG y, CIndexedSurface* pSrc, const RECT* prcSrc )
+{
+    if( !IsCreated() )
+        return E_POINTER;
+    if( NULL == pSrc || NULL == pSrc->GetBits() )
+        return E_INVALIDARG;
+
+    RECT rcSrc;
+    SetRect( &rcSrc, 0, 0, pSrc->GetWidth(), pSrc->GetHeight() );
+    if( prcSrc )
+        IntersectRect( &rcSrc, &rcSrc, prcSrc );
+
+    RECT rcFrame;
+    RECT rcDest;
+    SetRect( &rcFrame, 0, 0, m_dwWidth, m_dwHeight );
+    SetRect( &rcDest, x, y, x + rcSrc.right - rcSrc.left, y + rcSrc.bottom - rcSrc.top );
+    if( !IntersectRect( &rcDest, &rcDest, &rcFrame ) )
+        return S_OK;
+
+    DWORD       dwCount = rcDest.right - rcDest.left;
+    const BYTE* pbSrc   = pSrc->GetBits() + ( rcSrc.top + rcDest.top - y ) * pSrc->GetPitch() +
+                          rcSrc.left + rcDest.left - x;
+    BYTE*       pbDest  = m_pbFrame + rcDest.top * m_lPitch + rcDest.left;
+
+    for( LONG ly = rcDest.top; ly < rcDest.bottom; ly++ )
+    {
+        if( pSrc->IsColorKeyed() )
+            ColorKeySpan( pbDest, pbSrc, dwCount, pSrc->GetColorKey() );
+        else
+            memcpy( pbDest, pbSrc, dwCount );
+
+        pbSrc  += pSrc->GetPitch();
+        pbDest += m_lPitch;
+    }
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CIndexedDisplay::ExpandSlice()
+// Desc: Run by each thread of the pool on its band of rows
+//-----------------------------------------------------------------------------
+VOID CIndexedDisplay::ExpandSlice( VOID* pContext, DWORD dwFirst, DWORD dwCount )
+{
+    CIndexedDisplay* pThis = (CIndexedDisplay*)pContext;
+
+    for( DWORD y = dwFirst; y < dwFirst + dwCount; y++ )
+    {
+        Palette_ExpandRow( (DWORD*)( pThis->m_pbDest + y * pThis->m_lDestPitch ),
+                           pThis->m_pbFrame + y * pThis->m_lPitch, pThis->m_dwDestWidth,
+                           pThis->m_Palette.adwColors );
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CIndexedDisplay::Present()
+// Desc: Puts the frame in the display's back buffer, looking up each
+//       pixel's colour across the pool. The back buffer must be 32 bits a
+//       pixel.
+//-----------------------------------------------------------------------------
+HRESULT CIndexedDisplay::Present( CDisplay* pDisplay )
+{
+    HRESULT              hr;
+    LPDIRECTDRAWSURFACE7 pddsBack = pDisplay ? pDisplay->GetBackBuffer() : NULL;
+
+    if( NULL == pddsBack || !IsCreated() )
+        return E_POINTER;
+
+    DDSURFACEDESC2 ddsd;
+    ZeroMemory( &ddsd, sizeof(ddsd) );
+    ddsd.dwSize = sizeof(ddsd);
+    pddsBack->GetSurfaceDesc( &ddsd );
+
+    if( ddsd.ddpfPixelFormat.dwRGBBitCount != 32 )
+        return E_NOTIMPL;
+
+    if( FAILED( hr = pddsBack->Lock( NULL, &ddsd, DDLOCK_WAIT | DDLOCK_WRITEONLY, NULL ) ) )
+        return hr;
+
+    m_pbDest      = (BYTE*)ddsd.lpSurface;
+    m_lDestPitch  = ddsd.lPitch;
+    m_dwDestWidth = min( m_dwWidth, ddsd.dwWidth );
+
+    m_Pool.Run( ExpandSlice, this, min( m_dwHeight, ddsd.dwHeight ) );
+
+    pddsBack->Unlock( NULL );
+
+    return S_OK;
+}
@@ -0,0 +1,124 @@
+//-----------------------------------------------------------------------------
+// File: indexeddisplay.h
+//
+// Desc: A display drawn by the processor into an 8 bit frame of palette
+//       indices, a quarter of the memory traffic of a 32 bit frame for
+//       every clear, blt and capture. Sprites are mapped to the display's
+//       palette once when they are copied in, so a blt copies bytes and a
+//       colour keyed one compares them against the sprite's key index, 16
+//       at a time with SSE2.
+//
+//       Present() looks up each index's colour as it writes the frame into
+//       a 32 bit back buffer, with the rows split across a thread pool. The
+//       palette never goes near DirectDraw, so the display runs at 32 bits
+//       like any other and nothing needs realising.
+//-----------------------------------------------------------------------------
+#ifndef INDEXEDDISPLAY_H
+#define INDEXEDDISPLAY_H
+
+#include "ddutil.h"
+#include "palette.h"
+#include "threadpool.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: class CIndexedSurface
+// Desc: An 8 bit image in memory to blt from, copied from a 32 bit CSurface
+//       through a palette. A colour keyed surface is given an index none of
+//       its other pixels use as its key.
+//-----------------------------------------------------------------------------
+class CIndexedSurface
+{
+    BYTE*   m_pbBits;
+    LONG    m_lPitch;
+    DWORD   m_dwWidth;
+    DWORD   m_dwHeight;
+    BOOL    m_bColorKeyed;
+    BYTE    m_bColorKey;
+
+    CIndexedSurface( const CIndexedSurface& );
+    CIndexedSurface& operator=( const CIndexedSurface& );
+
+public:
+    CIndexedSurface();
+    ~CIndexedSurface();
+
+    HRESULT Create( DWORD dwWidth, DWORD dwHeight );
+    HRESULT CopyFrom( CSurface* pSurface, const PALETTE* pPalette );
+    VOID    Destroy();
+
+    BYTE*   GetBits()           { return m_pbBits; }
+    LONG    GetPitch()          { return m_lPitch; }
+    DWORD   GetWidth()          { return m_dwWidth; }
+    DWORD   GetHeight()         { return m_dwHeight; }
+    BOOL    IsColorKeyed()      { return m_bColorKeyed; }
+    BYTE    GetColorKey()       { return m_bColorKey; }
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: class CIndexedDisplay
+// Desc: The frame, its palette and the threads for Present(). Drawing goes
+//       straight into the frame on the calling thread. Nothing is allocated
+//       after Create() until the frame is resized.
+//-----------------------------------------------------------------------------
+class CIndexedDisplay
+{
+    BYTE*           m_pbFrame;
+    LONG            m_lPitch;
+    DWORD           m_dwWidth;
+    DWORD           m_dwHeight;
+    PALETTE         m_Palette;
+    CThreadPool     m_Pool;
+
+    // The Present() in progress, read by the pool's threads
+    BYTE*           m_pbDest;
+    LONG            m_lDestPitch;
+    DWORD           m_dwDestWidth;
+
+    static VOID ExpandSlice( VOID* pContext, DWORD dwFirst, DWORD dwCount );
+
+    CIndexedDisplay( const CIndexedDisplay& );
+    CIndexedDisplay& operator=( const CIndexedDisplay& );
+
+public:
+    CIndexedDisplay();
+    ~CIndexedDisplay();
+
+    // dwNumThreads of 0 uses one thread per processor. The palette starts
+    // as black alone, until SetPalette().
+    HRESULT Create( DWORD dwWidth, DWORD dwHeight, DWORD dwNumThreads );
+    VOID    Destroy();
+
+    // A new frame size, keeping the threads and the palette
+    HRESULT Resize( DWORD dwWidth, DWORD dwHeight );
+
+    // Surfaces copied through the old palette need copying again
+    VOID    SetPalette( const PALETTE* pPalette );
+
+    // Drawing, clipped to the frame. Colours are 32 bit and drawn as the
+    // nearest entry in the palette. Blt() colour keys if pSrc has a key,
+    // and takes all of pSrc if prcSrc is NULL.
+    HRESULT Clear( DWORD dwColor = 0L );
+    HRESULT FillRect( const RECT* prc, DWORD dwColor );
+    HRESULT Blt( LONG x, LONG y, CIndexedSurface* pSrc, const RECT* prcSrc = NULL );
+
+    // Expands the frame into a 32 bit back buffer, as much of it as fits
+    HRESULT Present( CDisplay* pDisplay );
+
+    BOOL            IsCreated()         { return m_pbFrame != NULL; }
+    BYTE*           GetBits()           { return m_pbFrame; }
+    LONG            GetPitch()          { return m_lPitch; }
+    DWORD           GetWidth()          { return m_dwWidth; }
+    DWORD           GetHeight()         { return m_dwHeight; }
+    const PALETTE*  GetPalette()        { return &m_Palette; }
+};
+
+
+
+
+#endif // INDEXEDDISPLAY_H
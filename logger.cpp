@@ -0,0 +1,550 @@
+//-----------------------------------------------------------------------------
+// File: logger.cpp
+//
+// Desc: The logger ring and its writer thread.
+//
+//       The ring is a bounded multi-producer queue where each slot carries a
+//       sequence number. A producer claims a slot with a single compare and
+//       exchange on the enqueue position, fills it in, then publishes it by
+//       bumping the slot's sequence. Only the writer thread dequeues, so the
+//       consumer side needs no atomics at all. When the ring is full the
+//       message is dropped and counted rather than blocking the caller.
+//-----------------------------------------------------------------------------
+#define STRICT
+#include <windows.h>
+#include <tchar.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include "logger.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines, constants, and global variables
+//-----------------------------------------------------------------------------
+#define LOG_RING_SIZE       4096    // Must be a power of 2
+#define LOG_MAX_ARGS        8
+#define LOG_FLUSH_MS        10
+#define LOG_LINE_LENGTH     1024
+
+union LOG_ARG
+{
+    INT64       nValue;
+    double      fValue;
+    const void* pValue;
+};
+
+struct LOG_RECORD
+{
+    volatile LONG   lSequence;
+    DWORD           dwArgs;
+    BOOL            bTruncated;     // The format wanted more than LOG_MAX_ARGS
+    const TCHAR*    strFmt;
+    LOG_ARG         aArgs[LOG_MAX_ARGS];
+};
+
+enum LOG_ARGTYPE { LOG_ARG_NONE, LOG_ARG_INT, LOG_ARG_INT64, LOG_ARG_DOUBLE, LOG_ARG_PTR };
+
+static LOG_RECORD           g_aLogRing[LOG_RING_SIZE];
+static volatile LONG        g_lLogEnqueue  = 0;
+static LONG                 g_lLogDequeue  = 0;
+static volatile LONG        g_lLogDropped  = 0;
+static volatile LONG        g_lLogRunning  = 0;
+static volatile LONG        g_lLogWriters  = 0;     // Producers that may still publish a slot
+static HANDLE               g_hLogThread   = NULL;
+static HANDLE               g_hLogStop     = NULL;
+static FILE*                g_pLogFile     = NULL;
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Log_NextSpec()
+// Desc: Finds the next conversion in a printf style format string. Returns
+//       a pointer to the character after the conversion, or NULL if there
+//       are none left. The conversion's '%' is returned through ppSpec, its
+//       length modifier, if any, through ppLength, its argument type through
+//       pType, and the number of '*' widths or precisions (each of which
+//       takes an int argument) through pdwStars.
+//-----------------------------------------------------------------------------
+static const TCHAR* Log_NextSpec( const TCHAR* strFmt, const TCHAR** ppSpec, const TCHAR** ppLength,
+                                  LOG_ARGTYPE* pType, DWORD* pdwStars )
+{
+    const TCHAR* p = strFmt;
+
+    while( *p )
+    {
+        if( *p++ != '%' )
+            continue;
+
+        *ppSpec   = p - 1;
+        *ppLength = p;
+        *pdwStars = 0;
+
+        if( *p == '%' )
+        {
+            *pType = LOG_ARG_NONE;
+            return p + 1;
+        }
+
+        // Flags, width and precision
+        while( *p && _tcschr( _T("-+ #0123456789.*"), *p ) )
+        {
+            if( *p++ == '*' && *pdwStars < 2 )
+                (*pdwStars)++;
+        }
+
+        // Length modifiers. I64, ll and j take 64 bits; z, t and a bare I
+        // take the size of a pointer; I32 and the rest take an int.
+        DWORD dwSize = sizeof(int);
+        *ppLength    = p;
+        if( p[0] == 'I' && p[1] == '6' && p[2] == '4' )
+        {
+            dwSize = sizeof(INT64);
+            p += 3;
+        }
+        else if( p[0] == 'I' && p[1] == '3' && p[2] == '2' )
+        {
+            p += 3;
+        }
+        else if( p[0] == 'l' && p[1] == 'l' )
+        {
+            dwSize = sizeof(INT64);
+            p += 2;
+        }
+        else if( p[0] == 'j' )
+        {
+            dwSize = sizeof(INT64);
+            p++;
+        }
+        else if( p[0] == 'z' || p[0] == 't' || p[0] == 'I' )
+        {
+            dwSize = sizeof(INT_PTR);
+            p++;
+        }
+        else
+        {
+            while( *p && _tcschr( _T("hlLw"), *p ) )
+                p++;
+        }
+
+        switch( *p )
+        {
+            case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c': case 'C':
+                *pType = ( dwSize == sizeof(INT64) ) ? LOG_ARG_INT64 : LOG_ARG_INT;
+                break;
+
+            case 'e': case 'E': case 'f': case 'g': case 'G':
+                *pType = LOG_ARG_DOUBLE;
+                break;
+
+            case 's': case 'S': case 'p':
+                *pType = LOG_ARG_PTR;
+                break;
+
+            default:
+                // Unsupported (%n) or malformed, print it as text
+                *pType    = LOG_ARG_NONE;
+                *pdwStars = 0;
+                break;
+        }
+
+        return *p ? p + 1 : p;
+    }
+
+    return NULL;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Log_Format()
+// Desc: Expands a captured record into strLine
+//-----------------------------------------------------------------------------
+static VOID Log_Format( const LOG_RECORD* pRecord, TCHAR* strLine, int cchLine )
+{
+    const TCHAR* strFmt = pRecord->strFmt;
+    const TCHAR* strSpec;
+    const TCHAR* strLength;
+    const TCHAR* strNext;
+    LOG_ARGTYPE  type;
+    DWORD        dwStars;
+    DWORD        dwArg = 0;
+    int          cch   = 0;
+
+    #define LOG_SNPRINTF(v) ( dwStars == 0 ? _sntprintf( strOut, cchLeft, strOne, v ) :              \
+                              dwStars == 1 ? _sntprintf( strOut, cchLeft, strOne, anStar[0], v ) :   \
+                                             _sntprintf( strOut, cchLeft, strOne, anStar[0], anStar[1], v ) )
+
+    while( cch < cchLine - 1 &&
+           NULL != ( strNext = Log_NextSpec( strFmt, &strSpec, &strLength, &type, &dwStars ) ) )
+    {
+        // Copy the literal text up to the conversion
+        while( strFmt < strSpec && cch < cchLine - 1 )
+            strLine[cch++] = *strFmt++;
+
+        // A conversion whose arguments were cut off by LOG_MAX_ARGS is
+        // shown as a '?' rather than printed with a made up value
+        DWORD dwNeeded = dwStars + ( type != LOG_ARG_NONE ? 1 : 0 );
+        if( pRecord->bTruncated && dwArg + dwNeeded > pRecord->dwArgs )
+        {
+            strLine[cch++] = '?';
+            dwArg          = pRecord->dwArgs;
+            strFmt         = strNext;
+            continue;
+        }
+
+        // Take a copy of just this conversion so it can be handed to printf.
+        // A 64 bit integer is always printed with I64, and the pointer
+        // sized modifiers, which not every runtime knows, are dropped from
+        // one that fitted in an int.
+        TCHAR strOne[32];
+        int   cchSpec = (int)( strNext - strSpec );
+        if( cchSpec > 24 )
+            cchSpec = 24;
+        _tcsncpy( strOne, strSpec, cchSpec );
+        strOne[cchSpec] = 0;
+
+        if( ( type == LOG_ARG_INT64 || ( type == LOG_ARG_INT && *strLength && _tcschr( _T("ztjI"), *strLength ) ) ) &&
+            strLength - strSpec < cchSpec )
+        {
+            int cchPrefix = (int)( strLength - strSpec );
+            strOne[cchPrefix] = 0;
+            if( type == LOG_ARG_INT64 )
+                _tcscat( strOne, _T("I64") );
+            cchPrefix = (int)_tcslen( strOne );
+            strOne[cchPrefix]     = strNext[-1];
+            strOne[cchPrefix + 1] = 0;
+        }
+
+        int     anStar[2] = { 0, 0 };
+        LOG_ARG arg;
+        arg.nValue = 0;
+
+        for( DWORD i = 0; i < dwStars; i++ )
+        {
+            if( dwArg < pRecord->dwArgs )
+                anStar[i] = (int)pRecord->aArgs[dwArg++].nValue;
+        }
+        if( type != LOG_ARG_NONE && dwArg < pRecord->dwArgs )
+            arg = pRecord->aArgs[dwArg++];
+
+        int    cchLeft = cchLine - 1 - cch;
+        TCHAR* strOut  = strLine + cch;
+        int    nOut    = 0;
+
+        switch( type )
+        {
+            case LOG_ARG_NONE:
+                nOut = _sntprintf( strOut, cchLeft, _T("%s"), strSpec[1] == '%' ? _T("%") : strOne );
+                break;
+            case LOG_ARG_INT:
+                nOut = LOG_SNPRINTF( (int)arg.nValue );
+                break;
+            case LOG_ARG_INT64:
+                nOut = LOG_SNPRINTF( arg.nValue );
+                break;
+            case LOG_ARG_DOUBLE:
+                nOut = LOG_SNPRINTF( arg.fValue );
+                break;
+            case LOG_ARG_PTR:
+                if( NULL == arg.pValue && strNext[-1] != 'p' )
+                    arg.pValue = _T("(null)");
+                nOut = LOG_SNPRINTF( arg.pValue );
+                break;
+        }
+
+        // _sntprintf returns a negative number when it truncates
+        cch   += ( nOut < 0 || nOut > cchLeft ) ? cchLeft : nOut;
+        strFmt = strNext;
+    }
+
+    #undef LOG_SNPRINTF
+
+    // Whatever text follows the last conversion
+    while( *strFmt && cch < cchLine - 1 )
+        strLine[cch++] = *strFmt++;
+
+    strLine[cch] = 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Log_Output()
+// Desc: Writes a formatted line to the log file, or stderr
+//-----------------------------------------------------------------------------
+static VOID Log_Output( const TCHAR* strLine )
+{
+    _fputts( strLine, g_pLogFile ? g_pLogFile : stderr );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Log_Drain()
+// Desc: Formats and writes everything currently in the ring. Only ever
+//       called from one thread at a time.
+//-----------------------------------------------------------------------------
+static VOID Log_Drain()
+{
+    TCHAR strLine[LOG_LINE_LENGTH];
+    BOOL  bWrote = FALSE;
+
+    while( TRUE )
+    {
+        LOG_RECORD* pRecord = &g_aLogRing[g_lLogDequeue & (LOG_RING_SIZE - 1)];
+
+        // The slot is ready once its producer has published it
+        if( pRecord->lSequence - ( g_lLogDequeue + 1 ) != 0 )
+            break;
+
+        _ReadWriteBarrier();
+        Log_Format( pRecord, strLine, LOG_LINE_LENGTH );
+
+        // Hand the slot back to the producers for the next lap
+        _ReadWriteBarrier();
+        pRecord->lSequence = g_lLogDequeue + LOG_RING_SIZE;
+        g_lLogDequeue++;
+
+        Log_Output( strLine );
+        bWrote = TRUE;
+    }
+
+    if( bWrote )
+        fflush( g_pLogFile ? g_pLogFile : stderr );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Log_WriterThread()
+// Desc: Drains the ring until asked to stop
+//-----------------------------------------------------------------------------
+static DWORD WINAPI Log_WriterThread( LPVOID pParam )
+{
+    UNREFERENCED_PARAMETER( pParam );
+
+    while( WaitForSingleObject( g_hLogStop, LOG_FLUSH_MS ) == WAIT_TIMEOUT )
+        Log_Drain();
+
+    return 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Log_Init()
+// Desc: Opens the log file and starts the writer thread
+//-----------------------------------------------------------------------------
+HRESULT Log_Init( const TCHAR* strFile )
+{
+    if( g_lLogRunning )
+        return S_OK;
+
+    if( strFile && NULL == ( g_pLogFile = _tfopen( strFile, _T("w") ) ) )
+        return E_FAIL;
+
+    // Each slot starts out owned by the producer for its first lap
+    for( LONG i = 0; i < LOG_RING_SIZE; i++ )
+        g_aLogRing[i].lSequence = g_lLogEnqueue + i;
+    g_lLogDequeue = g_lLogEnqueue;
+
+    g_hLogStop = CreateEvent( NULL, TRUE, FALSE, NULL );
+    if( NULL == g_hLogStop )
+        return E_FAIL;
+
+    InterlockedExchange( &g_lLogRunning, 1 );
+
+    g_hLogThread = CreateThread( NULL, 0, Log_WriterThread, NULL, 0, NULL );
+    if( NULL == g_hLogThread )
+    {
+        Log_Shutdown();
+        return E_FAIL;
+    }
+
+    SetThreadPriority( g_hLogThread, THREAD_PRIORITY_BELOW_NORMAL );
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Log_Shutdown()
+// Desc: Stops the writer thread and flushes what is left. Safe to call more
+//       than once.
+//
+//       Clearing g_lLogRunning sends new messages the slow way, but a
+//       producer that got past that check may still be filling in a slot.
+//       Each producer counts itself in g_lLogWriters before the check and
+//       out after it publishes, so once the count reaches 0 every claimed
+//       slot has been published and the last drain below finds them all.
+//-----------------------------------------------------------------------------
+VOID Log_Shutdown()
+{
+    if( 0 == InterlockedExchange( &g_lLogRunning, 0 ) )
+        return;
+
+    while( g_lLogWriters != 0 )
+        Sleep( 0 );
+
+    if( g_hLogThread )
+    {
+        SetEvent( g_hLogStop );
+        WaitForSingleObject( g_hLogThread, INFINITE );
+        CloseHandle( g_hLogThread );
+        g_hLogThread = NULL;
+    }
+
+    CloseHandle( g_hLogStop );
+    g_hLogStop = NULL;
+
+    Log_Drain();
+
+    if( g_lLogDropped )
+    {
+        TCHAR strLine[64];
+        _sntprintf( strLine, 64, _T("logger: %ld messages dropped\n"), g_lLogDropped );
+        Log_Output( strLine );
+    }
+
+    if( g_pLogFile )
+    {
+        fclose( g_pLogFile );
+        g_pLogFile = NULL;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Log_WriteV()
+// Desc: Captures a message into the ring for the writer thread to format
+//-----------------------------------------------------------------------------
+VOID Log_WriteV( const TCHAR* strFmt, va_list args )
+{
+    if( NULL == strFmt )
+        return;
+
+    // Count this producer in before checking the logger is running, so
+    // Log_Shutdown() can't finish while it is part way through a slot
+    InterlockedIncrement( &g_lLogWriters );
+
+    if( 0 == g_lLogRunning )
+    {
+        InterlockedDecrement( &g_lLogWriters );
+
+        // No writer thread so do it the slow way
+        TCHAR strLine[LOG_LINE_LENGTH];
+        _vsntprintf( strLine, LOG_LINE_LENGTH, strFmt, args );
+        strLine[LOG_LINE_LENGTH - 1] = 0;
+        OutputDebugString( strLine );
+        return;
+    }
+
+    // Claim a slot
+    LOG_RECORD* pRecord;
+    LONG        lPos = g_lLogEnqueue;
+    while( TRUE )
+    {
+        pRecord = &g_aLogRing[lPos & (LOG_RING_SIZE - 1)];
+        LONG lDiff = pRecord->lSequence - lPos;
+
+        if( lDiff == 0 )
+        {
+            LONG lPrev = InterlockedCompareExchange( &g_lLogEnqueue, lPos + 1, lPos );
+            if( lPrev == lPos )
+                break;
+            lPos = lPrev;
+        }
+        else if( lDiff < 0 )
+        {
+            // The writer thread has not caught up, drop the message
+            InterlockedIncrement( &g_lLogDropped );
+            InterlockedDecrement( &g_lLogWriters );
+            return;
+        }
+        else
+        {
+            lPos = g_lLogEnqueue;
+        }
+    }
+
+    // Copy the raw arguments, using the format string to know their types.
+    // A format with more than LOG_MAX_ARGS is kept up to the last one that
+    // fits and marked as truncated.
+    const TCHAR* strSpec;
+    const TCHAR* strLength;
+    const TCHAR* p = strFmt;
+    LOG_ARGTYPE  type;
+    DWORD        dwStars;
+    DWORD        dwArgs = 0;
+    BOOL         bTruncated = FALSE;
+
+    while( NULL != ( p = Log_NextSpec( p, &strSpec, &strLength, &type, &dwStars ) ) )
+    {
+        if( dwArgs + dwStars + ( type != LOG_ARG_NONE ? 1 : 0 ) > LOG_MAX_ARGS )
+        {
+            bTruncated = TRUE;
+            break;
+        }
+
+        for( DWORD i = 0; i < dwStars; i++ )
+            pRecord->aArgs[dwArgs++].nValue = va_arg( args, int );
+
+        switch( type )
+        {
+            case LOG_ARG_INT:    pRecord->aArgs[dwArgs++].nValue = va_arg( args, int );          break;
+            case LOG_ARG_INT64:  pRecord->aArgs[dwArgs++].nValue = va_arg( args, INT64 );        break;
+            case LOG_ARG_DOUBLE: pRecord->aArgs[dwArgs++].fValue = va_arg( args, double );       break;
+            case LOG_ARG_PTR:    pRecord->aArgs[dwArgs++].pValue = va_arg( args, const void* );  break;
+            case LOG_ARG_NONE:   break;
+        }
+    }
+
+    pRecord->strFmt     = strFmt;
+    pRecord->dwArgs     = dwArgs;
+    pRecord->bTruncated = bTruncated;
+
+    // Publish the slot to the writer thread
+    _ReadWriteBarrier();
+    pRecord->lSequence = lPos + 1;
+
+    InterlockedDecrement( &g_lLogWriters );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Log_Write()
+// Desc: printf style front end to Log_WriteV()
+//-----------------------------------------------------------------------------
+VOID Log_Write( const TCHAR* strFmt, ... )
+{
+    va_list args;
+    va_start( args, strFmt );
+    Log_WriteV( strFmt, args );
+    va_end( args );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Log_GetDropped()
+// Desc: Returns how many messages were lost because the ring was full
+//-----------------------------------------------------------------------------
+LONG Log_GetDropped()
+{
+    return g_lLogDropped;
+}
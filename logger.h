@@ -0,0 +1,41 @@
+//-----------------------------------------------------------------------------
+// File: logger.h
+//
+// Desc: Deferred-format logger. Log_Write() only copies the format string
+//       pointer and its raw arguments into a lock-free ring; a background
+//       thread does the actual formatting and writes the result to a file
+//       or stderr, so logging from the game loop does not hurt frame times.
+//
+//       As formatting happens later on another thread, the format string
+//       and any %s arguments must still be valid after Log_Write() returns.
+//       String literals and __FILE__ are fine, stack buffers are not.
+//
+//       At most 8 arguments are kept, counting '*' widths. Conversions past
+//       them are written as '?' rather than dropped silently.
+//-----------------------------------------------------------------------------
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdarg.h>
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Log_*()
+// Desc: Log_Init() starts the writer thread, sending output to strFile or to
+//       stderr if strFile is NULL. Log_Shutdown() waits for messages being
+//       queued on other threads, writes everything queued and stops the
+//       thread. Until Log_Init() is called, or once Log_Shutdown() starts,
+//       Log_Write() formats and writes synchronously.
+//-----------------------------------------------------------------------------
+HRESULT Log_Init( const TCHAR* strFile );
+VOID    Log_Shutdown();
+VOID    Log_Write( const TCHAR* strFmt, ... );
+VOID    Log_WriteV( const TCHAR* strFmt, va_list args );
+LONG    Log_GetDropped();
+
+
+
+
+#endif // LOGGER_H
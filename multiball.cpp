@@ -0,0 +1,375 @@
+//-----------------------------------------------------------------------------
+// File: multiball.cpp
+//
+// Desc: Multi-ball physics and the broadphase grid.
+//
+//       Each step moves every ball on its own against the walls and bats,
+//       using the same rules as UpdateBall(), then sorts the balls into
+//       grid cells with a counting sort and tests each ball only against
+//       the balls in its own cell and the neighbouring cells. Each pair of
+//       neighbouring cells is visited once, from whichever is first in
+//       scan order, so no pair is tested twice.
+//-----------------------------------------------------------------------------
+#define STRICT
+#include <windows.h>
+#include <math.h>
+#include "dxutil.h"
+#include "multiball.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMultiBall()
+// Desc:
+//-----------------------------------------------------------------------------
+CMultiBall::CMultiBall()
+{
+    m_pBalls       = NULL;
+    m_pdwBallCell  = NULL;
+    m_pdwCellBalls = NULL;
+    m_dwNumBalls   = 0;
+    m_dwLeadBall   = 0;
+    m_dwSeed       = 0;
+    m_dwPairTests  = 0;
+    m_dwCollisions = 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: ~CMultiBall()
+// Desc:
+//-----------------------------------------------------------------------------
+CMultiBall::~CMultiBall()
+{
+    Destroy();
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMultiBall::Create()
+// Desc: Allocates room for dwNumBalls balls and serves them. The same seed
+//       always gives the same game.
+//-----------------------------------------------------------------------------
+HRESULT CMultiBall::Create( DWORD dwNumBalls, DWORD dwSeed )
+{
+    Destroy();
+
+    if( dwNumBalls == 0 || dwNumBalls > MULTIBALL_MAX )
+        return E_INVALIDARG;
+
+    m_pBalls       = new BALL_STRUCT[dwNumBalls];
+    m_pdwBallCell  = new DWORD[dwNumBalls];
+    m_pdwCellBalls = new DWORD[dwNumBalls];
+    if( NULL == m_pBalls || NULL == m_pdwBallCell || NULL == m_pdwCellBalls )
+    {
+        Destroy();
+        return E_OUTOFMEMORY;
+    }
+
+    m_dwNumBalls = dwNumBalls;
+    m_dwSeed     = dwSeed;
+
+    Serve();
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMultiBall::Destroy()
+// Desc:
+//-----------------------------------------------------------------------------
+VOID CMultiBall::Destroy()
+{
+    SAFE_DELETE_ARRAY( m_pBalls );
+    SAFE_DELETE_ARRAY( m_pdwBallCell );
+    SAFE_DELETE_ARRAY( m_pdwCellBalls );
+
+    m_dwNumBalls = 0;
+    m_dwLeadBall = 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMultiBall::Serve()
+// Desc: Scatters the balls over the middle half of the field, each with a
+//       fresh serve
+//-----------------------------------------------------------------------------
+VOID CMultiBall::Serve()
+{
+    for( DWORD i = 0; i < m_dwNumBalls; i++ )
+    {
+        ServeBall( &m_pBalls[i] );
+        m_pBalls[i].fPosX = FIELD_WIDTH / 4 + Random( FIELD_WIDTH / 2 - BALL_SPRITE_DIAMETER );
+    }
+
+    m_dwLeadBall = 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMultiBall::Random()
+// Desc: A number from 0 up to fRange. This has its own generator rather than
+//       using rand(), so a multi-ball game replays the same from its seed.
+//-----------------------------------------------------------------------------
+FLOAT CMultiBall::Random( FLOAT fRange )
+{
+    m_dwSeed = m_dwSeed * 1664525 + 1013904223;
+    return (FLOAT)( ( m_dwSeed >> 8 ) & 0xFFFFFF ) * ( fRange / 16777216.0f );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMultiBall::ServeBall()
+// Desc: Puts a ball back on the centre line with a new velocity, picked the
+//       same way as Sim_Serve() does
+//-----------------------------------------------------------------------------
+VOID CMultiBall::ServeBall( BALL_STRUCT* pBall )
+{
+    pBall->fPosX = (FLOAT)( ( FIELD_WIDTH / 2 ) - ( BALL_SPRITE_DIAMETER / 2 ) );
+    pBall->fPosY = Random( FIELD_HEIGHT - BALL_SPRITE_DIAMETER );
+
+    // Keep changing the velocity until speed is realistic
+    do
+    {
+        pBall->fVelX = Random( 500.0f ) - 250.0f;
+        pBall->fVelY = Random( 500.0f ) - 250.0f;
+    }
+    while( fabsf( pBall->fVelX ) <= 100.0f || fabsf( pBall->fVelY ) <= 50.0f );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMultiBall::MoveBall()
+// Desc: Moves one ball and bounces it off the walls and bats. A ball that
+//       gets past a bat scores a point and is served again.
+//-----------------------------------------------------------------------------
+VOID CMultiBall::MoveBall( BALL_STRUCT* pBall, FLOAT fTimeDelta,
+                           SPRITE_STRUCT* pPlayerBat, SPRITE_STRUCT* pComputerBat,
+                           DWORD* pdwPlayerPoints, DWORD* pdwComputerPoints )
+{
+    pBall->fPosX += pBall->fVelX * fTimeDelta;
+    pBall->fPosY += pBall->fVelY * fTimeDelta;
+
+    // Check if either side scored
+    if( pBall->fPosX < 0.0f )
+    {
+        (*pdwComputerPoints)++;
+        ServeBall( pBall );
+        return;
+    }
+
+    if( pBall->fPosX >= FIELD_WIDTH - BALL_SPRITE_DIAMETER )
+    {
+        (*pdwPlayerPoints)++;
+        ServeBall( pBall );
+        return;
+    }
+
+    // Bounce the ball if it hits the top or bottom
+    if( pBall->fPosY < 0 )
+    {
+        pBall->fPosY = 0;
+        pBall->fVelY = -pBall->fVelY;
+    }
+    else if( pBall->fPosY > FIELD_HEIGHT - BALL_SPRITE_DIAMETER )
+    {
+        pBall->fPosY = FIELD_HEIGHT - 1 - BALL_SPRITE_DIAMETER;
+        pBall->fVelY = -pBall->fVelY;
+    }
+
+    // Bounce the ball if it hit either bat. Only balls heading towards a
+    // bat can hit it, or one pushed back by another ball would stick.
+    if( pBall->fVelX < 0 &&
+        pBall->fPosX <= pPlayerBat->fPosX + BAT_SPRITE_WIDTH &&
+        pBall->fPosY + BALL_SPRITE_DIAMETER >= pPlayerBat->fPosY &&
+        pBall->fPosY <= pPlayerBat->fPosY + BAT_SPRITE_HEIGHT )
+    {
+        pBall->fPosX = (FLOAT)( BAT_EDGE_SPACER + BAT_SPRITE_WIDTH );
+        pBall->fVelX = -pBall->fVelX + BALL_SPEED_INC;
+    }
+
+    if( pBall->fVelX > 0 &&
+        pBall->fPosX + BALL_SPRITE_DIAMETER >= pComputerBat->fPosX &&
+        pBall->fPosY + BALL_SPRITE_DIAMETER >= pComputerBat->fPosY &&
+        pBall->fPosY <= pComputerBat->fPosY + BAT_SPRITE_HEIGHT )
+    {
+        pBall->fPosX = (FLOAT)( FIELD_WIDTH - ( BAT_EDGE_SPACER + BAT_SPRITE_WIDTH + BALL_SPRITE_DIAMETER ) );
+        pBall->fVelX = -pBall->fVelX - BALL_SPEED_INC;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMultiBall::BuildGrid()
+// Desc: Counting sort of the balls by the cell their centre is in. After
+//       this the balls in cell c are m_pdwCellBalls[m_adwCellStart[c]] up
+//       to, but not including, m_pdwCellBalls[m_adwCellStart[c + 1]].
+//-----------------------------------------------------------------------------
+VOID CMultiBall::BuildGrid()
+{
+    ZeroMemory( m_adwCellStart, sizeof(m_adwCellStart) );
+
+    for( DWORD i = 0; i < m_dwNumBalls; i++ )
+    {
+        int x = (int)( m_pBalls[i].fPosX + BALL_SPRITE_DIAMETER / 2 ) / MULTIBALL_CELL_SIZE;
+        int y = (int)( m_pBalls[i].fPosY + BALL_SPRITE_DIAMETER / 2 ) / MULTIBALL_CELL_SIZE;
+        x = max( 0, min( MULTIBALL_GRID_WIDTH - 1, x ) );
+        y = max( 0, min( MULTIBALL_GRID_HEIGHT - 1, y ) );
+
+        m_pdwBallCell[i] = y * MULTIBALL_GRID_WIDTH + x;
+        m_adwCellStart[m_pdwBallCell[i]]++;
+    }
+
+    // Turn the counts into the end of each cell's run...
+    DWORD dwTotal = 0;
+    for( DWORD c = 0; c <= MULTIBALL_GRID_CELLS; c++ )
+    {
+        dwTotal += m_adwCellStart[c];
+        m_adwCellStart[c] = dwTotal;
+    }
+
+    // ...then fill each run from the back, which leaves every entry
+    // pointing at the start of its run
+    for( DWORD i = m_dwNumBalls; i-- > 0; )
+        m_pdwCellBalls[--m_adwCellStart[m_pdwBallCell[i]]] = i;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMultiBall::CollideCells()
+// Desc: Tests every ball in one cell against every ball in another, or
+//       every pair within a cell if both are the same
+//-----------------------------------------------------------------------------
+VOID CMultiBall::CollideCells( DWORD dwCellA, DWORD dwCellB )
+{
+    DWORD dwEndA   = m_adwCellStart[dwCellA + 1];
+    DWORD dwStartB = m_adwCellStart[dwCellB];
+    DWORD dwEndB   = m_adwCellStart[dwCellB + 1];
+
+    for( DWORD a = m_adwCellStart[dwCellA]; a < dwEndA; a++ )
+    {
+        DWORD b = ( dwCellA == dwCellB ) ? a + 1 : dwStartB;
+        for( ; b < dwEndB; b++ )
+            Collide( &m_pBalls[m_pdwCellBalls[a]], &m_pBalls[m_pdwCellBalls[b]] );
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMultiBall::Collide()
+// Desc: If two balls overlap, pushes them apart and swaps their velocities
+//       along the line between their centres, which is an elastic collision
+//       between equal masses
+//-----------------------------------------------------------------------------
+VOID CMultiBall::Collide( BALL_STRUCT* pBallA, BALL_STRUCT* pBallB )
+{
+    m_dwPairTests++;
+
+    FLOAT fDX    = pBallB->fPosX - pBallA->fPosX;
+    FLOAT fDY    = pBallB->fPosY - pBallA->fPosY;
+    FLOAT fDist2 = fDX * fDX + fDY * fDY;
+
+    if( fDist2 >= BALL_SPRITE_DIAMETER * BALL_SPRITE_DIAMETER || fDist2 == 0.0f )
+        return;
+
+    m_dwCollisions++;
+
+    FLOAT fDist = sqrtf( fDist2 );
+    FLOAT fNX   = fDX / fDist;
+    FLOAT fNY   = fDY / fDist;
+
+    FLOAT fPush = ( BALL_SPRITE_DIAMETER - fDist ) * 0.5f;
+    pBallA->fPosX -= fNX * fPush;
+    pBallA->fPosY -= fNY * fPush;
+    pBallB->fPosX += fNX * fPush;
+    pBallB->fPosY += fNY * fPush;
+
+    // Only exchange momentum if they are still closing on each other
+    FLOAT fClosing = ( pBallA->fVelX - pBallB->fVelX ) * fNX +
+                     ( pBallA->fVelY - pBallB->fVelY ) * fNY;
+    if( fClosing > 0.0f )
+    {
+        pBallA->fVelX -= fClosing * fNX;
+        pBallA->fVelY -= fClosing * fNY;
+        pBallB->fVelX += fClosing * fNX;
+        pBallB->fVelY += fClosing * fNY;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMultiBall::Update()
+// Desc: Moves every ball, then resolves ball-ball collisions through the
+//       grid
+//-----------------------------------------------------------------------------
+VOID CMultiBall::Update( FLOAT fTimeDelta, SPRITE_STRUCT* pPlayerBat, SPRITE_STRUCT* pComputerBat,
+                         DWORD* pdwPlayerPoints, DWORD* pdwComputerPoints )
+{
+    *pdwPlayerPoints   = 0;
+    *pdwComputerPoints = 0;
+    m_dwPairTests      = 0;
+    m_dwCollisions     = 0;
+
+    FLOAT fLeadX = -1.0f;
+
+    for( DWORD i = 0; i < m_dwNumBalls; i++ )
+    {
+        MoveBall( &m_pBalls[i], fTimeDelta, pPlayerBat, pComputerBat,
+                  pdwPlayerPoints, pdwComputerPoints );
+
+        if( m_pBalls[i].fVelX > 0 && m_pBalls[i].fPosX > fLeadX )
+        {
+            fLeadX       = m_pBalls[i].fPosX;
+            m_dwLeadBall = i;
+        }
+    }
+
+    BuildGrid();
+
+    // Visit each cell with the neighbours to its right and below, so each
+    // pair of neighbouring cells is seen once
+    for( DWORD y = 0; y < MULTIBALL_GRID_HEIGHT; y++ )
+    {
+        for( DWORD x = 0; x < MULTIBALL_GRID_WIDTH; x++ )
+        {
+            DWORD c = y * MULTIBALL_GRID_WIDTH + x;
+
+            CollideCells( c, c );
+            if( x + 1 < MULTIBALL_GRID_WIDTH )
+                CollideCells( c, c + 1 );
+
+            if( y + 1 < MULTIBALL_GRID_HEIGHT )
+            {
+                if( x > 0 )
+                    CollideCells( c, c + MULTIBALL_GRID_WIDTH - 1 );
+                CollideCells( c, c + MULTIBALL_GRID_WIDTH );
+                if( x + 1 < MULTIBALL_GRID_WIDTH )
+                    CollideCells( c, c + MULTIBALL_GRID_WIDTH + 1 );
+            }
+        }
+    }
+}
@@ -0,0 +1,94 @@
+//-----------------------------------------------------------------------------
+// File: multiball.h
+//
+// Desc: Multi-ball party mode. Hundreds or thousands of balls share the
+//       field with the two bats and bounce off each other as well as the
+//       walls. Ball-ball collisions are found through a uniform grid over
+//       the field, so the cost of a step grows with the number of balls
+//       rather than the number of pairs of balls.
+//-----------------------------------------------------------------------------
+#ifndef MULTIBALL_H
+#define MULTIBALL_H
+
+#include "pongy.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+#define MULTIBALL_MAX           4096
+
+// Grid cells are one ball across, so two balls that touch are always in
+// the same or neighbouring cells
+#define MULTIBALL_CELL_SIZE     BALL_SPRITE_DIAMETER
+#define MULTIBALL_GRID_WIDTH    ( ( FIELD_WIDTH  + MULTIBALL_CELL_SIZE - 1 ) / MULTIBALL_CELL_SIZE )
+#define MULTIBALL_GRID_HEIGHT   ( ( FIELD_HEIGHT + MULTIBALL_CELL_SIZE - 1 ) / MULTIBALL_CELL_SIZE )
+#define MULTIBALL_GRID_CELLS    ( MULTIBALL_GRID_WIDTH * MULTIBALL_GRID_HEIGHT )
+
+struct BALL_STRUCT
+{
+    FLOAT fPosX;
+    FLOAT fPosY;
+    FLOAT fVelX;
+    FLOAT fVelY;
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: class CMultiBall
+// Desc: The balls and the broadphase grid. All memory is allocated by
+//       Create(), Update() allocates nothing.
+//-----------------------------------------------------------------------------
+class CMultiBall
+{
+    BALL_STRUCT* m_pBalls;
+    DWORD*       m_pdwBallCell;     // Grid cell of each ball this step
+    DWORD*       m_pdwCellBalls;    // Ball indices, sorted by cell
+    DWORD        m_adwCellStart[MULTIBALL_GRID_CELLS + 1];
+    DWORD        m_dwNumBalls;
+    DWORD        m_dwLeadBall;
+    DWORD        m_dwSeed;
+    DWORD        m_dwPairTests;
+    DWORD        m_dwCollisions;
+
+    FLOAT   Random( FLOAT fRange );
+    VOID    ServeBall( BALL_STRUCT* pBall );
+    VOID    MoveBall( BALL_STRUCT* pBall, FLOAT fTimeDelta,
+                      SPRITE_STRUCT* pPlayerBat, SPRITE_STRUCT* pComputerBat,
+                      DWORD* pdwPlayerPoints, DWORD* pdwComputerPoints );
+    VOID    BuildGrid();
+    VOID    CollideCells( DWORD dwCellA, DWORD dwCellB );
+    VOID    Collide( BALL_STRUCT* pBallA, BALL_STRUCT* pBallB );
+
+public:
+    CMultiBall();
+    ~CMultiBall();
+
+    HRESULT Create( DWORD dwNumBalls, DWORD dwSeed );
+    VOID    Destroy();
+    VOID    Serve();
+
+    // Steps every ball, returning the points scored by each side
+    VOID    Update( FLOAT fTimeDelta, SPRITE_STRUCT* pPlayerBat, SPRITE_STRUCT* pComputerBat,
+                    DWORD* pdwPlayerPoints, DWORD* pdwComputerPoints );
+
+    BOOL         IsActive()         { return m_dwNumBalls > 0; }
+    DWORD        GetNumBalls()      { return m_dwNumBalls; }
+    BALL_STRUCT* GetBalls()         { return m_pBalls; }
+
+    // The ball heading for the computer's bat that is closest to it
+    BALL_STRUCT* GetLeadBall()      { return &m_pBalls[m_dwLeadBall]; }
+
+    // Broadphase counters for the last Update()
+    DWORD        GetPairTests()     { return m_dwPairTests; }
+    DWORD        GetCollisions()    { return m_dwCollisions; }
+};
+
+
+
+
+#endif // MULTIBALL_H
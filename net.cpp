@@ -0,0 +1,459 @@
+//-----------------------------------------------------------------------------
+// File: net.cpp
+//
+// Desc: The UDP transport. Winsock has to be included before windows.h, so
+//       this file includes it first rather than leaving it to net.h.
+//-----------------------------------------------------------------------------
+#define STRICT
+#include <winsock2.h>
+#include <windows.h>
+#include <stdlib.h>
+#include <string.h>
+#include "net.h"
+
+#pragma comment( lib, "ws2_32.lib" )
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CUdpTransport::CUdpTransport()
+// Desc:
+//-----------------------------------------------------------------------------
+CUdpTransport::CUdpTransport()
+{
+    m_sock          = INVALID_SOCKET;
+    m_dwPeerAddr    = 0;
+    m_wPeerPort     = 0;
+    m_bStarted      = FALSE;
+    m_pDelayed      = NULL;
+    m_dwNumDelayed  = 0;
+    m_dwLatency     = 0;
+    m_dwJitter      = 0;
+    m_dwLossPercent = 0;
+    m_dwSeed        = 1;
+    m_lSent         = 0;
+    m_lReceived     = 0;
+    m_lDropped      = 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CUdpTransport::~CUdpTransport()
+// Desc:
+//-----------------------------------------------------------------------------
+CUdpTransport::~CUdpTransport()
+{
+    Destroy();
+    delete[] m_pDelayed;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CUdpTransport::Create()
+// Desc: Opens a non-blocking UDP socket on wLocalPort
+//-----------------------------------------------------------------------------
+HRESULT CUdpTransport::Create( WORD wLocalPort )
+{
+    WSADATA wsaData;
+
+    Destroy();
+
+    if( 0 != WSAStartup( MAKEWORD( 2, 2 ), &wsaData ) )
+        return E_FAIL;
+    m_bStarted = TRUE;
+
+    if( INVALID_SOCKET == ( m_sock = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP ) ) )
+    {
+        Destroy();
+        return E_FAIL;
+    }
+
+    sockaddr_in addr;
+    ZeroMemory( &addr, sizeof(addr) );
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl( INADDR_ANY );
+    addr.sin_port        = htons( wLocalPort );
+
+    u_long lNonBlocking = 1;
+    if( SOCKET_ERROR == bind( m_sock, (sockaddr*)&addr, sizeof(addr) ) ||
+        SOCKET_ERROR == ioctlsocket( m_sock, FIONBIO, &lNonBlocking ) )
+    {
+        Destroy();
+        return E_FAIL;
+    }
+
+    m_dwSeed = GetTickCount() | 1;
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CUdpTransport::Destroy()
+// Desc: Closes the socket, throwing away any held back packets
+//-----------------------------------------------------------------------------
+VOID CUdpTransport::Destroy()
+{
+    if( m_sock != INVALID_SOCKET )
+    {
+        closesocket( m_sock );
+        m_sock = INVALID_SOCKET;
+    }
+
+    if( m_bStarted )
+    {
+        WSACleanup();
+        m_bStarted = FALSE;
+    }
+
+    for( DWORD i = 0; m_pDelayed && i < NET_DELAY_SLOTS; i++ )
+        m_pDelayed[i].dwSize = 0;
+
+    m_dwNumDelayed = 0;
+    m_dwPeerAddr   = 0;
+    m_wPeerPort    = 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CUdpTransport::SetPeer()
+// Desc: Sets where packets go. strPeer is a dotted IPv4 address, with an
+//       optional ":port" after it, otherwise wDefaultPort is used.
+//-----------------------------------------------------------------------------
+HRESULT CUdpTransport::SetPeer( const char* strPeer, WORD wDefaultPort )
+{
+    char  strAddr[64];
+    WORD  wPort = wDefaultPort;
+
+    strncpy( strAddr, strPeer, sizeof(strAddr) - 1 );
+    strAddr[sizeof(strAddr) - 1] = 0;
+
+    char* pColon = strchr( strAddr, ':' );
+    if( pColon )
+    {
+        *pColon = 0;
+        wPort   = (WORD)atoi( pColon + 1 );
+    }
+
+    DWORD dwAddr = inet_addr( strAddr );
+    if( dwAddr == INADDR_NONE || wPort == 0 )
+        return E_INVALIDARG;
+
+    m_dwPeerAddr = dwAddr;
+    m_wPeerPort  = htons( wPort );
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CUdpTransport::SetConditions()
+// Desc: Makes the network worse. Each packet sent is held back for
+//       dwLatency ms plus up to dwJitter more, and dropped dwLossPercent
+//       times in a hundred.
+//-----------------------------------------------------------------------------
+HRESULT CUdpTransport::SetConditions( DWORD dwLatency, DWORD dwJitter, DWORD dwLossPercent )
+{
+    if( ( dwLatency || dwJitter ) && NULL == m_pDelayed )
+    {
+        if( NULL == ( m_pDelayed = new DELAYED[NET_DELAY_SLOTS] ) )
+            return E_OUTOFMEMORY;
+
+        for( DWORD i = 0; i < NET_DELAY_SLOTS; i++ )
+            m_pDelayed[i].dwSize = 0;
+    }
+
+    m_dwLatency     = dwLatency;
+    m_dwJitter      = dwJitter;
+    m_dwLossPercent = dwLossPercent;
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CUdpTransport::Random()
+// Desc: A number from 0 up to dwRange - 1
+//-----------------------------------------------------------------------------
+DWORD CUdpTransport::Random( DWORD dwRange )
+{
+    m_dwSeed = m_dwSeed * 1664525 + 1013904223;
+    return ( ( m_dwSeed >> 8 ) & 0xFFFFFF ) % dwRange;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CUdpTransport::SendNow()
+// Desc: Sends a packet to the peer straight away
+//-----------------------------------------------------------------------------
+HRESULT CUdpTransport::SendNow( const VOID* pData, DWORD dwSize )
+{
+    NET_ADDRESS to;
+    to.dwAddr = m_dwPeerAddr;
+    to.wPort  = m_wPeerPort;
+
+    return SendTo( &to, pData, dwSize );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CUdpTransport::SendTo()
+// Desc: Sends a packet to pTo straight away. Winsock lets any number of
+//       threads send on one socket at once.
+//-----------------------------------------------------------------------------
+HRESULT CUdpTransport::SendTo( const NET_ADDRESS* pTo, const VOID* pData, DWORD dwSize )
+{
+    if( m_sock == INVALID_SOCKET )
+        return E_FAIL;
+
+    sockaddr_in addr;
+    ZeroMemory( &addr, sizeof(addr) );
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = pTo->dwAddr;
+    addr.sin_port        = pTo->wPort;
+
+    if( SOCKET_ERROR == sendto( m_sock, (const char*)pData, (int)dwSize, 0,
+                                (sockaddr*)&addr, sizeof(addr) ) )
+    {
+        // A full send buffer is just more packet loss to a UDP game
+        InterlockedIncrement( &m_lDropped );
+        return S_FALSE;
+    }
+
+    InterlockedIncrement( &m_lSent );
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CUdpTransport::Send()
+// Desc: Sends a packet to the peer, or holds it back if there is latency
+//       to add. Packets are silently lost if there is no peer yet, or if
+//       the network is set up to lose them.
+//-----------------------------------------------------------------------------
+HRESULT CUdpTransport::Send( const VOID* pData, DWORD dwSize, DWORD dwNow )
+{
+    if( m_sock == INVALID_SOCKET )
+        return E_FAIL;
+
+    if( dwSize > NET_MAX_PACKET )
+        return E_INVALIDARG;
+
+    if( !HasPeer() )
+        return S_FALSE;
+
+    if( m_dwLossPercent && Random( 100 ) < m_dwLossPercent )
+    {
+        InterlockedIncrement( &m_lDropped );
+        return S_FALSE;
+    }
+
+    if( m_dwLatency == 0 && m_dwJitter == 0 )
+        return SendNow( pData, dwSize );
+
+    if( m_dwNumDelayed == NET_DELAY_SLOTS )
+    {
+        InterlockedIncrement( &m_lDropped );
+        return S_FALSE;
+    }
+
+    for( DWORD i = 0; i < NET_DELAY_SLOTS; i++ )
+    {
+        DELAYED* pDelayed = &m_pDelayed[i];
+        if( pDelayed->dwSize )
+            continue;
+
+        pDelayed->dwSendTime = dwNow + m_dwLatency + ( m_dwJitter ? Random( m_dwJitter + 1 ) : 0 );
+        pDelayed->dwSize     = dwSize;
+        memcpy( pDelayed->abData, pData, dwSize );
+        m_dwNumDelayed++;
+        break;
+    }
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CUdpTransport::Update()
+// Desc: Sends every held back packet whose time has come. With jitter they
+//       can go out in a different order to the one they were sent in, just
+//       as they could on a real network.
+//-----------------------------------------------------------------------------
+VOID CUdpTransport::Update( DWORD dwNow )
+{
+    for( DWORD i = 0; i < NET_DELAY_SLOTS && m_dwNumDelayed; i++ )
+    {
+        DELAYED* pDelayed = &m_pDelayed[i];
+
+        if( pDelayed->dwSize && (LONG)( dwNow - pDelayed->dwSendTime ) >= 0 )
+        {
+            SendNow( pDelayed->abData, pDelayed->dwSize );
+            pDelayed->dwSize = 0;
+            m_dwNumDelayed--;
+        }
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CUdpTransport::ReceiveAny()
+// Desc: Takes the next packet from the socket, whoever sent it
+//-----------------------------------------------------------------------------
+HRESULT CUdpTransport::ReceiveAny( VOID* pData, DWORD* pdwSize, NET_ADDRESS* pFrom )
+{
+    if( m_sock == INVALID_SOCKET )
+        return E_FAIL;
+
+    while( TRUE )
+    {
+        sockaddr_in addr;
+        int         nAddrLen = sizeof(addr);
+        int         nSize    = recvfrom( m_sock, (char*)pData, (int)*pdwSize, 0,
+                                         (sockaddr*)&addr, &nAddrLen );
+
+        // Nothing waiting, or an error that only spoils one packet: the
+        // peer's port being closed, which UDP reports on the next receive,
+        // or a packet too big to be one of ours
+        if( nSize == SOCKET_ERROR )
+        {
+            int nError = WSAGetLastError();
+            if( nError == WSAEWOULDBLOCK )
+                return S_FALSE;
+            if( nError == WSAECONNRESET || nError == WSAEMSGSIZE )
+                continue;
+            return E_FAIL;
+        }
+
+        pFrom->dwAddr = addr.sin_addr.s_addr;
+        pFrom->wPort  = addr.sin_port;
+        *pdwSize      = (DWORD)nSize;
+        return S_OK;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CUdpTransport::Receive()
+// Desc: Takes the next packet from the peer, if there is one. Until a peer
+//       is set the first sender becomes the peer; after that packets from
+//       anyone else are ignored.
+//-----------------------------------------------------------------------------
+HRESULT CUdpTransport::Receive( VOID* pData, DWORD* pdwSize )
+{
+    DWORD   dwBufferSize = *pdwSize;
+    HRESULT hr;
+
+    while( TRUE )
+    {
+        NET_ADDRESS from;
+
+        *pdwSize = dwBufferSize;
+        if( S_OK != ( hr = ReceiveAny( pData, pdwSize, &from ) ) )
+            return hr;
+
+        if( !HasPeer() )
+        {
+            m_dwPeerAddr = from.dwAddr;
+            m_wPeerPort  = from.wPort;
+        }
+        else if( from.dwAddr != m_dwPeerAddr || from.wPort != m_wPeerPort )
+        {
+            continue;
+        }
+
+        InterlockedIncrement( &m_lReceived );
+        return S_OK;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CUdpTransport::ReceiveFrom()
+// Desc: Takes the next packet from anyone, if there is one
+//-----------------------------------------------------------------------------
+HRESULT CUdpTransport::ReceiveFrom( VOID* pData, DWORD* pdwSize, NET_ADDRESS* pFrom )
+{
+    HRESULT hr = ReceiveAny( pData, pdwSize, pFrom );
+    if( hr == S_OK )
+        InterlockedIncrement( &m_lReceived );
+
+    return hr;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CUdpTransport::Wait()
+// Desc: Blocks in select() until the socket has a packet or dwTimeout ms
+//       have gone by. With every client on the one socket there is only
+//       ever one thing to wait on.
+//-----------------------------------------------------------------------------
+HRESULT CUdpTransport::Wait( DWORD dwTimeout )
+{
+    if( m_sock == INVALID_SOCKET )
+        return E_FAIL;
+
+    fd_set  readSet;
+    timeval tv;
+
+    FD_ZERO( &readSet );
+    FD_SET( m_sock, &readSet );
+    tv.tv_sec  = dwTimeout / 1000;
+    tv.tv_usec = ( dwTimeout % 1000 ) * 1000;
+
+    int nReady = select( 0, &readSet, NULL, NULL, &tv );
+    if( nReady == SOCKET_ERROR )
+        return E_FAIL;
+
+    return nReady ? S_OK : S_FALSE;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CUdpTransport::SetBufferSize()
+// Desc: A burst of packets bigger than the receive buffer is lost before
+//       anyone gets to read it, so a server asks for a big one
+//-----------------------------------------------------------------------------
+HRESULT CUdpTransport::SetBufferSize( DWORD dwBytes )
+{
+    if( m_sock == INVALID_SOCKET )
+        return E_FAIL;
+
+    int nBytes = (int)dwBytes;
+    if( SOCKET_ERROR == setsockopt( m_sock, SOL_SOCKET, SO_RCVBUF, (const char*)&nBytes, sizeof(nBytes) ) ||
+        SOCKET_ERROR == setsockopt( m_sock, SOL_SOCKET, SO_SNDBUF, (const char*)&nBytes, sizeof(nBytes) ) )
+        return E_FAIL;
+
+    return S_OK;
+}
@@ -0,0 +1,123 @@
+//-----------------------------------------------------------------------------
+// File: net.h
+//
+// Desc: A bare UDP transport between two peers, with bad network
+//       conditions that can be switched on for testing. Outgoing packets
+//       can be held back by a fixed latency plus random jitter, or dropped
+//       at random, so two copies of the game on one machine talking over
+//       127.0.0.1 behave as if they were far apart.
+//
+//       Nothing here knows the time; the caller passes it in, so a test can
+//       run the network on a clock of its own.
+//
+//       A server talking to many clients over the one socket uses SendTo()
+//       and ReceiveFrom() instead, which take the address with each packet
+//       and skip the bad conditions.
+//-----------------------------------------------------------------------------
+#ifndef NET_H
+#define NET_H
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+#define NET_MAX_PACKET          256     // Largest packet in bytes
+#define NET_DELAY_SLOTS         256     // Packets that can be held back at once
+
+// Where a packet came from or goes to, both in network byte order
+struct NET_ADDRESS
+{
+    DWORD   dwAddr;
+    WORD    wPort;
+};
+
+#define NET_SAME_ADDRESS(a,b)   ( (a)->dwAddr == (b)->dwAddr && (a)->wPort == (b)->wPort )
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: class CUdpTransport
+// Desc: One non-blocking UDP socket and the held back packets. The peer is
+//       either set up front or, for the side that waits to be joined, taken
+//       from the first packet that arrives.
+//-----------------------------------------------------------------------------
+class CUdpTransport
+{
+    struct DELAYED
+    {
+        DWORD   dwSendTime;
+        DWORD   dwSize;             // 0 if the slot is free
+        BYTE    abData[NET_MAX_PACKET];
+    };
+
+    SOCKET          m_sock;
+    DWORD           m_dwPeerAddr;   // Both in network byte order
+    WORD            m_wPeerPort;
+    BOOL            m_bStarted;     // WSAStartup() has been called
+
+    DELAYED*        m_pDelayed;     // NET_DELAY_SLOTS of them, once there is latency
+    DWORD           m_dwNumDelayed;
+    DWORD           m_dwLatency;
+    DWORD           m_dwJitter;
+    DWORD           m_dwLossPercent;
+    DWORD           m_dwSeed;
+
+    // Bumped with Interlocked*() as SendTo() can be called from many threads
+    volatile LONG   m_lSent;
+    volatile LONG   m_lReceived;
+    volatile LONG   m_lDropped;
+
+    DWORD   Random( DWORD dwRange );
+    HRESULT SendNow( const VOID* pData, DWORD dwSize );
+    HRESULT ReceiveAny( VOID* pData, DWORD* pdwSize, NET_ADDRESS* pFrom );
+
+    CUdpTransport( const CUdpTransport& );
+    CUdpTransport& operator=( const CUdpTransport& );
+
+public:
+    CUdpTransport();
+    ~CUdpTransport();
+
+    // wLocalPort of 0 lets the system pick one
+    HRESULT Create( WORD wLocalPort );
+    VOID    Destroy();
+
+    // strPeer is a dotted IPv4 address, with or without ":port"
+    HRESULT SetPeer( const char* strPeer, WORD wDefaultPort );
+    BOOL    HasPeer()               { return m_wPeerPort != 0; }
+
+    // The held back packets are only allocated once latency is asked for,
+    // so a transport without it stays small
+    HRESULT SetConditions( DWORD dwLatency, DWORD dwJitter, DWORD dwLossPercent );
+
+    // Send() queues the packet if there is latency to add, Update() sends
+    // any that are due. Receive() returns S_FALSE when nothing is waiting.
+    HRESULT Send( const VOID* pData, DWORD dwSize, DWORD dwNow );
+    VOID    Update( DWORD dwNow );
+    HRESULT Receive( VOID* pData, DWORD* pdwSize );
+
+    // For many peers. SendTo() is safe to call from several threads at once,
+    // ReceiveFrom() returns S_FALSE when nothing is waiting.
+    HRESULT SendTo( const NET_ADDRESS* pTo, const VOID* pData, DWORD dwSize );
+    HRESULT ReceiveFrom( VOID* pData, DWORD* pdwSize, NET_ADDRESS* pFrom );
+
+    // Waits up to dwTimeout ms for a packet to arrive. Returns S_FALSE if
+    // none did.
+    HRESULT Wait( DWORD dwTimeout );
+
+    // Sets the socket's send and receive buffers, which a busy server
+    // needs far bigger than the default
+    HRESULT SetBufferSize( DWORD dwBytes );
+
+    DWORD   GetSent()               { return (DWORD)m_lSent; }
+    DWORD   GetReceived()           { return (DWORD)m_lReceived; }
+    DWORD   GetDropped()            { return (DWORD)m_lDropped; }
+};
+
+
+
+
+#endif // NET_H
@@ -0,0 +1,406 @@
+//-----------------------------------------------------------------------------
+// File: palette.cpp
+//
+// Desc: The median cut quantiser and the palette expansion.
+//-----------------------------------------------------------------------------
+#define STRICT
+#include <windows.h>
+#include <limits.h>
+#include <string.h>
+#include <emmintrin.h>
+#include "dxutil.h"
+#include "palette.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+#define PALETTE_COLOR_MASK      0x00FFFFFF  // Colour keys ignore the spare byte
+
+// A 5 bit channel of a 5:5:5 colour, 0 red, 1 green and 2 blue
+#define CHANNEL( wColor, i )    ( ( (wColor) >> ( 10 - 5 * (i) ) ) & 31 )
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CPaletteQuantizer()
+// Desc:
+//-----------------------------------------------------------------------------
+CPaletteQuantizer::CPaletteQuantizer()
+{
+    m_pBins     = NULL;
+    m_pwColors  = NULL;
+    m_pwScratch = NULL;
+    m_pBoxes    = NULL;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: ~CPaletteQuantizer()
+// Desc:
+//-----------------------------------------------------------------------------
+CPaletteQuantizer::~CPaletteQuantizer()
+{
+    Destroy();
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CPaletteQuantizer::Create()
+// Desc: Allocates the histogram and the space to cut it in
+//-----------------------------------------------------------------------------
+HRESULT CPaletteQuantizer::Create()
+{
+    Destroy();
+
+    m_pBins     = new BIN[PALETTE_INVERSE_SIZE];
+    m_pwColors  = new WORD[PALETTE_INVERSE_SIZE];
+    m_pwScratch = new WORD[PALETTE_INVERSE_SIZE];
+    m_pBoxes    = new BOX[PALETTE_MAX_COLORS];
+
+    if( NULL == m_pBins || NULL == m_pwColors || NULL == m_pwScratch || NULL == m_pBoxes )
+    {
+        Destroy();
+        return E_OUTOFMEMORY;
+    }
+
+    Reset();
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CPaletteQuantizer::Destroy()
+// Desc:
+//-----------------------------------------------------------------------------
+VOID CPaletteQuantizer::Destroy()
+{
+    SAFE_DELETE_ARRAY( m_pBins );
+    SAFE_DELETE_ARRAY( m_pwColors );
+    SAFE_DELETE_ARRAY( m_pwScratch );
+    SAFE_DELETE_ARRAY( m_pBoxes );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CPaletteQuantizer::Reset()
+// Desc:
+//-----------------------------------------------------------------------------
+VOID CPaletteQuantizer::Reset()
+{
+    if( m_pBins )
+        ZeroMemory( m_pBins, PALETTE_INVERSE_SIZE * sizeof(BIN) );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CPaletteQuantizer::AddPixels()
+// Desc:
+//-----------------------------------------------------------------------------
+VOID CPaletteQuantizer::AddPixels( const DWORD* pdwBits, LONG lPitch, DWORD dwWidth, DWORD dwHeight,
+                                   BOOL bColorKeyed, DWORD dwColorKey )
+{
+    if( NULL == m_pBins || NULL == pdwBits )
+        return;
+
+    for( DWORD y = 0; y < dwHeight; y++ )
+    {
+        const DWORD* pdwRow = (const DWORD*)( (const BYTE*)pdwBits + y * lPitch );
+
+        for( DWORD x = 0; x < dwWidth; x++ )
+        {
+            DWORD dwColor = pdwRow[x] & PALETTE_COLOR_MASK;
+            if( bColorKeyed && dwColor == ( dwColorKey & PALETTE_COLOR_MASK ) )
+                continue;
+
+            BIN* pBin = &m_pBins[ ( ( dwColor >> 9 ) & 0x7C00 ) |
+                                  ( ( dwColor >> 6 ) & 0x03E0 ) |
+                                  ( ( dwColor >> 3 ) & 0x001F ) ];
+            pBin->dwCount++;
+            pBin->llRed   += ( dwColor >> 16 ) & 0xFF;
+            pBin->llGreen += ( dwColor >> 8 ) & 0xFF;
+            pBin->llBlue  += dwColor & 0xFF;
+        }
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CPaletteQuantizer::ShrinkBox()
+// Desc: Fits a box's bounds and pixel count to the colours in it
+//-----------------------------------------------------------------------------
+VOID CPaletteQuantizer::ShrinkBox( BOX* pBox )
+{
+    pBox->llPixels = 0;
+    for( int i = 0; i < 3; i++ )
+    {
+        pBox->abMin[i] = 31;
+        pBox->abMax[i] = 0;
+    }
+
+    for( DWORD c = pBox->dwFirst; c < pBox->dwLast; c++ )
+    {
+        WORD wColor = m_pwColors[c];
+
+        for( int i = 0; i < 3; i++ )
+        {
+            BYTE bValue = (BYTE)CHANNEL( wColor, i );
+            pBox->abMin[i] = min( pBox->abMin[i], bValue );
+            pBox->abMax[i] = max( pBox->abMax[i], bValue );
+        }
+
+        pBox->llPixels += m_pBins[wColor].dwCount;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CPaletteQuantizer::SplitBox()
+// Desc: Sorts a box's colours along its widest channel, with a counting
+//       sort as a channel only has 32 values, and splits it where half its
+//       pixels are on each side. pNew gets the upper half.
+//-----------------------------------------------------------------------------
+VOID CPaletteQuantizer::SplitBox( BOX* pBox, BOX* pNew )
+{
+    int nChannel = 0;
+    for( int i = 1; i < 3; i++ )
+    {
+        if( pBox->abMax[i] - pBox->abMin[i] > pBox->abMax[nChannel] - pBox->abMin[nChannel] )
+            nChannel = i;
+    }
+
+    DWORD adwStart[33];
+    ZeroMemory( adwStart, sizeof(adwStart) );
+
+    for( DWORD c = pBox->dwFirst; c < pBox->dwLast; c++ )
+        adwStart[CHANNEL( m_pwColors[c], nChannel ) + 1]++;
+
+    adwStart[0] = pBox->dwFirst;
+    for( int v = 0; v < 32; v++ )
+        adwStart[v + 1] += adwStart[v];
+
+    for( DWORD c = pBox->dwFirst; c < pBox->dwLast; c++ )
+        m_pwScratch[adwStart[CHANNEL( m_pwColors[c], nChannel )]++] = m_pwColors[c];
+
+    memcpy( m_pwColors + pBox->dwFirst, m_pwScratch + pBox->dwFirst,
+            ( pBox->dwLast - pBox->dwFirst ) * sizeof(WORD) );
+
+    // Both halves keep at least one colour
+    LONGLONG llHalf   = pBox->llPixels / 2;
+    LONGLONG llPixels = 0;
+    DWORD    dwSplit  = pBox->dwFirst;
+
+    while( dwSplit < pBox->dwLast - 1 )
+    {
+        llPixels += m_pBins[m_pwColors[dwSplit]].dwCount;
+        dwSplit++;
+        if( llPixels >= llHalf )
+            break;
+    }
+
+    pNew->dwFirst = dwSplit;
+    pNew->dwLast  = pBox->dwLast;
+    pBox->dwLast  = dwSplit;
+
+    ShrinkBox( pBox );
+    ShrinkBox( pNew );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CPaletteQuantizer::Build()
+// Desc: Cuts the histogram into boxes, takes the mean colour of each, and
+//       works out the inverse map. A fixed colour always maps to itself.
+//-----------------------------------------------------------------------------
+HRESULT CPaletteQuantizer::Build( PALETTE* pPalette, DWORD dwMaxColors, const DWORD* pdwFixed, DWORD dwNumFixed )
+{
+    if( NULL == m_pBins )
+        return E_POINTER;
+    if( NULL == pPalette || dwMaxColors == 0 || dwMaxColors > PALETTE_MAX_COLORS ||
+        dwNumFixed > dwMaxColors || ( dwNumFixed > 0 && NULL == pdwFixed ) )
+        return E_INVALIDARG;
+
+    for( DWORD i = 0; i < dwNumFixed; i++ )
+        pPalette->adwColors[i] = pdwFixed[i] & PALETTE_COLOR_MASK;
+
+    DWORD dwNumColors = 0;
+    for( DWORD c = 0; c < PALETTE_INVERSE_SIZE; c++ )
+    {
+        if( m_pBins[c].dwCount )
+            m_pwColors[dwNumColors++] = (WORD)c;
+    }
+
+    // Keep splitting the box with the most pixels across the widest range
+    // until there are enough or none can be split
+    DWORD dwNumBoxes = 0;
+    if( dwNumColors > 0 && dwMaxColors > dwNumFixed )
+    {
+        m_pBoxes[0].dwFirst = 0;
+        m_pBoxes[0].dwLast  = dwNumColors;
+        ShrinkBox( &m_pBoxes[0] );
+        dwNumBoxes = 1;
+
+        while( dwNumBoxes < dwMaxColors - dwNumFixed )
+        {
+            BOX*     pSplit   = NULL;
+            LONGLONG llBest   = 0;
+
+            for( DWORD b = 0; b < dwNumBoxes; b++ )
+            {
+                BOX* pBox   = &m_pBoxes[b];
+                int  nRange = max( pBox->abMax[0] - pBox->abMin[0],
+                                   max( pBox->abMax[1] - pBox->abMin[1], pBox->abMax[2] - pBox->abMin[2] ) );
+
+                if( pBox->dwLast - pBox->dwFirst > 1 && pBox->llPixels * nRange > llBest )
+                {
+                    pSplit = pBox;
+                    llBest = pBox->llPixels * nRange;
+                }
+            }
+
+            if( NULL == pSplit )
+                break;
+
+            SplitBox( pSplit, &m_pBoxes[dwNumBoxes++] );
+        }
+    }
+
+    for( DWORD b = 0; b < dwNumBoxes; b++ )
+    {
+        LONGLONG llRed = 0, llGreen = 0, llBlue = 0, llPixels = 0;
+
+        for( DWORD c = m_pBoxes[b].dwFirst; c < m_pBoxes[b].dwLast; c++ )
+        {
+            const BIN* pBin = &m_pBins[m_pwColors[c]];
+            llRed    += pBin->llRed;
+            llGreen  += pBin->llGreen;
+            llBlue   += pBin->llBlue;
+            llPixels += pBin->dwCount;
+        }
+
+        pPalette->adwColors[dwNumFixed + b] = (DWORD)( ( llRed + llPixels / 2 ) / llPixels ) << 16 |
+                                              (DWORD)( ( llGreen + llPixels / 2 ) / llPixels ) << 8 |
+                                              (DWORD)( ( llBlue + llPixels / 2 ) / llPixels );
+    }
+
+    pPalette->dwNumColors = dwNumFixed + dwNumBoxes;
+    if( pPalette->dwNumColors == 0 )
+        return E_FAIL;
+
+    for( DWORD i = pPalette->dwNumColors; i < PALETTE_MAX_COLORS; i++ )
+        pPalette->adwColors[i] = 0;
+
+    // The nearest entry to the middle of each 5:5:5 colour
+    int anRed[PALETTE_MAX_COLORS], anGreen[PALETTE_MAX_COLORS], anBlue[PALETTE_MAX_COLORS];
+    for( DWORD i = 0; i < pPalette->dwNumColors; i++ )
+    {
+        anRed[i]   = ( pPalette->adwColors[i] >> 16 ) & 0xFF;
+        anGreen[i] = ( pPalette->adwColors[i] >> 8 ) & 0xFF;
+        anBlue[i]  = pPalette->adwColors[i] & 0xFF;
+    }
+
+    for( DWORD c = 0; c < PALETTE_INVERSE_SIZE; c++ )
+    {
+        int  nRed   = ( CHANNEL( c, 0 ) << 3 ) | 4;
+        int  nGreen = ( CHANNEL( c, 1 ) << 3 ) | 4;
+        int  nBlue  = ( CHANNEL( c, 2 ) << 3 ) | 4;
+        int  nBest  = INT_MAX;
+        BYTE bBest  = 0;
+
+        for( DWORD i = 0; i < pPalette->dwNumColors && nBest > 0; i++ )
+        {
+            int dr = nRed - anRed[i];
+            int dg = nGreen - anGreen[i];
+            int db = nBlue - anBlue[i];
+            int nDist = dr * dr + dg * dg + db * db;
+
+            if( nDist < nBest )
+            {
+                nBest = nDist;
+                bBest = (BYTE)i;
+            }
+        }
+
+        pPalette->abInverse[c] = bBest;
+    }
+
+    for( DWORD i = 0; i < dwNumFixed; i++ )
+    {
+        DWORD dwColor = pPalette->adwColors[i];
+        pPalette->abInverse[ ( ( dwColor >> 9 ) & 0x7C00 ) |
+                             ( ( dwColor >> 6 ) & 0x03E0 ) |
+                             ( ( dwColor >> 3 ) & 0x001F ) ] = (BYTE)i;
+    }
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Lookup4()
+// Desc: The colours of four indices packed in a DWORD, first in the low
+//       byte. SSE2 has no gather, so the lookups are one at a time and only
+//       the stores are wide.
+//-----------------------------------------------------------------------------
+static inline __m128i Lookup4( DWORD dwIndices, const DWORD* pdwColors )
+{
+    return _mm_setr_epi32( (int)pdwColors[dwIndices & 0xFF],
+                           (int)pdwColors[( dwIndices >> 8 ) & 0xFF],
+                           (int)pdwColors[( dwIndices >> 16 ) & 0xFF],
+                           (int)pdwColors[dwIndices >> 24] );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Palette_ExpandRow()
+// Desc: Looks up the colour of each index in a row. Pixels go one at a time
+//       up to a 16 byte boundary in pdwDest, then 16 at a time with
+//       streaming stores.
+//-----------------------------------------------------------------------------
+VOID Palette_ExpandRow( DWORD* pdwDest, const BYTE* pbSrc, DWORD dwCount, const DWORD* pdwColors )
+{
+    DWORD x = 0;
+
+    for( ; x < dwCount && ( (UINT_PTR)( pdwDest + x ) & 15 ); x++ )
+        pdwDest[x] = pdwColors[pbSrc[x]];
+
+    for( ; x + 16 <= dwCount; x += 16 )
+    {
+        const DWORD* pdwIndices = (const DWORD*)( pbSrc + x );
+        __m128i*     pDest      = (__m128i*)( pdwDest + x );
+
+        _mm_stream_si128( pDest,     Lookup4( pdwIndices[0], pdwColors ) );
+        _mm_stream_si128( pDest + 1, Lookup4( pdwIndices[1], pdwColors ) );
+        _mm_stream_si128( pDest + 2, Lookup4( pdwIndices[2], pdwColors ) );
+        _mm_stream_si128( pDest + 3, Lookup4( pdwIndices[3], pdwColors ) );
+    }
+
+    for( ; x < dwCount; x++ )
+        pdwDest[x] = pdwColors[pbSrc[x]];
+
+    _mm_sfence();
+}
@@ -0,0 +1,127 @@
+//-----------------------------------------------------------------------------
+// File: palette.h
+//
+// Desc: Making a palette of up to 256 colours for a set of 32 bit images,
+//       and turning 8 bit indices back into 32 bit pixels.
+//
+//       CPaletteQuantizer counts the colours of every image added to it in
+//       a histogram of 5:5:5 colours, then cuts the histogram by median cut:
+//       the box of colours with the most pixels across the widest range is
+//       split at the pixel median of that channel, until there are as many
+//       boxes as colours wanted. Each box's colour is the mean of the pixels
+//       in it. Colours that must be exact, such as the clear colour, can be
+//       fixed in the palette ahead of the boxes.
+//
+//       The PALETTE it makes carries an inverse map, the nearest entry for
+//       every 5:5:5 colour, so mapping a pixel to an index is one lookup.
+//
+//       Palette_ExpandRow() writes the 32 bit colour of each index in a row,
+//       16 pixels a loop with SSE2 streaming stores, as the pixels are going
+//       to a back buffer that nothing reads until it is shown.
+//-----------------------------------------------------------------------------
+#ifndef PALETTE_H
+#define PALETTE_H
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+#define PALETTE_MAX_COLORS      256
+#define PALETTE_INVERSE_SIZE    32768       // One entry per 5:5:5 colour
+
+// Colours are X8R8G8B8, as 32 bit surfaces hold them
+struct PALETTE
+{
+    DWORD   dwNumColors;
+    DWORD   adwColors[PALETTE_MAX_COLORS];
+    BYTE    abInverse[PALETTE_INVERSE_SIZE];
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Palette_Map()
+// Desc: The index of the palette entry nearest a 32 bit colour
+//-----------------------------------------------------------------------------
+inline BYTE Palette_Map( const PALETTE* pPalette, DWORD dwColor )
+{
+    return pPalette->abInverse[ ( ( dwColor >> 9 ) & 0x7C00 ) |
+                                ( ( dwColor >> 6 ) & 0x03E0 ) |
+                                ( ( dwColor >> 3 ) & 0x001F ) ];
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: class CPaletteQuantizer
+// Desc: The histogram and the scratch space for cutting it. Everything is
+//       allocated by Create(), so building a palette allocates nothing.
+//-----------------------------------------------------------------------------
+class CPaletteQuantizer
+{
+    // The pixels counted for one 5:5:5 colour, and their 8 bit channel
+    // sums for the mean
+    struct BIN
+    {
+        DWORD       dwCount;
+        LONGLONG    llRed;
+        LONGLONG    llGreen;
+        LONGLONG    llBlue;
+    };
+
+    // A box is the colours m_pwColors[dwFirst] up to m_pwColors[dwLast]
+    struct BOX
+    {
+        DWORD       dwFirst;
+        DWORD       dwLast;
+        LONGLONG    llPixels;
+        BYTE        abMin[3];           // 5 bit red, green and blue
+        BYTE        abMax[3];
+    };
+
+    BIN*        m_pBins;
+    WORD*       m_pwColors;             // The colours counted so far
+    WORD*       m_pwScratch;
+    BOX*        m_pBoxes;
+
+    VOID    ShrinkBox( BOX* pBox );
+    VOID    SplitBox( BOX* pBox, BOX* pNew );
+
+    CPaletteQuantizer( const CPaletteQuantizer& );
+    CPaletteQuantizer& operator=( const CPaletteQuantizer& );
+
+public:
+    CPaletteQuantizer();
+    ~CPaletteQuantizer();
+
+    HRESULT Create();
+    VOID    Destroy();
+
+    // Forgets every colour counted
+    VOID    Reset();
+
+    // Counts an image's pixels, leaving out the key colour if it is keyed
+    VOID    AddPixels( const DWORD* pdwBits, LONG lPitch, DWORD dwWidth, DWORD dwHeight,
+                       BOOL bColorKeyed, DWORD dwColorKey );
+
+    // Makes a palette of up to dwMaxColors, the dwNumFixed colours at
+    // pdwFixed first and the rest cut from the histogram
+    HRESULT Build( PALETTE* pPalette, DWORD dwMaxColors, const DWORD* pdwFixed, DWORD dwNumFixed );
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// Function-prototypes
+//-----------------------------------------------------------------------------
+VOID Palette_ExpandRow( DWORD* pdwDest, const BYTE* pbSrc, DWORD dwCount, const DWORD* pdwColors );
+
+
+
+
+#endif // PALETTE_H
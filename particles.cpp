@@ -0,0 +1,303 @@
+//-----------------------------------------------------------------------------
+// File: particles.cpp
+//
+// Desc: The particle pool. The arrays are padded to a multiple of 4, so
+//       the last group of a step may move a few unused slots along with
+//       the live particles, which does no harm and saves a scalar tail.
+//-----------------------------------------------------------------------------
+#define STRICT
+#include <windows.h>
+#include <math.h>
+#include <emmintrin.h>
+#include "dxutil.h"
+#include "particles.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CParticles::CParticles()
+// Desc:
+//-----------------------------------------------------------------------------
+CParticles::CParticles()
+{
+    m_pbMemory       = NULL;
+    m_pfPosX         = NULL;
+    m_pfPosY         = NULL;
+    m_pfVelX         = NULL;
+    m_pfVelY         = NULL;
+    m_pfLife         = NULL;
+    m_pPoints        = NULL;
+    m_dwCapacity     = 0;
+    m_dwNumParticles = 0;
+    m_dwDropped      = 0;
+    m_dwSeed         = 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CParticles::~CParticles()
+// Desc:
+//-----------------------------------------------------------------------------
+CParticles::~CParticles()
+{
+    Destroy();
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CParticles::Create()
+// Desc: Allocates room for dwCapacity particles, rounded up to a multiple
+//       of 4, in one block with each array aligned for SSE
+//-----------------------------------------------------------------------------
+HRESULT CParticles::Create( DWORD dwCapacity, DWORD dwSeed )
+{
+    Destroy();
+
+    if( dwCapacity == 0 )
+        return E_INVALIDARG;
+
+    DWORD dwCount  = ( dwCapacity + 3 ) & ~3;
+    DWORD dwFloats = dwCount * sizeof(FLOAT);
+    DWORD dwBytes  = dwFloats * 5 + dwCount * sizeof(POINT);
+
+    if( NULL == ( m_pbMemory = new BYTE[dwBytes + 15] ) )
+        return E_OUTOFMEMORY;
+
+    ZeroMemory( m_pbMemory, dwBytes + 15 );
+
+    BYTE* pbAligned = (BYTE*)( ( (UINT_PTR)m_pbMemory + 15 ) & ~(UINT_PTR)15 );
+    m_pfPosX  = (FLOAT*)( pbAligned );
+    m_pfPosY  = (FLOAT*)( pbAligned + dwFloats );
+    m_pfVelX  = (FLOAT*)( pbAligned + dwFloats * 2 );
+    m_pfVelY  = (FLOAT*)( pbAligned + dwFloats * 3 );
+    m_pfLife  = (FLOAT*)( pbAligned + dwFloats * 4 );
+    m_pPoints = (POINT*)( pbAligned + dwFloats * 5 );
+
+    m_dwCapacity     = dwCount;
+    m_dwNumParticles = 0;
+    m_dwDropped      = 0;
+    m_dwSeed         = dwSeed;
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CParticles::Destroy()
+// Desc:
+//-----------------------------------------------------------------------------
+VOID CParticles::Destroy()
+{
+    SAFE_DELETE_ARRAY( m_pbMemory );
+
+    m_pfPosX         = NULL;
+    m_pfPosY         = NULL;
+    m_pfVelX         = NULL;
+    m_pfVelY         = NULL;
+    m_pfLife         = NULL;
+    m_pPoints        = NULL;
+    m_dwCapacity     = 0;
+    m_dwNumParticles = 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CParticles::Random()
+// Desc: A number from 0 up to fRange
+//-----------------------------------------------------------------------------
+FLOAT CParticles::Random( FLOAT fRange )
+{
+    m_dwSeed = m_dwSeed * 1664525 + 1013904223;
+    return (FLOAT)( ( m_dwSeed >> 8 ) & 0xFFFFFF ) * ( fRange / 16777216.0f );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CParticles::Emit()
+// Desc: Adds a burst of particles at one point, each living between half
+//       and all of PARTICLE_LIFE
+//-----------------------------------------------------------------------------
+DWORD CParticles::Emit( FLOAT fX, FLOAT fY, FLOAT fVelX, FLOAT fVelY, FLOAT fSpeed, DWORD dwCount )
+{
+    DWORD dwFree = m_dwCapacity - m_dwNumParticles;
+    if( dwCount > dwFree )
+    {
+        m_dwDropped += dwCount - dwFree;
+        dwCount      = dwFree;
+    }
+
+    for( DWORD i = 0; i < dwCount; i++ )
+    {
+        DWORD dwIndex = m_dwNumParticles++;
+        FLOAT fAngle  = Random( 6.2831853f );
+        FLOAT fBurst  = Random( fSpeed );
+
+        m_pfPosX[dwIndex] = fX;
+        m_pfPosY[dwIndex] = fY;
+        m_pfVelX[dwIndex] = fVelX + cosf( fAngle ) * fBurst;
+        m_pfVelY[dwIndex] = fVelY + sinf( fAngle ) * fBurst;
+        m_pfLife[dwIndex] = PARTICLE_LIFE * ( 0.5f + Random( 0.5f ) );
+    }
+
+    return dwCount;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CParticles::Update()
+// Desc: Moves four particles at a time and counts down their lives. Any
+//       that have left the bottom or sides of the field have their lives
+//       zeroed, and if any died the pool is compacted afterwards.
+//-----------------------------------------------------------------------------
+VOID CParticles::Update( FLOAT fTimeDelta )
+{
+    const __m128 xDelta      = _mm_set1_ps( fTimeDelta );
+    const __m128 xFall       = _mm_set1_ps( PARTICLE_GRAVITY * fTimeDelta );
+    const __m128 xZero       = _mm_setzero_ps();
+    const __m128 xMaxX       = _mm_set1_ps( (FLOAT)FIELD_WIDTH );
+    const __m128 xMaxY       = _mm_set1_ps( (FLOAT)FIELD_HEIGHT );
+    DWORD        dwFirstDead = m_dwNumParticles;
+
+    for( DWORD i = 0; i < m_dwNumParticles; i += 4 )
+    {
+        __m128 xVelX = _mm_load_ps( m_pfVelX + i );
+        __m128 xVelY = _mm_add_ps( _mm_load_ps( m_pfVelY + i ), xFall );
+        __m128 xPosX = _mm_add_ps( _mm_load_ps( m_pfPosX + i ), _mm_mul_ps( xVelX, xDelta ) );
+        __m128 xPosY = _mm_add_ps( _mm_load_ps( m_pfPosY + i ), _mm_mul_ps( xVelY, xDelta ) );
+        __m128 xLife = _mm_sub_ps( _mm_load_ps( m_pfLife + i ), xDelta );
+
+        __m128 xOut = _mm_or_ps( _mm_or_ps( _mm_cmplt_ps( xPosX, xZero ), _mm_cmpge_ps( xPosX, xMaxX ) ),
+                                 _mm_cmpge_ps( xPosY, xMaxY ) );
+        xLife = _mm_andnot_ps( xOut, xLife );
+
+        _mm_store_ps( m_pfPosX + i, xPosX );
+        _mm_store_ps( m_pfPosY + i, xPosY );
+        _mm_store_ps( m_pfVelY + i, xVelY );
+        _mm_store_ps( m_pfLife + i, xLife );
+
+        // Only the slots in use count towards compacting
+        int nMask = _mm_movemask_ps( _mm_cmple_ps( xLife, xZero ) );
+        if( i + 4 > m_dwNumParticles )
+            nMask &= ( 1 << ( m_dwNumParticles - i ) ) - 1;
+        if( nMask && dwFirstDead == m_dwNumParticles )
+            dwFirstDead = i;
+    }
+
+    if( dwFirstDead < m_dwNumParticles )
+        Compact( dwFirstDead );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CParticles::Compact()
+// Desc: Removes the dead particles from dwFirst on by copying the last one
+//       over each, stepping over groups of four that are all alive
+//-----------------------------------------------------------------------------
+VOID CParticles::Compact( DWORD dwFirst )
+{
+    const __m128 xZero = _mm_setzero_ps();
+    DWORD        i     = dwFirst;
+
+    while( i < m_dwNumParticles )
+    {
+        if( ( i & 3 ) == 0 && i + 4 <= m_dwNumParticles &&
+            0 == _mm_movemask_ps( _mm_cmple_ps( _mm_load_ps( m_pfLife + i ), xZero ) ) )
+        {
+            i += 4;
+            continue;
+        }
+
+        if( m_pfLife[i] > 0.0f )
+        {
+            i++;
+            continue;
+        }
+
+        DWORD dwLast = --m_dwNumParticles;
+        m_pfPosX[i] = m_pfPosX[dwLast];
+        m_pfPosY[i] = m_pfPosY[dwLast];
+        m_pfVelX[i] = m_pfVelX[dwLast];
+        m_pfVelY[i] = m_pfVelY[dwLast];
+        m_pfLife[i] = m_pfLife[dwLast];
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CParticles::Project()
+// Desc: Maps the particles into the view as ViewPoint() maps sprites, four
+//       at a time, and writes out as POINTs those above the bottom of the
+//       field whose sprite is wholly in the view. A group of four that are
+//       all in is stored as it is; the rest are copied one at a time.
+//-----------------------------------------------------------------------------
+const POINT* CParticles::Project( const VIEW* pView, DWORD dwSize, DWORD* pdwCount )
+{
+    FLOAT  fHalf   = dwSize * 0.5f;
+    __m128 xScale  = _mm_set1_ps( pView->fScale );
+    __m128 xLeft   = _mm_set1_ps( pView->lLeft - fHalf );
+    __m128 xTop    = _mm_set1_ps( pView->lTop - fHalf );
+    __m128 xZero   = _mm_setzero_ps();
+    __m128 xMaxX   = _mm_set1_ps( (FLOAT)( (LONG)pView->dwWidth - (LONG)dwSize ) );
+    __m128 xMaxY   = _mm_set1_ps( (FLOAT)( (LONG)pView->dwHeight - (LONG)dwSize ) );
+    DWORD  dwCount = 0;
+
+    POINT  aGroup[4];
+
+    for( DWORD i = 0; i < m_dwNumParticles; i += 4 )
+    {
+        __m128 xPosY = _mm_load_ps( m_pfPosY + i );
+        __m128 xX    = _mm_add_ps( xLeft, _mm_mul_ps( _mm_load_ps( m_pfPosX + i ), xScale ) );
+        __m128 xY    = _mm_add_ps( xTop, _mm_mul_ps( xPosY, xScale ) );
+
+        // Sparks still rising above the field are left out until they
+        // fall back into it
+        __m128 xIn = _mm_and_ps( _mm_and_ps( _mm_cmpge_ps( xX, xZero ), _mm_cmple_ps( xX, xMaxX ) ),
+                                 _mm_and_ps( _mm_cmpge_ps( xY, xZero ), _mm_cmple_ps( xY, xMaxY ) ) );
+        xIn = _mm_and_ps( xIn, _mm_cmpge_ps( xPosY, xZero ) );
+
+        int nMask = _mm_movemask_ps( xIn );
+        if( i + 4 > m_dwNumParticles )
+            nMask &= ( 1 << ( m_dwNumParticles - i ) ) - 1;
+        if( 0 == nMask )
+            continue;
+
+        __m128i xiX = _mm_cvttps_epi32( xX );
+        __m128i xiY = _mm_cvttps_epi32( xY );
+
+        if( 15 == nMask )
+        {
+            _mm_storeu_si128( (__m128i*)( m_pPoints + dwCount ), _mm_unpacklo_epi32( xiX, xiY ) );
+            _mm_storeu_si128( (__m128i*)( m_pPoints + dwCount + 2 ), _mm_unpackhi_epi32( xiX, xiY ) );
+            dwCount += 4;
+            continue;
+        }
+
+        _mm_storeu_si128( (__m128i*)( aGroup ), _mm_unpacklo_epi32( xiX, xiY ) );
+        _mm_storeu_si128( (__m128i*)( aGroup + 2 ), _mm_unpackhi_epi32( xiX, xiY ) );
+        for( DWORD j = 0; j < 4; j++ )
+        {
+            if( nMask & ( 1 << j ) )
+                m_pPoints[dwCount++] = aGroup[j];
+        }
+    }
+
+    *pdwCount = dwCount;
+    return m_pPoints;
+}
@@ -0,0 +1,98 @@
+//-----------------------------------------------------------------------------
+// File: particles.h
+//
+// Desc: Sparks for bat hits and points. Each particle is a point with a
+//       velocity and the seconds it has left to live, falling under
+//       gravity until it runs out of life or leaves the field.
+//
+//       Particles are stored as separate arrays of x, y, x velocity, y
+//       velocity and life rather than an array of structures, so a step
+//       moves four of them at a time with SSE. A particle that dies has the
+//       last one copied over it, which keeps the live ones packed at the
+//       front without moving the rest.
+//
+//       All the particles are drawn with the same small sprite, so
+//       Project() turns every position into view pixels in one pass, four
+//       at a time, leaving out those off the field or the view, ready for
+//       the display to blt the sprite at each.
+//-----------------------------------------------------------------------------
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+#include "pongy.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+#define PARTICLE_POOL_SIZE      8192        // Particles the game can have at once
+#define PARTICLE_DIAMETER       6           // The sprite, in field units
+#define PARTICLE_GRAVITY        600.0f      // Field units per second per second, down
+#define PARTICLE_LIFE           0.8f        // Longest a particle lives, in seconds
+#define PARTICLE_HIT_COUNT      32          // Sparks off a bat hit
+#define PARTICLE_HIT_SPEED      200.0f
+#define PARTICLE_POINT_COUNT    200         // Sparks from the score for a point
+#define PARTICLE_POINT_SPEED    350.0f
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: class CParticles
+// Desc: A fixed pool of particles. All memory is allocated by Create();
+//       Emit(), Update() and Project() allocate nothing, and Emit() drops
+//       what doesn't fit once the pool is full.
+//-----------------------------------------------------------------------------
+class CParticles
+{
+    BYTE*   m_pbMemory;
+    FLOAT*  m_pfPosX;               // Each 16 byte aligned and m_dwCapacity long
+    FLOAT*  m_pfPosY;
+    FLOAT*  m_pfVelX;
+    FLOAT*  m_pfVelY;
+    FLOAT*  m_pfLife;               // Seconds left
+    POINT*  m_pPoints;              // Written by Project()
+    DWORD   m_dwCapacity;           // A multiple of 4
+    DWORD   m_dwNumParticles;
+    DWORD   m_dwDropped;            // Emitted with the pool full
+    DWORD   m_dwSeed;
+
+    FLOAT   Random( FLOAT fRange );
+    VOID    Compact( DWORD dwFirst );
+
+    CParticles( const CParticles& );
+    CParticles& operator=( const CParticles& );
+
+public:
+    CParticles();
+    ~CParticles();
+
+    HRESULT Create( DWORD dwCapacity, DWORD dwSeed );
+    VOID    Destroy();
+
+    // Adds up to dwCount particles at fX, fY in field units, each moving
+    // at fVelX, fVelY plus up to fSpeed in a random direction. Returns how
+    // many fitted.
+    DWORD   Emit( FLOAT fX, FLOAT fY, FLOAT fVelX, FLOAT fVelY, FLOAT fSpeed, DWORD dwCount );
+
+    // Moves every particle on by fTimeDelta seconds and removes the dead
+    VOID    Update( FLOAT fTimeDelta );
+
+    // The top left in the view of a dwSize pixel sprite centred on each
+    // particle that is in the field and wholly in the view. The rest are
+    // culled rather than pinned to the edge. There are *pdwCount of them,
+    // valid until the next Update().
+    const POINT* Project( const VIEW* pView, DWORD dwSize, DWORD* pdwCount );
+
+    BOOL    IsCreated()         { return m_pbMemory != NULL; }
+    DWORD   GetNumParticles()   { return m_dwNumParticles; }
+    DWORD   GetCapacity()       { return m_dwCapacity; }
+    DWORD   GetDropped()        { return m_dwDropped; }
+};
+
+
+
+
+#endif // PARTICLES_H
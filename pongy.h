@@ -0,0 +1,82 @@
+//-----------------------------------------------------------------------------
+// File: pongy.h
+//
+// Desc: Constants, types and globals shared between Pongy.cpp and the other
+//       game modules
+//
+// Author: Alan 'Big Al' Cruikshanks
+//-----------------------------------------------------------------------------
+#ifndef PONGY_H
+#define PONGY_H
+
+#include "ddutil.h"
+#include "pool.h"
+#include "sim.h"
+#include "softdisplay.h"
+#include "indexeddisplay.h"
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+// The frame arena holds the draw list, one item for the score, each sprite
+// and each multi-ball, and is made once at startup to fit the ball count
+#define DRAW_LIST_SIZE(dwNumBalls)		( ( NUM_SPRITES + 1 + (dwNumBalls) ) * sizeof(DRAWITEM) )
+#define FRAME_ARENA_HEADROOM			(16 * 1024)		// For anything else in a frame
+#define FRAME_ARENA_SIZE(dwNumBalls)	( DRAW_LIST_SIZE( dwNumBalls ) + FRAME_ARENA_HEADROOM )
+#define FRAME_ARENA_MAX_SIZE			(1024 * 1024)	// Most it is ever made
+
+#define NETPLAY_PORT			27960	// For -join without a port
+#define NETPLAY_MAX_CATCHUP		4		// Most frames played in one go
+
+#define FULLSCREEN_BPP			32		// Software and indexed drawing need 32 bits
+#define MAX_BACK_BUFFERS		3		// For -backbuffers
+
+#define VIEW_DEFAULT_WIDTH		FIELD_WIDTH		// Client area the window opens at
+#define VIEW_DEFAULT_HEIGHT		FIELD_HEIGHT
+#define VIEW_MIN_WIDTH			320				// Smallest client area allowed
+#define VIEW_MIN_HEIGHT			240
+
+// How the field is drawn into the back buffer. It is scaled by the same
+// amount both ways to fit, and centred, leaving black bars along the sides
+// or the top and bottom when the shapes differ.
+struct VIEW
+{
+	DWORD			dwWidth;		// Back buffer, in pixels
+	DWORD			dwHeight;
+	FLOAT			fScale;			// Pixels per field unit
+	LONG			lLeft;			// Where the field's top left lands
+	LONG			lTop;
+};
+
+// One surface to blt in a frame's draw list, and the software and indexed
+// displays' copies of it
+struct DRAWITEM
+{
+	DWORD				x;
+	DWORD				y;
+	CSurface*			pSurface;
+	CSoftSurface*		pSoft;
+	CIndexedSurface*	pIndexed;
+};
+
+//-----------------------------------------------------------------------------
+// Global variables, defined in Pongy.cpp
+//-----------------------------------------------------------------------------
+extern HWND				g_hMainWnd;
+extern CDisplayHandle	g_pDisplay;
+extern CSurfaceHandle	g_pBallSurface;
+extern CSurfaceHandle	g_pBatSurface;
+extern CSurfaceHandle	g_pTextSurface;
+extern SIM_STATE		g_Sim;
+extern CArena			g_FrameArena;
+extern VIEW				g_View;
+
+//-----------------------------------------------------------------------------
+// Function-prototypes for the parts of Pongy.cpp used elsewhere
+//-----------------------------------------------------------------------------
+VOID    UpdateComputerBat( FLOAT fTimeDelta );
+VOID    UpdateBall( FLOAT fTimeDelta );
+HRESULT DrawScore();
+HRESULT DisplayFrame( BOOL bRepaint );
+
+#endif // PONGY_H
@@ -0,0 +1,432 @@
+//-----------------------------------------------------------------------------
+// File: pongybots.cpp
+//
+// Desc: pongy-bots, a console program playing thousands of players against
+//       pongy-server at once, to load test it. Build it from this file,
+//       net.cpp, snapshot.cpp and sim.cpp.
+//
+//       pongy-bots [-server ip[:port]] [-bots n] [-spectators n]
+//                  [-watchmatches n] [-seconds n]
+//
+//       Every bot shares the one socket, telling its packets apart by the
+//       nonce it joined with, so the bots cost the machine no more than a
+//       busy client would. Each one joins, sends a move every frame that
+//       chases the ball, and once a second the program prints how many are
+//       playing, how many states arrived, their size and the input to state
+//       round trip.
+//
+//       Spectators are told apart by their address, so each has a socket
+//       of its own. They watch the first -watchmatches matches, all of
+//       them the first by default, which is the most the server can be
+//       asked to send from one coded state.
+//-----------------------------------------------------------------------------
+#define STRICT
+#include <winsock2.h>
+#include <windows.h>
+#include <mmsystem.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dxutil.h"
+#include "server.h"
+
+#pragma comment( lib, "winmm.lib" )
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+#define BOTS_DEFAULT            1000
+#define BOTS_JOIN_RETRY         1000        // ms between joins until welcomed
+#define BOTS_STATE_TIMEOUT      2000        // ms without a state before joining again
+#define BOTS_DEAD_ZONE          8.0f        // Pixels either side of the bat's middle
+
+struct BOT
+{
+    DWORD       dwMatch;
+    DWORD       dwPlayer;
+    BOOL        bSeated;
+    DWORD       dwLastJoin;             // ms
+    DWORD       dwLastState;            // ms
+    DWORD       dwNewest;               // Frame of the newest snapshot
+    SNAPSHOT    aRing[SNAPSHOT_RING];   // Baselines for the server's deltas
+};
+
+// Spectators' states are all coded against keyframes, so only those go
+// in the ring
+struct WATCHER
+{
+    DWORD       dwMatch;
+    SNAPSHOT    aKeyframes[SNAPSHOT_RING];
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+volatile LONG g_lQuit = 0;
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: GetOption()
+// Desc: The argument after strName on the command line, or strDefault
+//-----------------------------------------------------------------------------
+const char* GetOption( int argc, char* argv[], const char* strName, const char* strDefault )
+{
+    for( int i = 1; i < argc - 1; i++ )
+    {
+        if( 0 == strcmp( argv[i], strName ) )
+            return argv[i + 1];
+    }
+
+    return strDefault;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: ConsoleHandler()
+// Desc: Ctrl+C stops the bots cleanly
+//-----------------------------------------------------------------------------
+BOOL WINAPI ConsoleHandler( DWORD dwCtrlType )
+{
+    InterlockedExchange( &g_lQuit, 1 );
+    return TRUE;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: GetMicroseconds()
+// Desc: A microsecond clock for the round trip stamps
+//-----------------------------------------------------------------------------
+DWORD GetMicroseconds()
+{
+    static LARGE_INTEGER s_liFreq = { 0 };
+    LARGE_INTEGER        liNow;
+
+    if( s_liFreq.QuadPart == 0 )
+        QueryPerformanceFrequency( &s_liFreq );
+
+    // Split so the multiply can't overflow however long the machine has
+    // been up
+    QueryPerformanceCounter( &liNow );
+    return (DWORD)( liNow.QuadPart / s_liFreq.QuadPart * 1000000 +
+                    liNow.QuadPart % s_liFreq.QuadPart * 1000000 / s_liFreq.QuadPart );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: ReceiveSpectates()
+// Desc: Decodes every state waiting on a spectator's socket, returning how
+//       many did, and adding up their size and the ones that didn't
+//-----------------------------------------------------------------------------
+DWORD ReceiveSpectates( CUdpTransport* pNet, WATCHER* pWatcher, DWORD* pdwBytes, DWORD* pdwUndecoded )
+{
+    BYTE  abPacket[NET_MAX_PACKET];
+    DWORD dwSize   = sizeof(abPacket);
+    DWORD dwStates = 0;
+
+    while( S_OK == pNet->Receive( abPacket, &dwSize ) )
+    {
+        const MATCH_SPECTATE* pSpectate = (const MATCH_SPECTATE*)abPacket;
+        DWORD dwPacketSize = dwSize;
+        dwSize = sizeof(abPacket);
+
+        if( dwPacketSize < MATCH_SPECTATE_HEADER_SIZE || pSpectate->header.dwMagic != MATCH_MAGIC ||
+            pSpectate->header.dwType != matchSpectate || pSpectate->dwMatch != pWatcher->dwMatch )
+            continue;
+
+        const BYTE* pSnapshot = pSpectate->abSnapshot;
+        DWORD       dwBytes   = dwPacketSize - MATCH_SPECTATE_HEADER_SIZE;
+        SNAPSHOT    snap;
+
+        if( FAILED( Snapshot_Decode( pSnapshot, dwBytes, pWatcher->aKeyframes, &snap ) ) )
+        {
+            (*pdwUndecoded)++;
+            continue;
+        }
+
+        // The first bit is clear for a full snapshot
+        if( dwBytes && 0 == ( pSnapshot[0] & 1 ) )
+            pWatcher->aKeyframes[SNAPSHOT_SLOT( snap.dwFrame )] = snap;
+
+        *pdwBytes += dwBytes;
+        dwStates++;
+    }
+
+    return dwStates;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: main()
+// Desc: Runs every bot and spectator once a frame from one thread
+//-----------------------------------------------------------------------------
+int main( int argc, char* argv[] )
+{
+    const char* strServer = GetOption( argc, argv, "-server", "127.0.0.1" );
+    DWORD       dwNumBots = (DWORD)atol( GetOption( argc, argv, "-bots", "0" ) );
+    DWORD       dwSeconds = (DWORD)atol( GetOption( argc, argv, "-seconds", "0" ) );
+    DWORD       dwWatch   = (DWORD)atol( GetOption( argc, argv, "-spectators", "0" ) );
+    DWORD       dwSpread  = (DWORD)atol( GetOption( argc, argv, "-watchmatches", "1" ) );
+
+    if( dwNumBots == 0 )
+        dwNumBots = BOTS_DEFAULT;
+
+    CUdpTransport net;
+    if( FAILED( net.Create( 0 ) ) || FAILED( net.SetPeer( strServer, SERVER_PORT ) ) )
+    {
+        fprintf( stderr, "pongy-bots: can't reach %s\n", strServer );
+        return 1;
+    }
+    net.SetBufferSize( SERVER_SOCKET_BUFFER );
+
+    BOT* pBots = new BOT[dwNumBots];
+    if( NULL == pBots )
+        return 1;
+    ZeroMemory( pBots, dwNumBots * sizeof(BOT) );
+
+    CUdpTransport* pWatchNets = dwWatch ? new CUdpTransport[dwWatch] : NULL;
+    WATCHER*       pWatchers  = dwWatch ? new WATCHER[dwWatch] : NULL;
+    if( dwWatch && ( NULL == pWatchNets || NULL == pWatchers ) )
+        return 1;
+
+    for( DWORD i = 0; i < dwWatch; i++ )
+    {
+        if( FAILED( pWatchNets[i].Create( 0 ) ) || FAILED( pWatchNets[i].SetPeer( strServer, SERVER_PORT ) ) )
+        {
+            fprintf( stderr, "pongy-bots: can't open a socket for spectator %lu\n", i );
+            return 1;
+        }
+
+        pWatchers[i].dwMatch = i % max( dwSpread, 1 );
+        Snapshot_ClearRing( pWatchers[i].aKeyframes );
+    }
+
+    printf( "pongy-bots: %lu bots playing and %lu watching on %s\n", dwNumBots, dwWatch, strServer );
+
+    SetConsoleCtrlHandler( ConsoleHandler, TRUE );
+    timeBeginPeriod( 1 );
+
+    DWORD    dwStart          = timeGetTime();
+    DWORD    dwNextFrame      = dwStart;
+    DWORD    dwNextReport     = dwStart + 1000;
+    DWORD    dwSecond         = 0;
+    DWORD    dwStates         = 0;
+    DWORD    dwStateBytes     = 0;
+    DWORD    dwUndecoded      = 0;
+    DWORD    dwRoundTrips     = 0;
+    LONGLONG llTripTotal      = 0;
+    DWORD    dwTripMax        = 0;
+    DWORD    dwFrame          = 0;
+    DWORD    dwSpectated      = 0;
+    DWORD    dwWatchBytes     = 0;
+    DWORD    dwWatchUndecoded = 0;
+    BYTE     abPacket[NET_MAX_PACKET];
+
+    // One frame's worth of moves is about the right pace to keep the
+    // server's queues short
+    const DWORD dwFrameLength = 1000 / SERVER_TICK_RATE;
+
+    while( !g_lQuit && ( dwSeconds == 0 || dwSecond < dwSeconds ) )
+    {
+        DWORD dwNow = timeGetTime();
+
+        if( (LONG)( dwNow - dwNextFrame ) < 0 )
+        {
+            net.Wait( dwNextFrame - dwNow );
+        }
+
+        DWORD dwSize = sizeof(abPacket);
+        while( S_OK == net.Receive( abPacket, &dwSize ) )
+        {
+            const MATCH_HEADER* pHeader = (const MATCH_HEADER*)abPacket;
+            DWORD dwPacketSize = dwSize;
+            dwSize = sizeof(abPacket);
+
+            if( dwPacketSize < sizeof(MATCH_HEADER) || pHeader->dwMagic != MATCH_MAGIC )
+                continue;
+
+            if( pHeader->dwType == matchWelcome && dwPacketSize == sizeof(MATCH_WELCOME) )
+            {
+                const MATCH_WELCOME* pWelcome = (const MATCH_WELCOME*)abPacket;
+                if( pWelcome->dwNonce >= dwNumBots )
+                    continue;
+
+                // A repeat welcome means the match has started, so keep
+                // the snapshots heard so far
+                BOT* pBot = &pBots[pWelcome->dwNonce];
+                if( !pBot->bSeated || pBot->dwMatch != pWelcome->dwMatch )
+                {
+                    Snapshot_ClearRing( pBot->aRing );
+                    pBot->dwNewest = SNAPSHOT_NO_FRAME;
+                }
+
+                pBot->dwMatch     = pWelcome->dwMatch;
+                pBot->dwPlayer    = pWelcome->dwPlayer;
+                pBot->dwLastState = timeGetTime();
+                pBot->bSeated     = TRUE;
+            }
+            else if( pHeader->dwType == matchState )
+            {
+                const MATCH_STATE* pState = (const MATCH_STATE*)abPacket;
+                if( dwPacketSize < MATCH_STATE_HEADER_SIZE || pState->dwNonce >= dwNumBots )
+                    continue;
+
+                BOT*     pBot = &pBots[pState->dwNonce];
+                SNAPSHOT snap;
+
+                if( !pBot->bSeated ||
+                    FAILED( Snapshot_Decode( pState->abSnapshot, dwPacketSize - MATCH_STATE_HEADER_SIZE,
+                                             pBot->aRing, &snap ) ) )
+                {
+                    dwUndecoded++;
+                    continue;
+                }
+
+                // A late one can still be a baseline, but isn't news
+                pBot->aRing[SNAPSHOT_SLOT( snap.dwFrame )] = snap;
+                if( pBot->dwNewest == SNAPSHOT_NO_FRAME || (LONG)( snap.dwFrame - pBot->dwNewest ) > 0 )
+                    pBot->dwNewest = snap.dwFrame;
+
+                pBot->dwLastState = timeGetTime();
+                dwStates++;
+                dwStateBytes += dwPacketSize - MATCH_STATE_HEADER_SIZE;
+
+                if( pState->dwStamp )
+                {
+                    DWORD dwTrip = GetMicroseconds() - pState->dwStamp;
+                    llTripTotal += dwTrip;
+                    dwTripMax    = max( dwTripMax, dwTrip );
+                    dwRoundTrips++;
+                }
+            }
+        }
+
+        dwNow = timeGetTime();
+        if( (LONG)( dwNow - dwNextFrame ) < 0 )
+            continue;
+
+        // Skip frames rather than send a burst if we fell behind
+        dwNextFrame += dwFrameLength;
+        if( (LONG)( dwNow - dwNextFrame ) > 0 )
+            dwNextFrame = dwNow + dwFrameLength;
+
+        DWORD dwSeated = 0;
+        for( DWORD i = 0; i < dwNumBots; i++ )
+        {
+            BOT* pBot = &pBots[i];
+
+            // The match ended, most likely because the opponent left
+            if( pBot->bSeated && dwNow - pBot->dwLastState > BOTS_STATE_TIMEOUT )
+                pBot->bSeated = FALSE;
+
+            if( !pBot->bSeated )
+            {
+                if( pBot->dwLastJoin == 0 || dwNow - pBot->dwLastJoin >= BOTS_JOIN_RETRY )
+                {
+                    MATCH_JOIN join;
+                    join.header.dwMagic = MATCH_MAGIC;
+                    join.header.dwType  = matchJoin;
+                    join.dwNonce        = i;
+
+                    net.Send( &join, sizeof(join), dwNow );
+                    pBot->dwLastJoin = dwNow;
+                }
+                continue;
+            }
+
+            // Nothing to chase until the first snapshot
+            LONG lBallY = 0, lBatY = 0;
+            if( pBot->dwNewest != SNAPSHOT_NO_FRAME )
+            {
+                const SNAPSHOT* pSnap = &pBot->aRing[SNAPSHOT_SLOT( pBot->dwNewest )];
+                lBallY = pSnap->alFields[snapBallY];
+                lBatY  = pSnap->alFields[pBot->dwPlayer ? snapComputerBatY : snapPlayerBatY];
+            }
+
+            FLOAT fBallY  = lBallY / SNAPSHOT_POS_SCALE;
+            FLOAT fMiddle = lBatY / SNAPSHOT_POS_SCALE + BAT_SPRITE_HEIGHT / 2 - BALL_SPRITE_DIAMETER / 2;
+
+            MATCH_INPUT input;
+            input.header.dwMagic = MATCH_MAGIC;
+            input.header.dwType  = matchInput;
+            input.dwMatch        = pBot->dwMatch;
+            input.dwPlayer       = pBot->dwPlayer;
+            input.dwStamp        = GetMicroseconds() | 1;
+            input.dwAckFrame     = pBot->dwNewest;
+            input.nMove          = fBallY > fMiddle + BOTS_DEAD_ZONE ?  1 :
+                                 ( fBallY < fMiddle - BOTS_DEAD_ZONE ? -1 : 0 );
+
+            net.Send( &input, sizeof(input), dwNow );
+            dwSeated++;
+        }
+
+        for( DWORD i = 0; i < dwWatch; i++ )
+        {
+            dwSpectated += ReceiveSpectates( &pWatchNets[i], &pWatchers[i], &dwWatchBytes, &dwWatchUndecoded );
+
+            // Once a second each, spread over the frames
+            if( ( dwFrame + i ) % SERVER_TICK_RATE == 0 )
+            {
+                MATCH_WATCH watch;
+                watch.header.dwMagic = MATCH_MAGIC;
+                watch.header.dwType  = matchWatch;
+                watch.dwMatch        = pWatchers[i].dwMatch;
+
+                pWatchNets[i].Send( &watch, sizeof(watch), dwNow );
+            }
+        }
+        dwFrame++;
+
+        if( (LONG)( dwNow - dwNextReport ) >= 0 )
+        {
+            printf( "%4lus  %6lu seated  %7lu states/s  %.1f bytes  undecoded %lu  "
+                    "round trip %.2f ms avg %.2f ms max  send drops %lu\n",
+                    dwSecond + 1, dwSeated, dwStates,
+                    dwStates ? (double)dwStateBytes / dwStates : 0.0, dwUndecoded,
+                    dwRoundTrips ? llTripTotal / 1000.0 / dwRoundTrips : 0.0, dwTripMax / 1000.0,
+                    net.GetDropped() );
+
+            if( dwWatch )
+            {
+                printf( "       %6lu watching  %7lu states/s  %.1f bytes  undecoded %lu\n",
+                        dwWatch, dwSpectated, dwSpectated ? (double)dwWatchBytes / dwSpectated : 0.0,
+                        dwWatchUndecoded );
+            }
+
+            dwStates         = 0;
+            dwStateBytes     = 0;
+            dwUndecoded      = 0;
+            dwRoundTrips     = 0;
+            llTripTotal      = 0;
+            dwTripMax        = 0;
+            dwSpectated      = 0;
+            dwWatchBytes     = 0;
+            dwWatchUndecoded = 0;
+            dwNextReport    += 1000;
+            dwSecond++;
+        }
+    }
+
+    timeEndPeriod( 1 );
+    SAFE_DELETE_ARRAY( pBots );
+    SAFE_DELETE_ARRAY( pWatchers );
+    SAFE_DELETE_ARRAY( pWatchNets );
+    net.Destroy();
+
+    return 0;
+}
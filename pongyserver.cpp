@@ -0,0 +1,209 @@
+//-----------------------------------------------------------------------------
+// File: pongyserver.cpp
+//
+// Desc: pongy-server, a console program hosting matches for as long as it
+//       runs, or for -seconds. Build it from this file, server.cpp,
+//       threadpool.cpp, net.cpp, snapshot.cpp and sim.cpp.
+//
+//       pongy-server [-port n] [-matches n] [-spectators n] [-threads n]
+//                    [-rate n] [-seconds n]
+//
+//       Once a second it prints how long the ticks took and how many
+//       packets went each way, which with pongy-bots on the same machine
+//       is how the server is load tested. With spectators it also prints
+//       how many states were coded for them against how many were sent,
+//       and how long the sending took.
+//-----------------------------------------------------------------------------
+#define STRICT
+#include <winsock2.h>
+#include <windows.h>
+#include <mmsystem.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "server.h"
+
+#pragma comment( lib, "winmm.lib" )
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+#define SERVER_DEFAULT_MATCHES  4096
+#define SERVER_DEFAULT_SPECTATORS 16384
+#define SERVER_MAX_LATE_TICKS   5           // Ticks caught up at once before giving up on them
+
+
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+volatile LONG g_lQuit = 0;
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: GetOption()
+// Desc: The number after strName on the command line, or dwDefault
+//-----------------------------------------------------------------------------
+DWORD GetOption( int argc, char* argv[], const char* strName, DWORD dwDefault )
+{
+    for( int i = 1; i < argc - 1; i++ )
+    {
+        if( 0 == strcmp( argv[i], strName ) )
+            return (DWORD)atol( argv[i + 1] );
+    }
+
+    return dwDefault;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: ConsoleHandler()
+// Desc: Ctrl+C stops the server cleanly
+//-----------------------------------------------------------------------------
+BOOL WINAPI ConsoleHandler( DWORD dwCtrlType )
+{
+    InterlockedExchange( &g_lQuit, 1 );
+    return TRUE;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: main()
+// Desc: Ticks the server SERVER_TICK_RATE times a second. A tick that
+//       starts late is caught up straight away, up to SERVER_MAX_LATE_TICKS
+//       of them, after which the server has fallen behind for good and
+//       the missed ticks are dropped.
+//-----------------------------------------------------------------------------
+int main( int argc, char* argv[] )
+{
+    DWORD dwPort    = GetOption( argc, argv, "-port", SERVER_PORT );
+    DWORD dwMatches = GetOption( argc, argv, "-matches", SERVER_DEFAULT_MATCHES );
+    DWORD dwWatch   = GetOption( argc, argv, "-spectators", SERVER_DEFAULT_SPECTATORS );
+    DWORD dwThreads = GetOption( argc, argv, "-threads", 0 );
+    DWORD dwRate    = GetOption( argc, argv, "-rate", SERVER_BROADCAST_RATE );
+    DWORD dwSeconds = GetOption( argc, argv, "-seconds", 0 );
+
+    CMatchServer server;
+    if( FAILED( server.Create( (WORD)dwPort, dwMatches, dwWatch, dwThreads, dwRate ) ) )
+    {
+        fprintf( stderr, "pongy-server: can't start on port %lu\n", dwPort );
+        return 1;
+    }
+
+    printf( "pongy-server: port %lu, %lu matches, %lu spectators, %lu threads, %lu states a second\n",
+            dwPort, dwMatches, dwWatch, server.GetNumThreads(), min( dwRate, (DWORD)SERVER_TICK_RATE ) );
+
+    SetConsoleCtrlHandler( ConsoleHandler, TRUE );
+    timeBeginPeriod( 1 );
+
+    LARGE_INTEGER liFreq, liNow, liStart, liTickStart;
+    QueryPerformanceFrequency( &liFreq );
+    QueryPerformanceCounter( &liStart );
+
+    LONGLONG llTickLength    = liFreq.QuadPart / SERVER_TICK_RATE;
+    LONGLONG llNextTick      = liStart.QuadPart;
+    LONGLONG llNextReport    = liStart.QuadPart + liFreq.QuadPart;
+    LONGLONG llTickTotal     = 0;
+    LONGLONG llTickMax       = 0;
+    LONGLONG llFanOutTotal   = 0;
+    LONGLONG llFanOutMax     = 0;
+    DWORD    dwTicks         = 0;
+    DWORD    dwLateTicks     = 0;
+    DWORD    dwLastSent      = 0;
+    DWORD    dwLastRecv      = 0;
+    DWORD    dwLastSnaps     = 0;
+    DWORD    dwLastBytes     = 0;
+    DWORD    dwLastCoded     = 0;
+    DWORD    dwLastSpectated = 0;
+    DWORD    dwSecond        = 0;
+
+    while( !g_lQuit && ( dwSeconds == 0 || dwSecond < dwSeconds ) )
+    {
+        QueryPerformanceCounter( &liNow );
+
+        if( liNow.QuadPart < llNextTick )
+        {
+            // Sleep(1) can take up to 2ms even with timeBeginPeriod(1)
+            Sleep( llNextTick - liNow.QuadPart > 2 * liFreq.QuadPart / 1000 ? 1 : 0 );
+            continue;
+        }
+
+        if( liNow.QuadPart - llNextTick > SERVER_MAX_LATE_TICKS * llTickLength )
+        {
+            dwLateTicks += (DWORD)( ( liNow.QuadPart - llNextTick ) / llTickLength );
+            llNextTick   = liNow.QuadPart;
+        }
+
+        QueryPerformanceCounter( &liTickStart );
+        server.Tick();
+        QueryPerformanceCounter( &liNow );
+
+        LONGLONG llTickTime = liNow.QuadPart - liTickStart.QuadPart;
+        llTickTotal   += llTickTime;
+        llTickMax      = max( llTickMax, llTickTime );
+        llFanOutTotal += server.GetFanOutTime();
+        llFanOutMax    = max( llFanOutMax, server.GetFanOutTime() );
+        dwTicks++;
+        llNextTick    += llTickLength;
+
+        if( liNow.QuadPart >= llNextReport )
+        {
+            DWORD dwSent  = server.GetSent();
+            DWORD dwRecv  = server.GetReceived();
+            DWORD dwSnaps = server.GetSnapshots() - dwLastSnaps;
+            DWORD dwBytes = server.GetSnapshotBytes() - dwLastBytes;
+
+            printf( "%4lus  %6lu matches  tick %.3f ms avg %.3f ms max  in %7lu/s  out %7lu/s  "
+                    "snapshot %.1f bytes  late ticks %lu  dropped inputs %lu sends %lu  saturated %ld\n",
+                    dwSecond + 1, server.GetPlaying(),
+                    1000.0 * llTickTotal / dwTicks / liFreq.QuadPart,
+                    1000.0 * llTickMax / liFreq.QuadPart,
+                    dwRecv - dwLastRecv, dwSent - dwLastSent,
+                    dwSnaps ? (double)dwBytes / dwSnaps : 0.0,
+                    dwLateTicks, server.GetInputsDropped(), server.GetSendsDropped(),
+                    Snapshot_GetSaturated() );
+
+            if( server.GetSpectators() )
+            {
+                DWORD dwCoded     = server.GetSpectateCoded();
+                DWORD dwSpectated = server.GetSpectateSent();
+
+                printf( "       %6lu spectators  coded %6lu/s  sent %7lu/s  fan-out %.3f ms avg %.3f ms max  "
+                        "watches dropped %lu\n",
+                        server.GetSpectators(), dwCoded - dwLastCoded, dwSpectated - dwLastSpectated,
+                        1000.0 * llFanOutTotal / dwTicks / liFreq.QuadPart,
+                        1000.0 * llFanOutMax / liFreq.QuadPart, server.GetWatchesDropped() );
+
+                dwLastCoded     = dwCoded;
+                dwLastSpectated = dwSpectated;
+            }
+
+            dwLastSent    = dwSent;
+            dwLastRecv    = dwRecv;
+            dwLastSnaps  += dwSnaps;
+            dwLastBytes  += dwBytes;
+            llTickTotal   = 0;
+            llTickMax     = 0;
+            llFanOutTotal = 0;
+            llFanOutMax   = 0;
+            dwTicks       = 0;
+            llNextReport += liFreq.QuadPart;
+            dwSecond++;
+        }
+    }
+
+    timeEndPeriod( 1 );
+    server.Destroy();
+
+    return 0;
+}
@@ -0,0 +1,370 @@
+//-----------------------------------------------------------------------------
+// File: pongyverify.cpp
+//
+// Desc: pongy-verify, a console program that plays back every match in a
+//       replay log through the current sim and reports any whose hashes
+//       no longer match, with the first tick they differ by. Build it from
+//       this file, replay.cpp, threadpool.cpp and sim.cpp.
+//
+//       pongy-verify <file> [-threads n] [-show n]
+//
+//       It is made for archives of millions of matches. A reader thread
+//       streams the file into one batch while the pool plays back the one
+//       before, so the disk and every processor are busy at once, and
+//       memory stays at two batches however big the file is. Within a
+//       batch each thread takes the next match as it finishes the last,
+//       so long matches don't hold the rest up.
+//
+//       It exits with 0 if every match played back the same, otherwise 1.
+//-----------------------------------------------------------------------------
+#define STRICT
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dxutil.h"
+#include "replay.h"
+#include "threadpool.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+#define VERIFY_BATCH_BYTES      ( 64 * 1024 * 1024 )
+#define VERIFY_BATCH_MATCHES    65536
+#define VERIFY_READ_BUFFER      ( 1024 * 1024 )
+#define VERIFY_DEFAULT_SHOW     100         // Divergent matches listed before just counting them
+
+struct MATCH_ENTRY
+{
+    DWORD           dwOffset;           // Of the header in the batch
+    DWORD           dwNumber;           // In the file, from 0
+    ULONGLONG       qwFilePos;          // Of the header in the file
+    REPLAY_RESULT   result;
+};
+
+struct BATCH
+{
+    BYTE*           pData;
+    MATCH_ENTRY*    pMatches;
+    DWORD           dwNumMatches;
+    volatile LONG   lNext;              // Next match for a thread to take
+    BOOL            bLast;              // Nothing more to read after this batch
+    HANDLE          hFilled;            // Set by the reader
+    HANDLE          hEmpty;             // Set once the batch has been played
+};
+
+// The reader thread's state
+struct READER
+{
+    FILE*           pFile;
+    BATCH*          pBatches;           // Two, filled in turn
+    ULONGLONG       qwFilePos;
+    DWORD           dwNumber;
+    REPLAY_HEADER   pending;            // Read, but didn't fit in the last batch
+    BOOL            bPending;
+    const char*     strError;           // Why reading stopped early, if it did
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: GetOption()
+// Desc: The number after strName on the command line, or dwDefault
+//-----------------------------------------------------------------------------
+DWORD GetOption( int argc, char* argv[], const char* strName, DWORD dwDefault )
+{
+    for( int i = 1; i < argc - 1; i++ )
+    {
+        if( 0 == strcmp( argv[i], strName ) )
+            return (DWORD)atol( argv[i + 1] );
+    }
+
+    return dwDefault;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: ScanUnended()
+// Desc: Fills in the totals of a match that was never ended by walking its
+//       ticks, so the matches after it can still be read. The file is put
+//       back at the start of its ticks. It plays back as damaged, having no
+//       final hash.
+//-----------------------------------------------------------------------------
+HRESULT ScanUnended( READER* pReader, REPLAY_HEADER* pHeader )
+{
+    ReplayScanStop stop = Replay_ScanFile( pReader->pFile, pHeader );
+
+    _fseeki64( pReader->pFile, pReader->qwFilePos + sizeof(*pHeader), SEEK_SET );
+
+    return ( stop == scanNotATick ) ? E_FAIL : S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: FillBatch()
+// Desc: Reads whole matches into a batch until it is full or the file
+//       ends. A match is never split across batches.
+//-----------------------------------------------------------------------------
+VOID FillBatch( READER* pReader, BATCH* pBatch )
+{
+    DWORD dwUsed = 0;
+
+    pBatch->dwNumMatches = 0;
+    pBatch->lNext        = 0;
+    pBatch->bLast        = FALSE;
+
+    while( pBatch->dwNumMatches < VERIFY_BATCH_MATCHES )
+    {
+        REPLAY_HEADER header;
+
+        if( pReader->bPending )
+        {
+            header            = pReader->pending;
+            pReader->bPending = FALSE;
+        }
+        else
+        {
+            size_t nRead = fread( &header, 1, sizeof(header), pReader->pFile );
+            if( nRead == 0 && feof( pReader->pFile ) )
+            {
+                pBatch->bLast = TRUE;
+                return;
+            }
+
+            if( nRead != sizeof(header) || header.dwMagic != REPLAY_MAGIC )
+                pReader->strError = "not a replay log, or damaged";
+            else if( header.dwBytes == 0 && FAILED( ScanUnended( pReader, &header ) ) )
+                pReader->strError = "a match that was never finished, and is damaged";
+            else if( header.dwBytes > VERIFY_BATCH_BYTES - sizeof(header) )
+                pReader->strError = "a match too long to play back";
+
+            if( pReader->strError )
+            {
+                pBatch->bLast = TRUE;
+                return;
+            }
+        }
+
+        if( dwUsed + sizeof(header) + header.dwBytes > VERIFY_BATCH_BYTES )
+        {
+            pReader->pending  = header;
+            pReader->bPending = TRUE;
+            return;
+        }
+
+        MATCH_ENTRY* pEntry = &pBatch->pMatches[pBatch->dwNumMatches];
+        pEntry->dwOffset  = dwUsed;
+        pEntry->dwNumber  = pReader->dwNumber;
+        pEntry->qwFilePos = pReader->qwFilePos;
+
+        memcpy( pBatch->pData + dwUsed, &header, sizeof(header) );
+        dwUsed += sizeof(header);
+
+        if( header.dwBytes != fread( pBatch->pData + dwUsed, 1, header.dwBytes, pReader->pFile ) )
+        {
+            pReader->strError = "the file ends part way through a match";
+            pBatch->bLast     = TRUE;
+            return;
+        }
+
+        dwUsed += header.dwBytes;
+        pReader->qwFilePos += sizeof(header) + header.dwBytes;
+        pReader->dwNumber++;
+        pBatch->dwNumMatches++;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: ReaderThread()
+// Desc: Fills the two batches in turn, each once it has been played
+//-----------------------------------------------------------------------------
+DWORD WINAPI ReaderThread( LPVOID pParam )
+{
+    READER* pReader = (READER*)pParam;
+
+    for( DWORD b = 0; ; b ^= 1 )
+    {
+        BATCH* pBatch = &pReader->pBatches[b];
+
+        WaitForSingleObject( pBatch->hEmpty, INFINITE );
+        FillBatch( pReader, pBatch );
+        SetEvent( pBatch->hFilled );
+
+        if( pBatch->bLast )
+            return 0;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: PlaySlice()
+// Desc: Run by each thread of the pool, taking matches from the batch one
+//       at a time until there are none left
+//-----------------------------------------------------------------------------
+VOID PlaySlice( VOID* pContext, DWORD dwFirst, DWORD dwCount )
+{
+    BATCH* pBatch = (BATCH*)pContext;
+
+    for( ;; )
+    {
+        DWORD dwMatch = (DWORD)InterlockedIncrement( &pBatch->lNext ) - 1;
+        if( dwMatch >= pBatch->dwNumMatches )
+            return;
+
+        MATCH_ENTRY*         pEntry  = &pBatch->pMatches[dwMatch];
+        const REPLAY_HEADER* pHeader = (const REPLAY_HEADER*)( pBatch->pData + pEntry->dwOffset );
+
+        Replay_PlayMatch( pHeader, (const BYTE*)( pHeader + 1 ), &pEntry->result );
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: main()
+// Desc: Plays back every batch as the reader fills it, and lists the
+//       matches that came out differently in the order they are in the file
+//-----------------------------------------------------------------------------
+int main( int argc, char* argv[] )
+{
+    if( argc < 2 || argv[1][0] == '-' )
+    {
+        fprintf( stderr, "usage: pongy-verify <file> [-threads n] [-show n]\n" );
+        return 1;
+    }
+
+    DWORD dwThreads = GetOption( argc, argv, "-threads", 0 );
+    DWORD dwShow    = GetOption( argc, argv, "-show", VERIFY_DEFAULT_SHOW );
+
+    READER reader;
+    ZeroMemory( &reader, sizeof(reader) );
+
+    if( NULL == ( reader.pFile = fopen( argv[1], "rb" ) ) )
+    {
+        fprintf( stderr, "pongy-verify: can't open %s\n", argv[1] );
+        return 1;
+    }
+    setvbuf( reader.pFile, NULL, _IOFBF, VERIFY_READ_BUFFER );
+
+    CThreadPool pool;
+    BATCH       aBatches[2];
+
+    ZeroMemory( aBatches, sizeof(aBatches) );
+    reader.pBatches = aBatches;
+
+    for( DWORD b = 0; b < 2; b++ )
+    {
+        aBatches[b].pData    = new BYTE[VERIFY_BATCH_BYTES];
+        aBatches[b].pMatches = new MATCH_ENTRY[VERIFY_BATCH_MATCHES];
+        aBatches[b].hFilled  = CreateEvent( NULL, FALSE, FALSE, NULL );
+        aBatches[b].hEmpty   = CreateEvent( NULL, FALSE, TRUE, NULL );
+
+        if( NULL == aBatches[b].pData || NULL == aBatches[b].pMatches ||
+            NULL == aBatches[b].hFilled || NULL == aBatches[b].hEmpty )
+        {
+            fprintf( stderr, "pongy-verify: out of memory\n" );
+            return 1;
+        }
+    }
+
+    HANDLE hReader = NULL;
+    if( FAILED( pool.Create( dwThreads ) ) ||
+        NULL == ( hReader = CreateThread( NULL, 0, ReaderThread, &reader, 0, NULL ) ) )
+    {
+        fprintf( stderr, "pongy-verify: can't start the threads\n" );
+        return 1;
+    }
+
+    printf( "pongy-verify: playing back %s on %lu threads\n", argv[1], pool.GetNumThreads() );
+
+    LARGE_INTEGER liFreq, liStart, liEnd;
+    QueryPerformanceFrequency( &liFreq );
+    QueryPerformanceCounter( &liStart );
+
+    DWORD     dwMatches  = 0;
+    DWORD     dwDiverged = 0;
+    DWORD     dwCorrupt  = 0;
+    ULONGLONG qwTicks    = 0;
+
+    for( DWORD b = 0; ; b ^= 1 )
+    {
+        BATCH* pBatch = &aBatches[b];
+
+        WaitForSingleObject( pBatch->hFilled, INFINITE );
+
+        // One slice per thread; each takes matches off the batch itself
+        pool.Run( PlaySlice, pBatch, pool.GetNumThreads() );
+
+        for( DWORD i = 0; i < pBatch->dwNumMatches; i++ )
+        {
+            MATCH_ENTRY*   pEntry  = &pBatch->pMatches[i];
+            REPLAY_RESULT* pResult = &pEntry->result;
+
+            qwTicks += pResult->dwTicks;
+
+            if( pResult->dwDiverged != REPLAY_NO_TICK )
+            {
+                if( dwDiverged++ < dwShow )
+                    printf( "match %lu at byte %I64u: differs by tick %lu, same at tick %lu "
+                            "(hash %08lx, was %08lx)\n",
+                            pEntry->dwNumber, pEntry->qwFilePos, pResult->dwDiverged,
+                            pResult->dwLastMatched, pResult->dwActual, pResult->dwExpected );
+            }
+            else if( pResult->bCorrupt )
+            {
+                if( dwCorrupt++ < dwShow )
+                    printf( "match %lu at byte %I64u: damaged after tick %lu\n",
+                            pEntry->dwNumber, pEntry->qwFilePos, pResult->dwTicks );
+            }
+        }
+
+        dwMatches += pBatch->dwNumMatches;
+
+        if( pBatch->bLast )
+            break;
+
+        SetEvent( pBatch->hEmpty );
+    }
+
+    QueryPerformanceCounter( &liEnd );
+    double fSeconds = (double)( liEnd.QuadPart - liStart.QuadPart ) / liFreq.QuadPart;
+
+    printf( "%lu matches, %I64u ticks in %.2f s: %.1f million ticks/s, %.1f MB/s. "
+            "%lu differ, %lu damaged\n",
+            dwMatches, qwTicks, fSeconds,
+            fSeconds > 0.0 ? qwTicks / fSeconds / 1000000.0 : 0.0,
+            fSeconds > 0.0 ? reader.qwFilePos / fSeconds / ( 1024.0 * 1024.0 ) : 0.0,
+            dwDiverged, dwCorrupt );
+
+    if( reader.strError )
+        printf( "stopped at match %lu, byte %I64u: %s\n", reader.dwNumber, reader.qwFilePos, reader.strError );
+
+    WaitForSingleObject( hReader, INFINITE );
+    CloseHandle( hReader );
+    pool.Destroy();
+    fclose( reader.pFile );
+
+    for( DWORD b = 0; b < 2; b++ )
+    {
+        SAFE_DELETE_ARRAY( aBatches[b].pData );
+        SAFE_DELETE_ARRAY( aBatches[b].pMatches );
+        CloseHandle( aBatches[b].hFilled );
+        CloseHandle( aBatches[b].hEmpty );
+    }
+
+    return ( dwDiverged || dwCorrupt || reader.strError ) ? 1 : 0;
+}
@@ -0,0 +1,259 @@
+//-----------------------------------------------------------------------------
+// File: pool.cpp
+//
+// Desc: The frame arena and the counting operator new.
+//
+//       Every new and new[] in the program, in all their forms, goes through
+//       the operators here, which bump a counter before passing the request
+//       on to malloc. The frame stats sample the counter at the start and
+//       end of each frame, so any allocation that creeps into the game loop
+//       shows up straight away in the overlay and the CSV stream.
+//-----------------------------------------------------------------------------
+#define STRICT
+#include <windows.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <new>
+#include "pool.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+static volatile LONG g_lHeapAllocs = 0;
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Mem_Alloc(), Mem_AlignedAlloc()
+// Desc: Count a call to any form of operator new and pass it on to the C
+//       heap. Both return NULL when out of memory, leaving the throwing forms
+//       to throw.
+//-----------------------------------------------------------------------------
+static void* Mem_Alloc( size_t cb )
+{
+    InterlockedIncrement( &g_lHeapAllocs );
+    return malloc( cb ? cb : 1 );
+}
+
+#ifdef __cpp_aligned_new
+static void* Mem_AlignedAlloc( size_t cb, std::align_val_t al )
+{
+    InterlockedIncrement( &g_lHeapAllocs );
+    return _aligned_malloc( cb ? cb : 1, (size_t)al );
+}
+#endif
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: operator new(), operator delete()
+// Desc: Counted replacements for the global allocation operators. The plain
+//       forms throw std::bad_alloc when out of memory, as the standard ones
+//       do, and the std::nothrow forms return NULL. The aligned forms, for
+//       types aligned past what malloc gives, are only there when the
+//       compiler has them, and come from _aligned_malloc so they need their
+//       own deletes.
+//-----------------------------------------------------------------------------
+void* operator new( size_t cb )
+{
+    void* p = Mem_Alloc( cb );
+    if( NULL == p )
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[]( size_t cb )
+{
+    void* p = Mem_Alloc( cb );
+    if( NULL == p )
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new( size_t cb, const std::nothrow_t& )
+{
+    return Mem_Alloc( cb );
+}
+
+void* operator new[]( size_t cb, const std::nothrow_t& )
+{
+    return Mem_Alloc( cb );
+}
+
+void operator delete( void* p )
+{
+    free( p );
+}
+
+void operator delete[]( void* p )
+{
+    free( p );
+}
+
+void operator delete( void* p, const std::nothrow_t& )
+{
+    free( p );
+}
+
+void operator delete[]( void* p, const std::nothrow_t& )
+{
+    free( p );
+}
+
+#ifdef __cpp_aligned_new
+void* operator new( size_t cb, std::align_val_t al )
+{
+    void* p = Mem_AlignedAlloc( cb, al );
+    if( NULL == p )
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[]( size_t cb, std::align_val_t al )
+{
+    void* p = Mem_AlignedAlloc( cb, al );
+    if( NULL == p )
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new( size_t cb, std::align_val_t al, const std::nothrow_t& )
+{
+    return Mem_AlignedAlloc( cb, al );
+}
+
+void* operator new[]( size_t cb, std::align_val_t al, const std::nothrow_t& )
+{
+    return Mem_AlignedAlloc( cb, al );
+}
+
+void operator delete( void* p, std::align_val_t )
+{
+    _aligned_free( p );
+}
+
+void operator delete[]( void* p, std::align_val_t )
+{
+    _aligned_free( p );
+}
+
+void operator delete( void* p, std::align_val_t, const std::nothrow_t& )
+{
+    _aligned_free( p );
+}
+
+void operator delete[]( void* p, std::align_val_t, const std::nothrow_t& )
+{
+    _aligned_free( p );
+}
+#endif
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Mem_GetHeapAllocs()
+// Desc:
+//-----------------------------------------------------------------------------
+DWORD Mem_GetHeapAllocs()
+{
+    return (DWORD)g_lHeapAllocs;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CArena()
+// Desc:
+//-----------------------------------------------------------------------------
+CArena::CArena()
+{
+    m_pBase       = NULL;
+    m_dwSize      = 0;
+    m_dwUsed      = 0;
+    m_dwHighWater = 0;
+    m_dwFailed    = 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: ~CArena()
+// Desc:
+//-----------------------------------------------------------------------------
+CArena::~CArena()
+{
+    Destroy();
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CArena::Create()
+// Desc: Reserves and commits dwSize bytes straight from the OS, so the
+//       arena itself never shows up in the heap counter
+//-----------------------------------------------------------------------------
+HRESULT CArena::Create( DWORD dwSize )
+{
+    Destroy();
+
+    m_pBase = (BYTE*)VirtualAlloc( NULL, dwSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE );
+    if( NULL == m_pBase )
+        return E_OUTOFMEMORY;
+
+    m_dwSize = dwSize;
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CArena::Destroy()
+// Desc:
+//-----------------------------------------------------------------------------
+VOID CArena::Destroy()
+{
+    if( m_pBase )
+    {
+        VirtualFree( m_pBase, 0, MEM_RELEASE );
+        m_pBase = NULL;
+    }
+
+    m_dwSize = 0;
+    m_dwUsed = 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CArena::Alloc()
+// Desc: Hands out the next dwBytes, aligned to dwAlign which must be a
+//       power of 2
+//-----------------------------------------------------------------------------
+VOID* CArena::Alloc( DWORD dwBytes, DWORD dwAlign )
+{
+    DWORD dwStart = ( m_dwUsed + dwAlign - 1 ) & ~( dwAlign - 1 );
+
+    if( NULL == m_pBase || dwStart + dwBytes > m_dwSize )
+    {
+        m_dwFailed++;
+        return NULL;
+    }
+
+    m_dwUsed = dwStart + dwBytes;
+    if( m_dwUsed > m_dwHighWater )
+        m_dwHighWater = m_dwUsed;
+
+    return m_pBase + dwStart;
+}
@@ -0,0 +1,126 @@
+//-----------------------------------------------------------------------------
+// File: pool.h
+//
+// Desc: Allocation helpers for the game loop. CPool is a fixed-size free
+//       list for objects of one type, CArena is a linear allocator that is
+//       emptied once a frame, and the heap counter lets the frame stats show
+//       that a steady-state frame makes no calls to the heap at all.
+//-----------------------------------------------------------------------------
+#ifndef POOL_H
+#define POOL_H
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Mem_GetHeapAllocs()
+// Desc: The number of times any form of operator new or new[] has been
+//       called since startup
+//-----------------------------------------------------------------------------
+DWORD Mem_GetHeapAllocs();
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: class CPool
+// Desc: dwCount slots of raw storage for objects of type T. Alloc() and
+//       Free() are O(1) pushes and pops on a free list threaded through the
+//       unused slots. The pool only hands out memory, construction is left
+//       to the caller (usually a class operator new).
+//-----------------------------------------------------------------------------
+template <class T, DWORD dwCount>
+class CPool
+{
+    union SLOT
+    {
+        SLOT*   pNext;
+        double  fAlign;             // Keeps every slot 8 byte aligned
+        BYTE    abObject[sizeof(T)];
+    };
+
+    SLOT    m_aSlots[dwCount];
+    SLOT*   m_pFree;
+    DWORD   m_dwUsed;
+    DWORD   m_dwHighWater;
+
+public:
+    CPool()
+    {
+        for( DWORD i = 0; i < dwCount - 1; i++ )
+            m_aSlots[i].pNext = &m_aSlots[i + 1];
+        m_aSlots[dwCount - 1].pNext = NULL;
+
+        m_pFree       = &m_aSlots[0];
+        m_dwUsed      = 0;
+        m_dwHighWater = 0;
+    }
+
+    // Returns NULL once every slot is in use
+    VOID* Alloc()
+    {
+        SLOT* pSlot = m_pFree;
+        if( NULL == pSlot )
+            return NULL;
+
+        m_pFree = pSlot->pNext;
+        if( ++m_dwUsed > m_dwHighWater )
+            m_dwHighWater = m_dwUsed;
+
+        return pSlot;
+    }
+
+    VOID Free( VOID* p )
+    {
+        SLOT* pSlot  = (SLOT*)p;
+        pSlot->pNext = m_pFree;
+        m_pFree      = pSlot;
+        m_dwUsed--;
+    }
+
+    BOOL  Owns( VOID* p )       { return p >= (VOID*)&m_aSlots[0] && p < (VOID*)&m_aSlots[dwCount]; }
+    DWORD GetUsed()             { return m_dwUsed; }
+    DWORD GetHighWater()        { return m_dwHighWater; }
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: class CArena
+// Desc: A block of memory handed out front to back and given back all at
+//       once with Reset(). Used for anything that only has to live until the
+//       end of the frame, such as draw lists, so there is nothing to free.
+//-----------------------------------------------------------------------------
+class CArena
+{
+    BYTE*   m_pBase;
+    DWORD   m_dwSize;
+    DWORD   m_dwUsed;
+    DWORD   m_dwHighWater;
+    DWORD   m_dwFailed;
+
+public:
+    CArena();
+    ~CArena();
+
+    HRESULT Create( DWORD dwSize );
+    VOID    Destroy();
+
+    // Returns NULL if the arena is full, which is counted by GetFailed()
+    VOID*   Alloc( DWORD dwBytes, DWORD dwAlign = 8 );
+    VOID    Reset()             { m_dwUsed = 0; }
+
+    // Gives back everything handed out since GetMark() returned dwMark
+    DWORD   GetMark()           { return m_dwUsed; }
+    VOID    Rewind( DWORD dwMark )  { m_dwUsed = dwMark; }
+
+    DWORD   GetUsed()           { return m_dwUsed; }
+    DWORD   GetHighWater()      { return m_dwHighWater; }
+    DWORD   GetFailed()         { return m_dwFailed; }
+};
+
+
+
+
+#endif // POOL_H
@@ -0,0 +1,267 @@
+//-----------------------------------------------------------------------------
+// File: profiler.cpp
+//
+// Desc: Per-thread trace rings and the background thread that writes them
+//       out in Chrome Trace Event format.
+//
+//       Each ring has exactly one writer (the thread that owns it) and one
+//       reader (the flush thread), so recording a zone is just a couple of
+//       stores and no locks. If the flush thread falls behind, events are
+//       dropped and counted rather than stalling the game.
+//-----------------------------------------------------------------------------
+#ifdef PONGY_PROFILE
+
+#define STRICT
+#include <windows.h>
+#include <tchar.h>
+#include <stdio.h>
+#include "profiler.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines, constants, and global variables
+//-----------------------------------------------------------------------------
+#define PROF_RING_SIZE      8192    // Events per thread, must be a power of 2
+#define PROF_FLUSH_MS       50      // How often the flush thread wakes up
+
+struct PROF_EVENT
+{
+    const char* strName;
+    DWORD64     qwStart;
+    DWORD64     qwEnd;
+};
+
+struct PROF_RING
+{
+    PROF_EVENT      aEvents[PROF_RING_SIZE];
+    volatile DWORD  dwWrite;        // Only written by the owning thread
+    volatile DWORD  dwRead;         // Only written by the flush thread
+    volatile LONG   lDropped;
+    DWORD           dwThreadId;
+    PROF_RING*      pNext;
+};
+
+static __declspec(thread) PROF_RING* t_pRing = NULL;
+
+static PROF_RING* volatile  g_pProfRings     = NULL;
+static volatile LONG        g_lProfRunning   = 0;
+static HANDLE               g_hProfThread    = NULL;
+static HANDLE               g_hProfStop      = NULL;
+static FILE*                g_pProfFile      = NULL;
+static BOOL                 g_bProfFirst     = TRUE;
+static DWORD64              g_qwProfBase     = 0;
+static double               g_fProfTicksPerUs = 1.0;
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Prof_RegisterThread()
+// Desc: Allocates the calling thread's ring and pushes it onto the global
+//       list. Rings live for the rest of the process.
+//-----------------------------------------------------------------------------
+static PROF_RING* Prof_RegisterThread()
+{
+    PROF_RING* pRing = new PROF_RING;
+    if( NULL == pRing )
+        return NULL;
+
+    pRing->dwWrite    = 0;
+    pRing->dwRead     = 0;
+    pRing->lDropped   = 0;
+    pRing->dwThreadId = GetCurrentThreadId();
+
+    // Lock-free push onto the head of the list
+    PROF_RING* pHead;
+    do
+    {
+        pHead        = g_pProfRings;
+        pRing->pNext = pHead;
+    }
+    while( InterlockedCompareExchangePointer( (void* volatile*)&g_pProfRings,
+                                              pRing, pHead ) != pHead );
+
+    t_pRing = pRing;
+    return pRing;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Prof_Record()
+// Desc: Appends a complete event to the calling thread's ring
+//-----------------------------------------------------------------------------
+VOID Prof_Record( const char* strName, DWORD64 qwStart, DWORD64 qwEnd )
+{
+    if( 0 == g_lProfRunning )
+        return;
+
+    PROF_RING* pRing = t_pRing;
+    if( NULL == pRing && NULL == ( pRing = Prof_RegisterThread() ) )
+        return;
+
+    DWORD dwWrite = pRing->dwWrite;
+    if( dwWrite - pRing->dwRead >= PROF_RING_SIZE )
+    {
+        pRing->lDropped++;
+        return;
+    }
+
+    PROF_EVENT* pEvent = &pRing->aEvents[dwWrite & (PROF_RING_SIZE - 1)];
+    pEvent->strName = strName;
+    pEvent->qwStart = qwStart;
+    pEvent->qwEnd   = qwEnd;
+
+    // Make sure the event is written before the flush thread can see it
+    _ReadWriteBarrier();
+    pRing->dwWrite = dwWrite + 1;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Prof_Drain()
+// Desc: Writes every pending event in every ring to the trace file
+//-----------------------------------------------------------------------------
+static VOID Prof_Drain()
+{
+    for( PROF_RING* pRing = g_pProfRings; pRing; pRing = pRing->pNext )
+    {
+        DWORD dwRead  = pRing->dwRead;
+        DWORD dwWrite = pRing->dwWrite;
+        _ReadWriteBarrier();
+
+        for( ; dwRead != dwWrite; dwRead++ )
+        {
+            PROF_EVENT* pEvent = &pRing->aEvents[dwRead & (PROF_RING_SIZE - 1)];
+            double fStart = (double)(LONGLONG)( pEvent->qwStart - g_qwProfBase ) / g_fProfTicksPerUs;
+            double fDur   = (double)(LONGLONG)( pEvent->qwEnd - pEvent->qwStart ) / g_fProfTicksPerUs;
+
+            fprintf( g_pProfFile, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,"
+                                  "\"ts\":%.3f,\"dur\":%.3f}",
+                     g_bProfFirst ? "" : ",", pEvent->strName, pRing->dwThreadId,
+                     fStart, fDur );
+            g_bProfFirst = FALSE;
+        }
+
+        // Hand the slots back to the owning thread
+        _ReadWriteBarrier();
+        pRing->dwRead = dwRead;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Prof_FlushThread()
+// Desc: Periodically drains the rings until asked to stop
+//-----------------------------------------------------------------------------
+static DWORD WINAPI Prof_FlushThread( LPVOID pParam )
+{
+    UNREFERENCED_PARAMETER( pParam );
+
+    while( WaitForSingleObject( g_hProfStop, PROF_FLUSH_MS ) == WAIT_TIMEOUT )
+        Prof_Drain();
+
+    return 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Prof_Init()
+// Desc: Opens the trace file, calibrates the timestamp counter and starts
+//       the flush thread
+//-----------------------------------------------------------------------------
+HRESULT Prof_Init( const TCHAR* strFile )
+{
+    if( g_lProfRunning )
+        return S_OK;
+
+    if( NULL == ( g_pProfFile = _tfopen( strFile, TEXT("w") ) ) )
+        return E_FAIL;
+
+    // Work out how many TSC ticks there are in a microsecond by timing a
+    // short sleep against the performance counter
+    LARGE_INTEGER qwFreq, qwStart, qwEnd;
+    QueryPerformanceFrequency( &qwFreq );
+    QueryPerformanceCounter( &qwStart );
+    DWORD64 qwTscStart = __rdtsc();
+    Sleep( 10 );
+    QueryPerformanceCounter( &qwEnd );
+    DWORD64 qwTscEnd = __rdtsc();
+
+    double fMicroSecs = (double)( qwEnd.QuadPart - qwStart.QuadPart ) * 1000000.0 /
+                        (double)qwFreq.QuadPart;
+    g_fProfTicksPerUs = (double)( qwTscEnd - qwTscStart ) / fMicroSecs;
+    g_qwProfBase      = qwTscEnd;
+
+    fprintf( g_pProfFile, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[" );
+    g_bProfFirst = TRUE;
+
+    g_hProfStop = CreateEvent( NULL, TRUE, FALSE, NULL );
+    InterlockedExchange( &g_lProfRunning, 1 );
+
+    g_hProfThread = CreateThread( NULL, 0, Prof_FlushThread, NULL, 0, NULL );
+    if( NULL == g_hProfThread )
+    {
+        Prof_Shutdown();
+        return E_FAIL;
+    }
+
+    SetThreadPriority( g_hProfThread, THREAD_PRIORITY_BELOW_NORMAL );
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Prof_Shutdown()
+// Desc: Stops the flush thread, writes out anything left in the rings and
+//       closes the trace file. Safe to call more than once.
+//-----------------------------------------------------------------------------
+VOID Prof_Shutdown()
+{
+    if( 0 == InterlockedExchange( &g_lProfRunning, 0 ) )
+        return;
+
+    if( g_hProfThread )
+    {
+        SetEvent( g_hProfStop );
+        WaitForSingleObject( g_hProfThread, INFINITE );
+        CloseHandle( g_hProfThread );
+        g_hProfThread = NULL;
+    }
+
+    if( g_hProfStop )
+    {
+        CloseHandle( g_hProfStop );
+        g_hProfStop = NULL;
+    }
+
+    Prof_Drain();
+
+    // Record how many events were lost so a short trace is not a mystery
+    LONG lDropped = 0;
+    for( PROF_RING* pRing = g_pProfRings; pRing; pRing = pRing->pNext )
+        lDropped += pRing->lDropped;
+
+    fprintf( g_pProfFile, "%s\n{\"name\":\"dropped_events\",\"ph\":\"C\",\"pid\":1,"
+                          "\"ts\":0,\"args\":{\"count\":%ld}}\n]}\n",
+             g_bProfFirst ? "" : ",", lDropped );
+    fclose( g_pProfFile );
+    g_pProfFile = NULL;
+
+    // The rings themselves are left alone as their owning threads may still
+    // hold on to them; they are reused if profiling is started again.
+}
+
+#endif // PONGY_PROFILE
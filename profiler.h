@@ -0,0 +1,68 @@
+//-----------------------------------------------------------------------------
+// File: profiler.h
+//
+// Desc: Scoped trace zones for finding out where a frame's time goes. Each
+//       thread records zones into its own ring buffer, and a background
+//       thread flushes them to a Chrome Trace Event JSON file which can be
+//       loaded into chrome://tracing or ui.perfetto.dev.
+//
+//       Everything here compiles to nothing unless PONGY_PROFILE is defined.
+//-----------------------------------------------------------------------------
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#ifdef PONGY_PROFILE
+
+#include <intrin.h>
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Prof_*()
+// Desc: Prof_Init() starts the flush thread writing to strFile, and
+//       Prof_Shutdown() drains whatever is left and closes the file.
+//       Prof_Record() is what the PROF_ZONE() macro calls on scope exit.
+//-----------------------------------------------------------------------------
+HRESULT Prof_Init( const TCHAR* strFile );
+VOID    Prof_Shutdown();
+VOID    Prof_Record( const char* strName, DWORD64 qwStart, DWORD64 qwEnd );
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: class CProfZone
+// Desc: Records the time between its construction and destruction as a
+//       single complete event. strName must be a string literal as only the
+//       pointer is stored.
+//-----------------------------------------------------------------------------
+class CProfZone
+{
+    const char* m_strName;
+    DWORD64     m_qwStart;
+
+public:
+    CProfZone( const char* strName ) : m_strName( strName ), m_qwStart( __rdtsc() ) {}
+    ~CProfZone() { Prof_Record( m_strName, m_qwStart, __rdtsc() ); }
+};
+
+#define PROF_CONCAT2(a, b)  a##b
+#define PROF_CONCAT(a, b)   PROF_CONCAT2(a, b)
+
+#define PROF_INIT(file)     Prof_Init( file )
+#define PROF_SHUTDOWN()     Prof_Shutdown()
+#define PROF_ZONE(name)     CProfZone PROF_CONCAT(profZone, __LINE__)( name )
+
+#else
+
+#define PROF_INIT(file)     (S_OK)
+#define PROF_SHUTDOWN()     ((void)0)
+#define PROF_ZONE(name)     ((void)0)
+
+#endif // PONGY_PROFILE
+
+
+
+
+#endif // PROFILER_H
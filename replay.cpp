@@ -0,0 +1,409 @@
+//-----------------------------------------------------------------------------
+// File: replay.cpp
+//
+// Desc: Writing match logs and playing them back. The writer goes through
+//       stdio with a large buffer, so a tick is a byte into memory; only
+//       ending a match seeks, to fill in the header.
+//-----------------------------------------------------------------------------
+#define STRICT
+#include <windows.h>
+#include <tchar.h>
+#include <string.h>
+#include "replay.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+#define REPLAY_WRITE_BUFFER     ( 64 * 1024 )
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CReplayWriter::CReplayWriter()
+// Desc:
+//-----------------------------------------------------------------------------
+CReplayWriter::CReplayWriter()
+{
+    m_pFile       = NULL;
+    m_llHeaderPos = -1;
+    m_fLastDelta  = 0.0f;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CReplayWriter::~CReplayWriter()
+// Desc:
+//-----------------------------------------------------------------------------
+CReplayWriter::~CReplayWriter()
+{
+    Close();
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CReplayWriter::Open()
+// Desc: Opens a log to add matches to the end of. It isn't opened for
+//       appending, as that would stop EndMatch() seeking back to the header.
+//-----------------------------------------------------------------------------
+HRESULT CReplayWriter::Open( const TCHAR* strFile )
+{
+    Close();
+
+    if( NULL == ( m_pFile = _tfopen( strFile, TEXT("r+b") ) ) &&
+        NULL == ( m_pFile = _tfopen( strFile, TEXT("w+b") ) ) )
+        return E_FAIL;
+
+    setvbuf( m_pFile, NULL, _IOFBF, REPLAY_WRITE_BUFFER );
+
+    FinishUnended();
+    _fseeki64( m_pFile, 0, SEEK_END );
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CReplayWriter::FinishUnended()
+// Desc: Walks the matches already in the log and fills in the totals of
+//       any left at 0 by a run that died before EndMatch(), so the matches
+//       added after it can still be found. Such a match has no REPLAY_END,
+//       so the verifier reports it as damaged after its last tick. Walking
+//       stops at anything that isn't a match, which is left as it is.
+//-----------------------------------------------------------------------------
+VOID CReplayWriter::FinishUnended()
+{
+    LONGLONG      llPos = 0;
+    REPLAY_HEADER header;
+
+    _fseeki64( m_pFile, 0, SEEK_SET );
+
+    while( 1 == fread( &header, sizeof(header), 1, m_pFile ) &&
+           header.dwMagic == REPLAY_MAGIC )
+    {
+        if( header.dwBytes == 0 )
+        {
+            if( scanNotATick == Replay_ScanFile( m_pFile, &header ) )
+                return;
+
+            // Also the seek stdio needs between reading and writing
+            _fseeki64( m_pFile, llPos, SEEK_SET );
+            fwrite( &header, sizeof(header), 1, m_pFile );
+        }
+
+        llPos += sizeof(header) + header.dwBytes;
+        _fseeki64( m_pFile, llPos, SEEK_SET );
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CReplayWriter::Close()
+// Desc: Closes the log. A match still being recorded is left unfinished;
+//       call EndMatch() first to keep it.
+//-----------------------------------------------------------------------------
+VOID CReplayWriter::Close()
+{
+    if( m_pFile )
+    {
+        fclose( m_pFile );
+        m_pFile = NULL;
+    }
+
+    m_llHeaderPos = -1;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CReplayWriter::BeginMatch()
+// Desc: Starts recording a match. The one before should have been ended
+//       with EndMatch(), or it is left unfinished.
+//-----------------------------------------------------------------------------
+HRESULT CReplayWriter::BeginMatch( ReplayMode mode, DWORD dwSeed, const SIM_PARAMS* pParams )
+{
+    if( NULL == m_pFile )
+        return E_FAIL;
+
+    ZeroMemory( &m_header, sizeof(m_header) );
+    m_header.dwMagic = REPLAY_MAGIC;
+    m_header.dwMode  = mode;
+    m_header.dwSeed  = dwSeed;
+    m_header.params  = *pParams;
+
+    m_llHeaderPos = _ftelli64( m_pFile );
+    m_fLastDelta  = 0.0f;
+
+    if( 1 != fwrite( &m_header, sizeof(m_header), 1, m_pFile ) )
+    {
+        m_llHeaderPos = -1;
+        return E_FAIL;
+    }
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CReplayWriter::AddTick()
+// Desc: Records one step. The time step is only written when it changes,
+//       and the state's hash every REPLAY_HASH_TICKS ticks.
+//-----------------------------------------------------------------------------
+VOID CReplayWriter::AddTick( int nMove, int nOtherMove, FLOAT fTimeDelta, const SIM_STATE* pState )
+{
+    if( !IsRecording() )
+        return;
+
+    BYTE bTick = (BYTE)( ( nMove + 1 ) | ( ( nOtherMove + 1 ) << 2 ) );
+    BOOL bHash = ( m_header.dwTicks + 1 ) % REPLAY_HASH_TICKS == 0;
+
+    // Compared as bits, so a step is only skipped if it is exactly the same
+    if( 0 != memcmp( &fTimeDelta, &m_fLastDelta, sizeof(FLOAT) ) || m_header.dwTicks == 0 )
+        bTick |= REPLAY_NEW_DELTA;
+    if( bHash )
+        bTick |= REPLAY_HASH;
+
+    fputc( bTick, m_pFile );
+    m_header.dwBytes++;
+
+    if( bTick & REPLAY_NEW_DELTA )
+    {
+        fwrite( &fTimeDelta, sizeof(FLOAT), 1, m_pFile );
+        m_header.dwBytes += sizeof(FLOAT);
+        m_fLastDelta      = fTimeDelta;
+    }
+
+    if( bHash )
+    {
+        DWORD dwHash = Sim_GetChecksum( pState );
+        fwrite( &dwHash, sizeof(DWORD), 1, m_pFile );
+        m_header.dwBytes += sizeof(DWORD);
+    }
+
+    m_header.dwTicks++;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CReplayWriter::EndMatch()
+// Desc: Writes the end of the match and the final state's hash, then goes
+//       back to fill in the header's totals
+//-----------------------------------------------------------------------------
+HRESULT CReplayWriter::EndMatch( const SIM_STATE* pState )
+{
+    if( !IsRecording() )
+        return S_FALSE;
+
+    DWORD dwHash = Sim_GetChecksum( pState );
+
+    fputc( REPLAY_END, m_pFile );
+    fwrite( &dwHash, sizeof(DWORD), 1, m_pFile );
+    m_header.dwBytes += 1 + sizeof(DWORD);
+
+    _fseeki64( m_pFile, m_llHeaderPos, SEEK_SET );
+    fwrite( &m_header, sizeof(m_header), 1, m_pFile );
+    _fseeki64( m_pFile, 0, SEEK_END );
+
+    m_llHeaderPos = -1;
+
+    return fflush( m_pFile ) == 0 ? S_OK : E_FAIL;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Replay_ScanFile()
+// Desc: Reads on a byte at a time through stdio's buffer, keeping the last
+//       four bytes to spot the next header. It can start part way through a
+//       tick cut off by the program dying, so it is looked for after every
+//       byte rather than only where a tick would start. A tick cut off at
+//       the end of the file is counted in dwBytes but not dwTicks, which
+//       Replay_PlayMatch() reports as damaged.
+//-----------------------------------------------------------------------------
+ReplayScanStop Replay_ScanFile( FILE* pFile, REPLAY_HEADER* pHeader )
+{
+    LONGLONG       llStart  = _ftelli64( pFile );
+    ReplayScanStop stop     = scanFileEnd;
+    DWORD          dwWindow = 0;
+    DWORD          dwBytes  = 0;
+    DWORD          dwTicks  = 0;
+    DWORD          dwLeft   = 0;        // Bytes still to come of the current tick
+    DWORD          dwBad    = 0;        // Where a byte that isn't a tick was, from 1
+    BOOL           bEnding  = FALSE;
+    int            c;
+
+    while( EOF != ( c = getc( pFile ) ) )
+    {
+        dwBytes++;
+        dwWindow = ( dwWindow >> 8 ) | ( (DWORD)c << 24 );
+
+        if( dwBytes >= sizeof(DWORD) && dwWindow == REPLAY_MAGIC )
+        {
+            dwBytes -= sizeof(DWORD);
+            stop     = scanNextMatch;
+            break;
+        }
+
+        // Give a bad byte three more to turn out to be the next header
+        if( dwBad )
+        {
+            if( dwBytes - dwBad == sizeof(DWORD) - 1 )
+            {
+                dwBytes = dwBad - 1;
+                stop    = scanNotATick;
+                break;
+            }
+            continue;
+        }
+
+        if( dwLeft )
+        {
+            if( --dwLeft == 0 )
+            {
+                if( bEnding )
+                {
+                    stop = scanEnd;
+                    break;
+                }
+                dwTicks++;
+            }
+            continue;
+        }
+
+        if( c == REPLAY_END )
+        {
+            bEnding = TRUE;
+            dwLeft  = sizeof(DWORD);
+        }
+        else if( ( c & 0xC0 ) || ( c & 3 ) == 3 || ( c & 12 ) == 12 )
+        {
+            dwBad = dwBytes;
+        }
+        else
+        {
+            dwLeft = ( c & REPLAY_NEW_DELTA ? sizeof(FLOAT) : 0 ) +
+                     ( c & REPLAY_HASH ? sizeof(DWORD) : 0 );
+            if( dwLeft == 0 )
+                dwTicks++;
+        }
+    }
+
+    // The file ended within three bytes of a bad one
+    if( stop == scanFileEnd && dwBad )
+    {
+        dwBytes = dwBad - 1;
+        stop    = scanNotATick;
+    }
+
+    pHeader->dwTicks = dwTicks;
+    pHeader->dwBytes = dwBytes;
+    _fseeki64( pFile, llStart + dwBytes, SEEK_SET );
+
+    return stop;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Replay_PlayMatch()
+// Desc: Plays a match back through the current sim. The hashes are of the
+//       whole SIM_STATE, so they cover the sprites, the score and the
+//       serving seed.
+//-----------------------------------------------------------------------------
+VOID Replay_PlayMatch( const REPLAY_HEADER* pHeader, const BYTE* pTicks, REPLAY_RESULT* pResult )
+{
+    const BYTE* pEnd   = pTicks + pHeader->dwBytes;
+    FLOAT       fDelta = 0.0f;
+    SIM_STATE   state;
+
+    pResult->dwTicks       = 0;
+    pResult->dwLastMatched = 0;
+    pResult->dwDiverged    = REPLAY_NO_TICK;
+    pResult->bCorrupt      = FALSE;
+
+    Sim_Init( &state, pHeader->dwSeed, &pHeader->params );
+
+    while( pTicks < pEnd )
+    {
+        BYTE  bTick = *pTicks++;
+        DWORD dwExpected;
+
+        if( bTick == REPLAY_END )
+        {
+            if( (DWORD)( pEnd - pTicks ) < sizeof(DWORD) )
+                break;
+
+            memcpy( &dwExpected, pTicks, sizeof(DWORD) );
+            pTicks += sizeof(DWORD);
+
+            if( Sim_GetChecksum( &state ) != dwExpected )
+            {
+                pResult->dwDiverged = pResult->dwTicks;
+                pResult->dwExpected = dwExpected;
+                pResult->dwActual   = Sim_GetChecksum( &state );
+            }
+
+            pResult->bCorrupt = pTicks != pEnd || pResult->dwTicks != pHeader->dwTicks;
+            return;
+        }
+
+        DWORD dwExtra = ( bTick & REPLAY_NEW_DELTA ? sizeof(FLOAT) : 0 ) +
+                        ( bTick & REPLAY_HASH ? sizeof(DWORD) : 0 );
+        if( (DWORD)( pEnd - pTicks ) < dwExtra || ( bTick & 3 ) == 3 || ( bTick & 12 ) == 12 )
+            break;
+
+        if( bTick & REPLAY_NEW_DELTA )
+        {
+            memcpy( &fDelta, pTicks, sizeof(FLOAT) );
+            pTicks += sizeof(FLOAT);
+        }
+
+        int nMove      = ( bTick & 3 ) - 1;
+        int nOtherMove = ( ( bTick >> 2 ) & 3 ) - 1;
+
+        if( pHeader->dwMode == replayVersus )
+            Sim_StepVersus( &state, nMove, nOtherMove, fDelta );
+        else
+            Sim_Step( &state, nMove, fDelta );
+
+        pResult->dwTicks++;
+
+        if( bTick & REPLAY_HASH )
+        {
+            memcpy( &dwExpected, pTicks, sizeof(DWORD) );
+            pTicks += sizeof(DWORD);
+
+            DWORD dwActual = Sim_GetChecksum( &state );
+            if( dwActual != dwExpected )
+            {
+                pResult->dwDiverged = pResult->dwTicks;
+                pResult->dwExpected = dwExpected;
+                pResult->dwActual   = dwActual;
+                return;
+            }
+
+            pResult->dwLastMatched = pResult->dwTicks;
+        }
+    }
+
+    // Ran out of bytes without reaching REPLAY_END, or hit a bad move
+    pResult->bCorrupt = TRUE;
+}
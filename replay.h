@@ -0,0 +1,137 @@
+//-----------------------------------------------------------------------------
+// File: replay.h
+//
+// Desc: Match logs for checking the simulation still plays old games the
+//       same way. A log holds a match's seed and settings, every tick's
+//       moves and time step, and a hash of the state every
+//       REPLAY_HASH_TICKS ticks and at the end. Playing the moves back
+//       through the current sim and comparing hashes shows whether a
+//       change to the physics changes the outcome of a recorded game, and
+//       from which tick.
+//
+//       A log file is just matches one after another, each a REPLAY_HEADER
+//       followed by its ticks, so archives are made by appending to a file
+//       or concatenating files. Each tick is a byte:
+//
+//         bits 0-1  player's move + 1
+//         bits 2-3  other player's move + 1, 1 in a game against the computer
+//         bit 4     REPLAY_NEW_DELTA, a FLOAT time step follows
+//         bit 5     REPLAY_HASH, the DWORD Sim_GetChecksum() after the step follows
+//
+//       and the match ends with REPLAY_END and the final state's hash.
+//       The time step is only written when it changes, so a fixed step
+//       game costs a byte a tick.
+//
+//       A match whose program died before ending it has 0 for its totals.
+//       Its ticks can still be found by walking them, as no tick byte has
+//       bit 6 or 7 set and a header starts with REPLAY_MAGIC, and
+//       Replay_ScanFile() does that for the writer and the verifier.
+//-----------------------------------------------------------------------------
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdio.h>
+#include "sim.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+#define REPLAY_MAGIC            0x31524750  // "PGR1"
+#define REPLAY_HASH_TICKS       60          // Ticks between recorded hashes
+#define REPLAY_NEW_DELTA        0x10
+#define REPLAY_HASH             0x20
+#define REPLAY_END              0xFF
+#define REPLAY_NO_TICK          0xFFFFFFFF
+
+// Which step function plays the match
+enum ReplayMode { replaySingle, replayVersus };
+
+// Why Replay_ScanFile() stopped walking an unfinished match's ticks
+enum ReplayScanStop { scanEnd, scanNextMatch, scanFileEnd, scanNotATick };
+
+// dwTicks and dwBytes are written when the match ends, and are 0 in a
+// match that never did until the next Open() or the verifier walks it
+struct REPLAY_HEADER
+{
+    DWORD       dwMagic;
+    DWORD       dwMode;             // ReplayMode
+    DWORD       dwSeed;             // Given to Sim_Init()
+    SIM_PARAMS  params;
+    DWORD       dwTicks;
+    DWORD       dwBytes;            // Of ticks, REPLAY_END and the final hash
+};
+
+// What playing one match back found
+struct REPLAY_RESULT
+{
+    DWORD       dwTicks;            // Ticks played
+    DWORD       dwLastMatched;      // Last tick whose hash was the same, 0 if none
+    DWORD       dwDiverged;         // First tick whose hash differs, or REPLAY_NO_TICK
+    DWORD       dwExpected;         // Hashes at dwDiverged
+    DWORD       dwActual;
+    BOOL        bCorrupt;           // The ticks ran past dwBytes or didn't add up
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: class CReplayWriter
+// Desc: Records matches to a log file, appending to it if it exists.
+//       AddTick() is called after each step with the moves and time step
+//       it was given and the state it left.
+//-----------------------------------------------------------------------------
+class CReplayWriter
+{
+    FILE*           m_pFile;
+    LONGLONG        m_llHeaderPos;      // Of the match being recorded, or -1
+    REPLAY_HEADER   m_header;
+    FLOAT           m_fLastDelta;
+
+    CReplayWriter( const CReplayWriter& );
+    CReplayWriter& operator=( const CReplayWriter& );
+
+    VOID    FinishUnended();
+
+public:
+    CReplayWriter();
+    ~CReplayWriter();
+
+    HRESULT Open( const TCHAR* strFile );
+    VOID    Close();
+
+    HRESULT BeginMatch( ReplayMode mode, DWORD dwSeed, const SIM_PARAMS* pParams );
+    VOID    AddTick( int nMove, int nOtherMove, FLOAT fTimeDelta, const SIM_STATE* pState );
+    HRESULT EndMatch( const SIM_STATE* pState );
+
+    BOOL    IsRecording()       { return m_llHeaderPos >= 0; }
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Replay_ScanFile()
+// Desc: Walks the ticks of a match that was never ended, from just after
+//       its header, and fills in the header's totals from them. The file is
+//       left at the next match's header, or at its end.
+//-----------------------------------------------------------------------------
+ReplayScanStop Replay_ScanFile( FILE* pFile, REPLAY_HEADER* pHeader );
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Replay_PlayMatch()
+// Desc: Plays a match back from its header and the dwBytes of ticks after
+//       it, stopping at the first hash that differs
+//-----------------------------------------------------------------------------
+VOID Replay_PlayMatch( const REPLAY_HEADER* pHeader, const BYTE* pTicks, REPLAY_RESULT* pResult );
+
+
+
+
+#endif // REPLAY_H
@@ -0,0 +1,661 @@
+//-----------------------------------------------------------------------------
+// File: resample.cpp
+//
+// Desc: The resampling filters. Weights are fixed point: bilinear mixes
+//       two pixels by a fraction out of 128, so a difference of two 8 bit
+//       channels times the fraction still fits a 16 bit lane, and box
+//       weights add up to 16384, so a weighted channel fits a 16 bit
+//       multiplier and a sum of them a 32 bit lane.
+//-----------------------------------------------------------------------------
+#define STRICT
+#include <windows.h>
+#include <string.h>
+#include <emmintrin.h>
+#include "dxutil.h"
+#include "resample.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+#define RESAMPLE_FRAC_BITS      7
+#define RESAMPLE_FRAC_ONE       ( 1 << RESAMPLE_FRAC_BITS )
+#define RESAMPLE_BOX_BITS       14
+#define RESAMPLE_BOX_ONE        ( 1 << RESAMPLE_BOX_BITS )
+#define RESAMPLE_NO_ROW         0xFFFFFFFF
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: RowOf()
+// Desc: The start of row y, which works for images stored bottom up too
+//-----------------------------------------------------------------------------
+static inline DWORD* RowOf( const RESAMPLE_IMAGE* pImage, DWORD y )
+{
+    return (DWORD*)( pImage->pBits + (LONG)y * pImage->lPitch );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Lerp()
+// Desc: a + ( b - a ) * w / 128 for each 16 bit lane, the lanes holding 8
+//       bit channels and w a fraction out of 128
+//-----------------------------------------------------------------------------
+static inline __m128i Lerp( __m128i a, __m128i b, __m128i w )
+{
+    __m128i d = _mm_mullo_epi16( _mm_sub_epi16( b, a ), w );
+    return _mm_add_epi16( a, _mm_srai_epi16( d, RESAMPLE_FRAC_BITS ) );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: FilterFor()
+// Desc: The filter actually used. Bilinear needs at least two source
+//       pixels each way, and is done as nearest when there aren't.
+//-----------------------------------------------------------------------------
+static ResampleFilter FilterFor( ResampleFilter filter, DWORD dwSrcWidth, DWORD dwSrcHeight )
+{
+    if( filter == resampleBilinear && ( dwSrcWidth < 2 || dwSrcHeight < 2 ) )
+        return resampleNearest;
+
+    return filter;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CResampler::CResampler()
+// Desc:
+//-----------------------------------------------------------------------------
+CResampler::CResampler()
+{
+    m_filter       = resampleNearest;
+    m_dwSrcWidth   = 0;
+    m_dwSrcHeight  = 0;
+    m_dwDestWidth  = 0;
+    m_dwDestHeight = 0;
+    m_pColumns     = NULL;
+    m_pRows        = NULL;
+    m_pwWeights    = NULL;
+    m_pBands       = NULL;
+    m_pdwScratch   = NULL;
+    m_dwNumBands   = 0;
+    m_dwRunBands   = 0;
+    m_pSrc         = NULL;
+    m_pDest        = NULL;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CResampler::~CResampler()
+// Desc:
+//-----------------------------------------------------------------------------
+CResampler::~CResampler()
+{
+    Destroy();
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CResampler::Create()
+// Desc: Works out where every destination column and row comes from, and
+//       gives each band its scratch rows
+//-----------------------------------------------------------------------------
+HRESULT CResampler::Create( DWORD dwSrcWidth, DWORD dwSrcHeight, DWORD dwDestWidth, DWORD dwDestHeight,
+                            ResampleFilter filter, DWORD dwMaxBands )
+{
+    Destroy();
+
+    if( dwSrcWidth == 0 || dwSrcHeight == 0 || dwDestWidth == 0 || dwDestHeight == 0 )
+        return E_INVALIDARG;
+
+    filter = FilterFor( filter, dwSrcWidth, dwSrcHeight );
+
+    m_filter       = filter;
+    m_dwSrcWidth   = dwSrcWidth;
+    m_dwSrcHeight  = dwSrcHeight;
+    m_dwDestWidth  = dwDestWidth;
+    m_dwDestHeight = dwDestHeight;
+    m_dwNumBands   = max( dwMaxBands, 1 );
+
+    // Bilinear keeps each pair of columns' fractions ready to load as one
+    // vector, box a weight for every source pixel a column covers
+    DWORD dwWeights = 0;
+    if( filter == resampleBilinear )
+        dwWeights = ( dwDestWidth + 1 ) / 2 * 8;
+    else if( filter == resampleBox )
+        dwWeights = dwSrcWidth + dwSrcHeight + 2 * ( dwDestWidth + dwDestHeight );
+
+    DWORD dwScratch = 0;
+    if( filter == resampleBilinear )
+        dwScratch = 2 * dwDestWidth;
+    else if( filter == resampleBox )
+        dwScratch = 5 * dwDestWidth;
+
+    m_pColumns = new TAP[dwDestWidth];
+    m_pRows    = new TAP[dwDestHeight];
+    m_pBands   = new BAND[m_dwNumBands];
+    if( dwWeights )
+        m_pwWeights = new WORD[dwWeights];
+    if( dwScratch )
+        m_pdwScratch = new DWORD[dwScratch * m_dwNumBands];
+
+    if( NULL == m_pColumns || NULL == m_pRows || NULL == m_pBands ||
+        ( dwWeights && NULL == m_pwWeights ) || ( dwScratch && NULL == m_pdwScratch ) )
+    {
+        Destroy();
+        return E_OUTOFMEMORY;
+    }
+
+    DWORD dwUsed = 0;
+    MakeTaps( m_pColumns, dwSrcWidth, dwDestWidth, &dwUsed );
+    MakeTaps( m_pRows, dwSrcHeight, dwDestHeight, &dwUsed );
+
+    if( filter == resampleBilinear )
+    {
+        for( DWORD x = 0; x < dwDestWidth; x++ )
+        {
+            WORD* pwPair = &m_pwWeights[x / 2 * 8 + ( x & 1 ) * 4];
+            pwPair[0] = pwPair[1] = pwPair[2] = pwPair[3] = m_pColumns[x].wFrac;
+        }
+    }
+
+    for( DWORD b = 0; b < m_dwNumBands; b++ )
+    {
+        BAND*  pBand   = &m_pBands[b];
+        DWORD* pdwBand = m_pdwScratch ? m_pdwScratch + b * dwScratch : NULL;
+
+        pBand->pdwRows[0] = pdwBand;
+        pBand->pdwRows[1] = pdwBand && filter == resampleBilinear ? pdwBand + dwDestWidth : NULL;
+        pBand->pdwSums    = pdwBand && filter == resampleBox ? pdwBand + dwDestWidth : NULL;
+        pBand->adwRowY[0] = RESAMPLE_NO_ROW;
+        pBand->adwRowY[1] = RESAMPLE_NO_ROW;
+    }
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CResampler::Destroy()
+// Desc:
+//-----------------------------------------------------------------------------
+VOID CResampler::Destroy()
+{
+    SAFE_DELETE_ARRAY( m_pColumns );
+    SAFE_DELETE_ARRAY( m_pRows );
+    SAFE_DELETE_ARRAY( m_pwWeights );
+    SAFE_DELETE_ARRAY( m_pBands );
+    SAFE_DELETE_ARRAY( m_pdwScratch );
+
+    m_dwSrcWidth   = 0;
+    m_dwSrcHeight  = 0;
+    m_dwDestWidth  = 0;
+    m_dwDestHeight = 0;
+    m_dwNumBands   = 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CResampler::Matches()
+// Desc: Whether Create() was last called with these sizes and filter
+//-----------------------------------------------------------------------------
+BOOL CResampler::Matches( DWORD dwSrcWidth, DWORD dwSrcHeight, DWORD dwDestWidth, DWORD dwDestHeight,
+                          ResampleFilter filter )
+{
+    return IsCreated() && m_dwSrcWidth == dwSrcWidth && m_dwSrcHeight == dwSrcHeight &&
+           m_dwDestWidth == dwDestWidth && m_dwDestHeight == dwDestHeight &&
+           m_filter == FilterFor( filter, dwSrcWidth, dwSrcHeight );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CResampler::MakeTaps()
+// Desc: Fills in where each of dwDest pixels along one axis comes from out
+//       of dwSrc. Positions are worked in whole numbers, in units of a
+//       source pixel over 2 * dwDest, so every size is exact.
+//-----------------------------------------------------------------------------
+HRESULT CResampler::MakeTaps( TAP* pTaps, DWORD dwSrc, DWORD dwDest, DWORD* pdwWeights )
+{
+    for( DWORD i = 0; i < dwDest; i++ )
+    {
+        TAP* pTap = &pTaps[i];
+        pTap->dwFirst   = 0;
+        pTap->dwCount   = 1;
+        pTap->dwWeights = 0;
+        pTap->wFrac     = 0;
+
+        if( m_filter == resampleNearest )
+        {
+            // The source pixel under the middle of this one
+            pTap->dwFirst = (DWORD)( ( ( 2 * (ULONGLONG)i + 1 ) * dwSrc ) / ( 2 * (ULONGLONG)dwDest ) );
+        }
+        else if( m_filter == resampleBilinear )
+        {
+            // The middle of this pixel in 128ths of a source pixel, from
+            // the middle of the first source pixel
+            LONGLONG llPos = (LONGLONG)( ( ( 2 * (ULONGLONG)i + 1 ) * dwSrc * RESAMPLE_FRAC_ONE ) /
+                                         ( 2 * (ULONGLONG)dwDest ) ) - RESAMPLE_FRAC_ONE / 2;
+            if( llPos < 0 )
+                llPos = 0;
+
+            pTap->dwFirst = (DWORD)( llPos >> RESAMPLE_FRAC_BITS );
+            pTap->wFrac   = (WORD)( llPos & ( RESAMPLE_FRAC_ONE - 1 ) );
+
+            if( pTap->dwFirst >= dwSrc - 1 )
+            {
+                pTap->dwFirst = dwSrc - 2;
+                pTap->wFrac   = RESAMPLE_FRAC_ONE;
+            }
+        }
+        else
+        {
+            // This pixel covers [ i * dwSrc, ( i + 1 ) * dwSrc ) in units
+            // of 1 / dwDest of a source pixel, and each source pixel it
+            // touches is weighted by how much of that it overlaps
+            ULONGLONG qwStart = (ULONGLONG)i * dwSrc;
+            ULONGLONG qwEnd   = qwStart + dwSrc;
+            DWORD     dwFirst = (DWORD)( qwStart / dwDest );
+            DWORD     dwLast  = (DWORD)( ( qwEnd - 1 ) / dwDest );
+            DWORD     dwTotal = 0;
+            DWORD     dwBig   = 0;
+            WORD*     pwW     = &m_pwWeights[*pdwWeights];
+
+            for( DWORD s = dwFirst; s <= dwLast; s++ )
+            {
+                ULONGLONG qwLo = max( qwStart, (ULONGLONG)s * dwDest );
+                ULONGLONG qwHi = min( qwEnd, (ULONGLONG)( s + 1 ) * dwDest );
+                DWORD     dwW  = (DWORD)( ( qwHi - qwLo ) * RESAMPLE_BOX_ONE / dwSrc );
+
+                pwW[s - dwFirst] = (WORD)dwW;
+                dwTotal += dwW;
+                if( dwW > pwW[dwBig] )
+                    dwBig = s - dwFirst;
+            }
+
+            // Rounding down loses a little; give it to the biggest share
+            pwW[dwBig] = (WORD)( pwW[dwBig] + RESAMPLE_BOX_ONE - dwTotal );
+
+            pTap->dwFirst   = dwFirst;
+            pTap->dwCount   = dwLast - dwFirst + 1;
+            pTap->dwWeights = *pdwWeights;
+            *pdwWeights    += pTap->dwCount;
+        }
+    }
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CResampler::Run()
+// Desc: Scales pSrc into pDest, splitting the rows into one band per
+//       thread if there is a pool
+//-----------------------------------------------------------------------------
+HRESULT CResampler::Run( const RESAMPLE_IMAGE* pDest, const RESAMPLE_IMAGE* pSrc, CThreadPool* pPool )
+{
+    if( !IsCreated() )
+        return E_FAIL;
+
+    if( pDest == NULL || pSrc == NULL || pDest->pBits == NULL || pSrc->pBits == NULL ||
+        pSrc->dwWidth != m_dwSrcWidth || pSrc->dwHeight != m_dwSrcHeight ||
+        pDest->dwWidth != m_dwDestWidth || pDest->dwHeight != m_dwDestHeight )
+        return E_INVALIDARG;
+
+    m_pSrc  = pSrc;
+    m_pDest = pDest;
+
+    m_dwRunBands = 1;
+    if( pPool )
+        m_dwRunBands = min( min( pPool->GetNumThreads(), m_dwNumBands ), m_dwDestHeight );
+
+    if( m_dwRunBands > 1 )
+        pPool->Run( BandSlice, this, m_dwRunBands );
+    else
+        RunBand( 0 );
+
+    m_pSrc  = NULL;
+    m_pDest = NULL;
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CResampler::BandSlice()
+// Desc: Run by the pool with one item per band
+//-----------------------------------------------------------------------------
+VOID CResampler::BandSlice( VOID* pContext, DWORD dwFirst, DWORD dwCount )
+{
+    CResampler* pThis = (CResampler*)pContext;
+
+    for( DWORD b = dwFirst; b < dwFirst + dwCount; b++ )
+        pThis->RunBand( b );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CResampler::RunBand()
+// Desc: Fills one band's share of the destination rows. The source may
+//       have changed since the last Run(), so the band's cached rows are
+//       forgotten first.
+//-----------------------------------------------------------------------------
+VOID CResampler::RunBand( DWORD dwBand )
+{
+    BAND* pBand   = &m_pBands[dwBand];
+    DWORD dwFirst = (DWORD)( (ULONGLONG)m_dwDestHeight * dwBand / m_dwRunBands );
+    DWORD dwLast  = (DWORD)( (ULONGLONG)m_dwDestHeight * ( dwBand + 1 ) / m_dwRunBands );
+
+    pBand->adwRowY[0] = RESAMPLE_NO_ROW;
+    pBand->adwRowY[1] = RESAMPLE_NO_ROW;
+
+    switch( m_filter )
+    {
+        case resampleNearest:  NearestRows( dwFirst, dwLast );         break;
+        case resampleBilinear: BilinearRows( pBand, dwFirst, dwLast ); break;
+        case resampleBox:      BoxRows( pBand, dwFirst, dwLast );      break;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CResampler::NearestRows()
+// Desc: Picks a source pixel for each destination pixel. There is nothing
+//       to compute, so this is bound by memory; a row that comes from the
+//       same source row as the one above is copied from it, and a row the
+//       same width as its source is copied whole.
+//-----------------------------------------------------------------------------
+VOID CResampler::NearestRows( DWORD dwFirst, DWORD dwLast )
+{
+    const TAP* pColumns = m_pColumns;
+    DWORD      dwWidth  = m_dwDestWidth;
+
+    for( DWORD y = dwFirst; y < dwLast; y++ )
+    {
+        DWORD*       pdwDest = RowOf( m_pDest, y );
+        const DWORD* pdwSrc  = RowOf( m_pSrc, m_pRows[y].dwFirst );
+
+        if( y > dwFirst && m_pRows[y].dwFirst == m_pRows[y - 1].dwFirst )
+        {
+            memcpy( pdwDest, RowOf( m_pDest, y - 1 ), dwWidth * sizeof(DWORD) );
+            continue;
+        }
+
+        if( dwWidth == m_dwSrcWidth )
+        {
+            memcpy( pdwDest, pdwSrc, dwWidth * sizeof(DWORD) );
+            continue;
+        }
+
+        DWORD x = 0;
+        for( ; x + 4 <= dwWidth; x += 4 )
+        {
+            pdwDest[x]     = pdwSrc[pColumns[x].dwFirst];
+            pdwDest[x + 1] = pdwSrc[pColumns[x + 1].dwFirst];
+            pdwDest[x + 2] = pdwSrc[pColumns[x + 2].dwFirst];
+            pdwDest[x + 3] = pdwSrc[pColumns[x + 3].dwFirst];
+        }
+        for( ; x < dwWidth; x++ )
+            pdwDest[x] = pdwSrc[pColumns[x].dwFirst];
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CResampler::BilinearRow()
+// Desc: Scales one source row across, two destination pixels at a time.
+//       Each loads the source pixel to its left and the one after in one
+//       64 bit read, so the pair gives both left pixels and both right
+//       pixels after a shuffle.
+//-----------------------------------------------------------------------------
+VOID CResampler::BilinearRow( const DWORD* pdwSrc, DWORD* pdwDest )
+{
+    const TAP*  pColumns = m_pColumns;
+    const WORD* pwW      = m_pwWeights;
+    DWORD       dwWidth  = m_dwDestWidth;
+    __m128i     zero     = _mm_setzero_si128();
+    DWORD       x        = 0;
+
+    for( ; x + 2 <= dwWidth; x += 2, pwW += 8 )
+    {
+        __m128i p0 = _mm_loadl_epi64( (const __m128i*)( pdwSrc + pColumns[x].dwFirst ) );
+        __m128i p1 = _mm_loadl_epi64( (const __m128i*)( pdwSrc + pColumns[x + 1].dwFirst ) );
+
+        // Left pixels in the low half, right pixels in the high half
+        __m128i lr = _mm_shuffle_epi32( _mm_unpacklo_epi64( p0, p1 ), _MM_SHUFFLE( 3, 1, 2, 0 ) );
+        __m128i l  = _mm_unpacklo_epi8( lr, zero );
+        __m128i r  = _mm_unpackhi_epi8( lr, zero );
+        __m128i w  = _mm_loadu_si128( (const __m128i*)pwW );
+
+        __m128i v = Lerp( l, r, w );
+        _mm_storel_epi64( (__m128i*)( pdwDest + x ), _mm_packus_epi16( v, v ) );
+    }
+
+    if( x < dwWidth )
+    {
+        __m128i p = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*)( pdwSrc + pColumns[x].dwFirst ) ), zero );
+        __m128i w = _mm_set1_epi16( (short)pColumns[x].wFrac );
+        __m128i v = Lerp( p, _mm_srli_si128( p, 8 ), w );
+
+        pdwDest[x] = (DWORD)_mm_cvtsi128_si32( _mm_packus_epi16( v, v ) );
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CResampler::BilinearRows()
+// Desc: Each destination row mixes two source rows scaled across. The
+//       band keeps the last two it scaled, so when scaling up every source
+//       row is scaled across once however many rows come from it. A row
+//       that falls exactly on a source row is scaled straight into place.
+//-----------------------------------------------------------------------------
+VOID CResampler::BilinearRows( BAND* pBand, DWORD dwFirst, DWORD dwLast )
+{
+    DWORD   dwWidth = m_dwDestWidth;
+    __m128i zero    = _mm_setzero_si128();
+
+    for( DWORD y = dwFirst; y < dwLast; y++ )
+    {
+        const TAP* pRow    = &m_pRows[y];
+        DWORD*     pdwDest = RowOf( m_pDest, y );
+
+        if( pRow->wFrac == 0 )
+        {
+            BilinearRow( RowOf( m_pSrc, pRow->dwFirst ), pdwDest );
+            continue;
+        }
+
+        // Find the two source rows scaled across, scaling any not kept
+        // into the slot the other isn't using
+        DWORD* apdwRows[2];
+        for( DWORD i = 0; i < 2; i++ )
+        {
+            DWORD dwY    = pRow->dwFirst + i;
+            DWORD dwKeep = pRow->dwFirst + ( i ^ 1 );
+
+            if( pBand->adwRowY[0] == dwY )
+                apdwRows[i] = pBand->pdwRows[0];
+            else if( pBand->adwRowY[1] == dwY )
+                apdwRows[i] = pBand->pdwRows[1];
+            else
+            {
+                DWORD dwSlot = pBand->adwRowY[0] == dwKeep ? 1 : 0;
+
+                BilinearRow( RowOf( m_pSrc, dwY ), pBand->pdwRows[dwSlot] );
+                pBand->adwRowY[dwSlot] = dwY;
+                apdwRows[i] = pBand->pdwRows[dwSlot];
+            }
+        }
+
+        const DWORD* pdwTop    = apdwRows[0];
+        const DWORD* pdwBottom = apdwRows[1];
+        __m128i      w         = _mm_set1_epi16( (short)pRow->wFrac );
+        DWORD        x         = 0;
+
+        for( ; x + 4 <= dwWidth; x += 4 )
+        {
+            __m128i t = _mm_loadu_si128( (const __m128i*)( pdwTop + x ) );
+            __m128i b = _mm_loadu_si128( (const __m128i*)( pdwBottom + x ) );
+
+            __m128i lo = Lerp( _mm_unpacklo_epi8( t, zero ), _mm_unpacklo_epi8( b, zero ), w );
+            __m128i hi = Lerp( _mm_unpackhi_epi8( t, zero ), _mm_unpackhi_epi8( b, zero ), w );
+            _mm_storeu_si128( (__m128i*)( pdwDest + x ), _mm_packus_epi16( lo, hi ) );
+        }
+
+        for( ; x < dwWidth; x++ )
+        {
+            __m128i t = _mm_unpacklo_epi8( _mm_cvtsi32_si128( (int)pdwTop[x] ), zero );
+            __m128i b = _mm_unpacklo_epi8( _mm_cvtsi32_si128( (int)pdwBottom[x] ), zero );
+            __m128i v = Lerp( t, b, w );
+
+            pdwDest[x] = (DWORD)_mm_cvtsi128_si32( _mm_packus_epi16( v, v ) );
+        }
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CResampler::BoxRow()
+// Desc: Scales one source row across, each destination pixel the weighted
+//       sum of the source pixels it covers. A channel widened to 32 bits
+//       is a 16 bit value with a 0 above it, so multiplying by a weight
+//       with a 0 above it and adding pairs gives the weighted channel.
+//-----------------------------------------------------------------------------
+VOID CResampler::BoxRow( const DWORD* pdwSrc, DWORD* pdwDest )
+{
+    const TAP* pColumns = m_pColumns;
+    __m128i    zero     = _mm_setzero_si128();
+    __m128i    round    = _mm_set1_epi32( RESAMPLE_BOX_ONE / 2 );
+
+    for( DWORD x = 0; x < m_dwDestWidth; x++ )
+    {
+        const TAP*   pTap  = &pColumns[x];
+        const DWORD* pdwS  = pdwSrc + pTap->dwFirst;
+        const WORD*  pwW   = m_pwWeights + pTap->dwWeights;
+        __m128i      sum   = round;
+
+        for( DWORD i = 0; i < pTap->dwCount; i++ )
+        {
+            __m128i p = _mm_unpacklo_epi8( _mm_cvtsi32_si128( (int)pdwS[i] ), zero );
+            p   = _mm_unpacklo_epi16( p, zero );
+            sum = _mm_add_epi32( sum, _mm_madd_epi16( p, _mm_set1_epi32( pwW[i] ) ) );
+        }
+
+        sum = _mm_srli_epi32( sum, RESAMPLE_BOX_BITS );
+        sum = _mm_packs_epi32( sum, sum );
+        pdwDest[x] = (DWORD)_mm_cvtsi128_si32( _mm_packus_epi16( sum, sum ) );
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CResampler::BoxRows()
+// Desc: Each destination row is the weighted sum of the source rows it
+//       covers, each scaled across first. The sums are kept at full
+//       precision, four 32 bit channels a pixel, until the row is done.
+//-----------------------------------------------------------------------------
+VOID CResampler::BoxRows( BAND* pBand, DWORD dwFirst, DWORD dwLast )
+{
+    DWORD   dwWidth = m_dwDestWidth;
+    DWORD*  pdwRow  = pBand->pdwRows[0];
+    DWORD*  pdwSums = pBand->pdwSums;
+    __m128i zero    = _mm_setzero_si128();
+
+    for( DWORD y = dwFirst; y < dwLast; y++ )
+    {
+        const TAP*  pRow    = &m_pRows[y];
+        const WORD* pwW     = m_pwWeights + pRow->dwWeights;
+        DWORD*      pdwDest = RowOf( m_pDest, y );
+
+        if( pRow->dwCount == 1 )
+        {
+            BoxRow( RowOf( m_pSrc, pRow->dwFirst ), pdwDest );
+            continue;
+        }
+
+        for( DWORD x = 0; x < dwWidth * 4; x += 4 )
+            _mm_storeu_si128( (__m128i*)( pdwSums + x ), _mm_set1_epi32( RESAMPLE_BOX_ONE / 2 ) );
+
+        for( DWORD i = 0; i < pRow->dwCount; i++ )
+        {
+            BoxRow( RowOf( m_pSrc, pRow->dwFirst + i ), pdwRow );
+
+            __m128i w = _mm_set1_epi32( pwW[i] );
+            DWORD   x = 0;
+
+            for( ; x + 4 <= dwWidth; x += 4 )
+            {
+                __m128i  p   = _mm_loadu_si128( (const __m128i*)( pdwRow + x ) );
+                __m128i  lo  = _mm_unpacklo_epi8( p, zero );
+                __m128i  hi  = _mm_unpackhi_epi8( p, zero );
+                __m128i* pS  = (__m128i*)( pdwSums + x * 4 );
+
+                _mm_storeu_si128( pS,     _mm_add_epi32( _mm_loadu_si128( pS ),     _mm_madd_epi16( _mm_unpacklo_epi16( lo, zero ), w ) ) );
+                _mm_storeu_si128( pS + 1, _mm_add_epi32( _mm_loadu_si128( pS + 1 ), _mm_madd_epi16( _mm_unpackhi_epi16( lo, zero ), w ) ) );
+                _mm_storeu_si128( pS + 2, _mm_add_epi32( _mm_loadu_si128( pS + 2 ), _mm_madd_epi16( _mm_unpacklo_epi16( hi, zero ), w ) ) );
+                _mm_storeu_si128( pS + 3, _mm_add_epi32( _mm_loadu_si128( pS + 3 ), _mm_madd_epi16( _mm_unpackhi_epi16( hi, zero ), w ) ) );
+            }
+
+            for( ; x < dwWidth; x++ )
+            {
+                __m128i  p  = _mm_unpacklo_epi8( _mm_cvtsi32_si128( (int)pdwRow[x] ), zero );
+                __m128i* pS = (__m128i*)( pdwSums + x * 4 );
+
+                _mm_storeu_si128( pS, _mm_add_epi32( _mm_loadu_si128( pS ), _mm_madd_epi16( _mm_unpacklo_epi16( p, zero ), w ) ) );
+            }
+        }
+
+        DWORD x = 0;
+        for( ; x + 4 <= dwWidth; x += 4 )
+        {
+            const __m128i* pS = (const __m128i*)( pdwSums + x * 4 );
+
+            __m128i lo = _mm_packs_epi32( _mm_srli_epi32( _mm_loadu_si128( pS ),     RESAMPLE_BOX_BITS ),
+                                          _mm_srli_epi32( _mm_loadu_si128( pS + 1 ), RESAMPLE_BOX_BITS ) );
+            __m128i hi = _mm_packs_epi32( _mm_srli_epi32( _mm_loadu_si128( pS + 2 ), RESAMPLE_BOX_BITS ),
+                                          _mm_srli_epi32( _mm_loadu_si128( pS + 3 ), RESAMPLE_BOX_BITS ) );
+            _mm_storeu_si128( (__m128i*)( pdwDest + x ), _mm_packus_epi16( lo, hi ) );
+        }
+
+        for( ; x < dwWidth; x++ )
+        {
+            __m128i v = _mm_srli_epi32( _mm_loadu_si128( (const __m128i*)( pdwSums + x * 4 ) ), RESAMPLE_BOX_BITS );
+            v = _mm_packs_epi32( v, v );
+            pdwDest[x] = (DWORD)_mm_cvtsi128_si32( _mm_packus_epi16( v, v ) );
+        }
+    }
+}
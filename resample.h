@@ -0,0 +1,127 @@
+//-----------------------------------------------------------------------------
+// File: resample.h
+//
+// Desc: Scaling 32 bit images, for loading bitmaps at any size and for
+//       showing a frame drawn at one size in a buffer of another, such as
+//       the 640x480 field on a 4K screen. Three filters:
+//
+//         resampleNearest   each pixel is the source pixel under its
+//                           middle; keeps colour keys exact
+//         resampleBilinear  blends the four source pixels around its
+//                           middle; smooth when scaling up
+//         resampleBox       averages every source pixel it covers, by how
+//                           much of each it covers; no aliasing when
+//                           scaling down
+//
+//       Every filter works in two passes, across each source row and then
+//       down the rows, with the per column positions and weights worked
+//       out once in Create(). Bilinear and box use SSE2. Run() can split
+//       the rows into bands across a CThreadPool; each band has scratch
+//       rows of its own, so nothing is allocated or shared after Create().
+//-----------------------------------------------------------------------------
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include "threadpool.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+enum ResampleFilter { resampleNearest, resampleBilinear, resampleBox };
+
+// 32 bits a pixel, in any channel order as all four are treated alike
+struct RESAMPLE_IMAGE
+{
+    BYTE*       pBits;
+    LONG        lPitch;             // Bytes from one row to the next
+    DWORD       dwWidth;
+    DWORD       dwHeight;
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: class CResampler
+// Desc: Scales images of one size to another with one filter. Create() it
+//       again when either size changes.
+//-----------------------------------------------------------------------------
+class CResampler
+{
+    // Where a destination column or row comes from. Nearest uses dwFirst,
+    // bilinear dwFirst and dwFirst + 1 mixed by wFrac out of 128, and box
+    // dwCount pixels from dwFirst, weighted by m_pwWeights[dwWeights] on.
+    struct TAP
+    {
+        DWORD   dwFirst;
+        DWORD   dwCount;
+        DWORD   dwWeights;
+        WORD    wFrac;
+    };
+
+    // One band's scratch. Bilinear keeps two scaled source rows and which
+    // rows they are; box keeps one scaled row and the sums for a
+    // destination row.
+    struct BAND
+    {
+        DWORD*  pdwRows[2];
+        DWORD   adwRowY[2];
+        DWORD*  pdwSums;
+    };
+
+    ResampleFilter  m_filter;
+    DWORD           m_dwSrcWidth;
+    DWORD           m_dwSrcHeight;
+    DWORD           m_dwDestWidth;
+    DWORD           m_dwDestHeight;
+    TAP*            m_pColumns;
+    TAP*            m_pRows;
+    WORD*           m_pwWeights;        // Bilinear fractions or box weights
+    BAND*           m_pBands;
+    DWORD*          m_pdwScratch;       // Every band's rows, in one block
+    DWORD           m_dwNumBands;
+    DWORD           m_dwRunBands;       // Bands the Run() in progress is split into
+
+    // The Run() in progress, read by the bands
+    const RESAMPLE_IMAGE* m_pSrc;
+    const RESAMPLE_IMAGE* m_pDest;
+
+    HRESULT MakeTaps( TAP* pTaps, DWORD dwSrc, DWORD dwDest, DWORD* pdwWeights );
+    VOID    RunBand( DWORD dwBand );
+    VOID    NearestRows( DWORD dwFirst, DWORD dwLast );
+    VOID    BilinearRows( BAND* pBand, DWORD dwFirst, DWORD dwLast );
+    VOID    BoxRows( BAND* pBand, DWORD dwFirst, DWORD dwLast );
+    VOID    BilinearRow( const DWORD* pdwSrc, DWORD* pdwDest );
+    VOID    BoxRow( const DWORD* pdwSrc, DWORD* pdwDest );
+
+    static VOID BandSlice( VOID* pContext, DWORD dwFirst, DWORD dwCount );
+
+    CResampler( const CResampler& );
+    CResampler& operator=( const CResampler& );
+
+public:
+    CResampler();
+    ~CResampler();
+
+    // dwMaxBands is the most bands Run() will be asked to split into,
+    // which for a pool is its GetNumThreads()
+    HRESULT Create( DWORD dwSrcWidth, DWORD dwSrcHeight, DWORD dwDestWidth, DWORD dwDestHeight,
+                    ResampleFilter filter, DWORD dwMaxBands = 1 );
+    VOID    Destroy();
+
+    // The images must be the sizes given to Create(). With a pool the
+    // rows are split across its threads.
+    HRESULT Run( const RESAMPLE_IMAGE* pDest, const RESAMPLE_IMAGE* pSrc, CThreadPool* pPool = NULL );
+
+    BOOL    IsCreated()         { return m_pColumns != NULL; }
+    BOOL    Matches( DWORD dwSrcWidth, DWORD dwSrcHeight, DWORD dwDestWidth, DWORD dwDestHeight,
+                     ResampleFilter filter );
+};
+
+
+
+
+#endif // RESAMPLE_H
@@ -8,6 +8,7 @@
 #define IDB_BAT                         108
 #define IDB_BALL                        109
 #define IDM_EXIT                        1001
+#define IDM_STATS                       1002
 
 // Next default values for new objects
 // 
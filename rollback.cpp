@@ -0,0 +1,329 @@
+//-----------------------------------------------------------------------------
+// File: rollback.cpp
+//
+// Desc: Rollback netcode. The order of a frame is: take in the other
+//       side's inputs, roll back and play forward again if any guess was
+//       wrong, play the new frame, then send our inputs.
+//-----------------------------------------------------------------------------
+#define STRICT
+#include <windows.h>
+#include "rollback.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+#define ROLLBACK_NONE           0xFFFFFFFF
+#define ROLLBACK_HEADER_SIZE    ( sizeof(ROLLBACK_PACKET) - ROLLBACK_RING )
+#define ROLLBACK_SLOT(f)        ( (f) & ( ROLLBACK_RING - 1 ) )
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CRollback::CRollback()
+// Desc:
+//-----------------------------------------------------------------------------
+CRollback::CRollback()
+{
+    m_pState     = NULL;
+    m_pTransport = NULL;
+    m_bActive    = FALSE;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CRollback::Create()
+// Desc: Starts a two player game in pState from ROLLBACK_SEED, which both
+//       sides must do at about the same time. The side that starts first
+//       plays ROLLBACK_MAX_PREDICT frames and then waits for the other.
+//-----------------------------------------------------------------------------
+HRESULT CRollback::Create( SIM_STATE* pState, DWORD dwLocalPlayer, CUdpTransport* pTransport )
+{
+    if( NULL == pState || dwLocalPlayer > 1 )
+        return E_INVALIDARG;
+
+    m_pState          = pState;
+    m_pTransport      = pTransport;
+    m_dwLocal         = dwLocalPlayer;
+    m_dwFrame         = 0;
+    m_dwConfirmed     = 0;
+    m_dwAcked         = 0;
+    m_dwRollbackFrame = ROLLBACK_NONE;
+    m_dwCheckFrame    = 0;
+    m_dwChecksum      = 0;
+    m_dwRollbacks     = 0;
+    m_dwResimulated   = 0;
+    m_dwMaxDepth      = 0;
+    m_dwStalls        = 0;
+    m_dwDesyncs       = 0;
+
+    ZeroMemory( m_anMoves, sizeof(m_anMoves) );
+    Sim_Init( m_pState, ROLLBACK_SEED );
+
+    m_bActive = TRUE;
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CRollback::Destroy()
+// Desc:
+//-----------------------------------------------------------------------------
+VOID CRollback::Destroy()
+{
+    m_pState     = NULL;
+    m_pTransport = NULL;
+    m_bActive    = FALSE;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CRollback::AdvanceFrame()
+// Desc: Plays one frame, unless the game has run ROLLBACK_MAX_PREDICT
+//       frames ahead of the other side's inputs, or so far ahead of its
+//       acknowledgements that our unacknowledged inputs would no longer fit
+//       in a packet. Inputs are sent either way, so a waiting side keeps
+//       the other one going.
+//-----------------------------------------------------------------------------
+HRESULT CRollback::AdvanceFrame( int nLocalMove, DWORD dwNow )
+{
+    if( !m_bActive )
+        return E_FAIL;
+
+    Receive();
+
+    if( m_dwRollbackFrame != ROLLBACK_NONE )
+    {
+        m_dwRollbacks++;
+        Resimulate( m_dwRollbackFrame );
+    }
+
+    CheckDesync();
+
+    HRESULT hr = S_FALSE;
+
+    // The other side can be ahead of us, so m_dwConfirmed can be past
+    // m_dwFrame
+    if( m_dwFrame < m_dwConfirmed + ROLLBACK_MAX_PREDICT &&
+        m_dwFrame - m_dwAcked < ROLLBACK_RING - 1 )
+    {
+        m_anMoves[m_dwLocal][ROLLBACK_SLOT( m_dwFrame )] =
+            (signed char)( nLocalMove < 0 ? -1 : ( nLocalMove > 0 ? 1 : 0 ) );
+
+        PlayFrame( m_dwFrame );
+        m_dwFrame++;
+        hr = S_OK;
+    }
+    else
+    {
+        m_dwStalls++;
+    }
+
+    SendInputs( dwNow );
+
+    return hr;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CRollback::Resimulate()
+// Desc: Restores the state saved at the start of dwFrame and plays every
+//       frame from there to the current one with the inputs now known
+//-----------------------------------------------------------------------------
+HRESULT CRollback::Resimulate( DWORD dwFrame )
+{
+    m_dwRollbackFrame = ROLLBACK_NONE;
+
+    if( dwFrame >= m_dwFrame || m_dwFrame - dwFrame >= ROLLBACK_RING )
+        return E_INVALIDARG;
+
+    DWORD dwDepth = m_dwFrame - dwFrame;
+    if( dwDepth > m_dwMaxDepth )
+        m_dwMaxDepth = dwDepth;
+    m_dwResimulated += dwDepth;
+
+    *m_pState = m_aStates[ROLLBACK_SLOT( dwFrame )];
+
+    for( DWORD f = dwFrame; f < m_dwFrame; f++ )
+        PlayFrame( f );
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CRollback::PlayFrame()
+// Desc: Saves the state and plays dwFrame. The other side's move is the
+//       real one if we have it, otherwise a guess that it is still doing
+//       whatever it was last doing, which is right far more often than not.
+//-----------------------------------------------------------------------------
+VOID CRollback::PlayFrame( DWORD dwFrame )
+{
+    DWORD dwSlot   = ROLLBACK_SLOT( dwFrame );
+    DWORD dwRemote = 1 - m_dwLocal;
+
+    m_aStates[dwSlot] = *m_pState;
+
+    if( dwFrame >= m_dwConfirmed )
+    {
+        m_anMoves[dwRemote][dwSlot] = ( m_dwConfirmed > 0 ) ?
+            m_anMoves[dwRemote][ROLLBACK_SLOT( m_dwConfirmed - 1 )] : 0;
+    }
+
+    Sim_StepVersus( m_pState, m_anMoves[0][dwSlot], m_anMoves[1][dwSlot], ROLLBACK_TIME_DELTA );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CRollback::GetStateAt()
+// Desc: The state at the start of dwFrame, or NULL if it is no longer kept
+//-----------------------------------------------------------------------------
+const SIM_STATE* CRollback::GetStateAt( DWORD dwFrame )
+{
+    if( dwFrame == m_dwFrame )
+        return m_pState;
+
+    if( dwFrame > m_dwFrame || m_dwFrame - dwFrame >= ROLLBACK_RING )
+        return NULL;
+
+    return &m_aStates[ROLLBACK_SLOT( dwFrame )];
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CRollback::CheckDesync()
+// Desc: Compares the other side's checksum with our own state for the same
+//       frame, once we have every input before it too. A difference means
+//       the two games have gone their own ways and rollback can't fix it.
+//-----------------------------------------------------------------------------
+VOID CRollback::CheckDesync()
+{
+    if( m_dwCheckFrame == 0 || m_dwCheckFrame > m_dwConfirmed )
+        return;
+
+    const SIM_STATE* pState = GetStateAt( m_dwCheckFrame );
+    if( pState && Sim_GetChecksum( pState ) != m_dwChecksum )
+        m_dwDesyncs++;
+
+    m_dwCheckFrame = 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CRollback::Receive()
+// Desc: Takes in every packet waiting
+//-----------------------------------------------------------------------------
+VOID CRollback::Receive()
+{
+    if( NULL == m_pTransport )
+        return;
+
+    ROLLBACK_PACKET packet;
+    DWORD           dwSize = sizeof(packet);
+
+    while( S_OK == m_pTransport->Receive( &packet, &dwSize ) )
+    {
+        ReceivePacket( &packet, dwSize );
+        dwSize = sizeof(packet);
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CRollback::ReceivePacket()
+// Desc: Takes the other side's inputs from a packet. Any that were played
+//       on a guess that turns out wrong mark where to roll back to.
+//-----------------------------------------------------------------------------
+VOID CRollback::ReceivePacket( const ROLLBACK_PACKET* pPacket, DWORD dwSize )
+{
+    if( dwSize < ROLLBACK_HEADER_SIZE || pPacket->dwMagic != ROLLBACK_MAGIC ||
+        pPacket->dwNumMoves > ROLLBACK_RING ||
+        dwSize != ROLLBACK_HEADER_SIZE + pPacket->dwNumMoves )
+        return;
+
+    // Packets can arrive out of order, so only ever move forward
+    if( (LONG)( pPacket->dwAckFrame - m_dwAcked ) > 0 && pPacket->dwAckFrame <= m_dwFrame )
+        m_dwAcked = pPacket->dwAckFrame;
+
+    if( pPacket->dwCheckFrame > m_dwCheckFrame )
+    {
+        m_dwCheckFrame = pPacket->dwCheckFrame;
+        m_dwChecksum   = pPacket->dwChecksum;
+    }
+
+    DWORD dwRemote = 1 - m_dwLocal;
+
+    for( DWORD i = 0; i < pPacket->dwNumMoves; i++ )
+    {
+        DWORD dwFrame = pPacket->dwFirstFrame + i;
+
+        if( dwFrame < m_dwConfirmed )
+            continue;
+
+        // Only take inputs in order, and never so far ahead that they would
+        // overwrite ones a rollback might still need
+        if( dwFrame > m_dwConfirmed ||
+            dwFrame >= m_dwFrame + ROLLBACK_RING - ROLLBACK_MAX_PREDICT )
+            break;
+
+        DWORD dwSlot = ROLLBACK_SLOT( dwFrame );
+        if( dwFrame < m_dwFrame && m_anMoves[dwRemote][dwSlot] != pPacket->anMoves[i] &&
+            dwFrame < m_dwRollbackFrame )
+            m_dwRollbackFrame = dwFrame;
+
+        m_anMoves[dwRemote][dwSlot] = pPacket->anMoves[i];
+        m_dwConfirmed++;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CRollback::SendInputs()
+// Desc: Sends every local input the other side hasn't acknowledged, with
+//       our acknowledgement of theirs and a checksum of the newest state
+//       that no longer depends on a guess
+//-----------------------------------------------------------------------------
+VOID CRollback::SendInputs( DWORD dwNow )
+{
+    if( NULL == m_pTransport )
+        return;
+
+    ROLLBACK_PACKET packet;
+
+    packet.dwMagic      = ROLLBACK_MAGIC;
+    packet.dwFirstFrame = m_dwAcked;
+    packet.dwAckFrame   = m_dwConfirmed;
+    packet.dwNumMoves   = m_dwFrame - m_dwAcked;
+    packet.dwCheckFrame = min( m_dwConfirmed, m_dwFrame );
+    packet.dwChecksum   = Sim_GetChecksum( GetStateAt( packet.dwCheckFrame ) );
+
+    for( DWORD i = 0; i < packet.dwNumMoves; i++ )
+        packet.anMoves[i] = m_anMoves[m_dwLocal][ROLLBACK_SLOT( m_dwAcked + i )];
+
+    m_pTransport->Send( &packet, ROLLBACK_HEADER_SIZE + packet.dwNumMoves, dwNow );
+    m_pTransport->Update( dwNow );
+}
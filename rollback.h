@@ -0,0 +1,113 @@
+//-----------------------------------------------------------------------------
+// File: rollback.h
+//
+// Desc: Rollback netcode for two player games. Each side steps the game
+//       straight away with its own input and a guess at the other side's,
+//       the last input it heard from them. When the real input turns up and
+//       the guess was wrong, the game is put back to the frame it was
+//       wrong from and played forward again with the right inputs, all
+//       within one frame, so neither player ever waits for the network.
+//
+//       A state is saved before every frame, which is cheap because a
+//       SIM_STATE is a few dozen bytes of plain data.
+//-----------------------------------------------------------------------------
+#ifndef ROLLBACK_H
+#define ROLLBACK_H
+
+#include "sim.h"
+#include "net.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+#define ROLLBACK_RING           64          // Frames of states and inputs kept, a power of 2
+#define ROLLBACK_MAX_PREDICT    12          // Frames played on guesses before waiting
+#define ROLLBACK_TIME_DELTA     ( 1.0f / 60.0f )
+#define ROLLBACK_SEED           0x504F4E47  // Both sides serve the same balls
+#define ROLLBACK_MAGIC          0x52425031
+
+// Sent every frame by each side, carrying all of its inputs the other side
+// hasn't acknowledged yet, so a lost packet is covered by the next one
+struct ROLLBACK_PACKET
+{
+    DWORD       dwMagic;
+    DWORD       dwFirstFrame;       // Frame of anMoves[0]
+    DWORD       dwAckFrame;         // Sender has the receiver's inputs before this
+    DWORD       dwCheckFrame;       // Frame the checksum is for, both inputs known
+    DWORD       dwChecksum;
+    DWORD       dwNumMoves;
+    signed char anMoves[ROLLBACK_RING];
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: class CRollback
+// Desc: One side of a two player game. Player 0 has the left bat, player 1
+//       the right. The game it steps is the caller's, so it can be drawn as
+//       usual after each AdvanceFrame().
+//-----------------------------------------------------------------------------
+class CRollback
+{
+    SIM_STATE*      m_pState;
+    CUdpTransport*  m_pTransport;
+    DWORD           m_dwLocal;          // 0 or 1
+
+    // State at the start of frame f and both inputs for it are kept in
+    // slot f % ROLLBACK_RING
+    SIM_STATE       m_aStates[ROLLBACK_RING];
+    signed char     m_anMoves[2][ROLLBACK_RING];
+
+    DWORD           m_dwFrame;          // Next frame to play
+    DWORD           m_dwConfirmed;      // Remote inputs before this are real, not guesses
+    DWORD           m_dwAcked;          // Remote has our inputs before this
+    DWORD           m_dwRollbackFrame;  // First frame played on a wrong guess
+    DWORD           m_dwCheckFrame;     // Last checksum heard from the other side
+    DWORD           m_dwChecksum;
+    BOOL            m_bActive;
+
+    DWORD           m_dwRollbacks;
+    DWORD           m_dwResimulated;
+    DWORD           m_dwMaxDepth;
+    DWORD           m_dwStalls;
+    DWORD           m_dwDesyncs;
+
+    VOID    PlayFrame( DWORD dwFrame );
+    const SIM_STATE* GetStateAt( DWORD dwFrame );
+    VOID    CheckDesync();
+    VOID    Receive();
+    VOID    ReceivePacket( const ROLLBACK_PACKET* pPacket, DWORD dwSize );
+    VOID    SendInputs( DWORD dwNow );
+
+public:
+    CRollback();
+
+    // pTransport may be NULL, for timing re-simulation on its own
+    HRESULT Create( SIM_STATE* pState, DWORD dwLocalPlayer, CUdpTransport* pTransport );
+    VOID    Destroy();
+
+    // Plays the next frame with the local player's move. Returns S_FALSE,
+    // without playing, if the other side has fallen too far behind.
+    HRESULT AdvanceFrame( int nLocalMove, DWORD dwNow );
+
+    // Puts the game back to the start of dwFrame and plays forward to the
+    // current frame again
+    HRESULT Resimulate( DWORD dwFrame );
+
+    BOOL    IsActive()          { return m_bActive; }
+    DWORD   GetFrame()          { return m_dwFrame; }
+    DWORD   GetRollbacks()      { return m_dwRollbacks; }
+    DWORD   GetResimulated()    { return m_dwResimulated; }
+    DWORD   GetMaxDepth()       { return m_dwMaxDepth; }
+    DWORD   GetStalls()         { return m_dwStalls; }
+    DWORD   GetDesyncs()        { return m_dwDesyncs; }
+};
+
+
+
+
+#endif // ROLLBACK_H
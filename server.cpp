@@ -0,0 +1,878 @@
+//-----------------------------------------------------------------------------
+// File: server.cpp
+//
+// Desc: The match server. Only the receive thread seats players and fills
+//       the input queues; only the worker stepping a match reads them and
+//       sends its states. The one thing both touch is a match's status.
+//
+//       Spectators go through the main thread instead: the receive thread
+//       queues what they ask for and the main thread applies it at the
+//       start of the next tick, before any worker runs.
+//-----------------------------------------------------------------------------
+#define STRICT
+#include <winsock2.h>
+#include <windows.h>
+#include "dxutil.h"
+#include "server.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+#define SERVER_QUEUE_SLOT(i)    ( (i) & ( SERVER_INPUT_QUEUE - 1 ) )
+#define SERVER_WATCH_SLOT(i)    ( (i) & ( SERVER_WATCH_QUEUE - 1 ) )
+#define SERVER_WAIT_TIMEOUT     100         // ms, how often the receive thread checks for stop
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMatchServer::CMatchServer()
+// Desc:
+//-----------------------------------------------------------------------------
+CMatchServer::CMatchServer()
+{
+    m_pMatches         = NULL;
+    m_dwNumMatches     = 0;
+    m_dwWaiting        = 0;
+    m_dwNextFree       = 0;
+    m_pSpectators      = NULL;
+    m_dwMaxSpectators  = 0;
+    m_dwNumSpectators  = 0;
+    m_dwSpectatorEnd   = 0;
+    m_dwFreeSpectator  = 0;
+    m_dwSweep          = 0;
+    m_pdwHash          = NULL;
+    m_dwHashMask       = 0;
+    m_dwWatchWrite     = 0;
+    m_dwWatchRead      = 0;
+    m_llFanOutTime     = 0;
+    m_hReceiveThread   = NULL;
+    m_lStop            = 0;
+    m_dwTick           = 0;
+    m_dwBroadcastTicks = 1;
+    m_dwSeed           = 0;
+    m_lPlaying         = 0;
+    m_lInputsDropped   = 0;
+    m_lMatchesEnded    = 0;
+    m_lSnapshots       = 0;
+    m_lSnapshotBytes   = 0;
+    m_lSpectateCoded   = 0;
+    m_lSpectateBytes   = 0;
+    m_lSpectateSent    = 0;
+    m_lWatchesDropped  = 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMatchServer::~CMatchServer()
+// Desc:
+//-----------------------------------------------------------------------------
+CMatchServer::~CMatchServer()
+{
+    Destroy();
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMatchServer::Create()
+// Desc: Allocates every match and spectator up front, opens the socket on
+//       wPort and starts the receive thread and the workers
+//-----------------------------------------------------------------------------
+HRESULT CMatchServer::Create( WORD wPort, DWORD dwMaxMatches, DWORD dwMaxSpectators,
+                              DWORD dwNumThreads, DWORD dwBroadcastRate )
+{
+    HRESULT hr;
+
+    Destroy();
+
+    if( dwMaxMatches == 0 || dwBroadcastRate == 0 )
+        return E_INVALIDARG;
+
+    if( dwBroadcastRate > SERVER_TICK_RATE )
+        dwBroadcastRate = SERVER_TICK_RATE;
+
+    if( NULL == ( m_pMatches = new MATCH[dwMaxMatches] ) )
+        return E_OUTOFMEMORY;
+
+    ZeroMemory( m_pMatches, dwMaxMatches * sizeof(MATCH) );
+    m_dwNumMatches     = dwMaxMatches;
+    m_dwWaiting        = dwMaxMatches;
+    m_dwNextFree       = 0;
+    m_dwTick           = 0;
+    m_dwBroadcastTicks = SERVER_TICK_RATE / dwBroadcastRate;
+    m_dwSeed           = GetTickCount();
+    m_lStop            = 0;
+    m_lPlaying         = 0;
+    m_lInputsDropped   = 0;
+    m_lMatchesEnded    = 0;
+    m_lSnapshots       = 0;
+    m_lSnapshotBytes   = 0;
+    m_lSpectateCoded   = 0;
+    m_lSpectateBytes   = 0;
+    m_lSpectateSent    = 0;
+    m_lWatchesDropped  = 0;
+    m_dwWatchWrite     = 0;
+    m_dwWatchRead      = 0;
+
+    if( dwMaxSpectators )
+    {
+        // Chains stay short with twice as many as there can be spectators
+        DWORD dwHashSize = 1;
+        while( dwHashSize < dwMaxSpectators * 2 )
+            dwHashSize <<= 1;
+
+        m_pSpectators = new SPECTATOR[dwMaxSpectators];
+        m_pdwHash     = new DWORD[dwHashSize];
+        if( NULL == m_pSpectators || NULL == m_pdwHash )
+        {
+            Destroy();
+            return E_OUTOFMEMORY;
+        }
+
+        for( DWORD i = 0; i < dwMaxSpectators; i++ )
+        {
+            m_pSpectators[i].dwMatch = dwMaxMatches;
+            m_pSpectators[i].dwNext  = i + 1;
+        }
+
+        for( DWORD i = 0; i < dwHashSize; i++ )
+            m_pdwHash[i] = dwMaxSpectators;
+
+        m_dwHashMask = dwHashSize - 1;
+    }
+
+    m_dwMaxSpectators = dwMaxSpectators;
+    m_dwNumSpectators = 0;
+    m_dwSpectatorEnd  = 0;
+    m_dwFreeSpectator = 0;
+    m_dwSweep         = 0;
+
+    if( FAILED( hr = m_Net.Create( wPort ) ) )
+    {
+        Destroy();
+        return hr;
+    }
+
+    // Not fatal, the default buffers just lose packets sooner
+    m_Net.SetBufferSize( SERVER_SOCKET_BUFFER );
+
+    if( FAILED( hr = m_Pool.Create( dwNumThreads ) ) )
+    {
+        Destroy();
+        return hr;
+    }
+
+    if( NULL == ( m_hReceiveThread = CreateThread( NULL, 0, ReceiveThread, this, 0, NULL ) ) )
+    {
+        Destroy();
+        return E_FAIL;
+    }
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMatchServer::Destroy()
+// Desc: Stops the threads, closes the socket and frees the matches and
+//       spectators
+//-----------------------------------------------------------------------------
+VOID CMatchServer::Destroy()
+{
+    InterlockedExchange( &m_lStop, 1 );
+
+    if( m_hReceiveThread )
+    {
+        WaitForSingleObject( m_hReceiveThread, INFINITE );
+        CloseHandle( m_hReceiveThread );
+        m_hReceiveThread = NULL;
+    }
+
+    m_Pool.Destroy();
+    m_Net.Destroy();
+
+    SAFE_DELETE_ARRAY( m_pMatches );
+    SAFE_DELETE_ARRAY( m_pSpectators );
+    SAFE_DELETE_ARRAY( m_pdwHash );
+    m_dwNumMatches    = 0;
+    m_dwMaxSpectators = 0;
+    m_dwNumSpectators = 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMatchServer::Tick()
+// Desc: Steps every match in one batch across the pool, then sends the
+//       spectators their states in a second. Free matches and spectator
+//       slots cost a single read each, so there are no lists of live ones
+//       to keep.
+//-----------------------------------------------------------------------------
+VOID CMatchServer::Tick()
+{
+    if( NULL == m_pMatches )
+        return;
+
+    UpdateSpectators();
+
+    m_Pool.Run( StepSlice, this, m_dwNumMatches );
+
+    LARGE_INTEGER liStart, liEnd;
+    QueryPerformanceCounter( &liStart );
+
+    if( m_dwNumSpectators )
+        m_Pool.Run( FanOutSlice, this, m_dwSpectatorEnd );
+
+    QueryPerformanceCounter( &liEnd );
+    m_llFanOutTime = liEnd.QuadPart - liStart.QuadPart;
+
+    m_dwTick++;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMatchServer::StepSlice()
+// Desc: Steps matches dwFirst to dwFirst + dwCount - 1
+//-----------------------------------------------------------------------------
+VOID CMatchServer::StepSlice( VOID* pContext, DWORD dwFirst, DWORD dwCount )
+{
+    CMatchServer* pServer = (CMatchServer*)pContext;
+
+    for( DWORD i = dwFirst; i < dwFirst + dwCount; i++ )
+        pServer->StepMatch( i );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMatchServer::StepMatch()
+// Desc: Takes each player's next move from their queue, or keeps their last
+//       one if none has come, steps the game and sends the state if it is
+//       this match's turn. Matches take their turns on different ticks, so
+//       the sends are spread evenly rather than all going out at once.
+//-----------------------------------------------------------------------------
+VOID CMatchServer::StepMatch( DWORD dwMatch )
+{
+    MATCH* pMatch  = &m_pMatches[dwMatch];
+    LONG   lStatus = pMatch->lStatus;
+
+    if( lStatus == statusFree )
+        return;
+
+    if( lStatus == statusWaiting )
+    {
+        if( TimedOut( &pMatch->aSeats[0] ) )
+            InterlockedCompareExchange( &pMatch->lStatus, statusFree, statusWaiting );
+        return;
+    }
+
+    if( TimedOut( &pMatch->aSeats[0] ) || TimedOut( &pMatch->aSeats[1] ) )
+    {
+        // Before the match is free and the receive thread can reuse it
+        ReleaseSpectate( pMatch );
+
+        if( statusPlaying == InterlockedCompareExchange( &pMatch->lStatus, statusFree, statusPlaying ) )
+        {
+            InterlockedDecrement( &m_lPlaying );
+            InterlockedIncrement( &m_lMatchesEnded );
+        }
+        return;
+    }
+
+    for( DWORD p = 0; p < 2; p++ )
+    {
+        SEAT*        pSeat    = &pMatch->aSeats[p];
+        INPUT_QUEUE* pQueue   = &pSeat->queue;
+        DWORD        dwRead   = pQueue->dwRead;
+        DWORD        dwQueued = pQueue->dwWrite - dwRead;
+
+        if( dwQueued == 0 )
+            continue;
+
+        // A client whose clock runs a little fast slowly fills its queue,
+        // and every move queued is a tick of lag, so skip to the newest
+        if( dwQueued > SERVER_INPUT_QUEUE / 2 )
+            dwRead += dwQueued - 1;
+
+        _ReadWriteBarrier();
+        pSeat->nMove = pQueue->anMoves[SERVER_QUEUE_SLOT( dwRead )];
+        _ReadWriteBarrier();
+        pQueue->dwRead = dwRead + 1;
+    }
+
+    Sim_StepVersus( &pMatch->state, pMatch->aSeats[0].nMove, pMatch->aSeats[1].nMove, SERVER_TIME_DELTA );
+    pMatch->dwFrame++;
+
+    if( ( m_dwTick + dwMatch ) % m_dwBroadcastTicks == 0 )
+    {
+        // Kept so later snapshots can be coded against it
+        SNAPSHOT* pSnap = &pMatch->aSnapshots[SNAPSHOT_SLOT( pMatch->dwFrame )];
+        Snapshot_FromState( pSnap, &pMatch->state, pMatch->dwFrame );
+
+        SendState( pMatch, pSnap, 0 );
+        SendState( pMatch, pSnap, 1 );
+
+        if( pMatch->dwSpectators )
+            CodeSpectate( dwMatch, pSnap );
+        else
+            ReleaseSpectate( pMatch );
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMatchServer::CodeSpectate()
+// Desc: Codes a state once for every spectator of a match, into a packet
+//       of its own that nobody else holds. Each is a delta from the
+//       match's keyframe, which is replaced every SERVER_KEYFRAME_TICKS.
+//-----------------------------------------------------------------------------
+VOID CMatchServer::CodeSpectate( DWORD dwMatch, const SNAPSHOT* pSnap )
+{
+    MATCH*         pMatch  = &m_pMatches[dwMatch];
+    SHARED_PACKET* pShared = NULL;
+
+    // The keyframe and the newest state hold at most two
+    for( DWORD i = 0; i < SERVER_SHARED_PACKETS; i++ )
+    {
+        if( pMatch->aShared[i].lRefs == 0 )
+        {
+            pShared = &pMatch->aShared[i];
+            break;
+        }
+    }
+
+    BOOL bKeyframe = NULL == pMatch->pKeyframe ||
+                     pSnap->dwFrame - pMatch->keySnapshot.dwFrame >= SERVER_KEYFRAME_TICKS;
+
+    pShared->packet.header.dwMagic = MATCH_MAGIC;
+    pShared->packet.header.dwType  = matchSpectate;
+    pShared->packet.dwMatch        = dwMatch;
+
+    DWORD dwBytes = Snapshot_Encode( pSnap, bKeyframe ? NULL : &pMatch->keySnapshot,
+                                     pShared->packet.abSnapshot );
+
+    pShared->dwSize = MATCH_SPECTATE_HEADER_SIZE + dwBytes;
+    pShared->lRefs  = 1;
+
+    if( bKeyframe )
+    {
+        if( pMatch->pKeyframe )
+            pMatch->pKeyframe->Release();
+
+        pShared->AddRef();
+        pMatch->pKeyframe   = pShared;
+        pMatch->keySnapshot = *pSnap;
+    }
+
+    if( pMatch->pLatest )
+        pMatch->pLatest->Release();
+
+    pMatch->pLatest      = pShared;
+    pMatch->dwLatestTick = m_dwTick;
+
+    InterlockedIncrement( &m_lSpectateCoded );
+    InterlockedExchangeAdd( &m_lSpectateBytes, (LONG)dwBytes );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMatchServer::ReleaseSpectate()
+// Desc: Lets go of a match's keyframe and newest state
+//-----------------------------------------------------------------------------
+VOID CMatchServer::ReleaseSpectate( MATCH* pMatch )
+{
+    if( pMatch->pKeyframe )
+    {
+        pMatch->pKeyframe->Release();
+        pMatch->pKeyframe = NULL;
+    }
+
+    if( pMatch->pLatest )
+    {
+        pMatch->pLatest->Release();
+        pMatch->pLatest = NULL;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMatchServer::FanOutSlice()
+// Desc: Sends spectators dwFirst to dwFirst + dwCount - 1 the state their
+//       match coded this tick, if it coded one. Every spectator of a match
+//       is sent the very same bytes.
+//-----------------------------------------------------------------------------
+VOID CMatchServer::FanOutSlice( VOID* pContext, DWORD dwFirst, DWORD dwCount )
+{
+    CMatchServer* pServer = (CMatchServer*)pContext;
+    LONG          lSent   = 0;
+
+    for( DWORD i = dwFirst; i < dwFirst + dwCount; i++ )
+    {
+        SPECTATOR* pSpectator = &pServer->m_pSpectators[i];
+        if( pSpectator->dwMatch >= pServer->m_dwNumMatches )
+            continue;
+
+        MATCH*         pMatch  = &pServer->m_pMatches[pSpectator->dwMatch];
+        SHARED_PACKET* pLatest = pMatch->pLatest;
+
+        if( NULL == pLatest || pMatch->dwLatestTick != pServer->m_dwTick )
+            continue;
+
+        // Deltas are no use without the keyframe they are coded against
+        if( pSpectator->bNeedKeyframe )
+        {
+            if( pMatch->pKeyframe != pLatest )
+            {
+                pServer->m_Net.SendTo( &pSpectator->addr, &pMatch->pKeyframe->packet,
+                                       pMatch->pKeyframe->dwSize );
+                lSent++;
+            }
+            pSpectator->bNeedKeyframe = FALSE;
+        }
+
+        pServer->m_Net.SendTo( &pSpectator->addr, &pLatest->packet, pLatest->dwSize );
+        lSent++;
+    }
+
+    InterlockedExchangeAdd( &pServer->m_lSpectateSent, lSent );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMatchServer::SendState()
+// Desc: Sends a snapshot to one player, coded against the newest one they
+//       have acknowledged if it is still in the match's ring
+//-----------------------------------------------------------------------------
+VOID CMatchServer::SendState( MATCH* pMatch, const SNAPSHOT* pSnap, DWORD dwPlayer )
+{
+    SEAT*           pSeat      = &pMatch->aSeats[dwPlayer];
+    DWORD           dwAckFrame = pSeat->dwAckFrame;
+    const SNAPSHOT* pBase      = NULL;
+    MATCH_STATE     state;
+
+    if( dwAckFrame != SNAPSHOT_NO_FRAME && dwAckFrame != pSnap->dwFrame &&
+        pMatch->aSnapshots[SNAPSHOT_SLOT( dwAckFrame )].dwFrame == dwAckFrame )
+        pBase = &pMatch->aSnapshots[SNAPSHOT_SLOT( dwAckFrame )];
+
+    state.header.dwMagic = MATCH_MAGIC;
+    state.header.dwType  = matchState;
+    state.dwNonce        = pSeat->dwNonce;
+    state.dwStamp        = pSeat->dwStamp;
+
+    DWORD dwBytes = Snapshot_Encode( pSnap, pBase, state.abSnapshot );
+
+    m_Net.SendTo( &pSeat->addr, &state, MATCH_STATE_HEADER_SIZE + dwBytes );
+
+    InterlockedIncrement( &m_lSnapshots );
+    InterlockedExchangeAdd( &m_lSnapshotBytes, (LONG)dwBytes );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMatchServer::TimedOut()
+// Desc: Whether a seat has gone SERVER_TIMEOUT_TICKS without a packet
+//-----------------------------------------------------------------------------
+BOOL CMatchServer::TimedOut( const SEAT* pSeat )
+{
+    return m_dwTick - pSeat->dwLastHeard > SERVER_TIMEOUT_TICKS;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMatchServer::ReceiveThread()
+// Desc: Waits for packets and hands each one on until told to stop
+//-----------------------------------------------------------------------------
+DWORD WINAPI CMatchServer::ReceiveThread( LPVOID pParam )
+{
+    CMatchServer* pServer = (CMatchServer*)pParam;
+    BYTE          abPacket[NET_MAX_PACKET];
+
+    while( !pServer->m_lStop )
+    {
+        if( S_OK != pServer->m_Net.Wait( SERVER_WAIT_TIMEOUT ) )
+            continue;
+
+        NET_ADDRESS from;
+        DWORD       dwSize = sizeof(abPacket);
+
+        while( S_OK == pServer->m_Net.ReceiveFrom( abPacket, &dwSize, &from ) )
+        {
+            pServer->ReceivePacket( abPacket, dwSize, &from );
+            dwSize = sizeof(abPacket);
+        }
+    }
+
+    return 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMatchServer::ReceivePacket()
+// Desc: Checks a packet is one of ours and the right size for its type
+//-----------------------------------------------------------------------------
+VOID CMatchServer::ReceivePacket( const BYTE* pData, DWORD dwSize, const NET_ADDRESS* pFrom )
+{
+    const MATCH_HEADER* pHeader = (const MATCH_HEADER*)pData;
+
+    if( dwSize < sizeof(MATCH_HEADER) || pHeader->dwMagic != MATCH_MAGIC )
+        return;
+
+    switch( pHeader->dwType )
+    {
+        case matchJoin:
+            if( dwSize == sizeof(MATCH_JOIN) )
+                Join( (const MATCH_JOIN*)pData, pFrom );
+            break;
+
+        case matchInput:
+            if( dwSize == sizeof(MATCH_INPUT) )
+                TakeInput( (const MATCH_INPUT*)pData, pFrom );
+            break;
+
+        case matchWatch:
+            if( dwSize == sizeof(MATCH_WATCH) )
+                QueueWatch( (const MATCH_WATCH*)pData, pFrom );
+            break;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMatchServer::Join()
+// Desc: Seats a player. The second seat of the waiting match is taken if
+//       there is one, otherwise the next free match is opened and the
+//       player waits in it for an opponent. With every match full the
+//       join is ignored and the client will ask again.
+//-----------------------------------------------------------------------------
+VOID CMatchServer::Join( const MATCH_JOIN* pJoin, const NET_ADDRESS* pFrom )
+{
+    if( m_dwWaiting < m_dwNumMatches )
+    {
+        MATCH* pMatch = &m_pMatches[m_dwWaiting];
+        SEAT*  pFirst = &pMatch->aSeats[0];
+
+        // The same player asking again, its welcome having been lost
+        if( pMatch->lStatus == statusWaiting && NET_SAME_ADDRESS( &pFirst->addr, pFrom ) &&
+            pFirst->dwNonce == pJoin->dwNonce )
+        {
+            pFirst->dwLastHeard = m_dwTick;
+            SendWelcome( m_dwWaiting, 0 );
+            return;
+        }
+
+        // No worker reads the second seat of a waiting match, so it can be
+        // filled in before the match starts. If the first player timed out
+        // meanwhile the match is free again and this one waits instead.
+        ResetSeat( &pMatch->aSeats[1], pFrom, pJoin->dwNonce );
+
+        DWORD dwMatch = m_dwWaiting;
+        m_dwWaiting = m_dwNumMatches;
+
+        if( statusWaiting == InterlockedCompareExchange( &pMatch->lStatus, statusPlaying, statusWaiting ) )
+        {
+            InterlockedIncrement( &m_lPlaying );
+            SendWelcome( dwMatch, 0 );
+            SendWelcome( dwMatch, 1 );
+            return;
+        }
+    }
+
+    for( DWORD i = 0; i < m_dwNumMatches; i++ )
+    {
+        DWORD  dwMatch = ( m_dwNextFree + i ) % m_dwNumMatches;
+        MATCH* pMatch  = &m_pMatches[dwMatch];
+
+        if( pMatch->lStatus != statusFree )
+            continue;
+
+        Sim_Init( &pMatch->state, m_dwSeed + dwMatch * 0x9E3779B9 + m_dwTick );
+        Snapshot_ClearRing( pMatch->aSnapshots );
+        pMatch->dwFrame = 0;
+        ResetSeat( &pMatch->aSeats[0], pFrom, pJoin->dwNonce );
+
+        InterlockedExchange( &pMatch->lStatus, statusWaiting );
+        m_dwWaiting  = dwMatch;
+        m_dwNextFree = dwMatch + 1;
+
+        SendWelcome( dwMatch, 0 );
+        return;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMatchServer::ResetSeat()
+// Desc: Gives a seat to a new player
+//-----------------------------------------------------------------------------
+VOID CMatchServer::ResetSeat( SEAT* pSeat, const NET_ADDRESS* pAddr, DWORD dwNonce )
+{
+    pSeat->addr          = *pAddr;
+    pSeat->dwNonce       = dwNonce;
+    pSeat->dwLastHeard   = m_dwTick;
+    pSeat->dwStamp       = 0;
+    pSeat->dwAckFrame    = SNAPSHOT_NO_FRAME;
+    pSeat->nMove         = 0;
+    pSeat->queue.dwWrite = 0;
+    pSeat->queue.dwRead  = 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMatchServer::SendWelcome()
+// Desc: Tells a player which match and seat is theirs. The first player is
+//       welcomed again when the second arrives, as a sign the game is on.
+//-----------------------------------------------------------------------------
+VOID CMatchServer::SendWelcome( DWORD dwMatch, DWORD dwPlayer )
+{
+    SEAT*         pSeat = &m_pMatches[dwMatch].aSeats[dwPlayer];
+    MATCH_WELCOME welcome;
+
+    welcome.header.dwMagic = MATCH_MAGIC;
+    welcome.header.dwType  = matchWelcome;
+    welcome.dwNonce        = pSeat->dwNonce;
+    welcome.dwMatch        = dwMatch;
+    welcome.dwPlayer       = dwPlayer;
+
+    m_Net.SendTo( &pSeat->addr, &welcome, sizeof(welcome) );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMatchServer::TakeInput()
+// Desc: Queues a move for the worker stepping its match. Moves from anyone
+//       but the seat's owner, or for a match not being played, are ignored,
+//       as are moves that find the queue full.
+//-----------------------------------------------------------------------------
+VOID CMatchServer::TakeInput( const MATCH_INPUT* pInput, const NET_ADDRESS* pFrom )
+{
+    if( pInput->dwMatch >= m_dwNumMatches || pInput->dwPlayer > 1 )
+        return;
+
+    MATCH* pMatch = &m_pMatches[pInput->dwMatch];
+    SEAT*  pSeat  = &pMatch->aSeats[pInput->dwPlayer];
+
+    if( pMatch->lStatus != statusPlaying || !NET_SAME_ADDRESS( &pSeat->addr, pFrom ) )
+        return;
+
+    pSeat->dwLastHeard = m_dwTick;
+    pSeat->dwStamp     = pInput->dwStamp;
+
+    // Inputs can arrive out of order, so only move the acknowledgement on
+    if( pSeat->dwAckFrame == SNAPSHOT_NO_FRAME ||
+        ( pInput->dwAckFrame != SNAPSHOT_NO_FRAME && (LONG)( pInput->dwAckFrame - pSeat->dwAckFrame ) > 0 ) )
+        pSeat->dwAckFrame = pInput->dwAckFrame;
+
+    INPUT_QUEUE* pQueue  = &pSeat->queue;
+    DWORD        dwWrite = pQueue->dwWrite;
+
+    if( dwWrite - pQueue->dwRead >= SERVER_INPUT_QUEUE )
+    {
+        InterlockedIncrement( &m_lInputsDropped );
+        return;
+    }
+
+    pQueue->anMoves[SERVER_QUEUE_SLOT( dwWrite )] =
+        (signed char)( pInput->nMove < 0 ? -1 : ( pInput->nMove > 0 ? 1 : 0 ) );
+    _ReadWriteBarrier();
+    pQueue->dwWrite = dwWrite + 1;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMatchServer::QueueWatch()
+// Desc: Queues a MATCH_WATCH for the main thread. With the queue full it is
+//       dropped, and the spectator will ask again within a second.
+//-----------------------------------------------------------------------------
+VOID CMatchServer::QueueWatch( const MATCH_WATCH* pWatch, const NET_ADDRESS* pFrom )
+{
+    DWORD dwWrite = m_dwWatchWrite;
+
+    if( NULL == m_pSpectators || dwWrite - m_dwWatchRead >= SERVER_WATCH_QUEUE )
+    {
+        InterlockedIncrement( &m_lWatchesDropped );
+        return;
+    }
+
+    m_aWatches[SERVER_WATCH_SLOT( dwWrite )].addr    = *pFrom;
+    m_aWatches[SERVER_WATCH_SLOT( dwWrite )].dwMatch = pWatch->dwMatch;
+    _ReadWriteBarrier();
+    m_dwWatchWrite = dwWrite + 1;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMatchServer::UpdateSpectators()
+// Desc: Applies the queued MATCH_WATCHes and times out a slice of the
+//       spectators, enough that all of them are checked once a second
+//-----------------------------------------------------------------------------
+VOID CMatchServer::UpdateSpectators()
+{
+    DWORD dwWrite = m_dwWatchWrite;
+    DWORD dwRead  = m_dwWatchRead;
+
+    _ReadWriteBarrier();
+
+    while( dwRead != dwWrite )
+    {
+        WATCH_REQUEST request = m_aWatches[SERVER_WATCH_SLOT( dwRead )];
+        _ReadWriteBarrier();
+        m_dwWatchRead = ++dwRead;
+
+        Watch( &request );
+    }
+
+    if( m_dwSpectatorEnd == 0 )
+        return;
+
+    for( DWORD n = m_dwSpectatorEnd / SERVER_TICK_RATE + 1; n > 0; n-- )
+    {
+        if( m_dwSweep >= m_dwSpectatorEnd )
+            m_dwSweep = 0;
+
+        SPECTATOR* pSpectator = &m_pSpectators[m_dwSweep];
+        if( pSpectator->dwMatch < m_dwNumMatches &&
+            m_dwTick - pSpectator->dwLastHeard > SERVER_TIMEOUT_TICKS )
+            RemoveSpectator( m_dwSweep );
+
+        m_dwSweep++;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMatchServer::Watch()
+// Desc: Adds a spectator, or keeps one watching, moves it to another match
+//       or takes it away. Only called by the main thread between batches.
+//-----------------------------------------------------------------------------
+VOID CMatchServer::Watch( const WATCH_REQUEST* pRequest )
+{
+    DWORD dwHash      = HashAddress( &pRequest->addr );
+    DWORD dwSpectator = m_pdwHash[dwHash];
+
+    while( dwSpectator != m_dwMaxSpectators &&
+           !NET_SAME_ADDRESS( &m_pSpectators[dwSpectator].addr, &pRequest->addr ) )
+        dwSpectator = m_pSpectators[dwSpectator].dwNext;
+
+    if( pRequest->dwMatch >= m_dwNumMatches )
+    {
+        if( dwSpectator != m_dwMaxSpectators )
+            RemoveSpectator( dwSpectator );
+        return;
+    }
+
+    if( dwSpectator != m_dwMaxSpectators )
+    {
+        SPECTATOR* pSpectator = &m_pSpectators[dwSpectator];
+        pSpectator->dwLastHeard = m_dwTick;
+
+        if( pSpectator->dwMatch != pRequest->dwMatch )
+        {
+            m_pMatches[pSpectator->dwMatch].dwSpectators--;
+            m_pMatches[pRequest->dwMatch].dwSpectators++;
+            pSpectator->dwMatch       = pRequest->dwMatch;
+            pSpectator->bNeedKeyframe = TRUE;
+        }
+        return;
+    }
+
+    // Every slot taken, so this one isn't watching
+    if( m_dwFreeSpectator == m_dwMaxSpectators )
+    {
+        InterlockedIncrement( &m_lWatchesDropped );
+        return;
+    }
+
+    dwSpectator       = m_dwFreeSpectator;
+    m_dwFreeSpectator = m_pSpectators[dwSpectator].dwNext;
+
+    SPECTATOR* pSpectator = &m_pSpectators[dwSpectator];
+    pSpectator->addr          = pRequest->addr;
+    pSpectator->dwMatch       = pRequest->dwMatch;
+    pSpectator->dwLastHeard   = m_dwTick;
+    pSpectator->bNeedKeyframe = TRUE;
+    pSpectator->dwNext        = m_pdwHash[dwHash];
+    m_pdwHash[dwHash]         = dwSpectator;
+
+    m_pMatches[pRequest->dwMatch].dwSpectators++;
+    m_dwNumSpectators++;
+    m_dwSpectatorEnd = max( m_dwSpectatorEnd, dwSpectator + 1 );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMatchServer::RemoveSpectator()
+// Desc: Takes a spectator out of its hash chain and puts its slot first
+//       in the free list, so the slots in use stay packed together
+//-----------------------------------------------------------------------------
+VOID CMatchServer::RemoveSpectator( DWORD dwSpectator )
+{
+    SPECTATOR* pSpectator = &m_pSpectators[dwSpectator];
+    DWORD*     pdwLink    = &m_pdwHash[HashAddress( &pSpectator->addr )];
+
+    while( *pdwLink != dwSpectator )
+        pdwLink = &m_pSpectators[*pdwLink].dwNext;
+
+    *pdwLink = pSpectator->dwNext;
+
+    m_pMatches[pSpectator->dwMatch].dwSpectators--;
+    pSpectator->dwMatch = m_dwNumMatches;
+    pSpectator->dwNext  = m_dwFreeSpectator;
+    m_dwFreeSpectator   = dwSpectator;
+    m_dwNumSpectators--;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CMatchServer::HashAddress()
+// Desc: Which hash chain a spectator's address is in
+//-----------------------------------------------------------------------------
+DWORD CMatchServer::HashAddress( const NET_ADDRESS* pAddr )
+{
+    DWORD dwHash = ( pAddr->dwAddr ^ ( (DWORD)pAddr->wPort << 16 ) ^ pAddr->wPort ) * 0x9E3779B1;
+    return ( dwHash ^ ( dwHash >> 15 ) ) & m_dwHashMask;
+}
@@ -0,0 +1,315 @@
+//-----------------------------------------------------------------------------
+// File: server.h
+//
+// Desc: A headless match server. One process hosts thousands of two player
+//       matches, each an authoritative SIM_STATE that only the server
+//       steps. Clients send their bat moves and the server sends back where
+//       everything is, so no client can cheat and none needs to run the
+//       game itself.
+//
+//       Every match is stepped once a tick, in one batch split across a
+//       thread pool. Packets are read by a thread of their own, which
+//       drops each move into a queue belonging to the player and match it
+//       is for, so the workers never wait on the network and never share
+//       anything with each other.
+//
+//       A match is played over this protocol, all packets starting with a
+//       MATCH_HEADER:
+//
+//         client -> server  MATCH_JOIN, until a MATCH_WELCOME comes back
+//         server -> client  MATCH_WELCOME, with the match and seat
+//         client -> server  MATCH_INPUT, once a frame
+//         server -> client  MATCH_STATE, SERVER_BROADCAST_RATE times a second
+//
+//       States carry a snapshot coded against the newest one the player
+//       has acknowledged in its inputs, so most are a few bytes.
+//
+//       A player who goes quiet for SERVER_TIMEOUT_TICKS loses their seat
+//       and the match ends for both.
+//
+//       Anyone else can watch a match:
+//
+//         client -> server  MATCH_WATCH, once a second for as long as it watches
+//         server -> client  MATCH_SPECTATE, SERVER_BROADCAST_RATE times a second
+//
+//       Spectators don't acknowledge anything, so every one of them can be
+//       sent the same bytes. A match with spectators codes each state once,
+//       against a keyframe it codes in full every SERVER_KEYFRAME_TICKS,
+//       into a shared packet; after the matches are stepped a second batch
+//       across the pool sends each spectator the packet of the match it
+//       watches, without copying or coding anything per spectator. A new
+//       spectator is sent the keyframe first. Losing a packet loses only
+//       that state, and losing a keyframe the states up to the next one.
+//-----------------------------------------------------------------------------
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "sim.h"
+#include "snapshot.h"
+#include "net.h"
+#include "threadpool.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+#define SERVER_PORT             27961
+#define SERVER_TICK_RATE        60          // Ticks a second
+#define SERVER_TIME_DELTA       ( 1.0f / SERVER_TICK_RATE )
+#define SERVER_BROADCAST_RATE   20          // States a second, by default
+#define SERVER_TIMEOUT_TICKS    ( 5 * SERVER_TICK_RATE )
+#define SERVER_INPUT_QUEUE      16          // Moves queued per player, a power of 2
+#define SERVER_SOCKET_BUFFER    ( 4 * 1024 * 1024 )
+#define SERVER_KEYFRAME_TICKS   SERVER_TICK_RATE    // Between full snapshots for spectators
+#define SERVER_WATCH_QUEUE      4096        // MATCH_WATCHes queued for the next tick, a power of 2
+#define SERVER_SHARED_PACKETS   3           // A match's keyframe, newest state and the next one
+#define MATCH_MAGIC             0x4D504731
+
+enum MatchPacketType { matchJoin, matchWelcome, matchInput, matchState, matchWatch, matchSpectate };
+
+struct MATCH_HEADER
+{
+    DWORD       dwMagic;
+    DWORD       dwType;             // MatchPacketType
+};
+
+// dwNonce is the client's own number for the seat it wants, echoed back
+// so one socket can hold seats for many players
+struct MATCH_JOIN
+{
+    MATCH_HEADER header;
+    DWORD       dwNonce;
+};
+
+struct MATCH_WELCOME
+{
+    MATCH_HEADER header;
+    DWORD       dwNonce;
+    DWORD       dwMatch;
+    DWORD       dwPlayer;           // 0 left bat, 1 right bat
+};
+
+// dwStamp is any time the client likes, sent back in the next MATCH_STATE
+// so it can measure the round trip
+struct MATCH_INPUT
+{
+    MATCH_HEADER header;
+    DWORD       dwMatch;
+    DWORD       dwPlayer;
+    DWORD       dwStamp;
+    DWORD       dwAckFrame;         // Newest snapshot decoded, or SNAPSHOT_NO_FRAME
+    LONG        nMove;              // -1 up, 0 stay, 1 down
+};
+
+// Only as much of abSnapshot as the snapshot needs is sent
+struct MATCH_STATE
+{
+    MATCH_HEADER header;
+    DWORD       dwNonce;
+    DWORD       dwStamp;            // Newest MATCH_INPUT dwStamp from this player
+    BYTE        abSnapshot[SNAPSHOT_MAX_BYTES];
+};
+
+#define MATCH_STATE_HEADER_SIZE ( sizeof(MATCH_STATE) - SNAPSHOT_MAX_BYTES )
+
+// A dwMatch past the server's last match stops watching
+struct MATCH_WATCH
+{
+    MATCH_HEADER header;
+    DWORD       dwMatch;
+};
+
+// The same packet goes to every spectator of the match, so it carries
+// nothing about any one of them. Only as much of abSnapshot as the
+// snapshot needs is sent.
+struct MATCH_SPECTATE
+{
+    MATCH_HEADER header;
+    DWORD       dwMatch;
+    BYTE        abSnapshot[SNAPSHOT_MAX_BYTES];
+};
+
+#define MATCH_SPECTATE_HEADER_SIZE ( sizeof(MATCH_SPECTATE) - SNAPSHOT_MAX_BYTES )
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: class CMatchServer
+// Desc: The matches, the socket and the threads. Everything is allocated by
+//       Create(); after that a tick allocates nothing.
+//-----------------------------------------------------------------------------
+class CMatchServer
+{
+    enum MatchStatus { statusFree, statusWaiting, statusPlaying };
+
+    // Moves from one player, written by the receive thread and read by
+    // the worker stepping the match
+    struct INPUT_QUEUE
+    {
+        volatile DWORD  dwWrite;
+        volatile DWORD  dwRead;
+        signed char     anMoves[SERVER_INPUT_QUEUE];
+    };
+
+    struct SEAT
+    {
+        NET_ADDRESS     addr;
+        DWORD           dwNonce;
+        volatile DWORD  dwLastHeard;        // Tick
+        volatile DWORD  dwStamp;
+        volatile DWORD  dwAckFrame;         // Newest snapshot the player has
+        int             nMove;              // Last move taken from the queue
+        INPUT_QUEUE     queue;
+    };
+
+    // A coded state for spectators, never changed once written and shared
+    // by whoever holds a reference. It is free again when the last
+    // reference is released.
+    struct SHARED_PACKET
+    {
+        volatile LONG   lRefs;
+        DWORD           dwSize;
+        MATCH_SPECTATE  packet;
+
+        VOID AddRef()               { InterlockedIncrement( &lRefs ); }
+        VOID Release()              { InterlockedDecrement( &lRefs ); }
+    };
+
+    // A match only changes status with InterlockedCompareExchange(). The
+    // receive thread takes it from free to waiting to playing, and the
+    // worker stepping it back to free when a player times out.
+    struct MATCH
+    {
+        volatile LONG   lStatus;
+        SEAT            aSeats[2];
+        SIM_STATE       state;
+        DWORD           dwFrame;
+        SNAPSHOT        aSnapshots[SNAPSHOT_RING];  // Sent, by frame
+
+        // Only touched by the worker stepping the match, and read by the
+        // fan-out, which runs after it
+        DWORD           dwSpectators;               // Changed between batches
+        SNAPSHOT        keySnapshot;
+        SHARED_PACKET*  pKeyframe;
+        SHARED_PACKET*  pLatest;                    // May be the keyframe
+        DWORD           dwLatestTick;
+        SHARED_PACKET   aShared[SERVER_SHARED_PACKETS];
+    };
+
+    // Spectators are only added and removed by the main thread between
+    // batches. Each is in a hash chain by address, or in the free list.
+    struct SPECTATOR
+    {
+        NET_ADDRESS     addr;
+        DWORD           dwMatch;                // m_dwNumMatches if the slot is free
+        DWORD           dwLastHeard;            // Tick
+        DWORD           dwNext;                 // Next in the chain or free list
+        BOOL            bNeedKeyframe;
+    };
+
+    // MATCH_WATCHes, queued by the receive thread for the main thread
+    struct WATCH_REQUEST
+    {
+        NET_ADDRESS     addr;
+        DWORD           dwMatch;
+    };
+
+    MATCH*          m_pMatches;
+    DWORD           m_dwNumMatches;
+    DWORD           m_dwWaiting;            // Match with one seat taken, or m_dwNumMatches
+    DWORD           m_dwNextFree;           // Where to start looking for a free match
+    SPECTATOR*      m_pSpectators;
+    DWORD           m_dwMaxSpectators;
+    DWORD           m_dwNumSpectators;
+    DWORD           m_dwSpectatorEnd;       // One past the highest slot ever used
+    DWORD           m_dwFreeSpectator;      // Head of the free list
+    DWORD           m_dwSweep;              // Next slot checked for timing out
+    DWORD*          m_pdwHash;              // Heads of the chains
+    DWORD           m_dwHashMask;
+    WATCH_REQUEST   m_aWatches[SERVER_WATCH_QUEUE];
+    volatile DWORD  m_dwWatchWrite;
+    volatile DWORD  m_dwWatchRead;
+    LONGLONG        m_llFanOutTime;
+    CUdpTransport   m_Net;
+    CThreadPool     m_Pool;
+    HANDLE          m_hReceiveThread;
+    volatile LONG   m_lStop;
+    volatile DWORD  m_dwTick;
+    DWORD           m_dwBroadcastTicks;     // Ticks between states
+    DWORD           m_dwSeed;
+
+    // Counted by any thread
+    volatile LONG   m_lPlaying;
+    volatile LONG   m_lInputsDropped;
+    volatile LONG   m_lMatchesEnded;
+    volatile LONG   m_lSnapshots;
+    volatile LONG   m_lSnapshotBytes;
+    volatile LONG   m_lSpectateCoded;
+    volatile LONG   m_lSpectateBytes;
+    volatile LONG   m_lSpectateSent;
+    volatile LONG   m_lWatchesDropped;
+
+    static DWORD WINAPI ReceiveThread( LPVOID pParam );
+    static VOID StepSlice( VOID* pContext, DWORD dwFirst, DWORD dwCount );
+    static VOID FanOutSlice( VOID* pContext, DWORD dwFirst, DWORD dwCount );
+
+    VOID    ReceivePacket( const BYTE* pData, DWORD dwSize, const NET_ADDRESS* pFrom );
+    VOID    Join( const MATCH_JOIN* pJoin, const NET_ADDRESS* pFrom );
+    VOID    TakeInput( const MATCH_INPUT* pInput, const NET_ADDRESS* pFrom );
+    VOID    SendWelcome( DWORD dwMatch, DWORD dwPlayer );
+    VOID    StepMatch( DWORD dwMatch );
+    VOID    SendState( MATCH* pMatch, const SNAPSHOT* pSnap, DWORD dwPlayer );
+    VOID    ResetSeat( SEAT* pSeat, const NET_ADDRESS* pAddr, DWORD dwNonce );
+    BOOL    TimedOut( const SEAT* pSeat );
+    VOID    QueueWatch( const MATCH_WATCH* pWatch, const NET_ADDRESS* pFrom );
+    VOID    UpdateSpectators();
+    VOID    Watch( const WATCH_REQUEST* pRequest );
+    VOID    RemoveSpectator( DWORD dwSpectator );
+    DWORD   HashAddress( const NET_ADDRESS* pAddr );
+    VOID    CodeSpectate( DWORD dwMatch, const SNAPSHOT* pSnap );
+    VOID    ReleaseSpectate( MATCH* pMatch );
+
+    CMatchServer( const CMatchServer& );
+    CMatchServer& operator=( const CMatchServer& );
+
+public:
+    CMatchServer();
+    ~CMatchServer();
+
+    // dwNumThreads of 0 uses one thread per processor. dwBroadcastRate is
+    // states a second, up to SERVER_TICK_RATE.
+    HRESULT Create( WORD wPort, DWORD dwMaxMatches, DWORD dwMaxSpectators,
+                    DWORD dwNumThreads, DWORD dwBroadcastRate );
+    VOID    Destroy();
+
+    // Steps every match by one tick and sends the spectators their states
+    VOID    Tick();
+
+    DWORD   GetTick()               { return m_dwTick; }
+    DWORD   GetNumThreads()         { return m_Pool.GetNumThreads(); }
+    DWORD   GetPlaying()            { return (DWORD)m_lPlaying; }
+    DWORD   GetMatchesEnded()       { return (DWORD)m_lMatchesEnded; }
+    DWORD   GetInputsDropped()      { return (DWORD)m_lInputsDropped; }
+    DWORD   GetSnapshots()          { return (DWORD)m_lSnapshots; }
+    DWORD   GetSnapshotBytes()      { return (DWORD)m_lSnapshotBytes; }
+    DWORD   GetSpectators()         { return m_dwNumSpectators; }
+    DWORD   GetSpectateCoded()      { return (DWORD)m_lSpectateCoded; }
+    DWORD   GetSpectateBytes()      { return (DWORD)m_lSpectateBytes; }
+    DWORD   GetSpectateSent()       { return (DWORD)m_lSpectateSent; }
+    DWORD   GetWatchesDropped()     { return (DWORD)m_lWatchesDropped; }
+
+    // QueryPerformanceCounter() counts the last tick spent sending to
+    // spectators
+    LONGLONG GetFanOutTime()        { return m_llFanOutTime; }
+    DWORD   GetSent()               { return m_Net.GetSent(); }
+    DWORD   GetReceived()           { return m_Net.GetReceived(); }
+    DWORD   GetSendsDropped()       { return m_Net.GetDropped(); }
+};
+
+
+
+
+#endif // SERVER_H
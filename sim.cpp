@@ -0,0 +1,324 @@
+//-----------------------------------------------------------------------------
+// File: sim.cpp
+//
+// Desc: The game simulation. These are the rules the game has always had,
+//       moved out of Pongy.cpp so they work on any SIM_STATE rather than the
+//       one game on screen.
+//-----------------------------------------------------------------------------
+#include <windows.h>
+#include <stdlib.h>
+#include "sim.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Sim_Random()
+// Desc: A number from 0 up to fRange, from the state's own generator rather
+//       than rand(), so a game depends only on its seed
+//-----------------------------------------------------------------------------
+static FLOAT Sim_Random( SIM_STATE* pState, FLOAT fRange )
+{
+    pState->dwSeed = pState->dwSeed * 1664525 + 1013904223;
+    return (FLOAT)( ( pState->dwSeed >> 8 ) & 0xFFFFFF ) * ( fRange / 16777216.0f );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Sim_ClampBat()
+// Desc: Keeps a bat from going beyond the screen borders
+//-----------------------------------------------------------------------------
+static VOID Sim_ClampBat( SPRITE_STRUCT* pBat )
+{
+    if( pBat->fPosY < 0 )
+        pBat->fPosY = 0;
+
+    if( pBat->fPosY > FIELD_HEIGHT - BAT_SPRITE_HEIGHT )
+        pBat->fPosY = FIELD_HEIGHT - 1 - BAT_SPRITE_HEIGHT;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Sim_GetDefaultParams()
+// Desc: The settings the game has always played with. The bats have always
+//       moved at 500 * BAT_SPEED / RAND_MAX - 250 field units a second, which
+//       comes to just under 250, so that is kept exactly.
+//-----------------------------------------------------------------------------
+VOID Sim_GetDefaultParams( SIM_PARAMS* pParams )
+{
+    pParams->fComputerLevel    = (FLOAT)COMPUTER_LEVEL;
+    pParams->fComputerBatSpeed = 250.0f - 500.0f * BAT_SPEED / RAND_MAX;
+    pParams->fPlayerBatSpeed   = 250.0f - 500.0f * BAT_SPEED / RAND_MAX;
+    pParams->fBallSpeedInc     = (FLOAT)BALL_SPEED_INC;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Sim_Init()
+// Desc: Starts a new game at 0 - 0 and serves the first ball
+//-----------------------------------------------------------------------------
+VOID Sim_Init( SIM_STATE* pState, DWORD dwSeed, const SIM_PARAMS* pParams )
+{
+    ZeroMemory( pState, sizeof(SIM_STATE) );
+    pState->dwSeed = dwSeed;
+
+    if( pParams )
+        pState->params = *pParams;
+    else
+        Sim_GetDefaultParams( &pState->params );
+
+    Sim_Serve( pState );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Sim_Serve()
+// Desc: Puts the ball back on the centre line with a new velocity and the
+//       bats back in the middle. The score, seed and settings carry on.
+//-----------------------------------------------------------------------------
+VOID Sim_Serve( SIM_STATE* pState )
+{
+    SPRITE_STRUCT* pBall = &pState->aSprite[0];
+
+    ZeroMemory( pState->aSprite, sizeof(pState->aSprite) );
+
+    // Set the ball sprite
+    pBall->sType = ball;
+    pBall->fPosX = (FLOAT)( ( FIELD_WIDTH / 2 ) - ( BALL_SPRITE_DIAMETER / 2 ) );
+    pBall->fPosY = 0.0f;
+
+    // Keep changing the velocity until speed is realistic
+    while( 1 )
+    {
+        pBall->fVelX = Sim_Random( pState, 500.0f ) - 250.0f;
+        pBall->fVelY = Sim_Random( pState, 500.0f ) - 250.0f;
+        if( pBall->fVelX > 100.0 || pBall->fVelX < -100.0 )
+            if( pBall->fVelY > 50.0 || pBall->fVelY < -50.0 )
+                break;
+    }
+
+    pState->whoseTurn = ( pBall->fVelX >= 0 ) ? computer : human;
+
+    // Set the player bat sprite
+    pState->aSprite[1].sType = playerBat;
+    pState->aSprite[1].fPosX = (FLOAT)( BAT_EDGE_SPACER );
+    pState->aSprite[1].fPosY = (FLOAT)( ( FIELD_HEIGHT / 2 ) - ( BAT_SPRITE_HEIGHT / 2 ) );
+    pState->aSprite[1].fVelY = -pState->params.fPlayerBatSpeed;
+
+    // Set the computer bat sprite
+    pState->aSprite[2].sType = computerBat;
+    pState->aSprite[2].fPosX = (FLOAT)( FIELD_WIDTH - ( BAT_SPRITE_WIDTH + BAT_EDGE_SPACER ) );
+    pState->aSprite[2].fPosY = (FLOAT)( ( FIELD_HEIGHT / 2 ) - ( BAT_SPRITE_HEIGHT / 2 ) );
+    pState->aSprite[2].fVelY = -pState->params.fComputerBatSpeed;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Sim_MoveBat()
+// Desc: Moves a bat up or down. Bat velocities are negative, so moving up
+//       adds it.
+//-----------------------------------------------------------------------------
+static VOID Sim_MoveBat( SPRITE_STRUCT* pBat, int nMove, FLOAT fTimeDelta )
+{
+    if( nMove < 0 )
+        pBat->fPosY += pBat->fVelY * fTimeDelta;
+    else if( nMove > 0 )
+        pBat->fPosY -= pBat->fVelY * fTimeDelta;
+
+    Sim_ClampBat( pBat );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Sim_MovePlayerBat()
+// Desc: Moves the player's bat up or down
+//-----------------------------------------------------------------------------
+VOID Sim_MovePlayerBat( SIM_STATE* pState, int nPlayerMove, FLOAT fTimeDelta )
+{
+    Sim_MoveBat( &pState->aSprite[1], nPlayerMove, fTimeDelta );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Sim_MoveComputerBat()
+// Desc: Moves the computer's bat up or down for a second human player
+//-----------------------------------------------------------------------------
+VOID Sim_MoveComputerBat( SIM_STATE* pState, int nComputerMove, FLOAT fTimeDelta )
+{
+    Sim_MoveBat( &pState->aSprite[2], nComputerMove, fTimeDelta );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Sim_UpdateComputerBat()
+// Desc: Moves the computer's bat towards the ball, once the player has hit
+//       it and it is past the computer's level
+//-----------------------------------------------------------------------------
+VOID Sim_UpdateComputerBat( SIM_STATE* pState, FLOAT fTimeDelta )
+{
+    SPRITE_STRUCT* pBall = &pState->aSprite[0];
+    SPRITE_STRUCT* pBat  = &pState->aSprite[2];
+
+    // Computer will not move until player has hit ball
+    if( ( pState->whoseTurn == human ) || ( pBall->fPosX < pState->params.fComputerLevel ) )
+        return;
+
+    // Update the computers bat position based on ball position
+    if( pBat->fPosY < pBall->fPosY )
+        pBat->fPosY -= pBat->fVelY * fTimeDelta;
+
+    if( pBat->fPosY > pBall->fPosY )
+        pBat->fPosY += pBat->fVelY * fTimeDelta;
+
+    Sim_ClampBat( pBat );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Sim_UpdateBall()
+// Desc: Moves the ball and bounces it off the walls and bats. If it gets
+//       past a bat the other side scores, the ball is served again and the
+//       point is returned. Hits are returned too, for anything counting
+//       rallies.
+//-----------------------------------------------------------------------------
+SimEvent Sim_UpdateBall( SIM_STATE* pState, FLOAT fTimeDelta )
+{
+    SPRITE_STRUCT* pBall        = &pState->aSprite[0];
+    SPRITE_STRUCT* pPlayerBat   = &pState->aSprite[1];
+    SPRITE_STRUCT* pComputerBat = &pState->aSprite[2];
+
+    // Update the sprite position
+    pBall->fPosX += pBall->fVelX * fTimeDelta;
+    pBall->fPosY += pBall->fVelY * fTimeDelta;
+
+    // Check if computer scored a point
+    if( pBall->fPosX < 0.0f )
+    {
+        pState->score.nComputerScore++;
+        Sim_Serve( pState );
+        return simComputerPoint;
+    }
+
+    // Check if player scored a point
+    if( pBall->fPosX >= FIELD_WIDTH - BALL_SPRITE_DIAMETER )
+    {
+        pState->score.nPlayerScore++;
+        Sim_Serve( pState );
+        return simPlayerPoint;
+    }
+
+    // Bounce the ball if it hits the top or bottom
+    if( pBall->fPosY < 0 )
+    {
+        pBall->fPosY = 0;
+        pBall->fVelY = -pBall->fVelY;
+        return simNone;
+    }
+
+    if( pBall->fPosY > FIELD_HEIGHT - BALL_SPRITE_DIAMETER )
+    {
+        pBall->fPosY = FIELD_HEIGHT - 1 - BALL_SPRITE_DIAMETER;
+        pBall->fVelY = -pBall->fVelY;
+        return simNone;
+    }
+
+    // Bounce the ball if it hit the players bat, speeding it up, and make
+    // it the computer's turn
+    if( pBall->fPosX <= pPlayerBat->fPosX + BAT_SPRITE_WIDTH )
+    {
+        if( ( pBall->fPosY + BALL_SPRITE_DIAMETER >= pPlayerBat->fPosY ) &&
+            ( pBall->fPosY <= pPlayerBat->fPosY + BAT_SPRITE_HEIGHT ) )
+        {
+            pBall->fPosX  = (FLOAT)( BAT_EDGE_SPACER + BAT_SPRITE_WIDTH );
+            pBall->fVelX  = -pBall->fVelX;
+            pBall->fVelX += pState->params.fBallSpeedInc;
+            pState->whoseTurn = computer;
+            return simPlayerHit;
+        }
+    }
+
+    // Bounce the ball if it hit the computers bat, and make it the player's
+    // turn
+    if( pBall->fPosX + BALL_SPRITE_DIAMETER >= pComputerBat->fPosX )
+    {
+        if( ( pBall->fPosY + BALL_SPRITE_DIAMETER >= pComputerBat->fPosY ) &&
+            ( pBall->fPosY <= pComputerBat->fPosY + BAT_SPRITE_HEIGHT ) )
+        {
+            pBall->fPosX  = (FLOAT)( FIELD_WIDTH - ( BAT_EDGE_SPACER + BAT_SPRITE_WIDTH + BALL_SPRITE_DIAMETER ) );
+            pBall->fVelX  = -pBall->fVelX;
+            pBall->fVelX -= pState->params.fBallSpeedInc;
+            pState->whoseTurn = human;
+            return simComputerHit;
+        }
+    }
+
+    return simNone;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Sim_Step()
+// Desc: One step of the game, in the order the sprites are stored: the
+//       ball, then the player's bat, then the computer's bat
+//-----------------------------------------------------------------------------
+SimEvent Sim_Step( SIM_STATE* pState, int nPlayerMove, FLOAT fTimeDelta )
+{
+    SimEvent event = Sim_UpdateBall( pState, fTimeDelta );
+    Sim_MovePlayerBat( pState, nPlayerMove, fTimeDelta );
+    Sim_UpdateComputerBat( pState, fTimeDelta );
+    return event;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Sim_GetChecksum()
+// Desc: An FNV-1a hash of the whole state, for checking that two copies of
+//       a game that should be the same really are
+//-----------------------------------------------------------------------------
+DWORD Sim_GetChecksum( const SIM_STATE* pState )
+{
+    const BYTE* pb     = (const BYTE*)pState;
+    DWORD       dwHash = 2166136261;
+
+    for( DWORD i = 0; i < sizeof(SIM_STATE); i++ )
+        dwHash = ( dwHash ^ pb[i] ) * 16777619;
+
+    return dwHash;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Sim_StepVersus()
+// Desc: One step of a two player game, where both bats are moved by input
+//-----------------------------------------------------------------------------
+SimEvent Sim_StepVersus( SIM_STATE* pState, int nPlayerMove, int nComputerMove, FLOAT fTimeDelta )
+{
+    SimEvent event = Sim_UpdateBall( pState, fTimeDelta );
+    Sim_MovePlayerBat( pState, nPlayerMove, fTimeDelta );
+    Sim_MoveComputerBat( pState, nComputerMove, fTimeDelta );
+    return event;
+}
@@ -0,0 +1,121 @@
+//-----------------------------------------------------------------------------
+// File: sim.h
+//
+// Desc: The game simulation: the ball, the bats and the score. It knows
+//       nothing about DirectX, the window or the keyboard, so the same code
+//       runs the game on screen and any number of headless copies.
+//
+//       Everything about a game lives in a SIM_STATE, which is plain data,
+//       including the seed used to serve the ball, so a state can be copied
+//       or saved with a memcpy and two copies stepped with the same input
+//       stay the same.
+//
+//       The difficulty settings travel in the state too, as a SIM_PARAMS,
+//       so games with different settings can run side by side.
+//-----------------------------------------------------------------------------
+#ifndef SIM_H
+#define SIM_H
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+// The field and everything on it are measured in field units, which
+// were the pixels of the original 640x480 window. The renderer scales
+// them to whatever size the window is, so the sim, snapshots and replays
+// are the same at any resolution.
+#define FIELD_WIDTH				640
+#define FIELD_HEIGHT			480
+
+#define BALL_SPRITE_DIAMETER	32
+
+#define BAT_SPRITE_WIDTH		10
+#define BAT_SPRITE_HEIGHT		75
+#define BAT_EDGE_SPACER			10
+#define COMPUTER_LEVEL			250.0
+
+#define NUM_SPRITES				3
+
+// Defaults for SIM_PARAMS
+#define BALL_SPEED				5
+#define BALL_SPEED_INC			50.0
+#define BAT_SPEED				15
+
+enum SpriteType {playerBat, computerBat, ball};
+enum PlayerType {human, computer};
+
+// What happened to the ball during a step
+enum SimEvent { simNone, simPlayerPoint, simComputerPoint, simPlayerHit, simComputerHit };
+
+#define SIM_IS_POINT(e)		( (e) == simPlayerPoint || (e) == simComputerPoint )
+
+struct SPRITE_STRUCT
+{
+	SpriteType sType;
+    FLOAT fPosX;
+    FLOAT fPosY;
+    FLOAT fVelX;
+    FLOAT fVelY;
+};
+
+struct SCORE_STRUCT
+{
+	int nPlayerScore;
+	int nComputerScore;
+};
+
+// The difficulty settings. Speeds are in field units per second.
+struct SIM_PARAMS
+{
+	FLOAT	fComputerLevel;		// Computer's bat waits until the ball is past this x
+	FLOAT	fComputerBatSpeed;
+	FLOAT	fPlayerBatSpeed;
+	FLOAT	fBallSpeedInc;		// Added to the ball's speed by each hit
+};
+
+// aSprite[0] is the ball, [1] the player's bat and [2] the computer's bat
+struct SIM_STATE
+{
+	SPRITE_STRUCT	aSprite[NUM_SPRITES];
+	SCORE_STRUCT	score;
+	PlayerType		whoseTurn;
+	DWORD			dwSeed;
+	SIM_PARAMS		params;
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Sim_*()
+// Desc: Sim_Init() starts a new game from dwSeed, with the default settings
+//       unless pParams is given, and Sim_Serve() puts the ball and bats back
+//       for the next point. Sim_Step() moves everything on by fTimeDelta
+//       seconds, in the same order as the game does, with nPlayerMove moving
+//       the player's bat up (< 0), down (> 0) or not at all. A point updates
+//       the score and serves again before returning. Sim_StepVersus() is
+//       the same for two players, the second moving the computer's bat.
+//
+//       The Sim_Move*()/Sim_Update*() functions are the parts of a step, for
+//       callers that need to time or drive them on their own, and
+//       Sim_GetChecksum() hashes a state for comparing copies of a game.
+//-----------------------------------------------------------------------------
+VOID     Sim_GetDefaultParams( SIM_PARAMS* pParams );
+VOID     Sim_Init( SIM_STATE* pState, DWORD dwSeed, const SIM_PARAMS* pParams = NULL );
+VOID     Sim_Serve( SIM_STATE* pState );
+SimEvent Sim_Step( SIM_STATE* pState, int nPlayerMove, FLOAT fTimeDelta );
+SimEvent Sim_StepVersus( SIM_STATE* pState, int nPlayerMove, int nComputerMove, FLOAT fTimeDelta );
+
+VOID     Sim_MovePlayerBat( SIM_STATE* pState, int nPlayerMove, FLOAT fTimeDelta );
+VOID     Sim_MoveComputerBat( SIM_STATE* pState, int nComputerMove, FLOAT fTimeDelta );
+VOID     Sim_UpdateComputerBat( SIM_STATE* pState, FLOAT fTimeDelta );
+SimEvent Sim_UpdateBall( SIM_STATE* pState, FLOAT fTimeDelta );
+
+DWORD    Sim_GetChecksum( const SIM_STATE* pState );
+
+
+
+
+#endif // SIM_H
@@ -0,0 +1,281 @@
+//-----------------------------------------------------------------------------
+// File: snapshot.cpp
+//
+// Desc: The snapshot codec. An encoded snapshot is, low bit first:
+//
+//         1 bit    1 if it is a delta
+//
+//       then for a full snapshot
+//
+//         32 bits  frame
+//         each field at its width in s_adwFieldBits, two's complement
+//
+//       or for a delta
+//
+//         16 bits  low bits of the baseline's frame
+//         8 bits   frames since the baseline, 1 to SNAPSHOT_MAX_AGE
+//         each field as 1 bit, 0 if unchanged, else 1 followed by a 2 bit
+//         size class and the zig-zagged change in DeltaBits() bits
+//-----------------------------------------------------------------------------
+#define STRICT
+#include <windows.h>
+#include "bitpack.h"
+#include "snapshot.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+#define SNAPSHOT_BASE_BITS      16
+#define SNAPSHOT_AGE_BITS       8
+
+// Full width of each field. 16 bits is +-2048 field units for positions.
+// Velocities get 24 bits, +-2 million units a second, as the ball speeds up
+// with every hit and a long enough rally would pass the +-8192 of 16 bits.
+// Anything that still doesn't fit is clamped and counted by
+// Snapshot_GetSaturated().
+static const DWORD s_adwFieldBits[SNAPSHOT_NUM_FIELDS] =
+{
+    16, 16, SNAPSHOT_VEL_BITS, SNAPSHOT_VEL_BITS,   // Ball
+    16, SNAPSHOT_VEL_BITS,                          // Player's bat
+    16, SNAPSHOT_VEL_BITS,                          // Computer's bat
+    12, 12                                          // Score
+};
+
+// Widths of the three smaller delta size classes. The largest is the
+// field's own width plus 2, as a change fits in one bit more than the
+// field and zig-zagged in another.
+static const DWORD s_adwDeltaBits[3] = { 4, 8, 12 };
+
+static volatile LONG s_lSaturated = 0;
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Quantise()
+// Desc: Rounds fValue * fScale to the nearest whole number that fits in
+//       dwBits as a signed value, clamping and counting any that don't
+//-----------------------------------------------------------------------------
+static LONG Quantise( FLOAT fValue, FLOAT fScale, DWORD dwBits )
+{
+    FLOAT fScaled = fValue * fScale;
+    LONG  lMax    = ( 1 << ( dwBits - 1 ) ) - 1;
+
+    if( fScaled >= (FLOAT)lMax + 0.5f || fScaled <= -( (FLOAT)lMax + 0.5f ) )
+    {
+        InterlockedIncrement( &s_lSaturated );
+        return ( fScaled > 0.0f ) ? lMax : -lMax;
+    }
+
+    return (LONG)( fScaled + ( fScaled >= 0.0f ? 0.5f : -0.5f ) );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: DeltaBits()
+// Desc: The width of a change to field dwField in size class dwClass
+//-----------------------------------------------------------------------------
+static DWORD DeltaBits( DWORD dwField, DWORD dwClass )
+{
+    return ( dwClass < 3 ) ? s_adwDeltaBits[dwClass] : s_adwFieldBits[dwField] + 2;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Snapshot_FromState()
+// Desc: Quantises the ball, the bats and the score
+//-----------------------------------------------------------------------------
+VOID Snapshot_FromState( SNAPSHOT* pSnap, const SIM_STATE* pState, DWORD dwFrame )
+{
+    const SPRITE_STRUCT* pBall   = &pState->aSprite[0];
+    LONG*                plField = pSnap->alFields;
+
+    pSnap->dwFrame = dwFrame;
+
+    plField[snapBallX]           = Quantise( pBall->fPosX, SNAPSHOT_POS_SCALE, 16 );
+    plField[snapBallY]           = Quantise( pBall->fPosY, SNAPSHOT_POS_SCALE, 16 );
+    plField[snapBallVelX]        = Quantise( pBall->fVelX, SNAPSHOT_VEL_SCALE, SNAPSHOT_VEL_BITS );
+    plField[snapBallVelY]        = Quantise( pBall->fVelY, SNAPSHOT_VEL_SCALE, SNAPSHOT_VEL_BITS );
+    plField[snapPlayerBatY]      = Quantise( pState->aSprite[1].fPosY, SNAPSHOT_POS_SCALE, 16 );
+    plField[snapPlayerBatVelY]   = Quantise( pState->aSprite[1].fVelY, SNAPSHOT_VEL_SCALE, SNAPSHOT_VEL_BITS );
+    plField[snapComputerBatY]    = Quantise( pState->aSprite[2].fPosY, SNAPSHOT_POS_SCALE, 16 );
+    plField[snapComputerBatVelY] = Quantise( pState->aSprite[2].fVelY, SNAPSHOT_VEL_SCALE, SNAPSHOT_VEL_BITS );
+    plField[snapPlayerScore]     = min( pState->score.nPlayerScore, 2047 );
+    plField[snapComputerScore]   = min( pState->score.nComputerScore, 2047 );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Snapshot_ToState()
+// Desc: Puts the ball, the bats and the score back into a game
+//-----------------------------------------------------------------------------
+VOID Snapshot_ToState( const SNAPSHOT* pSnap, SIM_STATE* pState )
+{
+    const LONG*    plField = pSnap->alFields;
+    SPRITE_STRUCT* pBall   = &pState->aSprite[0];
+
+    pBall->sType = ball;
+    pBall->fPosX = plField[snapBallX] / SNAPSHOT_POS_SCALE;
+    pBall->fPosY = plField[snapBallY] / SNAPSHOT_POS_SCALE;
+    pBall->fVelX = plField[snapBallVelX] / SNAPSHOT_VEL_SCALE;
+    pBall->fVelY = plField[snapBallVelY] / SNAPSHOT_VEL_SCALE;
+
+    pState->aSprite[1].sType = playerBat;
+    pState->aSprite[1].fPosX = (FLOAT)( BAT_EDGE_SPACER );
+    pState->aSprite[1].fPosY = plField[snapPlayerBatY] / SNAPSHOT_POS_SCALE;
+    pState->aSprite[1].fVelX = 0.0f;
+    pState->aSprite[1].fVelY = plField[snapPlayerBatVelY] / SNAPSHOT_VEL_SCALE;
+
+    pState->aSprite[2].sType = computerBat;
+    pState->aSprite[2].fPosX = (FLOAT)( FIELD_WIDTH - ( BAT_SPRITE_WIDTH + BAT_EDGE_SPACER ) );
+    pState->aSprite[2].fPosY = plField[snapComputerBatY] / SNAPSHOT_POS_SCALE;
+    pState->aSprite[2].fVelX = 0.0f;
+    pState->aSprite[2].fVelY = plField[snapComputerBatVelY] / SNAPSHOT_VEL_SCALE;
+
+    pState->score.nPlayerScore   = plField[snapPlayerScore];
+    pState->score.nComputerScore = plField[snapComputerScore];
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Snapshot_Encode()
+// Desc: Writes pSnap in full or as changes from pBase
+//-----------------------------------------------------------------------------
+DWORD Snapshot_Encode( const SNAPSHOT* pSnap, const SNAPSHOT* pBase, BYTE* pOut )
+{
+    CBitWriter writer( pOut );
+    DWORD      dwAge = pBase ? pSnap->dwFrame - pBase->dwFrame : 0;
+
+    if( dwAge == 0 || dwAge > SNAPSHOT_MAX_AGE )
+    {
+        writer.Write( 0, 1 );
+        writer.Write( pSnap->dwFrame, 32 );
+
+        for( DWORD i = 0; i < SNAPSHOT_NUM_FIELDS; i++ )
+        {
+            DWORD dwBits = s_adwFieldBits[i];
+            writer.Write( (DWORD)pSnap->alFields[i] & ( ( 1 << dwBits ) - 1 ), dwBits );
+        }
+
+        return writer.Finish();
+    }
+
+    writer.Write( 1, 1 );
+    writer.Write( pBase->dwFrame & ( ( 1 << SNAPSHOT_BASE_BITS ) - 1 ), SNAPSHOT_BASE_BITS );
+    writer.Write( dwAge, SNAPSHOT_AGE_BITS );
+
+    for( DWORD i = 0; i < SNAPSHOT_NUM_FIELDS; i++ )
+    {
+        LONG lDelta = pSnap->alFields[i] - pBase->alFields[i];
+        if( lDelta == 0 )
+        {
+            writer.Write( 0, 1 );
+            continue;
+        }
+
+        DWORD dwZigZag = ZigZag( lDelta );
+        DWORD dwClass  = 0;
+        while( dwClass < 3 && dwZigZag >> s_adwDeltaBits[dwClass] )
+            dwClass++;
+
+        // The change bit and the size class go out together
+        writer.Write( 1 | ( dwClass << 1 ), 3 );
+        writer.Write( dwZigZag, DeltaBits( i, dwClass ) );
+    }
+
+    return writer.Finish();
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Snapshot_Decode()
+// Desc: Reads a snapshot written by Snapshot_Encode()
+//-----------------------------------------------------------------------------
+HRESULT Snapshot_Decode( const BYTE* pIn, DWORD dwSize, const SNAPSHOT* pRing, SNAPSHOT* pSnap )
+{
+    CBitReader reader( pIn, dwSize );
+
+    if( 0 == reader.Read( 1 ) )
+    {
+        pSnap->dwFrame = reader.Read( 32 );
+
+        for( DWORD i = 0; i < SNAPSHOT_NUM_FIELDS; i++ )
+        {
+            // Shift the sign bit to the top and back to sign extend
+            DWORD dwBits = s_adwFieldBits[i];
+            pSnap->alFields[i] = (LONG)( reader.Read( dwBits ) << ( 32 - dwBits ) ) >> ( 32 - dwBits );
+        }
+
+        return reader.IsOverrun() ? E_FAIL : S_OK;
+    }
+
+    DWORD dwBaseBits = reader.Read( SNAPSHOT_BASE_BITS );
+    DWORD dwAge      = reader.Read( SNAPSHOT_AGE_BITS );
+
+    if( NULL == pRing )
+        return E_FAIL;
+
+    const SNAPSHOT* pBase = &pRing[SNAPSHOT_SLOT( dwBaseBits )];
+    if( pBase->dwFrame == SNAPSHOT_NO_FRAME ||
+        ( pBase->dwFrame & ( ( 1 << SNAPSHOT_BASE_BITS ) - 1 ) ) != dwBaseBits )
+        return E_FAIL;
+
+    // pSnap may be a slot in pRing, maybe even the baseline's
+    SNAPSHOT snap;
+    snap.dwFrame = pBase->dwFrame + dwAge;
+
+    for( DWORD i = 0; i < SNAPSHOT_NUM_FIELDS; i++ )
+    {
+        snap.alFields[i] = pBase->alFields[i];
+
+        if( 0 == reader.Read( 1 ) )
+            continue;
+
+        DWORD dwClass = reader.Read( 2 );
+        snap.alFields[i] += UnZigZag( reader.Read( DeltaBits( i, dwClass ) ) );
+    }
+
+    if( reader.IsOverrun() )
+        return E_FAIL;
+
+    *pSnap = snap;
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Snapshot_ClearRing()
+// Desc: Marks every slot of a ring of SNAPSHOT_RING snapshots empty
+//-----------------------------------------------------------------------------
+VOID Snapshot_ClearRing( SNAPSHOT* pRing )
+{
+    for( DWORD i = 0; i < SNAPSHOT_RING; i++ )
+        pRing[i].dwFrame = SNAPSHOT_NO_FRAME;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Snapshot_GetSaturated()
+// Desc: Returns how many fields have been clamped to fit their width
+//-----------------------------------------------------------------------------
+LONG Snapshot_GetSaturated()
+{
+    return s_lSaturated;
+}
@@ -0,0 +1,86 @@
+//-----------------------------------------------------------------------------
+// File: snapshot.h
+//
+// Desc: Compact snapshots of a game for sending over the network. The
+//       ball, bats and score are turned into fixed-point numbers relative
+//       to the field, then coded as changes from a baseline snapshot the
+//       other side is known to have, and packed into as few bits as the
+//       changes need. Fields that haven't moved cost one bit; at 20
+//       snapshots a second a typical one is 10 or 11 bytes, against 68 for
+//       the sprites and score as they are held in a SIM_STATE.
+//
+//       Without a baseline, for the first snapshot or after too many were
+//       lost, every field is written at its full width.
+//
+//       Each side keeps its recent snapshots in a ring of SNAPSHOT_RING
+//       slots by frame. A delta names its baseline by the low bits of the
+//       baseline's frame, which is enough to find it in the ring.
+//-----------------------------------------------------------------------------
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "sim.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+#define SNAPSHOT_POS_SCALE      16.0f       // Positions in 16ths of a field unit
+#define SNAPSHOT_VEL_SCALE      4.0f        // Velocities in quarters of a unit a second
+#define SNAPSHOT_VEL_BITS       24          // Full width of a velocity
+#define SNAPSHOT_VEL_MAX        ( ( ( 1 << ( SNAPSHOT_VEL_BITS - 1 ) ) - 1 ) / SNAPSHOT_VEL_SCALE )
+#define SNAPSHOT_MAX_BYTES      48          // Largest encoded snapshot
+#define SNAPSHOT_MAX_AGE        255         // Oldest baseline, in frames
+#define SNAPSHOT_RING           32          // Snapshots kept as baselines, a power of 2
+#define SNAPSHOT_SLOT(f)        ( (f) & ( SNAPSHOT_RING - 1 ) )
+#define SNAPSHOT_NO_FRAME       0xFFFFFFFF  // dwFrame of an empty ring slot
+
+// The fields of a snapshot. Bats only move up and down, so their x
+// positions are left out and put back from the field's layout.
+enum SnapshotField
+{
+    snapBallX, snapBallY, snapBallVelX, snapBallVelY,
+    snapPlayerBatY, snapPlayerBatVelY,
+    snapComputerBatY, snapComputerBatVelY,
+    snapPlayerScore, snapComputerScore,
+    SNAPSHOT_NUM_FIELDS
+};
+
+struct SNAPSHOT
+{
+    DWORD       dwFrame;
+    LONG        alFields[SNAPSHOT_NUM_FIELDS];
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Snapshot_*()
+// Desc: Snapshot_FromState() and Snapshot_ToState() convert to and from a
+//       game; ToState() only fills in the sprites and score.
+//
+//       Snapshot_Encode() writes pSnap as changes from pBase, or in full if
+//       pBase is NULL or more than SNAPSHOT_MAX_AGE frames older, and
+//       returns the size, at most SNAPSHOT_MAX_BYTES.
+//
+//       Snapshot_Decode() decodes a snapshot, taking its baseline from
+//       pRing. It fails if the baseline isn't there, or pRing is NULL and
+//       the snapshot needs one. Snapshot_ClearRing() empties a ring.
+//
+//       Snapshot_GetSaturated() counts the fields FromState() has had to
+//       clamp to fit, which the other side will have got wrong.
+//-----------------------------------------------------------------------------
+VOID    Snapshot_FromState( SNAPSHOT* pSnap, const SIM_STATE* pState, DWORD dwFrame );
+VOID    Snapshot_ToState( const SNAPSHOT* pSnap, SIM_STATE* pState );
+DWORD   Snapshot_Encode( const SNAPSHOT* pSnap, const SNAPSHOT* pBase, BYTE* pOut );
+HRESULT Snapshot_Decode( const BYTE* pIn, DWORD dwSize, const SNAPSHOT* pRing, SNAPSHOT* pSnap );
+VOID    Snapshot_ClearRing( SNAPSHOT* pRing );
+LONG    Snapshot_GetSaturated();
+
+
+
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,730 @@
+//-----------------------------------------------------------------------------
+// File: softdisplay.cpp
+//
+// Desc: The software display. Commands are binned by counting how many
+//       land on each tile, turning the counts into each tile's start in
+//       one array of references, and filling that in command order, so
+//       binning costs two passes over the commands and allocates nothing.
+//-----------------------------------------------------------------------------
+#define STRICT
+#include <windows.h>
+#include <string.h>
+#include <ddraw.h>
+#include "dxutil.h"
+#include "fill.h"
+#include "blitter.h"
+#include "softdisplay.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CSoftSurface::CSoftSurface()
+// Desc:
+//-----------------------------------------------------------------------------
+CSoftSurface::CSoftSurface()
+{
+    m_pdwBits        = NULL;
+    m_lPitch         = 0;
+    m_dwWidth        = 0;
+    m_dwHeight       = 0;
+    m_bColorKeyed    = FALSE;
+    m_dwColorKey     = 0;
+    m_bPremultiplied = FALSE;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CSoftSurface::~CSoftSurface()
+// Desc:
+//-----------------------------------------------------------------------------
+CSoftSurface::~CSoftSurface()
+{
+    Destroy();
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CSoftSurface::Create()
+// Desc: Makes a blank image with no colour key
+//-----------------------------------------------------------------------------
+HRESULT CSoftSurface::Create( DWORD dwWidth, DWORD dwHeight )
+{
+    Destroy();
+
+    if( dwWidth == 0 || dwHeight == 0 )
+        return E_INVALIDARG;
+
+    if( NULL == ( m_pdwBits = new DWORD[dwWidth * dwHeight] ) )
+        return E_OUTOFMEMORY;
+
+    ZeroMemory( m_pdwBits, dwWidth * dwHeight * sizeof(DWORD) );
+    m_lPitch   = dwWidth * sizeof(DWORD);
+    m_dwWidth  = dwWidth;
+    m_dwHeight = dwHeight;
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CSoftSurface::CopyFrom()
+// Desc: Copies a 32 bit surface's pixels and colour key, making this the
+//       same size. Copy it again after redrawing the surface. A surface
+//       with premultiplied alpha is blended rather than colour keyed.
+//-----------------------------------------------------------------------------
+HRESULT CSoftSurface::CopyFrom( CSurface* pSurface )
+{
+    HRESULT              hr;
+    DDSURFACEDESC2       ddsd;
+    LPDIRECTDRAWSURFACE7 pdds = pSurface ? pSurface->GetDDrawSurface() : NULL;
+
+    if( NULL == pdds )
+        return E_INVALIDARG;
+
+    ZeroMemory( &ddsd, sizeof(ddsd) );
+    ddsd.dwSize = sizeof(ddsd);
+    pdds->GetSurfaceDesc( &ddsd );
+
+    if( ddsd.ddpfPixelFormat.dwRGBBitCount != 32 )
+        return E_NOTIMPL;
+
+    if( ddsd.dwWidth != m_dwWidth || ddsd.dwHeight != m_dwHeight )
+    {
+        if( FAILED( hr = Create( ddsd.dwWidth, ddsd.dwHeight ) ) )
+            return hr;
+    }
+
+    if( FAILED( hr = pdds->Lock( NULL, &ddsd, DDLOCK_WAIT | DDLOCK_READONLY, NULL ) ) )
+        return hr;
+
+    const BYTE* pSrc  = (const BYTE*)ddsd.lpSurface;
+    BYTE*       pDest = (BYTE*)m_pdwBits;
+    for( DWORD y = 0; y < m_dwHeight; y++ )
+    {
+        memcpy( pDest, pSrc, m_dwWidth * sizeof(DWORD) );
+        pSrc  += ddsd.lPitch;
+        pDest += m_lPitch;
+    }
+
+    pdds->Unlock( NULL );
+
+    // The surface's key is kept as a GDI colour, so take the converted one
+    DDCOLORKEY ddck;
+    m_bPremultiplied = pSurface->IsPremultiplied();
+    m_bColorKeyed    = !m_bPremultiplied && pSurface->IsColorKeyed() &&
+                       SUCCEEDED( pdds->GetColorKey( DDCKEY_SRCBLT, &ddck ) );
+    m_dwColorKey     = m_bColorKeyed ? ddck.dwColorSpaceLowValue : 0;
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CSoftSurface::Destroy()
+// Desc:
+//-----------------------------------------------------------------------------
+VOID CSoftSurface::Destroy()
+{
+    SAFE_DELETE_ARRAY( m_pdwBits );
+
+    m_lPitch         = 0;
+    m_dwWidth        = 0;
+    m_dwHeight       = 0;
+    m_bColorKeyed    = FALSE;
+    m_bPremultiplied = FALSE;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CSoftDisplay::CSoftDisplay()
+// Desc:
+//-----------------------------------------------------------------------------
+CSoftDisplay::CSoftDisplay()
+{
+    m_pdwFrame      = NULL;
+    m_lPitch        = 0;
+    m_dwWidth       = 0;
+    m_dwHeight      = 0;
+    m_dwTilesX      = 0;
+    m_dwTilesY      = 0;
+    m_dwNumTiles    = 0;
+    m_pCommands     = NULL;
+    m_dwNumCommands = 0;
+    m_dwNumRefs     = 0;
+    m_bClear        = FALSE;
+    m_dwClearColor  = 0;
+    m_pdwTileStart  = NULL;
+    m_pdwRefs       = NULL;
+    m_lNextRow      = 0;
+    m_lNextTile     = 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CSoftDisplay::~CSoftDisplay()
+// Desc:
+//-----------------------------------------------------------------------------
+CSoftDisplay::~CSoftDisplay()
+{
+    Destroy();
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CSoftDisplay::Create()
+// Desc: Allocates the frame, the command queue and the tile lists, and
+//       starts the threads
+//-----------------------------------------------------------------------------
+HRESULT CSoftDisplay::Create( DWORD dwWidth, DWORD dwHeight, DWORD dwNumThreads )
+{
+    HRESULT hr;
+
+    Destroy();
+
+    // A row of tiles must fit in the tile lists for big fills to be split
+    if( dwWidth == 0 || dwHeight == 0 ||
+        ( ( dwWidth + SOFT_TILE_SIZE - 1 ) >> SOFT_TILE_SHIFT ) > SOFT_MAX_TILE_REFS )
+        return E_INVALIDARG;
+
+    m_dwWidth    = dwWidth;
+    m_dwHeight   = dwHeight;
+    m_lPitch     = dwWidth * sizeof(DWORD);
+    m_dwTilesX   = ( dwWidth  + SOFT_TILE_SIZE - 1 ) >> SOFT_TILE_SHIFT;
+    m_dwTilesY   = ( dwHeight + SOFT_TILE_SIZE - 1 ) >> SOFT_TILE_SHIFT;
+    m_dwNumTiles = m_dwTilesX * m_dwTilesY;
+
+    m_pdwFrame     = new DWORD[dwWidth * dwHeight];
+    m_pCommands    = new COMMAND[SOFT_MAX_COMMANDS];
+    m_pdwTileStart = new DWORD[m_dwNumTiles + 1];
+    m_pdwRefs      = new DWORD[SOFT_MAX_TILE_REFS];
+
+    if( NULL == m_pdwFrame || NULL == m_pCommands || NULL == m_pdwTileStart || NULL == m_pdwRefs )
+    {
+        Destroy();
+        return E_OUTOFMEMORY;
+    }
+
+    if( FAILED( hr = m_Pool.Create( dwNumThreads ) ) )
+    {
+        Destroy();
+        return hr;
+    }
+
+    ZeroMemory( m_pdwFrame, dwWidth * dwHeight * sizeof(DWORD) );
+    m_dwNumCommands = 0;
+    m_dwNumRefs     = 0;
+    m_bClear        = FALSE;
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CSoftDisplay::Resize()
+// Desc: Reallocates the frame and the tile lists for a new size, such as
+//       when the window is resized. The threads and the command queue are
+//       kept. Queued commands were clipped to the old size, so they go.
+//-----------------------------------------------------------------------------
+HRESULT CSoftDisplay::Resize( DWORD dwWidth, DWORD dwHeight )
+{
+    if( !IsCreated() )
+        return E_FAIL;
+    if( dwWidth == 0 || dwHeight == 0 )
+        return E_INVALIDARG;
+    if( dwWidth == m_dwWidth && dwHeight == m_dwHeight )
+        return S_OK;
+
+    DWORD dwTilesX = ( dwWidth  + SOFT_TILE_SIZE - 1 ) >> SOFT_TILE_SHIFT;
+    DWORD dwTilesY = ( dwHeight + SOFT_TILE_SIZE - 1 ) >> SOFT_TILE_SHIFT;
+    if( dwTilesX > SOFT_MAX_TILE_REFS )
+        return E_INVALIDARG;
+
+    DWORD* pdwFrame     = new DWORD[dwWidth * dwHeight];
+    DWORD* pdwTileStart = new DWORD[dwTilesX * dwTilesY + 1];
+    if( NULL == pdwFrame || NULL == pdwTileStart )
+    {
+        SAFE_DELETE_ARRAY( pdwFrame );
+        SAFE_DELETE_ARRAY( pdwTileStart );
+        return E_OUTOFMEMORY;
+    }
+
+    SAFE_DELETE_ARRAY( m_pdwFrame );
+    SAFE_DELETE_ARRAY( m_pdwTileStart );
+    m_pdwFrame     = pdwFrame;
+    m_pdwTileStart = pdwTileStart;
+
+    m_dwWidth    = dwWidth;
+    m_dwHeight   = dwHeight;
+    m_lPitch     = dwWidth * sizeof(DWORD);
+    m_dwTilesX   = dwTilesX;
+    m_dwTilesY   = dwTilesY;
+    m_dwNumTiles = dwTilesX * dwTilesY;
+
+    ZeroMemory( m_pdwFrame, dwWidth * dwHeight * sizeof(DWORD) );
+    m_dwNumCommands = 0;
+    m_dwNumRefs     = 0;
+    m_bClear        = FALSE;
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CSoftDisplay::Destroy()
+// Desc:
+//-----------------------------------------------------------------------------
+VOID CSoftDisplay::Destroy()
+{
+    m_Pool.Destroy();
+    m_Resampler.Destroy();
+
+    SAFE_DELETE_ARRAY( m_pdwFrame );
+    SAFE_DELETE_ARRAY( m_pCommands );
+    SAFE_DELETE_ARRAY( m_pdwTileStart );
+    SAFE_DELETE_ARRAY( m_pdwRefs );
+
+    m_dwWidth       = 0;
+    m_dwHeight      = 0;
+    m_dwNumTiles    = 0;
+    m_dwNumCommands = 0;
+    m_dwNumRefs     = 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CSoftDisplay::GetFrame()
+// Desc: The frame as an image, for capturing or scaling it elsewhere
+//-----------------------------------------------------------------------------
+VOID CSoftDisplay::GetFrame( RESAMPLE_IMAGE* pImage )
+{
+    pImage->pBits    = (BYTE*)m_pdwFrame;
+    pImage->lPitch   = m_lPitch;
+    pImage->dwWidth  = m_dwWidth;
+    pImage->dwHeight = m_dwHeight;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CSoftDisplay::Clear()
+// Desc: Drops everything queued, which it would cover, and has every tile
+//       cleared to dwColor before its commands are drawn
+//-----------------------------------------------------------------------------
+HRESULT CSoftDisplay::Clear( DWORD dwColor )
+{
+    if( !IsCreated() )
+        return E_POINTER;
+
+    m_dwNumCommands = 0;
+    m_dwNumRefs     = 0;
+    m_bClear        = TRUE;
+    m_dwClearColor  = dwColor;
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CSoftDisplay::FillRect()
+// Desc:
+//-----------------------------------------------------------------------------
+HRESULT CSoftDisplay::FillRect( const RECT* prc, DWORD dwColor )
+{
+    if( NULL == prc )
+        return E_INVALIDARG;
+
+    COMMAND command;
+    command.type    = softFill;
+    command.rcDest  = *prc;
+    command.dwColor = dwColor;
+    command.pSrc    = NULL;
+    command.lSrcX   = 0;
+    command.lSrcY   = 0;
+
+    return AddCommand( &command );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CSoftDisplay::Blt()
+// Desc: Queues a copy of prcSrc, or all of pSrc, with its top left at x, y
+//-----------------------------------------------------------------------------
+HRESULT CSoftDisplay::Blt( LONG x, LONG y, CSoftSurface* pSrc, const RECT* prcSrc )
+{
+    if( NULL == pSrc || NULL == pSrc->GetBits() )
+        return E_INVALIDARG;
+
+    RECT rcSrc;
+    SetRect( &rcSrc, 0, 0, pSrc->GetWidth(), pSrc->GetHeight() );
+    if( prcSrc )
+        IntersectRect( &rcSrc, &rcSrc, prcSrc );
+
+    COMMAND command;
+    command.type    = softBlt;
+    command.dwColor = 0;
+    command.pSrc    = pSrc;
+    command.lSrcX   = rcSrc.left;
+    command.lSrcY   = rcSrc.top;
+    SetRect( &command.rcDest, x, y, x + rcSrc.right - rcSrc.left, y + rcSrc.bottom - rcSrc.top );
+
+    return AddCommand( &command );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CSoftDisplay::AddCommand()
+// Desc: Clips a command to the frame and queues it, first drawing what is
+//       already queued if there isn't room
+//-----------------------------------------------------------------------------
+HRESULT CSoftDisplay::AddCommand( const COMMAND* pCommand )
+{
+    if( !IsCreated() )
+        return E_POINTER;
+
+    RECT rcFrame;
+    RECT rcDest;
+    SetRect( &rcFrame, 0, 0, m_dwWidth, m_dwHeight );
+    if( !IntersectRect( &rcDest, &pCommand->rcDest, &rcFrame ) )
+        return S_OK;
+
+    DWORD dwRefs = ( ( ( rcDest.right - 1 ) >> SOFT_TILE_SHIFT ) - ( rcDest.left >> SOFT_TILE_SHIFT ) + 1 ) *
+                   ( ( ( rcDest.bottom - 1 ) >> SOFT_TILE_SHIFT ) - ( rcDest.top >> SOFT_TILE_SHIFT ) + 1 );
+
+    if( m_dwNumCommands == SOFT_MAX_COMMANDS || m_dwNumRefs + dwRefs > SOFT_MAX_TILE_REFS )
+        Render();
+
+    // A fill bigger than the tile lists can hold is drawn in strips of
+    // whole tile rows. Each strip ends on a tile boundary, so one that
+    // starts part way into a tile still spans no more rows than fit.
+    if( dwRefs > SOFT_MAX_TILE_REFS )
+    {
+        COMMAND strip     = *pCommand;
+        LONG    lTileRows = SOFT_MAX_TILE_REFS / m_dwTilesX;
+        LONG    lNext;
+
+        for( LONG y = rcDest.top; y < rcDest.bottom; y = lNext )
+        {
+            lNext = ( ( y >> SOFT_TILE_SHIFT ) + lTileRows ) << SOFT_TILE_SHIFT;
+
+            strip.rcDest.top    = y;
+            strip.rcDest.bottom = min( lNext, rcDest.bottom );
+            strip.lSrcY         = pCommand->lSrcY + ( y - pCommand->rcDest.top );
+            AddCommand( &strip );
+        }
+
+        return S_OK;
+    }
+
+    COMMAND* pQueued = &m_pCommands[m_dwNumCommands++];
+    *pQueued = *pCommand;
+    pQueued->rcDest = rcDest;
+    pQueued->lSrcX += rcDest.left - pCommand->rcDest.left;
+    pQueued->lSrcY += rcDest.top - pCommand->rcDest.top;
+
+    m_dwNumRefs += dwRefs;
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CSoftDisplay::Render()
+// Desc: Bins the queued commands into tiles and draws the tiles across
+//       the pool
+//-----------------------------------------------------------------------------
+HRESULT CSoftDisplay::Render()
+{
+    if( !IsCreated() )
+        return E_POINTER;
+
+    if( m_dwNumCommands == 0 && !m_bClear )
+        return S_OK;
+
+    // Count each tile's commands, then turn the counts into starts
+    ZeroMemory( m_pdwTileStart, ( m_dwNumTiles + 1 ) * sizeof(DWORD) );
+
+    for( DWORD c = 0; c < m_dwNumCommands; c++ )
+    {
+        const RECT* prc = &m_pCommands[c].rcDest;
+        for( LONG ty = prc->top >> SOFT_TILE_SHIFT; ty <= ( prc->bottom - 1 ) >> SOFT_TILE_SHIFT; ty++ )
+        {
+            for( LONG tx = prc->left >> SOFT_TILE_SHIFT; tx <= ( prc->right - 1 ) >> SOFT_TILE_SHIFT; tx++ )
+                m_pdwTileStart[ty * m_dwTilesX + tx + 1]++;
+        }
+    }
+
+    for( DWORD t = 0; t < m_dwNumTiles; t++ )
+        m_pdwTileStart[t + 1] += m_pdwTileStart[t];
+
+    // Fill the lists in command order, moving each start along as it goes
+    // and then back again
+    for( DWORD c = 0; c < m_dwNumCommands; c++ )
+    {
+        const RECT* prc = &m_pCommands[c].rcDest;
+        for( LONG ty = prc->top >> SOFT_TILE_SHIFT; ty <= ( prc->bottom - 1 ) >> SOFT_TILE_SHIFT; ty++ )
+        {
+            for( LONG tx = prc->left >> SOFT_TILE_SHIFT; tx <= ( prc->right - 1 ) >> SOFT_TILE_SHIFT; tx++ )
+                m_pdwRefs[m_pdwTileStart[ty * m_dwTilesX + tx]++] = c;
+        }
+    }
+
+    for( DWORD t = m_dwNumTiles; t > 0; t-- )
+        m_pdwTileStart[t] = m_pdwTileStart[t - 1];
+    m_pdwTileStart[0] = 0;
+
+    // Clear the empty tiles first, each thread taking rows of them until
+    // there are none left
+    if( m_bClear )
+    {
+        m_lNextRow = 0;
+        m_Pool.Run( RowSlice, this, m_Pool.GetNumThreads() );
+    }
+
+    // One slice per thread; each takes tiles until there are none left
+    m_lNextTile = 0;
+    m_Pool.Run( TileSlice, this, m_Pool.GetNumThreads() );
+
+    m_dwNumCommands = 0;
+    m_dwNumRefs     = 0;
+    m_bClear        = FALSE;
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CSoftDisplay::RowSlice()
+// Desc: Run by each thread of the pool, clearing rows of tiles until there
+//       are none left
+//-----------------------------------------------------------------------------
+VOID CSoftDisplay::RowSlice( VOID* pContext, DWORD dwFirst, DWORD dwCount )
+{
+    CSoftDisplay* pThis = (CSoftDisplay*)pContext;
+
+    for( ;; )
+    {
+        DWORD dwRow = (DWORD)InterlockedIncrement( &pThis->m_lNextRow ) - 1;
+        if( dwRow >= pThis->m_dwTilesY )
+            return;
+
+        pThis->ClearRow( dwRow );
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CSoftDisplay::ClearRow()
+// Desc: Clears each run of tiles with no commands in a row of tiles as one
+//       rectangle. Streaming only pays for rows of a few kilobytes, so runs
+//       of SOFT_STREAM_TILES or more stream and shorter ones don't.
+//-----------------------------------------------------------------------------
+VOID CSoftDisplay::ClearRow( DWORD dwRow )
+{
+    const DWORD* pdwStart = m_pdwTileStart + dwRow * m_dwTilesX;
+    LONG         lTop     = dwRow << SOFT_TILE_SHIFT;
+    LONG         lBottom  = min( lTop + SOFT_TILE_SIZE, (LONG)m_dwHeight );
+    DWORD        tx       = 0;
+
+    while( tx < m_dwTilesX )
+    {
+        if( pdwStart[tx] != pdwStart[tx + 1] )
+        {
+            tx++;
+            continue;
+        }
+
+        DWORD dwRunStart = tx;
+        while( tx < m_dwTilesX && pdwStart[tx] == pdwStart[tx + 1] )
+            tx++;
+
+        LONG lLeft  = dwRunStart << SOFT_TILE_SHIFT;
+        LONG lRight = min( (LONG)( tx << SOFT_TILE_SHIFT ), (LONG)m_dwWidth );
+
+        Fill_Rect( (BYTE*)m_pdwFrame + lTop * m_lPitch + lLeft * sizeof(DWORD), m_lPitch, 32,
+                   lRight - lLeft, lBottom - lTop, m_dwClearColor,
+                   ( tx - dwRunStart >= SOFT_STREAM_TILES ) ? fillStream : fillCached );
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CSoftDisplay::TileSlice()
+// Desc: Run by each thread of the pool, drawing tiles one at a time until
+//       there are none left, so a few busy tiles don't hold the rest up
+//-----------------------------------------------------------------------------
+VOID CSoftDisplay::TileSlice( VOID* pContext, DWORD dwFirst, DWORD dwCount )
+{
+    CSoftDisplay* pThis = (CSoftDisplay*)pContext;
+
+    for( ;; )
+    {
+        DWORD dwTile = (DWORD)InterlockedIncrement( &pThis->m_lNextTile ) - 1;
+        if( dwTile >= pThis->m_dwNumTiles )
+            return;
+
+        pThis->DrawTile( dwTile );
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CSoftDisplay::DrawTile()
+// Desc: Clears a tile if the frame was cleared, then runs its commands in
+//       order, each clipped to the tile. Empty tiles were cleared by
+//       ClearRow().
+//-----------------------------------------------------------------------------
+VOID CSoftDisplay::DrawTile( DWORD dwTile )
+{
+    DWORD dwFirst = m_pdwTileStart[dwTile];
+    DWORD dwLast  = m_pdwTileStart[dwTile + 1];
+
+    if( dwFirst == dwLast )
+        return;
+
+    RECT rcTile;
+    rcTile.left   = ( dwTile % m_dwTilesX ) << SOFT_TILE_SHIFT;
+    rcTile.top    = ( dwTile / m_dwTilesX ) << SOFT_TILE_SHIFT;
+    rcTile.right  = min( rcTile.left + SOFT_TILE_SIZE, (LONG)m_dwWidth );
+    rcTile.bottom = min( rcTile.top + SOFT_TILE_SIZE, (LONG)m_dwHeight );
+
+    // The tile is drawn over straight away, so its clear stays in cache
+    if( m_bClear )
+    {
+        Fill_Rect( (BYTE*)m_pdwFrame + rcTile.top * m_lPitch + rcTile.left * sizeof(DWORD), m_lPitch, 32,
+                   rcTile.right - rcTile.left, rcTile.bottom - rcTile.top, m_dwClearColor, fillCached );
+    }
+
+    for( DWORD r = dwFirst; r < dwLast; r++ )
+    {
+        const COMMAND* pCommand = &m_pCommands[m_pdwRefs[r]];
+        RECT           rc;
+
+        IntersectRect( &rc, &pCommand->rcDest, &rcTile );
+
+        DWORD dwCount = rc.right - rc.left;
+
+        if( pCommand->type == softFill )
+        {
+            Fill_Rect( (BYTE*)m_pdwFrame + rc.top * m_lPitch + rc.left * sizeof(DWORD), m_lPitch, 32,
+                       dwCount, rc.bottom - rc.top, pCommand->dwColor, fillCached );
+            continue;
+        }
+
+        for( LONG y = rc.top; y < rc.bottom; y++ )
+        {
+            DWORD* pdwDest = (DWORD*)( (BYTE*)m_pdwFrame + y * m_lPitch ) + rc.left;
+
+            CSoftSurface* pSrc    = pCommand->pSrc;
+            LONG          lSrcY   = pCommand->lSrcY + ( y - pCommand->rcDest.top );
+            LONG          lSrcX   = pCommand->lSrcX + ( rc.left - pCommand->rcDest.left );
+            const DWORD*  pdwSrc  = (const DWORD*)( (const BYTE*)pSrc->GetBits() + lSrcY * pSrc->GetPitch() ) + lSrcX;
+
+            if( pSrc->IsPremultiplied() )
+                Blit_BlendRow( pdwDest, pdwSrc, dwCount );
+            else if( pSrc->IsColorKeyed() )
+                Blit_ColorKeyRow( pdwDest, pdwSrc, dwCount, pSrc->GetColorKey() );
+            else
+                memcpy( pdwDest, pdwSrc, dwCount * sizeof(DWORD) );
+        }
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CSoftDisplay::Present()
+// Desc: Draws anything still queued and puts the frame in the display's
+//       back buffer, copying it if they are the same size and scaling it
+//       across the pool if not. The back buffer must be 32 bits a pixel.
+//-----------------------------------------------------------------------------
+HRESULT CSoftDisplay::Present( CDisplay* pDisplay, ResampleFilter filter )
+{
+    HRESULT              hr;
+    LPDIRECTDRAWSURFACE7 pddsBack = pDisplay ? pDisplay->GetBackBuffer() : NULL;
+
+    if( NULL == pddsBack )
+        return E_POINTER;
+
+    if( FAILED( hr = Render() ) )
+        return hr;
+
+    DDSURFACEDESC2 ddsd;
+    ZeroMemory( &ddsd, sizeof(ddsd) );
+    ddsd.dwSize = sizeof(ddsd);
+    pddsBack->GetSurfaceDesc( &ddsd );
+
+    if( ddsd.ddpfPixelFormat.dwRGBBitCount != 32 )
+        return E_NOTIMPL;
+
+    BOOL bSameSize = ddsd.dwWidth == m_dwWidth && ddsd.dwHeight == m_dwHeight;
+    if( !bSameSize && !m_Resampler.Matches( m_dwWidth, m_dwHeight, ddsd.dwWidth, ddsd.dwHeight, filter ) )
+    {
+        if( FAILED( hr = m_Resampler.Create( m_dwWidth, m_dwHeight, ddsd.dwWidth, ddsd.dwHeight,
+                                             filter, m_Pool.GetNumThreads() ) ) )
+            return hr;
+    }
+
+    if( FAILED( hr = pddsBack->Lock( NULL, &ddsd, DDLOCK_WAIT | DDLOCK_WRITEONLY, NULL ) ) )
+        return hr;
+
+    RESAMPLE_IMAGE src;
+    RESAMPLE_IMAGE dest;
+    GetFrame( &src );
+    dest.pBits    = (BYTE*)ddsd.lpSurface;
+    dest.lPitch   = ddsd.lPitch;
+    dest.dwWidth  = ddsd.dwWidth;
+    dest.dwHeight = ddsd.dwHeight;
+
+    if( bSameSize )
+    {
+        for( DWORD y = 0; y < m_dwHeight; y++ )
+            memcpy( dest.pBits + y * dest.lPitch, src.pBits + y * src.lPitch, m_dwWidth * sizeof(DWORD) );
+    }
+    else
+    {
+        hr = m_Resampler.Run( &dest, &src, &m_Pool );
+    }
+
+    pddsBack->Unlock( NULL );
+
+    return hr;
+}
@@ -0,0 +1,178 @@
+//-----------------------------------------------------------------------------
+// File: softdisplay.h
+//
+// Desc: A display drawn by the processor into a 32 bit frame in memory,
+//       for frames too big for the card to blt quickly or that have to be
+//       drawn more than once, such as a 4K or 8K buffer. Clear(), FillRect()
+//       and Blt() only queue commands. Render() sorts them into the
+//       SOFT_TILE_SIZE square tiles they touch, then each thread of a pool
+//       takes the next tile to draw until there are none left. A tile
+//       stays in the processor's cache while every command on it runs, and
+//       no two threads write the same pixels, so it scales with cores.
+//
+//       Clear() throws away what was queued before it, as it would all be
+//       drawn over. Each tile with commands clears itself before they run,
+//       and the empty tiles are cleared first, a row at a time, with long
+//       runs of them streamed past the caches as nothing reads them until
+//       Present().
+//
+//       Present() copies the frame into a CDisplay's back buffer, scaling
+//       it with a CResampler if their sizes differ, so the usual flip or
+//       blt shows it.
+//-----------------------------------------------------------------------------
+#ifndef SOFTDISPLAY_H
+#define SOFTDISPLAY_H
+
+#include "ddutil.h"
+#include "resample.h"
+#include "threadpool.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+#define SOFT_TILE_SIZE          64          // Pixels each way, a power of 2
+#define SOFT_TILE_SHIFT         6
+#define SOFT_MAX_COMMANDS       16384       // Queued before Render() is forced
+#define SOFT_MAX_TILE_REFS      262144      // Commands on tiles, counting each tile
+#define SOFT_STREAM_TILES       16          // Empty tiles in a row that clear by streaming
+
+enum SoftCommandType { softFill, softBlt };
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: class CSoftSurface
+// Desc: A 32 bit image in memory to blt from, such as a sprite. It can be
+//       copied from a CSurface, so sprites are loaded the usual way first.
+//       Premultiplied surfaces are blended by their alpha, others copied
+//       with or without a colour key.
+//-----------------------------------------------------------------------------
+class CSoftSurface
+{
+    DWORD*  m_pdwBits;
+    LONG    m_lPitch;                   // In bytes
+    DWORD   m_dwWidth;
+    DWORD   m_dwHeight;
+    BOOL    m_bColorKeyed;
+    DWORD   m_dwColorKey;
+    BOOL    m_bPremultiplied;           // Alpha in the top byte, colours scaled by it
+
+    CSoftSurface( const CSoftSurface& );
+    CSoftSurface& operator=( const CSoftSurface& );
+
+public:
+    CSoftSurface();
+    ~CSoftSurface();
+
+    HRESULT Create( DWORD dwWidth, DWORD dwHeight );
+    HRESULT CopyFrom( CSurface* pSurface );
+    VOID    Destroy();
+
+    VOID    SetColorKey( DWORD dwColorKey ) { m_bColorKeyed = TRUE; m_dwColorKey = dwColorKey; }
+    VOID    SetPremultiplied( BOOL bPremultiplied ) { m_bPremultiplied = bPremultiplied; }
+
+    DWORD*  GetBits()           { return m_pdwBits; }
+    LONG    GetPitch()          { return m_lPitch; }
+    DWORD   GetWidth()          { return m_dwWidth; }
+    DWORD   GetHeight()         { return m_dwHeight; }
+    BOOL    IsColorKeyed()      { return m_bColorKeyed; }
+    DWORD   GetColorKey()       { return m_dwColorKey; }
+    BOOL    IsPremultiplied()   { return m_bPremultiplied; }
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: class CSoftDisplay
+// Desc: The frame, the queued commands and the tiles' lists of them. All
+//       memory and threads are set up by Create(); nothing is allocated
+//       while drawing, and Present() only allocates when the back buffer
+//       changes size.
+//-----------------------------------------------------------------------------
+class CSoftDisplay
+{
+    // A command, already clipped to the frame. Blts read from pSrc at
+    // ( lSrcX, lSrcY ) for the top left of rcDest.
+    struct COMMAND
+    {
+        SoftCommandType type;
+        RECT            rcDest;
+        DWORD           dwColor;
+        CSoftSurface*   pSrc;
+        LONG            lSrcX;
+        LONG            lSrcY;
+    };
+
+    DWORD*          m_pdwFrame;
+    LONG            m_lPitch;           // In bytes
+    DWORD           m_dwWidth;
+    DWORD           m_dwHeight;
+    DWORD           m_dwTilesX;
+    DWORD           m_dwTilesY;
+    DWORD           m_dwNumTiles;
+
+    COMMAND*        m_pCommands;
+    DWORD           m_dwNumCommands;
+    DWORD           m_dwNumRefs;        // Tiles touched by the queued commands
+    BOOL            m_bClear;           // Clear the tiles first
+    DWORD           m_dwClearColor;
+
+    // Tile t's commands are m_pdwRefs[m_pdwTileStart[t]] up to
+    // m_pdwRefs[m_pdwTileStart[t + 1]], in the order they were queued
+    DWORD*          m_pdwTileStart;
+    DWORD*          m_pdwRefs;
+
+    CThreadPool     m_Pool;
+    volatile LONG   m_lNextRow;         // Next row of tiles for a thread to clear
+    volatile LONG   m_lNextTile;        // Next tile for a thread to take
+    CResampler      m_Resampler;        // For Present() to another size
+
+    HRESULT AddCommand( const COMMAND* pCommand );
+    VOID    ClearRow( DWORD dwRow );
+    VOID    DrawTile( DWORD dwTile );
+
+    static VOID RowSlice( VOID* pContext, DWORD dwFirst, DWORD dwCount );
+    static VOID TileSlice( VOID* pContext, DWORD dwFirst, DWORD dwCount );
+
+    CSoftDisplay( const CSoftDisplay& );
+    CSoftDisplay& operator=( const CSoftDisplay& );
+
+public:
+    CSoftDisplay();
+    ~CSoftDisplay();
+
+    // dwNumThreads of 0 uses one thread per processor
+    HRESULT Create( DWORD dwWidth, DWORD dwHeight, DWORD dwNumThreads );
+    VOID    Destroy();
+
+    // A new frame size, keeping the threads. Anything queued is dropped.
+    HRESULT Resize( DWORD dwWidth, DWORD dwHeight );
+
+    // Queue drawing, clipped to the frame. Blt() colour keys if pSrc has a
+    // key, and takes all of pSrc if prcSrc is NULL.
+    HRESULT Clear( DWORD dwColor = 0L );
+    HRESULT FillRect( const RECT* prc, DWORD dwColor );
+    HRESULT Blt( LONG x, LONG y, CSoftSurface* pSrc, const RECT* prcSrc = NULL );
+
+    // Draws everything queued
+    HRESULT Render();
+
+    // Renders, then copies or scales the frame into a 32 bit back buffer
+    HRESULT Present( CDisplay* pDisplay, ResampleFilter filter = resampleBilinear );
+
+    BOOL    IsCreated()         { return m_pdwFrame != NULL; }
+    DWORD   GetWidth()          { return m_dwWidth; }
+    DWORD   GetHeight()         { return m_dwHeight; }
+    DWORD   GetNumThreads()     { return m_Pool.GetNumThreads(); }
+    VOID    GetFrame( RESAMPLE_IMAGE* pImage );
+};
+
+
+
+
+#endif // SOFTDISPLAY_H
@@ -0,0 +1,203 @@
+//-----------------------------------------------------------------------------
+// File: threadpool.cpp
+//
+// Desc: The worker thread pool
+//-----------------------------------------------------------------------------
+#define STRICT
+#include <windows.h>
+#include "threadpool.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CThreadPool::CThreadPool()
+// Desc:
+//-----------------------------------------------------------------------------
+CThreadPool::CThreadPool()
+{
+    m_dwNumThreads = 0;
+    m_hDone        = NULL;
+    m_lPending     = 0;
+    m_lStop        = 0;
+    m_pfnSlice     = NULL;
+    m_pContext     = NULL;
+    m_dwCount      = 0;
+    ZeroMemory( m_aWorkers, sizeof(m_aWorkers) );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CThreadPool::~CThreadPool()
+// Desc:
+//-----------------------------------------------------------------------------
+CThreadPool::~CThreadPool()
+{
+    Destroy();
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CThreadPool::Create()
+// Desc: Starts dwNumThreads - 1 workers, the calling thread making up the
+//       last one
+//-----------------------------------------------------------------------------
+HRESULT CThreadPool::Create( DWORD dwNumThreads )
+{
+    Destroy();
+
+    if( dwNumThreads == 0 )
+    {
+        SYSTEM_INFO si;
+        GetSystemInfo( &si );
+        dwNumThreads = si.dwNumberOfProcessors;
+    }
+
+    if( dwNumThreads > THREADPOOL_MAX_THREADS )
+        dwNumThreads = THREADPOOL_MAX_THREADS;
+
+    m_dwNumThreads = 1;
+    m_lStop        = 0;
+
+    if( dwNumThreads > 1 )
+    {
+        if( NULL == ( m_hDone = CreateEvent( NULL, FALSE, FALSE, NULL ) ) )
+        {
+            Destroy();
+            return E_FAIL;
+        }
+
+        for( DWORD i = 1; i < dwNumThreads; i++ )
+        {
+            WORKER* pWorker = &m_aWorkers[i];
+
+            pWorker->pPool   = this;
+            pWorker->dwIndex = i;
+            pWorker->hStart  = CreateEvent( NULL, FALSE, FALSE, NULL );
+            pWorker->hThread = pWorker->hStart ? CreateThread( NULL, 0, WorkerThread, pWorker, 0, NULL ) : NULL;
+            if( NULL == pWorker->hThread )
+            {
+                if( pWorker->hStart )
+                    CloseHandle( pWorker->hStart );
+                pWorker->hStart = NULL;
+                Destroy();
+                return E_FAIL;
+            }
+
+            m_dwNumThreads++;
+        }
+    }
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CThreadPool::Destroy()
+// Desc: Stops the workers
+//-----------------------------------------------------------------------------
+VOID CThreadPool::Destroy()
+{
+    InterlockedExchange( &m_lStop, 1 );
+
+    for( DWORD i = 1; i < m_dwNumThreads; i++ )
+    {
+        WORKER* pWorker = &m_aWorkers[i];
+
+        SetEvent( pWorker->hStart );
+        WaitForSingleObject( pWorker->hThread, INFINITE );
+        CloseHandle( pWorker->hThread );
+        CloseHandle( pWorker->hStart );
+    }
+
+    ZeroMemory( m_aWorkers, sizeof(m_aWorkers) );
+    m_dwNumThreads = 0;
+
+    if( m_hDone )
+    {
+        CloseHandle( m_hDone );
+        m_hDone = NULL;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CThreadPool::Run()
+// Desc: Calls pfnSlice for every slice of dwCount items and waits for them
+//       all. Fewer items than threads leaves some threads with nothing.
+//-----------------------------------------------------------------------------
+VOID CThreadPool::Run( SLICEFN pfnSlice, VOID* pContext, DWORD dwCount )
+{
+    m_pfnSlice = pfnSlice;
+    m_pContext = pContext;
+    m_dwCount  = dwCount;
+
+    if( m_dwNumThreads > 1 )
+    {
+        // SetEvent() is a full barrier, so the workers see the arguments
+        InterlockedExchange( &m_lPending, (LONG)( m_dwNumThreads - 1 ) );
+        for( DWORD i = 1; i < m_dwNumThreads; i++ )
+            SetEvent( m_aWorkers[i].hStart );
+    }
+
+    RunSlice( 0 );
+
+    if( m_dwNumThreads > 1 )
+        WaitForSingleObject( m_hDone, INFINITE );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CThreadPool::RunSlice()
+// Desc: Works out slice dwIndex, sharing the items out as evenly as
+//       possible with the first few slices taking one extra each
+//-----------------------------------------------------------------------------
+VOID CThreadPool::RunSlice( DWORD dwIndex )
+{
+    DWORD dwNumThreads = m_dwNumThreads ? m_dwNumThreads : 1;
+    DWORD dwBase       = m_dwCount / dwNumThreads;
+    DWORD dwExtra      = m_dwCount % dwNumThreads;
+    DWORD dwFirst      = dwIndex * dwBase + min( dwIndex, dwExtra );
+    DWORD dwCount      = dwBase + ( dwIndex < dwExtra ? 1 : 0 );
+
+    if( dwCount )
+        m_pfnSlice( m_pContext, dwFirst, dwCount );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CThreadPool::WorkerThread()
+// Desc: Waits to be started, runs its slice, and signals the done event if
+//       it is the last worker to finish
+//-----------------------------------------------------------------------------
+DWORD WINAPI CThreadPool::WorkerThread( LPVOID pParam )
+{
+    WORKER*      pWorker = (WORKER*)pParam;
+    CThreadPool* pPool   = pWorker->pPool;
+
+    while( 1 )
+    {
+        WaitForSingleObject( pWorker->hStart, INFINITE );
+        if( pPool->m_lStop )
+            break;
+
+        pPool->RunSlice( pWorker->dwIndex );
+
+        if( 0 == InterlockedDecrement( &pPool->m_lPending ) )
+            SetEvent( pPool->m_hDone );
+    }
+
+    return 0;
+}
@@ -0,0 +1,76 @@
+//-----------------------------------------------------------------------------
+// File: threadpool.h
+//
+// Desc: A fixed set of worker threads for splitting a loop over many
+//       independent items, such as games, across every processor. Run()
+//       cuts the items into one contiguous slice per thread, the calling
+//       thread doing the first slice itself, and returns once every slice
+//       is done. Nothing is allocated after Create().
+//-----------------------------------------------------------------------------
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+#define THREADPOOL_MAX_THREADS  64
+
+// Called once per slice with the items it should handle
+typedef VOID (*SLICEFN)( VOID* pContext, DWORD dwFirst, DWORD dwCount );
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: class CThreadPool
+// Desc: Each worker waits on its own start event, and the last one to
+//       finish a Run() sets the done event, so a Run() costs two event
+//       signals per worker however many items there are
+//-----------------------------------------------------------------------------
+class CThreadPool
+{
+    struct WORKER
+    {
+        CThreadPool* pPool;
+        DWORD        dwIndex;
+        HANDLE       hThread;
+        HANDLE       hStart;
+    };
+
+    WORKER          m_aWorkers[THREADPOOL_MAX_THREADS];
+    DWORD           m_dwNumThreads;     // Including the calling thread
+    HANDLE          m_hDone;
+    volatile LONG   m_lPending;
+    volatile LONG   m_lStop;
+
+    // The Run() in progress, read by the workers
+    SLICEFN         m_pfnSlice;
+    VOID*           m_pContext;
+    DWORD           m_dwCount;
+
+    static DWORD WINAPI WorkerThread( LPVOID pParam );
+    VOID    RunSlice( DWORD dwIndex );
+
+    CThreadPool( const CThreadPool& );
+    CThreadPool& operator=( const CThreadPool& );
+
+public:
+    CThreadPool();
+    ~CThreadPool();
+
+    // dwNumThreads of 0 uses one thread per processor
+    HRESULT Create( DWORD dwNumThreads );
+    VOID    Destroy();
+
+    VOID    Run( SLICEFN pfnSlice, VOID* pContext, DWORD dwCount );
+
+    DWORD   GetNumThreads()     { return m_dwNumThreads; }
+};
+
+
+
+
+#endif // THREADPOOL_H
@@ -0,0 +1,487 @@
+//-----------------------------------------------------------------------------
+// File: trails.cpp
+//
+// Desc: The trails. Fading multiplies every byte of a pixel by the same
+//       factor, which keeps the colours premultiplied, and rounds down so
+//       every pixel reaches zero and its tile can leave the live list. The
+//       factor for each whole millisecond comes from a table made once in
+//       Create(), to 16 bits so short steps at high frame rates keep their
+//       precision.
+//-----------------------------------------------------------------------------
+#define STRICT
+#include <windows.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <ddraw.h>
+#include <emmintrin.h>
+#include "dxutil.h"
+#include "trails.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: DecayRow()
+// Desc: Scales each byte of dwCount pixels by dwFactor / 65536, returning
+//       whether any of them are still lit
+//-----------------------------------------------------------------------------
+static BOOL DecayRow( DWORD* pdwRow, DWORD dwCount, DWORD dwFactor )
+{
+    const __m128i xZero   = _mm_setzero_si128();
+    const __m128i xFactor = _mm_set1_epi16( (short)dwFactor );
+    __m128i       xLit    = xZero;
+    DWORD         i       = 0;
+
+    for( ; i + 4 <= dwCount; i += 4 )
+    {
+        __m128i xPixels = _mm_loadu_si128( (const __m128i*)( pdwRow + i ) );
+        __m128i xLo     = _mm_mulhi_epu16( _mm_unpacklo_epi8( xPixels, xZero ), xFactor );
+        __m128i xHi     = _mm_mulhi_epu16( _mm_unpackhi_epi8( xPixels, xZero ), xFactor );
+
+        xPixels = _mm_packus_epi16( xLo, xHi );
+        _mm_storeu_si128( (__m128i*)( pdwRow + i ), xPixels );
+        xLit = _mm_or_si128( xLit, xPixels );
+    }
+
+    BOOL bLit = _mm_movemask_epi8( _mm_cmpeq_epi8( xLit, xZero ) ) != 0xFFFF;
+
+    for( ; i < dwCount; i++ )
+    {
+        DWORD dwResult = 0;
+        for( DWORD dwShift = 0; dwShift < 32; dwShift += 8 )
+            dwResult |= ( ( ( ( pdwRow[i] >> dwShift ) & 0xFF ) * dwFactor ) >> 16 ) << dwShift;
+
+        pdwRow[i] = dwResult;
+        bLit     |= ( dwResult != 0 );
+    }
+
+    return bLit;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: MaxRow()
+// Desc: Keeps the larger of each byte of the two rows in pdwDest
+//-----------------------------------------------------------------------------
+static VOID MaxRow( DWORD* pdwDest, const DWORD* pdwSrc, DWORD dwCount )
+{
+    DWORD i = 0;
+
+    for( ; i + 4 <= dwCount; i += 4 )
+    {
+        __m128i xDest = _mm_loadu_si128( (const __m128i*)( pdwDest + i ) );
+        __m128i xSrc  = _mm_loadu_si128( (const __m128i*)( pdwSrc + i ) );
+        _mm_storeu_si128( (__m128i*)( pdwDest + i ), _mm_max_epu8( xDest, xSrc ) );
+    }
+
+    for( ; i < dwCount; i++ )
+    {
+        DWORD dwResult = 0;
+        for( DWORD dwShift = 0; dwShift < 32; dwShift += 8 )
+            dwResult |= max( ( pdwDest[i] >> dwShift ) & 0xFF, ( pdwSrc[i] >> dwShift ) & 0xFF ) << dwShift;
+        pdwDest[i] = dwResult;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CTrails::CTrails()
+// Desc:
+//-----------------------------------------------------------------------------
+CTrails::CTrails()
+{
+    m_dwDecay    = TRAIL_DECAY_DEFAULT;
+    m_fPending   = 0.0f;
+    m_dwTilesX   = 0;
+    m_dwTilesY   = 0;
+    m_pbLive     = NULL;
+    m_pdwLive    = NULL;
+    m_dwNumLive  = 0;
+    m_bFollowing = FALSE;
+    m_ptLast.x   = 0;
+    m_ptLast.y   = 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CTrails::~CTrails()
+// Desc:
+//-----------------------------------------------------------------------------
+CTrails::~CTrails()
+{
+    Destroy();
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CTrails::Create()
+// Desc: Makes an empty buffer the size of the view and the fade for each
+//       whole millisecond, ( dwDecay / 256 ) ^ ( seconds * 60 ). There is
+//       nothing to stamp until SetSprite().
+//-----------------------------------------------------------------------------
+HRESULT CTrails::Create( DWORD dwWidth, DWORD dwHeight, DWORD dwDecay )
+{
+    if( dwDecay == 0 || dwDecay > 255 )
+        return E_INVALIDARG;
+
+    m_dwDecay = dwDecay;
+
+    for( DWORD i = 0; i <= TRAIL_DECAY_MAX_MS; i++ )
+    {
+        double fFactor = pow( dwDecay / 256.0, i * 60.0 / 1000.0 ) * 65536.0;
+        m_adwFactor[i] = (DWORD)min( fFactor + 0.5, 65535.0 );
+    }
+
+    return Resize( dwWidth, dwHeight );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CTrails::Destroy()
+// Desc:
+//-----------------------------------------------------------------------------
+VOID CTrails::Destroy()
+{
+    m_Buffer.Destroy();
+    m_Sprite.Destroy();
+    SAFE_DELETE_ARRAY( m_pbLive );
+    SAFE_DELETE_ARRAY( m_pdwLive );
+
+    m_dwTilesX   = 0;
+    m_dwTilesY   = 0;
+    m_dwNumLive  = 0;
+    m_bFollowing = FALSE;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CTrails::Resize()
+// Desc: Reallocates the buffer and tile lists for a new view size, keeping
+//       the sprite and decay
+//-----------------------------------------------------------------------------
+HRESULT CTrails::Resize( DWORD dwWidth, DWORD dwHeight )
+{
+    HRESULT hr;
+
+    SAFE_DELETE_ARRAY( m_pbLive );
+    SAFE_DELETE_ARRAY( m_pdwLive );
+    m_dwNumLive  = 0;
+    m_bFollowing = FALSE;
+    m_fPending   = 0.0f;
+
+    if( FAILED( hr = m_Buffer.Create( dwWidth, dwHeight ) ) )
+        return hr;
+
+    m_Buffer.SetPremultiplied( TRUE );
+
+    m_dwTilesX = ( dwWidth + TRAIL_TILE_SIZE - 1 ) >> TRAIL_TILE_SHIFT;
+    m_dwTilesY = ( dwHeight + TRAIL_TILE_SIZE - 1 ) >> TRAIL_TILE_SHIFT;
+
+    DWORD dwNumTiles = m_dwTilesX * m_dwTilesY;
+    m_pbLive  = new BYTE[dwNumTiles];
+    m_pdwLive = new DWORD[dwNumTiles];
+    if( NULL == m_pbLive || NULL == m_pdwLive )
+    {
+        Destroy();
+        return E_OUTOFMEMORY;
+    }
+
+    ZeroMemory( m_pbLive, dwNumTiles );
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CTrails::SetSprite()
+// Desc: Copies the ball from a 32 bit surface
+//-----------------------------------------------------------------------------
+HRESULT CTrails::SetSprite( CSurface* pSurface )
+{
+    HRESULT hr;
+
+    if( FAILED( hr = m_Sprite.CopyFrom( pSurface ) ) )
+        return hr;
+
+    return MakeStamp();
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CTrails::SetSprite()
+// Desc: Copies the ball from a 32 bit image in memory
+//-----------------------------------------------------------------------------
+HRESULT CTrails::SetSprite( CSoftSurface* pSprite )
+{
+    HRESULT hr;
+
+    if( NULL == pSprite || NULL == pSprite->GetBits() )
+        return E_INVALIDARG;
+
+    if( FAILED( hr = m_Sprite.Create( pSprite->GetWidth(), pSprite->GetHeight() ) ) )
+        return hr;
+
+    const BYTE* pbSrc  = (const BYTE*)pSprite->GetBits();
+    BYTE*       pbDest = (BYTE*)m_Sprite.GetBits();
+    for( DWORD y = 0; y < m_Sprite.GetHeight(); y++ )
+    {
+        memcpy( pbDest, pbSrc, m_Sprite.GetWidth() * sizeof(DWORD) );
+        pbSrc  += pSprite->GetPitch();
+        pbDest += m_Sprite.GetPitch();
+    }
+
+    if( pSprite->IsPremultiplied() )
+        m_Sprite.SetPremultiplied( TRUE );
+    else if( pSprite->IsColorKeyed() )
+        m_Sprite.SetColorKey( pSprite->GetColorKey() );
+
+    return MakeStamp();
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CTrails::MakeStamp()
+// Desc: Turns the copied sprite into premultiplied pixels, opaque except
+//       where it has its colour key, unless it was premultiplied already
+//-----------------------------------------------------------------------------
+HRESULT CTrails::MakeStamp()
+{
+    if( m_Sprite.IsPremultiplied() )
+        return S_OK;
+
+    BOOL  bColorKeyed = m_Sprite.IsColorKeyed();
+    DWORD dwColorKey  = m_Sprite.GetColorKey() & BLIT_COLOR_MASK;
+
+    BYTE* pbRow = (BYTE*)m_Sprite.GetBits();
+    for( DWORD y = 0; y < m_Sprite.GetHeight(); y++ )
+    {
+        DWORD* pdwRow = (DWORD*)pbRow;
+        for( DWORD x = 0; x < m_Sprite.GetWidth(); x++ )
+        {
+            DWORD dwColor = pdwRow[x] & BLIT_COLOR_MASK;
+            pdwRow[x] = ( bColorKeyed && dwColor == dwColorKey ) ? 0 : ( 0xFF000000 | dwColor );
+        }
+        pbRow += m_Sprite.GetPitch();
+    }
+
+    m_Sprite.SetPremultiplied( TRUE );
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CTrails::GetTileRect()
+// Desc: The pixels of a tile, cut short at the right and bottom edges
+//-----------------------------------------------------------------------------
+VOID CTrails::GetTileRect( DWORD dwTile, RECT* prc )
+{
+    prc->left   = ( dwTile % m_dwTilesX ) << TRAIL_TILE_SHIFT;
+    prc->top    = ( dwTile / m_dwTilesX ) << TRAIL_TILE_SHIFT;
+    prc->right  = min( prc->left + TRAIL_TILE_SIZE, (LONG)m_Buffer.GetWidth() );
+    prc->bottom = min( prc->top + TRAIL_TILE_SIZE, (LONG)m_Buffer.GetHeight() );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CTrails::Decay()
+// Desc: Fades each live tile by the time saved up, in whole milliseconds,
+//       dropping the ones that have gone black by swapping the last live
+//       tile into their place
+//-----------------------------------------------------------------------------
+VOID CTrails::Decay( FLOAT fTimeDelta )
+{
+    m_fPending += fTimeDelta;
+
+    DWORD dwMs = (DWORD)( m_fPending * 1000.0f );
+    if( dwMs < TRAIL_DECAY_MIN_MS )
+        return;
+
+    if( dwMs > TRAIL_DECAY_MAX_MS )
+    {
+        dwMs       = TRAIL_DECAY_MAX_MS;
+        m_fPending = 0.0f;
+    }
+    else
+        m_fPending -= dwMs / 1000.0f;
+
+    DWORD dwFactor = m_adwFactor[dwMs];
+    DWORD i        = 0;
+
+    while( i < m_dwNumLive )
+    {
+        RECT rc;
+        GetTileRect( m_pdwLive[i], &rc );
+
+        BOOL  bLit  = FALSE;
+        BYTE* pbRow = (BYTE*)m_Buffer.GetBits() + rc.top * m_Buffer.GetPitch() + rc.left * sizeof(DWORD);
+        for( LONG y = rc.top; y < rc.bottom; y++ )
+        {
+            bLit  |= DecayRow( (DWORD*)pbRow, rc.right - rc.left, dwFactor );
+            pbRow += m_Buffer.GetPitch();
+        }
+
+        if( bLit )
+        {
+            i++;
+            continue;
+        }
+
+        m_pbLive[m_pdwLive[i]] = 0;
+        m_pdwLive[i] = m_pdwLive[--m_dwNumLive];
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CTrails::Stamp()
+// Desc: Merges the sprite into the buffer, clipped to it, and puts the
+//       tiles it lands on in the live list
+//-----------------------------------------------------------------------------
+VOID CTrails::Stamp( LONG x, LONG y )
+{
+    if( NULL == m_pbLive || NULL == m_Sprite.GetBits() )
+        return;
+
+    RECT rcDest;
+    rcDest.left   = max( x, 0L );
+    rcDest.top    = max( y, 0L );
+    rcDest.right  = min( x + (LONG)m_Sprite.GetWidth(), (LONG)m_Buffer.GetWidth() );
+    rcDest.bottom = min( y + (LONG)m_Sprite.GetHeight(), (LONG)m_Buffer.GetHeight() );
+    if( rcDest.left >= rcDest.right || rcDest.top >= rcDest.bottom )
+        return;
+
+    const BYTE* pbSrc  = (const BYTE*)m_Sprite.GetBits() + ( rcDest.top - y ) * m_Sprite.GetPitch() +
+                         ( rcDest.left - x ) * sizeof(DWORD);
+    BYTE*       pbDest = (BYTE*)m_Buffer.GetBits() + rcDest.top * m_Buffer.GetPitch() +
+                         rcDest.left * sizeof(DWORD);
+    for( LONG row = rcDest.top; row < rcDest.bottom; row++ )
+    {
+        MaxRow( (DWORD*)pbDest, (const DWORD*)pbSrc, rcDest.right - rcDest.left );
+        pbSrc  += m_Sprite.GetPitch();
+        pbDest += m_Buffer.GetPitch();
+    }
+
+    for( LONG ty = rcDest.top >> TRAIL_TILE_SHIFT; ty <= ( rcDest.bottom - 1 ) >> TRAIL_TILE_SHIFT; ty++ )
+    {
+        for( LONG tx = rcDest.left >> TRAIL_TILE_SHIFT; tx <= ( rcDest.right - 1 ) >> TRAIL_TILE_SHIFT; tx++ )
+        {
+            DWORD dwTile = ty * m_dwTilesX + tx;
+            if( !m_pbLive[dwTile] )
+            {
+                m_pbLive[dwTile] = 1;
+                m_pdwLive[m_dwNumLive++] = dwTile;
+            }
+        }
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CTrails::Follow()
+// Desc: Stamps a quarter of a sprite apart along the way from the last
+//       point followed, so a fast ball leaves an unbroken trail
+//-----------------------------------------------------------------------------
+VOID CTrails::Follow( LONG x, LONG y )
+{
+    LONG lSize = (LONG)max( m_Sprite.GetWidth(), 1 );
+    LONG dx    = x - m_ptLast.x;
+    LONG dy    = y - m_ptLast.y;
+    LONG lMove = max( abs( dx ), abs( dy ) );
+
+    if( m_bFollowing && lMove <= lSize * TRAIL_MAX_SWEEP )
+    {
+        LONG lSteps = max( lMove * 4 / lSize, 1L );
+        for( LONG i = 1; i <= lSteps; i++ )
+            Stamp( m_ptLast.x + dx * i / lSteps, m_ptLast.y + dy * i / lSteps );
+    }
+    else
+    {
+        Stamp( x, y );
+    }
+
+    m_bFollowing = TRUE;
+    m_ptLast.x   = x;
+    m_ptLast.y   = y;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CTrails::Draw()
+// Desc: Queues a blend of each live tile on a software display
+//-----------------------------------------------------------------------------
+HRESULT CTrails::Draw( CSoftDisplay* pDisplay )
+{
+    HRESULT hr;
+
+    for( DWORD i = 0; i < m_dwNumLive; i++ )
+    {
+        RECT rc;
+        GetTileRect( m_pdwLive[i], &rc );
+
+        if( FAILED( hr = pDisplay->Blt( rc.left, rc.top, &m_Buffer, &rc ) ) )
+            return hr;
+    }
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CTrails::Draw()
+// Desc: Blends the live tiles into a 32 bit image, as much of each as fits
+//-----------------------------------------------------------------------------
+HRESULT CTrails::Draw( BLIT_IMAGE* pDest )
+{
+    for( DWORD i = 0; i < m_dwNumLive; i++ )
+    {
+        RECT rc;
+        GetTileRect( m_pdwLive[i], &rc );
+        rc.right  = min( rc.right, (LONG)pDest->dwWidth );
+        rc.bottom = min( rc.bottom, (LONG)pDest->dwHeight );
+        if( rc.left >= rc.right || rc.top >= rc.bottom )
+            continue;
+
+        const BYTE* pbSrc  = (const BYTE*)m_Buffer.GetBits() + rc.top * m_Buffer.GetPitch() + rc.left * sizeof(DWORD);
+        BYTE*       pbDest = pDest->pBits + rc.top * pDest->lPitch + rc.left * sizeof(DWORD);
+        for( LONG y = rc.top; y < rc.bottom; y++ )
+        {
+            Blit_BlendRow( (DWORD*)pbDest, (const DWORD*)pbSrc, rc.right - rc.left );
+            pbSrc  += m_Buffer.GetPitch();
+            pbDest += pDest->lPitch;
+        }
+    }
+
+    return S_OK;
+}
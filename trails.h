@@ -0,0 +1,114 @@
+//-----------------------------------------------------------------------------
+// File: trails.h
+//
+// Desc: Fading trails behind the balls. The balls are stamped each frame
+//       into an accumulation buffer the size of the view, which is faded by
+//       the time since the last frame and drawn under the sprites, so the
+//       trails are the same length whatever the frame rate.
+//
+//       The buffer is split into TRAIL_TILE_SIZE square tiles, and only the
+//       tiles a ball has passed over since they last faded to nothing are
+//       live. Fading, stamping and drawing all touch the live tiles alone,
+//       so the trails cost what the area they cover costs rather than a
+//       pass over the whole frame. A tile leaves the list the frame it
+//       fades to black.
+//
+//       The buffer is premultiplied 32 bit pixels with alpha in the top
+//       byte, faded four at a time with SSE2 and drawn with Blit_BlendRow().
+//       The game draws them only on the software display, as blending them
+//       into a back buffer in video memory would read it back every frame.
+//       A stamp keeps the brighter of each byte, so overlapping stamps
+//       don't saturate into a solid bar.
+//-----------------------------------------------------------------------------
+#ifndef TRAILS_H
+#define TRAILS_H
+
+#include "ddutil.h"
+#include "blitter.h"
+#include "softdisplay.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+#define TRAIL_TILE_SIZE         32          // Pixels each way, a power of 2
+#define TRAIL_TILE_SHIFT        5
+#define TRAIL_DECAY_DEFAULT     216         // Of each pixel kept a 60th of a second, out of 256
+#define TRAIL_DECAY_MIN_MS      16          // Shortest time faded at once, about a 60 Hz frame
+#define TRAIL_DECAY_MAX_MS      100         // Longer gaps fade as much as this
+#define TRAIL_MAX_SWEEP         4           // Longest move swept, in sprite widths
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: class CTrails
+// Desc: The accumulation buffer, the sprite stamped into it and its live
+//       tiles. Nothing is allocated after Create() until it is resized.
+//-----------------------------------------------------------------------------
+class CTrails
+{
+    CSoftSurface    m_Buffer;           // Premultiplied, the size of the view
+    CSoftSurface    m_Sprite;           // Premultiplied, opaque where the ball is
+    DWORD           m_dwDecay;
+    DWORD           m_adwFactor[TRAIL_DECAY_MAX_MS + 1];   // Kept out of 65536 after each whole millisecond
+    FLOAT           m_fPending;         // Seconds not yet faded
+    DWORD           m_dwTilesX;
+    DWORD           m_dwTilesY;
+    BYTE*           m_pbLive;           // Per tile, whether it is in m_pdwLive
+    DWORD*          m_pdwLive;          // The live tiles, in no order
+    DWORD           m_dwNumLive;
+    BOOL            m_bFollowing;       // m_ptLast is where Follow() last stamped
+    POINT           m_ptLast;
+
+    HRESULT MakeStamp();
+    VOID    GetTileRect( DWORD dwTile, RECT* prc );
+
+    CTrails( const CTrails& );
+    CTrails& operator=( const CTrails& );
+
+public:
+    CTrails();
+    ~CTrails();
+
+    // dwDecay is how much of each pixel is kept a 60th of a second, out
+    // of 256
+    HRESULT Create( DWORD dwWidth, DWORD dwHeight, DWORD dwDecay = TRAIL_DECAY_DEFAULT );
+    VOID    Destroy();
+
+    // A new view size, with the trails cleared
+    HRESULT Resize( DWORD dwWidth, DWORD dwHeight );
+
+    // The ball to stamp, copied from a 32 bit surface or image. Its colour
+    // key, if it has one, is clear. Set it again after redrawing the ball.
+    HRESULT SetSprite( CSurface* pSurface );
+    HRESULT SetSprite( CSoftSurface* pSprite );
+
+    // Fades the live tiles by fTimeDelta seconds, once a frame before
+    // stamping. Less than TRAIL_DECAY_MIN_MS is saved up for a later
+    // frame, as rounding down every byte at each of many small steps
+    // would shorten the trails at high rates.
+    VOID    Decay( FLOAT fTimeDelta );
+
+    // Stamps the sprite with its top left at x, y. Follow() also stamps
+    // the way from where it last stamped, unless that is further than
+    // TRAIL_MAX_SWEEP sprites away, as after a serve.
+    VOID    Stamp( LONG x, LONG y );
+    VOID    Follow( LONG x, LONG y );
+
+    // Blends the live tiles over a frame: queued on a software display, or
+    // into a 32 bit image in memory
+    HRESULT Draw( CSoftDisplay* pDisplay );
+    HRESULT Draw( BLIT_IMAGE* pDest );
+
+    BOOL    IsCreated()         { return m_pbLive != NULL; }
+    DWORD   GetNumLiveTiles()   { return m_dwNumLive; }
+    DWORD   GetNumTiles()       { return m_dwTilesX * m_dwTilesY; }
+};
+
+
+
+
+#endif // TRAILS_H
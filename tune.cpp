@@ -0,0 +1,285 @@
+//-----------------------------------------------------------------------------
+// File: tune.cpp
+//
+// Desc: Difficulty tuning. The grid is cut into jobs of a few thousand
+//       points each, and one thread per processor takes jobs off a shared
+//       counter until there are none left, so nothing waits on anything
+//       but the counter while the points are played.
+//-----------------------------------------------------------------------------
+#define STRICT
+#include <windows.h>
+#include <tchar.h>
+#include <stdio.h>
+#include <math.h>
+#include "dxutil.h"
+#include "tune.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines, constants, and global variables
+//-----------------------------------------------------------------------------
+#define TUNE_TIME_DELTA         ( 1.0f / 60.0f )
+#define TUNE_JOBS_PER_CELL      16
+#define TUNE_Z95                1.96
+
+// The grid swept by RunTuning(), the middle values being the defaults
+static const FLOAT s_afLevels[]      = { 150.0f, 200.0f, 250.0f, 300.0f, 350.0f, 400.0f };
+static const FLOAT s_afBatSpeeds[]   = { 150.0f, 200.0f, 250.0f, 300.0f, 350.0f };
+static const FLOAT s_afSpeedIncs[]   = { 25.0f, 50.0f, 75.0f };
+
+#define TUNE_NUM_LEVELS         ( sizeof(s_afLevels)    / sizeof(s_afLevels[0]) )
+#define TUNE_NUM_BAT_SPEEDS     ( sizeof(s_afBatSpeeds) / sizeof(s_afBatSpeeds[0]) )
+#define TUNE_NUM_SPEED_INCS     ( sizeof(s_afSpeedIncs) / sizeof(s_afSpeedIncs[0]) )
+#define TUNE_NUM_CELLS          ( TUNE_NUM_LEVELS * TUNE_NUM_BAT_SPEEDS * TUNE_NUM_SPEED_INCS )
+
+struct TUNE_JOBS
+{
+    TUNE_RESULT*    pResults;       // One per job
+    DWORD           dwNumJobs;
+    volatile LONG   lNext;
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Tune_Random()
+// Desc: A number from -fRange up to fRange for the stand-in player
+//-----------------------------------------------------------------------------
+static FLOAT Tune_Random( DWORD* pdwSeed, FLOAT fRange )
+{
+    *pdwSeed = *pdwSeed * 1664525 + 1013904223;
+    return (FLOAT)( ( *pdwSeed >> 8 ) & 0xFFFFFF ) * ( fRange * 2.0f / 16777216.0f ) - fRange;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Tune_PlayPoints()
+// Desc: The stand-in player follows the ball while it is coming its way,
+//       aiming for a spot up to TUNE_PLAYER_AIM_ERROR away from the middle
+//       of the bat, picked again for every shot. Its bat moves at the
+//       params' player bat speed like a human's would.
+//-----------------------------------------------------------------------------
+VOID Tune_PlayPoints( TUNE_RESULT* pResult, DWORD dwPoints, DWORD dwSeed )
+{
+    SIM_STATE sim;
+    Sim_Init( &sim, dwSeed, &pResult->params );
+
+    const DWORD dwMaxSteps = (DWORD)( TUNE_MAX_RALLY_SECONDS / TUNE_TIME_DELTA );
+
+    DWORD dwPlayerSeed = dwSeed ^ 0x5BD1E995;
+    FLOAT fAim         = Tune_Random( &dwPlayerSeed, TUNE_PLAYER_AIM_ERROR );
+    DWORD dwSteps      = 0;
+    DWORD dwHits       = 0;
+
+    for( DWORD dwPlayed = 0; dwPlayed < dwPoints; )
+    {
+        const SPRITE_STRUCT* pBall = &sim.aSprite[0];
+        const SPRITE_STRUCT* pBat  = &sim.aSprite[1];
+
+        int nMove = 0;
+        if( pBall->fVelX < 0 )
+        {
+            FLOAT fTarget = pBall->fPosY + ( BALL_SPRITE_DIAMETER - BAT_SPRITE_HEIGHT ) / 2 + fAim;
+            if( pBat->fPosY > fTarget + 2.0f )
+                nMove = -1;
+            else if( pBat->fPosY < fTarget - 2.0f )
+                nMove = 1;
+        }
+
+        SimEvent event = Sim_Step( &sim, nMove, TUNE_TIME_DELTA );
+        dwSteps++;
+
+        if( event == simPlayerHit || event == simComputerHit )
+        {
+            dwHits++;
+            if( event == simComputerHit )
+                fAim = Tune_Random( &dwPlayerSeed, TUNE_PLAYER_AIM_ERROR );
+            continue;
+        }
+
+        if( SIM_IS_POINT( event ) )
+        {
+            pResult->dwPoints++;
+            if( event == simComputerPoint )
+                pResult->dwComputerPoints++;
+
+            pResult->fHits    += dwHits;
+            pResult->fHitsSq  += (double)dwHits * dwHits;
+            pResult->fSeconds += dwSteps * TUNE_TIME_DELTA;
+        }
+        else if( dwSteps >= dwMaxSteps )
+        {
+            // Neither side can miss with these settings
+            pResult->dwAbandoned++;
+            Sim_Serve( &sim );
+        }
+        else
+        {
+            continue;
+        }
+
+        fAim    = Tune_Random( &dwPlayerSeed, TUNE_PLAYER_AIM_ERROR );
+        dwSteps = 0;
+        dwHits  = 0;
+        dwPlayed++;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Tune_WorkerThread()
+// Desc: Plays jobs until there are none left
+//-----------------------------------------------------------------------------
+static DWORD WINAPI Tune_WorkerThread( LPVOID pParam )
+{
+    TUNE_JOBS* pJobs = (TUNE_JOBS*)pParam;
+    LONG       lJob;
+
+    while( ( lJob = InterlockedIncrement( &pJobs->lNext ) - 1 ) < (LONG)pJobs->dwNumJobs )
+    {
+        Tune_PlayPoints( &pJobs->pResults[lJob], TUNE_POINTS_PER_CELL / TUNE_JOBS_PER_CELL,
+                         (DWORD)lJob * 0x9E3779B9 + 1 );
+    }
+
+    return 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Tune_WriteCell()
+// Desc: Writes one grid cell's CSV line. The win rate interval is a Wilson
+//       score interval, which stays sensible for rates near 0 or 1.
+//-----------------------------------------------------------------------------
+static VOID Tune_WriteCell( FILE* pFile, const TUNE_RESULT* pResult )
+{
+    double n      = pResult->dwPoints;
+    double fRate  = 0.0, fRateLo = 0.0, fRateHi = 0.0;
+    double fHits  = 0.0, fHitsCi = 0.0, fSecs = 0.0;
+
+    if( n > 0 )
+    {
+        double z2     = TUNE_Z95 * TUNE_Z95;
+        double fDenom = 1.0 + z2 / n;
+
+        fRate = pResult->dwComputerPoints / n;
+
+        double fCentre = ( fRate + z2 / ( 2.0 * n ) ) / fDenom;
+        double fHalf   = TUNE_Z95 * sqrt( fRate * ( 1.0 - fRate ) / n + z2 / ( 4.0 * n * n ) ) / fDenom;
+        fRateLo = fCentre - fHalf;
+        fRateHi = fCentre + fHalf;
+
+        fHits = pResult->fHits / n;
+        double fVar = pResult->fHitsSq / n - fHits * fHits;
+        fHitsCi = TUNE_Z95 * sqrt( ( fVar > 0.0 ? fVar : 0.0 ) / n );
+        fSecs = pResult->fSeconds / n;
+    }
+
+    fprintf( pFile, "%.0f,%.0f,%.0f,%lu,%lu,%.4f,%.4f,%.4f,%.3f,%.3f,%.3f\n",
+             pResult->params.fComputerLevel, pResult->params.fComputerBatSpeed,
+             pResult->params.fBallSpeedInc, pResult->dwPoints, pResult->dwAbandoned,
+             fRate, fRateLo, fRateHi, fHits, fHitsCi, fSecs );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: RunTuning()
+// Desc: Sweeps the computer's level, the computer's bat speed and the ball
+//       speed up per hit. The player's bat keeps its default speed, so each
+//       cell is the same player against a different computer.
+//-----------------------------------------------------------------------------
+HRESULT RunTuning( const TCHAR* strFile )
+{
+    HRESULT   hr = S_OK;
+    TUNE_JOBS jobs;
+    HANDLE    ahThreads[TUNE_MAX_THREADS];
+    DWORD     dwNumThreads = 0;
+    FILE*     pFile;
+
+    if( NULL == ( pFile = _tfopen( strFile, TEXT("w") ) ) )
+        return E_FAIL;
+
+    jobs.dwNumJobs = TUNE_NUM_CELLS * TUNE_JOBS_PER_CELL;
+    jobs.lNext     = 0;
+
+    if( NULL == ( jobs.pResults = new TUNE_RESULT[jobs.dwNumJobs] ) )
+    {
+        fclose( pFile );
+        return E_OUTOFMEMORY;
+    }
+
+    ZeroMemory( jobs.pResults, sizeof(TUNE_RESULT) * jobs.dwNumJobs );
+
+    // Every job in a cell plays with the same settings
+    SIM_PARAMS params;
+    Sim_GetDefaultParams( &params );
+
+    for( DWORD dwCell = 0; dwCell < TUNE_NUM_CELLS; dwCell++ )
+    {
+        params.fComputerLevel    = s_afLevels[dwCell / ( TUNE_NUM_BAT_SPEEDS * TUNE_NUM_SPEED_INCS )];
+        params.fComputerBatSpeed = s_afBatSpeeds[( dwCell / TUNE_NUM_SPEED_INCS ) % TUNE_NUM_BAT_SPEEDS];
+        params.fBallSpeedInc     = s_afSpeedIncs[dwCell % TUNE_NUM_SPEED_INCS];
+
+        for( DWORD j = 0; j < TUNE_JOBS_PER_CELL; j++ )
+            jobs.pResults[dwCell * TUNE_JOBS_PER_CELL + j].params = params;
+    }
+
+    // One thread per processor, counting this one
+    SYSTEM_INFO si;
+    GetSystemInfo( &si );
+
+    for( DWORD i = 1; i < si.dwNumberOfProcessors && dwNumThreads < TUNE_MAX_THREADS; i++ )
+    {
+        if( NULL == ( ahThreads[dwNumThreads] = CreateThread( NULL, 0, Tune_WorkerThread, &jobs, 0, NULL ) ) )
+            break;
+        dwNumThreads++;
+    }
+
+    Tune_WorkerThread( &jobs );
+
+    if( dwNumThreads )
+        WaitForMultipleObjects( dwNumThreads, ahThreads, TRUE, INFINITE );
+
+    for( DWORD i = 0; i < dwNumThreads; i++ )
+        CloseHandle( ahThreads[i] );
+
+    // Add each cell's jobs together and write it out
+    fprintf( pFile, "computer_level,computer_bat_speed,ball_speed_inc,points,abandoned,"
+                    "computer_win_rate,win_rate_lo95,win_rate_hi95,"
+                    "rally_hits,rally_hits_ci95,rally_seconds\n" );
+
+    for( DWORD dwCell = 0; dwCell < TUNE_NUM_CELLS; dwCell++ )
+    {
+        TUNE_RESULT* pCell = &jobs.pResults[dwCell * TUNE_JOBS_PER_CELL];
+
+        for( DWORD j = 1; j < TUNE_JOBS_PER_CELL; j++ )
+        {
+            pCell->dwPoints         += pCell[j].dwPoints;
+            pCell->dwComputerPoints += pCell[j].dwComputerPoints;
+            pCell->dwAbandoned      += pCell[j].dwAbandoned;
+            pCell->fHits            += pCell[j].fHits;
+            pCell->fHitsSq          += pCell[j].fHitsSq;
+            pCell->fSeconds         += pCell[j].fSeconds;
+        }
+
+        Tune_WriteCell( pFile, pCell );
+    }
+
+    if( ferror( pFile ) )
+        hr = E_FAIL;
+
+    fclose( pFile );
+    SAFE_DELETE_ARRAY( jobs.pResults );
+
+    return hr;
+}
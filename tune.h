@@ -0,0 +1,62 @@
+//-----------------------------------------------------------------------------
+// File: tune.h
+//
+// Desc: Difficulty tuning. Plays a very large number of simulated points
+//       for every combination of a grid of SIM_PARAMS settings, with a
+//       stand-in for the human on the player's side, and writes how often
+//       the computer wins each point and how long the rallies last, with
+//       95% confidence intervals, so difficulty presets can be picked from
+//       the numbers rather than by playing.
+//
+//       Run with -tune <file> to write the results as CSV.
+//-----------------------------------------------------------------------------
+#ifndef TUNE_H
+#define TUNE_H
+
+#include "sim.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+#define TUNE_MAX_THREADS        64
+#define TUNE_POINTS_PER_CELL    100000      // Points played for each setting
+#define TUNE_MAX_RALLY_SECONDS  120         // Rallies longer than this are abandoned
+#define TUNE_PLAYER_AIM_ERROR   40.0f       // Stand-in player misjudges by up to this, in pixels
+
+// One grid cell's results, added up across the threads that played it
+struct TUNE_RESULT
+{
+    SIM_PARAMS  params;
+    DWORD       dwPoints;
+    DWORD       dwComputerPoints;
+    DWORD       dwAbandoned;        // Rallies that hit TUNE_MAX_RALLY_SECONDS
+    double      fHits;              // Sum and sum of squares of hits per point
+    double      fHitsSq;
+    double      fSeconds;           // Total game time of every point
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: Tune_PlayPoints()
+// Desc: Plays dwPoints points with pResult->params and adds them into
+//       pResult. Each call only uses its own state, so any number can run
+//       at once.
+//-----------------------------------------------------------------------------
+VOID    Tune_PlayPoints( TUNE_RESULT* pResult, DWORD dwPoints, DWORD dwSeed );
+
+//-----------------------------------------------------------------------------
+// Name: RunTuning()
+// Desc: Sweeps the built-in grid on one thread per processor and writes the
+//       results to strFile as CSV
+//-----------------------------------------------------------------------------
+HRESULT RunTuning( const TCHAR* strFile );
+
+
+
+
+#endif // TUNE_H
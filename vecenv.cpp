@@ -0,0 +1,263 @@
+//-----------------------------------------------------------------------------
+// File: vecenv.cpp
+//
+// Desc: The vectorised training environment. Games are split into one
+//       contiguous slice per thread of the pool.
+//-----------------------------------------------------------------------------
+#define STRICT
+#include <windows.h>
+#include "dxutil.h"
+#include "vecenv.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CVecEnv::CVecEnv()
+// Desc:
+//-----------------------------------------------------------------------------
+CVecEnv::CVecEnv()
+{
+    m_pGames       = NULL;
+    m_dwNumGames   = 0;
+    m_pnActions    = NULL;
+    m_pfObs        = NULL;
+    m_pfRewards    = NULL;
+    m_pbDones      = NULL;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CVecEnv::~CVecEnv()
+// Desc:
+//-----------------------------------------------------------------------------
+CVecEnv::~CVecEnv()
+{
+    Destroy();
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CVecEnv::Create()
+// Desc: Allocates the games, serves the first ball in each from dwSeed and
+//       starts the worker threads
+//-----------------------------------------------------------------------------
+HRESULT CVecEnv::Create( DWORD dwNumGames, DWORD dwSeed, DWORD dwNumThreads )
+{
+    Destroy();
+
+    if( dwNumGames == 0 )
+        return E_INVALIDARG;
+
+    if( dwNumThreads == 0 )
+    {
+        SYSTEM_INFO si;
+        GetSystemInfo( &si );
+        dwNumThreads = si.dwNumberOfProcessors;
+    }
+
+    if( dwNumThreads > dwNumGames )
+        dwNumThreads = dwNumGames;
+
+    if( NULL == ( m_pGames = new SIM_STATE[dwNumGames] ) )
+        return E_OUTOFMEMORY;
+
+    m_dwNumGames = dwNumGames;
+    Reset( dwSeed, NULL );
+
+    if( FAILED( m_Pool.Create( dwNumThreads ) ) )
+    {
+        Destroy();
+        return E_FAIL;
+    }
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CVecEnv::Destroy()
+// Desc: Stops the workers and frees the games
+//-----------------------------------------------------------------------------
+VOID CVecEnv::Destroy()
+{
+    m_Pool.Destroy();
+
+    SAFE_DELETE_ARRAY( m_pGames );
+    m_dwNumGames = 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CVecEnv::Reset()
+// Desc: Starts every game again at 0 - 0, each from its own seed derived
+//       from dwSeed, and writes the first observations if pfObs is given.
+//       This is rare enough that it runs on the calling thread.
+//-----------------------------------------------------------------------------
+HRESULT CVecEnv::Reset( DWORD dwSeed, FLOAT* pfObs )
+{
+    if( NULL == m_pGames )
+        return E_FAIL;
+
+    for( DWORD i = 0; i < m_dwNumGames; i++ )
+    {
+        Sim_Init( &m_pGames[i], dwSeed + i * 0x9E3779B9 );
+
+        if( pfObs )
+            GetObservation( &m_pGames[i], &pfObs[i * VECENV_OBS_SIZE] );
+    }
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CVecEnv::Step()
+// Desc: Steps every game by one 60th of a second with its action
+//-----------------------------------------------------------------------------
+HRESULT CVecEnv::Step( const int* pnActions, FLOAT* pfObs, FLOAT* pfRewards, BYTE* pbDones )
+{
+    if( NULL == m_pGames )
+        return E_FAIL;
+
+    if( NULL == pnActions || NULL == pfObs || NULL == pfRewards || NULL == pbDones )
+        return E_INVALIDARG;
+
+    m_pnActions = pnActions;
+    m_pfObs     = pfObs;
+    m_pfRewards = pfRewards;
+    m_pbDones   = pbDones;
+
+    m_Pool.Run( StepSlice, this, m_dwNumGames );
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CVecEnv::StepSlice()
+// Desc: Steps games dwFirst to dwFirst + dwCount - 1 and writes their
+//       results. Each game's results are only ever written by one thread.
+//-----------------------------------------------------------------------------
+VOID CVecEnv::StepSlice( VOID* pContext, DWORD dwFirst, DWORD dwCount )
+{
+    CVecEnv* pEnv = (CVecEnv*)pContext;
+
+    for( DWORD i = dwFirst; i < dwFirst + dwCount; i++ )
+    {
+        SimEvent event = Sim_Step( &pEnv->m_pGames[i], pEnv->m_pnActions[i], VECENV_TIME_DELTA );
+
+        switch( event )
+        {
+            case simPlayerPoint:   pEnv->m_pfRewards[i] =  1.0f; break;
+            case simComputerPoint: pEnv->m_pfRewards[i] = -1.0f; break;
+            default:               pEnv->m_pfRewards[i] =  0.0f; break;
+        }
+
+        pEnv->m_pbDones[i] = SIM_IS_POINT( event );
+        GetObservation( &pEnv->m_pGames[i], &pEnv->m_pfObs[i * VECENV_OBS_SIZE] );
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CVecEnv::GetObservation()
+// Desc: Writes the VECENV_OBS_SIZE floats for one game. Positions are
+//       scaled from the field to -1 to 1 and velocities by 1000 pixels a
+//       second, which is about as fast as a rally gets.
+//-----------------------------------------------------------------------------
+VOID CVecEnv::GetObservation( const SIM_STATE* pState, FLOAT* pfObs )
+{
+    const FLOAT fScaleX = 2.0f / ( FIELD_WIDTH  - BALL_SPRITE_DIAMETER );
+    const FLOAT fScaleY = 2.0f / ( FIELD_HEIGHT - BALL_SPRITE_DIAMETER );
+    const FLOAT fScaleB = 2.0f / ( FIELD_HEIGHT - BAT_SPRITE_HEIGHT );
+    const FLOAT fScaleV = 1.0f / 1000.0f;
+
+    const SPRITE_STRUCT* pBall = &pState->aSprite[0];
+
+    pfObs[0] = pBall->fPosX * fScaleX - 1.0f;
+    pfObs[1] = pBall->fPosY * fScaleY - 1.0f;
+    pfObs[2] = pBall->fVelX * fScaleV;
+    pfObs[3] = pBall->fVelY * fScaleV;
+    pfObs[4] = pState->aSprite[1].fPosY * fScaleB - 1.0f;
+    pfObs[5] = pState->aSprite[2].fPosY * fScaleB - 1.0f;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: PongyVecEnv_Create()
+// Desc:
+//-----------------------------------------------------------------------------
+HPONGYVECENV PongyVecEnv_Create( DWORD dwNumGames, DWORD dwSeed, DWORD dwNumThreads )
+{
+    CVecEnv* pEnv = new CVecEnv();
+    if( NULL == pEnv )
+        return NULL;
+
+    if( FAILED( pEnv->Create( dwNumGames, dwSeed, dwNumThreads ) ) )
+    {
+        delete pEnv;
+        return NULL;
+    }
+
+    return (HPONGYVECENV)pEnv;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: PongyVecEnv_Destroy()
+// Desc:
+//-----------------------------------------------------------------------------
+VOID PongyVecEnv_Destroy( HPONGYVECENV hEnv )
+{
+    delete (CVecEnv*)hEnv;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: PongyVecEnv_Reset()
+// Desc:
+//-----------------------------------------------------------------------------
+HRESULT PongyVecEnv_Reset( HPONGYVECENV hEnv, DWORD dwSeed, FLOAT* pfObs )
+{
+    if( NULL == hEnv )
+        return E_INVALIDARG;
+
+    return ( (CVecEnv*)hEnv )->Reset( dwSeed, pfObs );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: PongyVecEnv_Step()
+// Desc:
+//-----------------------------------------------------------------------------
+HRESULT PongyVecEnv_Step( HPONGYVECENV hEnv, const int* pnActions,
+                          FLOAT* pfObs, FLOAT* pfRewards, BYTE* pbDones )
+{
+    if( NULL == hEnv )
+        return E_INVALIDARG;
+
+    return ( (CVecEnv*)hEnv )->Step( pnActions, pfObs, pfRewards, pbDones );
+}
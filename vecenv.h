@@ -0,0 +1,121 @@
+//-----------------------------------------------------------------------------
+// File: vecenv.h
+//
+// Desc: A vectorised training environment over the game simulation, for
+//       teaching bats to play. Reset() and Step() work on N games at once,
+//       writing observations, rewards and done flags straight into buffers
+//       the caller owns, and split the games across worker threads.
+//
+//       Each game gives VECENV_OBS_SIZE floats of observation, in this
+//       order, scaled to roughly -1 to 1:
+//
+//         ball x, ball y, ball x velocity, ball y velocity,
+//         player bat y, computer bat y
+//
+//       The action for each game moves the player's bat: -1 up, 0 stay,
+//       1 down. The reward is 1 when the player scores, -1 when the
+//       computer does and 0 otherwise, and a point also ends the episode.
+//       The next ball is served straight away, so the observation returned
+//       with a done flag is already the first of the next episode.
+//
+//       The C functions at the bottom wrap CVecEnv behind an opaque handle
+//       for callers that can't use C++, such as Python through ctypes.
+//-----------------------------------------------------------------------------
+#ifndef VECENV_H
+#define VECENV_H
+
+#include <windows.h>
+#include "sim.h"
+#include "threadpool.h"
+
+
+
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+#define VECENV_OBS_SIZE         6
+#define VECENV_TIME_DELTA       ( 1.0f / 60.0f )
+
+// Define PONGY_VECENV_EXPORTS when building vecenv.cpp into a DLL
+#ifdef PONGY_VECENV_EXPORTS
+#define PONGY_VECENV_API        __declspec(dllexport)
+#else
+#define PONGY_VECENV_API
+#endif
+
+
+
+
+#ifdef __cplusplus
+//-----------------------------------------------------------------------------
+// Name: class CVecEnv
+// Desc: The games and the worker threads. All memory and threads are set
+//       up by Create(), Reset() and Step() allocate nothing.
+//-----------------------------------------------------------------------------
+class CVecEnv
+{
+    SIM_STATE*      m_pGames;
+    DWORD           m_dwNumGames;
+    CThreadPool     m_Pool;
+
+    // Arguments to the Step() in progress, read by the workers
+    const int*      m_pnActions;
+    FLOAT*          m_pfObs;
+    FLOAT*          m_pfRewards;
+    BYTE*           m_pbDones;
+
+    static VOID StepSlice( VOID* pContext, DWORD dwFirst, DWORD dwCount );
+
+    CVecEnv( const CVecEnv& );
+    CVecEnv& operator=( const CVecEnv& );
+
+public:
+    CVecEnv();
+    ~CVecEnv();
+
+    // dwNumThreads of 0 uses one thread per processor
+    HRESULT Create( DWORD dwNumGames, DWORD dwSeed, DWORD dwNumThreads );
+    VOID    Destroy();
+
+    // pfObs holds dwNumGames * VECENV_OBS_SIZE floats, pnActions,
+    // pfRewards and pbDones hold dwNumGames each
+    HRESULT Reset( DWORD dwSeed, FLOAT* pfObs );
+    HRESULT Step( const int* pnActions, FLOAT* pfObs, FLOAT* pfRewards, BYTE* pbDones );
+
+    DWORD   GetNumGames()      { return m_dwNumGames; }
+    DWORD   GetNumThreads()    { return m_Pool.GetNumThreads(); }
+    SIM_STATE* GetGame( DWORD dwIndex ) { return &m_pGames[dwIndex]; }
+
+    static VOID GetObservation( const SIM_STATE* pState, FLOAT* pfObs );
+};
+#endif // __cplusplus
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: PongyVecEnv_*()
+// Desc: The C interface. Create returns NULL on failure, the others return
+//       the HRESULT from CVecEnv.
+//-----------------------------------------------------------------------------
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct PONGYVECENV* HPONGYVECENV;
+
+PONGY_VECENV_API HPONGYVECENV PongyVecEnv_Create( DWORD dwNumGames, DWORD dwSeed, DWORD dwNumThreads );
+PONGY_VECENV_API VOID         PongyVecEnv_Destroy( HPONGYVECENV hEnv );
+PONGY_VECENV_API HRESULT      PongyVecEnv_Reset( HPONGYVECENV hEnv, DWORD dwSeed, FLOAT* pfObs );
+PONGY_VECENV_API HRESULT      PongyVecEnv_Step( HPONGYVECENV hEnv, const int* pnActions,
+                                                FLOAT* pfObs, FLOAT* pfRewards, BYTE* pbDones );
+
+#ifdef __cplusplus
+}
+#endif
+
+
+
+
+#endif // VECENV_H